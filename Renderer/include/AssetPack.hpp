@@ -0,0 +1,126 @@
+#ifndef ASSET_PACK_CLASS
+#define ASSET_PACK_CLASS
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Cooked asset archive, written offline by tools/AssetCooker and mapped
+// read-only at runtime:
+//
+//   AssetPackHeader, padded to ASSET_PACK_ALIGNMENT
+//   payloads, each starting on an ASSET_PACK_ALIGNMENT boundary
+//   table of contents: AssetPackEntry[entryCount] sorted by name, followed
+//   by the names, metadata and chunk tables the entries point into
+//
+// Payloads are stored exactly as the GPU consumes them, so an uncompressed
+// payload can be handed to the upload path without being touched. Compressed
+// payloads are split into ASSET_PACK_CHUNK_SIZE chunks compressed on their
+// own, any range can then be decompressed without the chunks before it.
+const uint32_t ASSET_PACK_MAGIC = 0x50414b56; // "VKAP"
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint64_t ASSET_PACK_ALIGNMENT = 64 * 1024;
+const uint64_t ASSET_PACK_CHUNK_SIZE = 256 * 1024;
+
+enum class AssetType : uint32_t {
+    Mesh,
+    Texture,
+    Shader
+};
+
+enum AssetFlags : uint32_t {
+    ASSET_COMPRESSED = 1
+};
+
+struct AssetPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t alignment;
+    uint64_t tocOffset;
+    uint64_t tocSize;
+};
+
+struct AssetPackEntry {
+    // Offsets relative to the start of the table of contents
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    AssetType type;
+    uint32_t flags;
+    // Absolute file offset of the payload and the bytes it takes there
+    uint64_t offset;
+    uint64_t storedSize;
+    // Bytes once decompressed
+    uint64_t size;
+    // Type-specific description, MeshInfo or TextureInfo
+    uint32_t metadataOffset;
+    uint32_t metadataSize;
+    // Compressed payloads only: chunkCount + 1 uint64 offsets relative to the
+    // payload. A chunk whose stored size equals its decompressed size is raw.
+    uint32_t chunkTableOffset;
+    uint32_t chunkCount;
+};
+
+// Metadata of AssetType::Texture, the payload holds the mip levels back to back
+struct TextureInfo {
+    uint32_t width;
+    uint32_t height;
+    // VkFormat of the texels
+    uint32_t format;
+    uint32_t mipLevels;
+};
+
+class AssetPack {
+public:
+    AssetPack();
+    ~AssetPack();
+
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // Maps the whole file, throws if it is missing or malformed
+    void open(const std::string& path);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    uint32_t getEntryCount() const { return header ? header->entryCount : 0; }
+    const AssetPackEntry& getEntry(uint32_t index) const { return entries[index]; }
+    std::string getName(const AssetPackEntry& entry) const;
+    // nullptr if the pack has no such asset
+    const AssetPackEntry* find(const std::string& name) const;
+
+    template<typename T>
+    const T* getMetadata(const AssetPackEntry& entry) const {
+        if (entry.metadataSize < sizeof(T)) {
+            return nullptr;
+        }
+        return reinterpret_cast<const T*>(toc + entry.metadataOffset);
+    }
+
+    // The payload inside the mapping, nullptr for compressed payloads which
+    // have to go through read()
+    const void* getPayload(const AssetPackEntry& entry) const;
+
+    // Copies or decompresses size bytes of the payload starting at offset,
+    // typically straight into mapped staging memory
+    void read(const AssetPackEntry& entry, uint64_t offset, uint64_t size, void* destination) const;
+    void read(const AssetPackEntry& entry, void* destination) const { read(entry, 0, entry.size, destination); }
+
+private:
+    const uint8_t* base;
+    uint64_t fileSize;
+    const AssetPackHeader* header;
+    const AssetPackEntry* entries;
+    const uint8_t* toc;
+
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+
+    void validate();
+};
+
+#endif //ASSET_PACK_CLASS
@@ -0,0 +1,148 @@
+#ifndef ASYNC_FILE_READER_CLASS
+#define ASYNC_FILE_READER_CLASS
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Offsets, sizes and destinations of direct reads have to be multiples of
+// this; 4 KiB covers the logical block size of every common device
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+
+struct FileReaderConfig {
+    // Reads kept in flight at once, the io_uring submission queue size
+    uint32_t queueDepth = 128;
+    // Threads issuing blocking reads when io_uring is unavailable
+    uint32_t fallbackThreads = 4;
+    // Use the thread pool even where io_uring works
+    bool forceFallback = false;
+};
+
+struct AsyncFile {
+#ifdef _WIN32
+    void* handle = nullptr;
+#else
+    int handle = -1;
+#endif
+    uint64_t size = 0;
+    // Opened with O_DIRECT / FILE_FLAG_NO_BUFFERING, reads bypass the page cache
+    bool direct = false;
+
+    inline bool isOpen() const {
+#ifdef _WIN32
+        return handle != nullptr;
+#else
+        return handle >= 0;
+#endif
+    }
+};
+
+struct FileReadResult {
+    void* destination;
+    uint64_t offset;
+    // Less than requested only when the read ran into the end of the file
+    size_t bytesRead;
+    // 0 on success, otherwise the errno of the failed read
+    int error;
+};
+
+typedef std::function<void(const FileReadResult&)> FileReadCallback;
+
+// Reads files without blocking the caller. Requests from any thread are
+// batched and handed to io_uring on Linux, keeping up to queueDepth reads in
+// flight; elsewhere, or where io_uring is not allowed, a small pool of
+// threads issues blocking reads instead. Completions run on the reader's own
+// threads, so callbacks should be short, e.g. queue a job or set a flag.
+// Neither the ring nor the threads exist until the first submit(), a reader
+// that is never used costs nothing. Should io_uring fail while running, the
+// reads in flight fail with its error and later reads fall back to pread.
+class AsyncFileReader {
+public:
+    explicit AsyncFileReader(const FileReaderConfig& config = FileReaderConfig());
+    // Waits for every read that was submitted
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    // Throws if the file cannot be opened. A direct open falls back to
+    // buffered reads where the file system does not support it, check
+    // AsyncFile::direct.
+    static AsyncFile openFile(const std::string& path, bool direct = false);
+    static void closeFile(AsyncFile& file);
+
+    // For destinations of direct reads
+    static void* allocateAligned(size_t size, size_t alignment = DIRECT_IO_ALIGNMENT);
+    static void freeAligned(void* memory);
+
+    // Queues a read; it starts with the next submit(). The file and the
+    // destination have to stay valid until the read completes.
+    void read(const AsyncFile& file, uint64_t offset, size_t size, void* destination, FileReadCallback callback);
+    // Resolves to the bytes read, or throws the read's error
+    std::future<size_t> read(const AsyncFile& file, uint64_t offset, size_t size, void* destination);
+    // Hands every queued read to the backend at once
+    void submit();
+    // Submits and blocks until nothing is queued or in flight
+    void waitIdle();
+
+    // False until the first submit()
+    inline bool usesIoUring() const { return ring != nullptr && !ringFailed.load(std::memory_order_acquire); }
+    // Queued plus in flight
+    inline uint32_t pendingReads() const { return pending.load(std::memory_order_acquire); }
+
+private:
+    struct Request {
+        AsyncFile file;
+        uint64_t offset;
+        size_t size;
+        uint8_t* destination;
+        size_t done;
+        FileReadCallback callback;
+    };
+
+    struct Ring;
+
+    void validate(const AsyncFile& file, uint64_t offset, size_t size, const void* destination) const;
+    void complete(Request& request, int error);
+
+    void start();
+    void ringLoop();
+    // After a fatal io_uring error, waits for the reads the kernel took and
+    // queues what is left for fallbackLoop
+    void failRing();
+    void fallbackLoop();
+    static int readBlocking(const AsyncFile& file, uint64_t offset, size_t size, uint8_t* destination,
+                        size_t& bytesRead);
+
+    FileReaderConfig config;
+
+    // Reads queued by read() since the last submit()
+    std::mutex batchMutex;
+    std::vector<Request> batch;
+
+    // Reads the backend has not started yet
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<Request> queue;
+    bool stopping;
+
+    std::atomic<uint32_t> pending;
+    std::mutex idleMutex;
+    std::condition_variable idleCondition;
+
+    std::once_flag started;
+    std::unique_ptr<Ring> ring;
+    std::atomic<bool> ringFailed;
+    std::vector<std::thread> threads;
+};
+
+#endif //ASYNC_FILE_READER_CLASS
@@ -0,0 +1,51 @@
+#ifndef CAMERA_CLASS
+#define CAMERA_CLASS
+
+#include <cmath>
+
+#include "glm.hpp"
+#include "gtc/matrix_transform.hpp"
+
+// Perspective camera, matrices follow Vulkan conventions: clip space y points
+// down and depth goes from 0 at the near plane to 1 at the far plane
+struct Camera {
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 2.5f);
+    glm::vec3 target = glm::vec3(0.0f);
+    glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+    // Vertical field of view in radians
+    float fovY = 0.785398f;
+    float nearPlane = 0.1f;
+    float farPlane = 1000.0f;
+
+    bool operator==(const Camera& other) const {
+        return position == other.position && target == other.target && up == other.up && fovY == other.fovY &&
+            nearPlane == other.nearPlane && farPlane == other.farPlane;
+    }
+    bool operator!=(const Camera& other) const {
+        return !(*this == other);
+    }
+
+    glm::mat4 view() const {
+        return glm::lookAt(position, target, up);
+    }
+
+    // Built by hand so it does not depend on how GLM was configured
+    glm::mat4 projection(float aspect) const {
+        float f = 1.0f / std::tan(fovY * 0.5f);
+        glm::mat4 result(0.0f);
+        result[0][0] = f / aspect;
+        result[1][1] = -f;
+        result[2][2] = farPlane / (nearPlane - farPlane);
+        result[2][3] = -1.0f;
+        result[3][2] = (nearPlane * farPlane) / (nearPlane - farPlane);
+        return result;
+    }
+
+    // Pixels covered by one world unit at distance 1, scale by 1/distance
+    // to project lengths at other distances
+    float pixelsPerUnit(float viewportHeight) const {
+        return viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+    }
+};
+
+#endif //CAMERA_CLASS
@@ -0,0 +1,48 @@
+#ifndef COMPONENTS_CLASS
+#define COMPONENTS_CLASS
+
+#include <cstdint>
+
+#include "glm.hpp"
+
+// Components the renderer reads when extracting its draw list
+
+struct WorldTransform {
+    glm::mat4 matrix;
+};
+
+// Index into the renderer's mesh table
+struct MeshInstance {
+    uint32_t mesh;
+};
+
+// Never moves after it is created. Static entities are drawn per bucket from
+// a command buffer that is only recorded again when the bucket changes;
+// entities coming and going or switching mesh or LOD are noticed, a changed
+// transform has to be reported with Renderer::invalidateStaticBucket.
+struct StaticGeometry {
+    uint32_t bucket;
+};
+
+// Lights the sphere of radius around the entity's world position, falling
+// off with the inverse square of the distance
+struct PointLight {
+    glm::vec3 color;
+    float intensity;
+    float radius;
+};
+
+// Spawns rate particles per second at the entity's world position, moving
+// along its +y axis within spread radians of it. They are simulated and
+// drawn entirely on the GPU, see ParticleSystem.hpp.
+struct ParticleEmitter {
+    float rate;
+    // Seconds, the speed in units per second
+    float lifetime;
+    float speed;
+    float spread;
+    float size;
+    glm::vec4 color;
+};
+
+#endif //COMPONENTS_CLASS
@@ -0,0 +1,21 @@
+#ifndef COMPRESSION_CLASS
+#define COMPRESSION_CLASS
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Byte-oriented LZ77 in the style of LZ4: every sequence is a token byte
+// (literal length in the high nibble, match length - 4 in the low one),
+// extra length bytes for nibbles of 15, the literals and then a 16-bit
+// little-endian match offset. The last sequence has literals only.
+// Cheap enough to decompress straight into upload memory at load time.
+
+// Appends the compressed form of data to output
+void lzCompress(const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+
+// Returns false if the input is corrupt or does not decompress to exactly
+// size bytes
+bool lzDecompress(const uint8_t* data, size_t compressedSize, uint8_t* output, size_t size);
+
+#endif //COMPRESSION_CLASS
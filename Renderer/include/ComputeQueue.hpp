@@ -0,0 +1,61 @@
+#ifndef COMPUTE_QUEUE_CLASS
+#define COMPUTE_QUEUE_CLASS
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Compute submissions for a queue that may run alongside the graphics queue.
+// Every frame slot owns a command buffer, a fence guarding its reuse and a
+// semaphore that the graphics submission of the same frame waits on.
+class ComputeQueue {
+public:
+    ComputeQueue();
+
+    ComputeQueue(const ComputeQueue&) = delete;
+    ComputeQueue& operator=(const ComputeQueue&) = delete;
+
+    void init(VkDevice device, uint32_t family, uint32_t queueIndex, uint32_t graphicsFamily, size_t frameCount);
+    void shutdown();
+
+    // True when the queue is not the graphics queue itself, i.e. work
+    // submitted here can overlap rasterisation
+    inline bool isAsync() const { return async; }
+    inline uint32_t getFamily() const { return family; }
+    inline VkQueue getQueue() const { return queue; }
+
+    // Waits until the slot's previous compute work retired and starts recording
+    VkCommandBuffer begin(size_t frame);
+    // Submits the slot's command buffer; graphics work that consumes its
+    // results has to wait on the returned semaphore
+    VkSemaphore submit(size_t frame, const std::vector<VkSemaphore>& waitSemaphores = {},
+                    const std::vector<VkPipelineStageFlags>& waitStages = {});
+
+    // Queue family ownership transfers. Buffers and images with exclusive
+    // sharing need a release on the old queue followed by an acquire on the
+    // new one; between the same family both degrade to a plain barrier.
+    static void releaseBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+                            VkAccessFlags srcAccess, VkPipelineStageFlags srcStage);
+    static void acquireBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+                            VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+    static void releaseImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+                            VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+                            VkAccessFlags srcAccess, VkPipelineStageFlags srcStage);
+    static void acquireImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+                            VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+                            VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+
+private:
+    VkDevice device;
+    VkQueue queue;
+    uint32_t family;
+    bool async;
+
+    VkCommandPool commandPool;
+    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<VkFence> fences;
+    std::vector<VkSemaphore> finishedSemaphores;
+};
+
+#endif //COMPUTE_QUEUE_CLASS
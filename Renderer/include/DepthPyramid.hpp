@@ -0,0 +1,66 @@
+#ifndef DEPTH_PYRAMID_CLASS
+#define DEPTH_PYRAMID_CLASS
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "ResourceManager.hpp"
+
+// Levels kept at most, enough for a 65536 pixel wide depth buffer
+const uint32_t DEPTH_PYRAMID_MAX_LEVELS = 16;
+
+// Hierarchical depth for occlusion culling. Every texel holds the farthest
+// depth of what it covers, level 0 the rendered part of the depth buffer
+// scaled to the largest power of two that fits the whole buffer, so a bounds
+// test against it never culls anything visible. Built on the graphics queue by a compute reduction, one
+// dispatch per level.
+class DepthPyramid {
+public:
+    DepthPyramid();
+
+    DepthPyramid(const DepthPyramid&) = delete;
+    DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+    // reduceShader is only used while creating the pipeline
+    void init(VkDevice device, ResourceManager& resources, VkShaderModule reduceShader);
+    void shutdown();
+
+    // With the render targets, the device has to be idle
+    void resize(VkImage depthImage, VkFormat depthFormat, VkExtent2D extent);
+
+    // depthImage has to be in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+    // depthExtent is the part of it that was rendered to, from the top left.
+    // The previous contents are discarded once readStages are done with them,
+    // afterwards every level is in VK_IMAGE_LAYOUT_GENERAL and visible to them.
+    void record(VkCommandBuffer commandBuffer, VkPipelineStageFlags readStages, VkExtent2D depthExtent);
+
+    // Every level, sampled with texelFetch
+    VkImageView getView();
+    inline VkSampler getSampler() { return resources->get(sampler)->sampler; }
+    inline VkExtent2D getExtent() const { return extent; }
+    inline uint32_t getLevelCount() const { return levelCount; }
+
+private:
+    void destroyViews();
+
+    VkDevice device;
+    ResourceManager* resources;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    // One per level: the level below, or the depth buffer, and the level itself
+    std::vector<VkDescriptorSet> descriptorSets;
+    PipelineHandle pipeline;
+    SamplerHandle sampler;
+
+    ImageHandle image;
+    VkExtent2D extent;
+    uint32_t levelCount;
+    std::vector<VkImageView> levelViews;
+    // Depth aspect only, a view with stencil cannot be sampled
+    VkImageView depthView;
+};
+
+#endif //DEPTH_PYRAMID_CLASS
@@ -0,0 +1,144 @@
+#ifndef DRAW_PACKETS_CLASS
+#define DRAW_PACKETS_CLASS
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Draw sort keys, most significant field first:
+//   pass 4 | pipeline 8 | material 16 | mesh 16 | depth 20
+// Sorting by key groups draws by the state they need, so consecutive draws
+// rebind as little as possible; depth only orders draws that share all of
+// the state above it, front to back.
+const uint32_t DRAW_KEY_DEPTH_BITS = 20;
+const uint32_t DRAW_KEY_MESH_BITS = 16;
+const uint32_t DRAW_KEY_MATERIAL_BITS = 16;
+const uint32_t DRAW_KEY_PIPELINE_BITS = 8;
+const uint32_t DRAW_KEY_PASS_BITS = 4;
+
+const uint32_t DRAW_KEY_MESH_SHIFT = DRAW_KEY_DEPTH_BITS;
+const uint32_t DRAW_KEY_MATERIAL_SHIFT = DRAW_KEY_MESH_SHIFT + DRAW_KEY_MESH_BITS;
+const uint32_t DRAW_KEY_PIPELINE_SHIFT = DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS;
+const uint32_t DRAW_KEY_PASS_SHIFT = DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS;
+
+enum class DrawPass : uint32_t {
+    Opaque
+};
+
+enum class DrawPipeline : uint32_t {
+    // Vertex pipeline over the shared index buffer
+    Mesh,
+    // Meshlets culled on the GPU, drawn by the mesh shader pipeline or
+    // indirectly from the compacted index buffer
+    Cluster
+};
+
+struct DrawPacket {
+    uint64_t key;
+    // Into the snapshot's draw list
+    uint32_t draw;
+    uint32_t padding;
+};
+
+// Non-negative depths compare like their bit patterns, the top 20 bits below
+// the sign keep about 4 bits of mantissa precision per octave
+inline uint64_t makeDrawKey(DrawPass pass, DrawPipeline pipeline, uint32_t material, uint32_t mesh, float depth) {
+    uint32_t depthBits = 0;
+    if (depth > 0.0f) {
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+        depthBits >>= 31 - DRAW_KEY_DEPTH_BITS;
+    }
+    return static_cast<uint64_t>(pass) << DRAW_KEY_PASS_SHIFT |
+        static_cast<uint64_t>(pipeline) << DRAW_KEY_PIPELINE_SHIFT |
+        static_cast<uint64_t>(material & ((1u << DRAW_KEY_MATERIAL_BITS) - 1)) << DRAW_KEY_MATERIAL_SHIFT |
+        static_cast<uint64_t>(mesh & ((1u << DRAW_KEY_MESH_BITS) - 1)) << DRAW_KEY_MESH_SHIFT |
+        depthBits;
+}
+
+inline DrawPipeline getDrawPipeline(uint64_t key) {
+    return static_cast<DrawPipeline>((key >> DRAW_KEY_PIPELINE_SHIFT) & ((1u << DRAW_KEY_PIPELINE_BITS) - 1));
+}
+
+// Stable LSD radix sort over 8-bit digits, digits every key shares are
+// skipped; scratch is only there to avoid reallocating every frame
+void sortDrawPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch);
+
+// State changes of one frame's command buffer
+struct DrawStats {
+    uint32_t packets = 0;
+    uint32_t drawCalls = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t descriptorSetBinds = 0;
+    uint32_t vertexBufferBinds = 0;
+    uint32_t indexBufferBinds = 0;
+    // Binds skipped because the state was already bound
+    uint32_t redundantBinds = 0;
+    // Static buckets replayed from their cached command buffers, and the
+    // draws in them; none of these count as recorded above
+    uint32_t cachedBuckets = 0;
+    uint32_t cachedDrawCalls = 0;
+    uint32_t recordedBuckets = 0;
+    // Shadow atlas faces whose static casters were drawn again, and those
+    // copied from the cache; every face draws its dynamic casters
+    uint32_t shadowFacesRendered = 0;
+    uint32_t shadowFacesCached = 0;
+    uint32_t shadowDrawCalls = 0;
+
+    inline uint32_t stateChanges() const {
+        return pipelineBinds + descriptorSetBinds + vertexBufferBinds + indexBufferBinds;
+    }
+};
+
+// Most sets and vertex buffers BindState binds at once, so it can remember
+// them without allocating
+const uint32_t MAX_BOUND_DESCRIPTOR_SETS = 4;
+const uint32_t MAX_BOUND_VERTEX_BUFFERS = 4;
+
+// Remembers what is bound on a command buffer and drops binds that would
+// not change anything
+class BindState {
+public:
+    BindState(VkCommandBuffer commandBuffer, DrawStats& stats);
+
+    // True when the pipeline was actually bound, state tied to its layout
+    // such as push constants has to be set again then
+    bool bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+    // Binds from set 0 up
+    void bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, const VkDescriptorSet* sets,
+                        uint32_t count);
+    template<size_t N>
+    inline void bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout,
+                                const std::array<VkDescriptorSet, N>& sets) {
+        bindDescriptorSets(bindPoint, layout, sets.data(), static_cast<uint32_t>(N));
+    }
+    inline void bindDescriptorSet(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, VkDescriptorSet set) {
+        bindDescriptorSets(bindPoint, layout, &set, 1);
+    }
+    // Binds from binding 0 up, at offset 0
+    void bindVertexBuffers(const VkBuffer* buffers, uint32_t count);
+    template<size_t N>
+    inline void bindVertexBuffers(const std::array<VkBuffer, N>& buffers) {
+        bindVertexBuffers(buffers.data(), static_cast<uint32_t>(N));
+    }
+    inline void bindVertexBuffer(VkBuffer buffer) { bindVertexBuffers(&buffer, 1); }
+    void bindIndexBuffer(VkBuffer buffer, VkIndexType indexType);
+    inline void countDraw() { stats.drawCalls++; }
+    inline VkCommandBuffer getCommandBuffer() const { return commandBuffer; }
+
+private:
+    VkCommandBuffer commandBuffer;
+    DrawStats& stats;
+
+    VkPipeline pipeline;
+    std::array<VkDescriptorSet, MAX_BOUND_DESCRIPTOR_SETS> descriptorSets;
+    uint32_t descriptorSetCount;
+    std::array<VkBuffer, MAX_BOUND_VERTEX_BUFFERS> vertexBuffers;
+    uint32_t vertexBufferCount;
+    VkBuffer indexBuffer;
+    VkIndexType indexType;
+};
+
+#endif //DRAW_PACKETS_CLASS
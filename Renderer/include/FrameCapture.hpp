@@ -0,0 +1,143 @@
+#ifndef FRAME_CAPTURE_CLASS
+#define FRAME_CAPTURE_CLASS
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "ResourceManager.hpp"
+
+// Readback buffers in flight or being encoded; one more than the frames in
+// flight lets the encoder fall a frame behind before frames are dropped
+const uint32_t CAPTURE_RING_SIZE = 3;
+
+enum class CaptureOutput {
+    // Frames only go to the callback
+    Callback,
+    // One file per frame, path is the directory: frame_000042.png
+    Png,
+    // Every frame appended to one file as tightly packed RGBA rows, e.g. for
+    // ffmpeg -f rawvideo -pix_fmt rgba -video_size WxH -i path; frames that
+    // do not have the first frame's size are left out
+    RawVideo
+};
+
+// Always RGBA8 with the top row first, whatever the swapchain format is
+struct CapturedFrame {
+    // Frame number the renderer submitted it with
+    uint64_t frame;
+    uint32_t width;
+    uint32_t height;
+    // width * height * 4 bytes, only valid during the callback
+    const uint8_t* pixels;
+};
+
+typedef std::function<void(const CapturedFrame& frame)> CaptureCallback;
+
+struct CaptureStats {
+    uint64_t captured = 0;
+    // Skipped because every buffer of the ring was still busy
+    uint64_t dropped = 0;
+    uint64_t encoded = 0;
+};
+
+// Copies finished frames into a ring of host-visible readback buffers
+// without ever waiting on the GPU. The render thread records the copy at the
+// end of a frame and later reports which frames completed, the same frame
+// numbers the resource manager collects with; completed buffers go to a
+// thread of their own that converts and encodes them. When the encoder falls
+// behind, frames are dropped rather than rendering being slowed down.
+class FrameCapture {
+public:
+    FrameCapture();
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    void init(ResourceManager& resources);
+    // Encodes every frame that was captured, the device has to be idle
+    void shutdown();
+
+    // Any thread. Starting again ends the previous session; frames it
+    // captured are still written to its outputs. callback runs on the encoder
+    // thread for every frame, next to the output.
+    void start(CaptureOutput output, const std::string& path = "", CaptureCallback callback = nullptr);
+    void stop();
+    bool isCapturing();
+
+    // Render thread, after the frame's render pass: copies image, which has
+    // to be in the present layout and created with transfer source usage.
+    // False when nothing is captured, the frame is dropped or the format is
+    // not 8-bit RGBA or BGRA.
+    bool record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint64_t frame);
+    // Render thread: every frame up to completedFrame finished on the GPU
+    void collect(uint64_t completedFrame);
+
+    CaptureStats getStats();
+
+private:
+    // Outputs of one start(), alive until its last frame is encoded
+    struct Session {
+        ~Session();
+
+        CaptureOutput output;
+        std::string path;
+        CaptureCallback callback;
+        FILE* file = nullptr;
+        // Raw video: size of the first frame
+        VkExtent2D extent{};
+    };
+
+    enum class SlotState {
+        Free,
+        // Copy recorded, the frame has not completed yet
+        Pending,
+        Encoding
+    };
+
+    struct Slot {
+        SlotState state = SlotState::Free;
+        BufferHandle buffer;
+        VkDeviceSize size = 0;
+        uint64_t frame = 0;
+        VkExtent2D extent{};
+        bool bgra = false;
+        std::shared_ptr<Session> session;
+    };
+
+    void encode(Slot& slot);
+    void encodeLoop();
+
+    ResourceManager* resources;
+
+    std::mutex mutex;
+    std::shared_ptr<Session> session;
+    std::vector<Slot> slots;
+    // Slots in completion order, waiting for the encoder
+    std::deque<uint32_t> queue;
+    std::condition_variable queueCondition;
+    CaptureStats stats;
+    bool stopping;
+    std::thread thread;
+
+    // Encoder thread only
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> encoded;
+};
+
+// PNG of tightly packed RGBA8 rows, stored without compression so encoding
+// costs little more than a copy and a checksum
+void encodePng(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& png);
+
+#endif //FRAME_CAPTURE_CLASS
@@ -0,0 +1,108 @@
+#ifndef JOB_SYSTEM_CLASS
+#define JOB_SYSTEM_CLASS
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobSystemConfig {
+    // Number of worker threads, 0 picks one per hardware thread minus the caller
+    uint32_t workerCount = 0;
+    // Pin worker i to core (firstCore + i) % coreCount
+    bool pinWorkers = false;
+    uint32_t firstCore = 1;
+    // Explicit core per worker, takes precedence over pinWorkers when not empty
+    std::vector<uint32_t> workerCores;
+};
+
+struct Job {
+    std::function<void()> function;
+    const char* name;
+
+    std::atomic<uint32_t> pendingDependencies{0};
+    std::atomic<bool> finished{false};
+    std::exception_ptr error;
+
+    std::mutex continuationMutex;
+    std::vector<std::shared_ptr<Job>> continuations;
+
+    inline bool isFinished() const { return finished.load(std::memory_order_acquire); }
+};
+
+typedef std::shared_ptr<Job> JobHandle;
+
+struct JobTiming {
+    const char* name;
+    // Index of the queue that ran the job, workerCount() for external threads
+    uint32_t worker;
+    std::chrono::high_resolution_clock::time_point start;
+    std::chrono::high_resolution_clock::time_point end;
+};
+
+typedef std::function<void(const JobTiming&)> JobTimingCallback;
+
+// Work-stealing scheduler. Every worker owns a deque it pushes to and pops
+// from at the back; idle workers steal from the front of the others. Threads
+// that are not workers submit through a shared injection queue and help run
+// jobs while they wait, so waiting never blocks a core.
+class JobSystem {
+public:
+    explicit JobSystem(const JobSystemConfig& config = JobSystemConfig());
+    // Runs every job still queued, and the continuations they release, before
+    // the workers stop; errors of jobs nobody waited for are dropped
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // The job only becomes runnable once every dependency has finished
+    JobHandle submit(const char* name, std::function<void()> function,
+                    const std::vector<JobHandle>& dependencies = {});
+    // Runs other jobs until the given one finishes and rethrows its exception
+    void wait(const JobHandle& job);
+    void waitAll(const std::vector<JobHandle>& jobs);
+
+    // fn(begin, end) over ranges of at least grainSize elements; returns once all ran
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& fn,
+                    const char* name = "parallelFor");
+
+    // Called after every job with its timings; set it before submitting work
+    void setTimingCallback(JobTimingCallback callback);
+
+    inline uint32_t workerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    void workerLoop(uint32_t index);
+    void pinThread(std::thread& thread, uint32_t core);
+    uint32_t currentQueue() const;
+    void enqueue(const JobHandle& job);
+    bool runOne(uint32_t queueIndex);
+    void helpUntilFinished(const JobHandle& job);
+    void execute(const JobHandle& job, uint32_t queueIndex);
+
+    std::vector<std::thread> workers;
+    // One queue per worker plus the injection queue at index workers.size()
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<size_t> queuedJobs;
+    std::atomic<bool> stopping;
+
+    JobTimingCallback timingCallback;
+};
+
+#endif //JOB_SYSTEM_CLASS
@@ -0,0 +1,92 @@
+#ifndef LIGHT_GRID_CLASS
+#define LIGHT_GRID_CLASS
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "glm.hpp"
+#include "ResourceManager.hpp"
+
+// Clusters of the froxel grid: screen tiles split into depth slices that grow
+// exponentially from the near to the far plane
+const uint32_t LIGHT_GRID_X = 16;
+const uint32_t LIGHT_GRID_Y = 9;
+const uint32_t LIGHT_GRID_Z = 24;
+const uint32_t LIGHT_GRID_CLUSTERS = LIGHT_GRID_X * LIGHT_GRID_Y * LIGHT_GRID_Z;
+// Lights one cluster keeps, any further ones touching it are dropped. Matches
+// light_cull.comp and fragment.frag
+const uint32_t LIGHT_CLUSTER_CAPACITY = 128;
+// Lights uploaded per frame, the rest are dropped. Fixed so the descriptor
+// sets are written once and cached command buffers binding them stay valid
+const uint32_t LIGHT_GRID_MAX_LIGHTS = 16384;
+
+// One point light as the shaders read it
+struct LightData {
+    glm::vec3 position;
+    float radius;
+    // Scaled by the intensity
+    glm::vec3 color;
+    // Slot in the shadow atlas, -1 without shadows
+    int32_t shadow;
+};
+
+// Uniform buffer of the lighting set, std140
+struct LightingConstants {
+    glm::mat4 view;
+    glm::mat4 inverseProjection;
+    // Near and far plane, then scale and bias mapping log(view depth) to a slice
+    glm::vec4 depthParams;
+    // Tile size and framebuffer size in pixels
+    glm::vec4 tileParams;
+    // Grid size and the number of lights
+    glm::uvec4 grid;
+};
+
+// Clustered light culling. Every frame a compute pass on the async compute
+// queue bins the point lights into the froxel grid, the fragment shader then
+// only walks the list of the cluster it falls into. The lighting set holds the
+// constants, the lights and the per-cluster counts and indices; its buffers are
+// shared concurrently so no ownership transfer is needed before shading.
+class LightGrid {
+public:
+    LightGrid();
+
+    LightGrid(const LightGrid&) = delete;
+    LightGrid& operator=(const LightGrid&) = delete;
+
+    // cullShader is only used while creating the pipeline
+    void init(VkDevice device, ResourceManager& resources, VkShaderModule cullShader, uint32_t frameCount);
+    void shutdown();
+
+    // Render thread, before the frame's compute passes are submitted. The
+    // frame's previous use of its buffers has to have completed.
+    void update(size_t frame, const std::vector<LightData>& lights, const glm::mat4& view,
+            const glm::mat4& projection, float nearPlane, float farPlane, VkExtent2D extent);
+    // Compute queue, the grid is ready for the fragment shaders once the
+    // compute submission has signalled
+    void record(VkCommandBuffer commandBuffer, size_t frame);
+
+    // Bound at set 1 of the graphics pipelines, set 0 of the culling pipeline
+    inline VkDescriptorSetLayout getSetLayout() const { return setLayout; }
+    inline VkDescriptorSet getDescriptorSet(size_t frame) const { return descriptorSets[frame]; }
+
+private:
+    VkDevice device;
+    ResourceManager* resources;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;
+    PipelineHandle pipeline;
+
+    // Per frame in flight
+    std::vector<BufferHandle> constantBuffers;
+    std::vector<BufferHandle> lightBuffers;
+    // Lights per cluster, and LIGHT_CLUSTER_CAPACITY light indices per cluster
+    std::vector<BufferHandle> countBuffers;
+    std::vector<BufferHandle> indexBuffers;
+};
+
+#endif //LIGHT_GRID_CLASS
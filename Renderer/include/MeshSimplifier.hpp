@@ -0,0 +1,41 @@
+#ifndef MESH_SIMPLIFIER_CLASS
+#define MESH_SIMPLIFIER_CLASS
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+// One level of detail: a triangle list over the same vertices as the source
+// mesh, so every level can share a single vertex buffer
+struct LodLevel {
+    std::vector<uint32_t> indices;
+    // Object-space deviation from the full-detail surface
+    float error;
+};
+
+struct LodSettings {
+    uint32_t maxLevels = 6;
+    // Each level aims for this fraction of the previous level's triangles
+    float reduction = 0.5f;
+    // Levels that deviate further than this are not generated
+    float maxError = 1e30f;
+    // Stop once a level removes less than this fraction of the previous
+    // level's triangles, further levels would be near duplicates
+    float minimumReduction = 0.15f;
+};
+
+// Quadric error metric edge collapse (Garland & Heckbert). Vertices are only
+// ever collapsed onto one another, never moved, so the result indexes the
+// original vertex array. Vertices sharing a position with another vertex
+// (attribute seams) stay put, as do collapses that would flip a triangle.
+// error receives the worst deviation introduced, in object-space units.
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                size_t targetIndexCount, float& error);
+
+// Level 0 is the input itself with zero error; later levels get coarser until
+// the settings' limits are reached
+std::vector<LodLevel> generateLods(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                const LodSettings& settings = LodSettings());
+
+#endif //MESH_SIMPLIFIER_CLASS
@@ -0,0 +1,48 @@
+#ifndef MESHLETS_CLASS
+#define MESHLETS_CLASS
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+// Limits that fit one mesh shader workgroup; the triangle count keeps the
+// primitive indices of a meshlet under 128 * 3 bytes
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A small cluster of triangles with the bounds needed to cull it. The layout
+// matches the std430 struct the culling shaders read.
+struct Meshlet {
+    // Object-space bounding sphere
+    glm::vec3 center;
+    float radius;
+    // Every triangle normal lies within the cone around coneAxis; the cluster
+    // faces away from viewers for whom
+    //   dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius
+    // A cutoff of 1 means the normals are too spread out to ever cull it
+    glm::vec3 coneAxis;
+    float coneCutoff;
+    // Into MeshletData::vertices
+    uint32_t vertexOffset;
+    // Byte offset into MeshletData::triangles, always a multiple of 4
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+struct MeshletData {
+    std::vector<Meshlet> meshlets;
+    // Mesh vertex index of every meshlet-local vertex
+    std::vector<uint32_t> vertices;
+    // Three meshlet-local vertex indices per triangle, each meshlet's block
+    // padded to 4 bytes so shaders can read it as uint words
+    std::vector<uint8_t> triangles;
+};
+
+// Greedily grows clusters over shared vertices, preferring triangles that
+// add the fewest new vertices so neighbouring triangles end up together
+MeshletData buildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                        uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+#endif //MESHLETS_CLASS
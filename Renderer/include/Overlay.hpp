@@ -0,0 +1,145 @@
+#ifndef OVERLAY_CLASS
+#define OVERLAY_CLASS
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "glm.hpp"
+#include "ResourceManager.hpp"
+
+// Glyphs of the built-in font are 5x7 pixels on a grid of 6x8, so text at
+// scale 1 advances this far per character and per line
+const float OVERLAY_GLYPH_ADVANCE = 6.0f;
+const float OVERLAY_LINE_HEIGHT = 8.0f;
+
+// One corner of an overlay triangle. Positions are framebuffer pixels with
+// the origin at the top left, like the window's.
+struct OverlayVertex {
+    glm::vec2 position;
+    // Into the glyph atlas, solid shapes all sample one fully covered texel
+    glm::vec2 uv;
+    // RGBA8, red in the lowest byte
+    uint32_t color;
+
+    static VkVertexInputBindingDescription getBindingDescriptor() {
+        VkVertexInputBindingDescription bindingDescriptor{};
+        bindingDescriptor.binding = 0;
+        bindingDescriptor.stride = sizeof(OverlayVertex);
+        bindingDescriptor.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescriptor;
+    }
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescription() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(OverlayVertex, position);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(OverlayVertex, uv);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[2].offset = offsetof(OverlayVertex, color);
+
+        return attributeDescriptions;
+    }
+};
+
+// Immediate-mode 2D drawing for debug displays. Everything added during a
+// frame becomes triangles of one vertex list, drawn in the order it was
+// added; the list is handed to the render thread with the frame's snapshot
+// and starts out empty again for the next one. Update thread only.
+class OverlayBatch {
+public:
+    void line(const glm::vec2& from, const glm::vec2& to, const glm::vec4& color, float width = 1.0f);
+    void rect(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color);
+    // Upper case ASCII in the built-in font, scaled by whole pixels so it
+    // stays sharp. Lower case is drawn as upper case, other characters the
+    // font does not have as '?', and '\n' starts a new line. Returns the
+    // size of the text's bounding box.
+    glm::vec2 text(const glm::vec2& position, const std::string& string, const glm::vec4& color,
+                float scale = 1.0f);
+    // What text() would return, without drawing anything
+    static glm::vec2 measure(const std::string& string, float scale = 1.0f);
+
+    // Moves this frame's vertices into vertices, which is cleared to be
+    // filled by the next frame; both keep their capacity
+    void take(std::vector<OverlayVertex>& vertices);
+    inline bool empty() const { return vertices.empty(); }
+
+private:
+    void quad(const glm::vec2& min, const glm::vec2& max, const glm::vec2& uvMin, const glm::vec2& uvMax,
+            uint32_t color);
+
+    std::vector<OverlayVertex> vertices;
+};
+
+// Draws the frame's overlay triangles in a single non-indexed draw, sampling
+// the glyph atlas that holds the built-in font next to a solid texel. The
+// vertices go into a host-visible buffer per frame in flight that grows when
+// a frame needs more room, so nothing is allocated once the displays have
+// settled.
+class OverlayRenderer {
+public:
+    OverlayRenderer();
+
+    OverlayRenderer(const OverlayRenderer&) = delete;
+    OverlayRenderer& operator=(const OverlayRenderer&) = delete;
+
+    void init(VkDevice device, ResourceManager& resources, uint32_t frameCount);
+    void shutdown();
+
+    // Render thread, the frame's previous use of its buffer has to have completed
+    void update(size_t frame, const std::vector<OverlayVertex>& vertices);
+    // Graphics queue, outside of any render pass; uploads the atlas the first
+    // time and does nothing afterwards
+    void record(VkCommandBuffer commandBuffer);
+    // Inside a render pass with the pipeline and descriptor set bound
+    void draw(VkCommandBuffer commandBuffer, size_t frame, VkExtent2D extent);
+
+    inline bool empty(size_t frame) const { return vertexCounts[frame] == 0; }
+    inline VkBuffer getVertexBuffer(size_t frame) { return resources->get(vertexBuffers[frame])->buffer; }
+    // Set 0 of the overlay pipeline, which uses the layout as it is
+    inline VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+    inline VkPipelineLayout getPipelineLayout() const { return pipelineLayout; }
+
+private:
+    // Grows the frame's vertex buffer to hold at least vertexCount vertices
+    void reserve(size_t frame, size_t vertexCount);
+    void transition(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout,
+                VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage,
+                VkAccessFlags dstAccess);
+
+    VkDevice device;
+    ResourceManager* resources;
+
+    ImageHandle atlas;
+    SamplerHandle sampler;
+    // The atlas pixels until record() has copied them, then released
+    BufferHandle atlasStaging;
+    bool atlasReady;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    // Only the atlas, which never changes, so one set serves every frame
+    VkDescriptorSet descriptorSet;
+    VkPipelineLayout pipelineLayout;
+
+    // Per frame in flight
+    std::vector<BufferHandle> vertexBuffers;
+    std::vector<size_t> vertexCapacity;
+    std::vector<uint32_t> vertexCounts;
+};
+
+#endif //OVERLAY_CLASS
@@ -0,0 +1,161 @@
+#ifndef PARTICLE_SYSTEM_CLASS
+#define PARTICLE_SYSTEM_CLASS
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "glm.hpp"
+#include "ResourceManager.hpp"
+
+// Particles alive at once, emission stops while they are all in use. A power
+// of two so the bitonic sort never needs more room than the buffers have
+const uint32_t PARTICLE_CAPACITY = 1u << 20;
+// Emitters uploaded per frame, the rest are dropped. Fixed so the descriptor
+// sets are written once
+const uint32_t PARTICLE_MAX_EMITTERS = 1024;
+// Elements one workgroup sorts in shared memory, matches particle_sort.comp
+const uint32_t PARTICLE_SORT_BLOCK = 512;
+
+// One emitter's share of the frame's new particles, as the shaders read it
+struct ParticleEmitterData {
+    glm::vec3 position;
+    // Its first particle among all emitted this frame
+    uint32_t firstParticle;
+    glm::vec3 direction;
+    // Largest angle from direction in radians
+    float spread;
+    glm::vec4 color;
+    float speed;
+    float lifetime;
+    float size;
+    uint32_t count;
+};
+
+// Uniform buffer of the particle set, std140
+struct ParticleConstants {
+    glm::mat4 viewProjection;
+    // Billboard axes in world space
+    glm::vec4 cameraRight;
+    glm::vec4 cameraUp;
+    glm::vec4 cameraPosition;
+    // Acceleration, then the time step in seconds
+    glm::vec4 gravity;
+    // Particles to emit, the number of emitters and the frame's random seed
+    glm::uvec4 emission;
+};
+
+// Persistent state only the compute queue touches, std430
+struct ParticleCounters {
+    // Free particles, and how many were never used at all; those are taken
+    // in order once the dead list runs out, so nothing needs to be seeded
+    uint32_t deadCount;
+    uint32_t freshCount;
+    // Which of the two alive lists holds the living particles
+    uint32_t current;
+    // Clamped to the free particles
+    uint32_t emitCount;
+    uint32_t aliveCounts[2];
+    // Alive particles rounded up to a power of two, at least one sort block
+    uint32_t sortCount;
+    uint32_t padding;
+    // VkDispatchIndirectCommand each, padded to 16 bytes
+    glm::uvec4 emitDispatch;
+    glm::uvec4 simulateDispatch;
+    glm::uvec4 sortDispatch;
+};
+
+// Shared by the particle compute pipelines
+struct ParticlePushConstants {
+    // Step of particle_args.comp or particle_sort.comp
+    uint32_t mode;
+    // Bitonic sort: size of the sequences being merged and the compare distance
+    uint32_t k;
+    uint32_t j;
+};
+
+struct ParticleShaders {
+    VkShaderModule args;
+    VkShaderModule emit;
+    VkShaderModule simulate;
+    VkShaderModule sort;
+};
+
+// GPU particles. Emission, simulation, compaction of the living particles and
+// their back to front sort all run on the compute queue from buffers that
+// stay on the GPU; the only thing the host writes per frame is how many
+// particles each emitter spawns. The dead particles are a stack of free
+// indices, the living ones are compacted into the other of two alive lists
+// every frame. Dispatch sizes come from the counters through indirect
+// dispatches, and the frame's draw is a single indirect instanced draw of
+// camera-facing quads.
+//
+// Particle state is only read and written by the compute queue; what the
+// draw reads is written per frame in flight and shared concurrently, so the
+// graphics queue never needs an ownership transfer.
+class ParticleSystem {
+public:
+    ParticleSystem();
+
+    ParticleSystem(const ParticleSystem&) = delete;
+    ParticleSystem& operator=(const ParticleSystem&) = delete;
+
+    // The shaders are only used while creating the pipelines
+    void init(VkDevice device, ResourceManager& resources, const ParticleShaders& shaders, uint32_t frameCount);
+    void shutdown();
+
+    // Render thread, the frame's previous use of its buffers has to have
+    // completed. The emitters' particles follow each other in order.
+    void update(size_t frame, const std::vector<ParticleEmitterData>& emitters, const glm::mat4& view,
+            const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float deltaTime);
+    // Compute queue; the frame's draw is ready once the compute submission
+    // has signalled
+    void record(VkCommandBuffer commandBuffer, size_t frame);
+    // Inside a render pass with the draw pipeline and descriptor set bound
+    void draw(VkCommandBuffer commandBuffer, size_t frame);
+
+    // Set 0 of the compute pipelines and of the draw pipeline, which shares
+    // their layout; the push constants are only visible to compute
+    inline VkDescriptorSet getDescriptorSet(size_t frame) const { return descriptorSets[frame]; }
+    inline VkPipelineLayout getPipelineLayout() const { return pipelineLayout; }
+
+private:
+    // Makes the previous dispatch's writes visible to the next dispatch and
+    // to its indirect arguments
+    void barrier(VkCommandBuffer commandBuffer);
+    void bind(VkCommandBuffer commandBuffer, PipelineHandle pipeline, const ParticlePushConstants& constants);
+
+    VkDevice device;
+    ResourceManager* resources;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;
+    VkPipelineLayout pipelineLayout;
+    PipelineHandle argsPipeline;
+    PipelineHandle emitPipeline;
+    PipelineHandle simulatePipeline;
+    PipelineHandle sortPipeline;
+
+    // Compute queue only
+    BufferHandle particleBuffer;
+    BufferHandle deadBuffer;
+    // Both alive lists, PARTICLE_CAPACITY indices each
+    BufferHandle aliveBuffer;
+    BufferHandle counterBuffer;
+    // The counters start out zeroed by the first record
+    bool countersReady;
+    // Render thread, varies the random numbers of the emission per frame
+    uint32_t seed;
+
+    // Per frame in flight; the host writes the constants and emitters, the
+    // simulation the surviving particles' vertices, their sort keys and the draw
+    std::vector<BufferHandle> constantBuffers;
+    std::vector<BufferHandle> emitterBuffers;
+    std::vector<BufferHandle> vertexBuffers;
+    std::vector<BufferHandle> sortBuffers;
+    std::vector<BufferHandle> drawBuffers;
+};
+
+#endif //PARTICLE_SYSTEM_CLASS
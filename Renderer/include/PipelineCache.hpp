@@ -0,0 +1,162 @@
+#ifndef PIPELINE_CACHE_CLASS
+#define PIPELINE_CACHE_CLASS
+
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "ResourceManager.hpp"
+
+enum class BlendMode : uint32_t {
+    Opaque,
+    // newAlpha * newColor + (1 - newAlpha) * oldColor
+    Alpha,
+    // newAlpha * newColor + oldColor
+    Additive
+};
+
+// Shader features are boolean specialization constants whose constant_id is
+// the bit index, so every combination of features shares one SPIR-V module
+// and the driver folds the branches away when the pipeline is built.
+// Features that change a shader's interface cannot be constants, those need
+// a module of their own named in PipelineShader::name.
+enum ShaderFeature : uint32_t {
+    // Diffuse lighting, vertex colors only without it
+    SHADER_FEATURE_LIGHTING = 1u << 0,
+    // Normals as colors instead of shading
+    SHADER_FEATURE_DEBUG_NORMALS = 1u << 1
+};
+
+const uint32_t SHADER_FEATURE_COUNT = 2;
+
+struct PipelineShader {
+    VkShaderStageFlagBits stage;
+    // Resolved by the cache's shader loader, e.g. "vert.spv"
+    std::string name;
+    // ShaderFeature bits, constants the module does not declare are ignored
+    uint32_t features = 0;
+};
+
+// Everything a graphics pipeline is built from. Viewport and scissor are
+// always dynamic, so descriptions do not depend on the swapchain size.
+struct PipelineDesc {
+    std::vector<PipelineShader> shaders;
+    // Empty for pipelines without vertex input, e.g. mesh shaders
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+
+    BlendMode blend = BlendMode::Opaque;
+    // False for depth-only passes, blend is ignored then
+    bool colorAttachment = true;
+
+    // Not owned, has to outlive every pipeline built with it
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    bool operator==(const PipelineDesc& other) const;
+    bool operator!=(const PipelineDesc& other) const {
+        return !(*this == other);
+    }
+};
+
+size_t hashPipelineDesc(const PipelineDesc& desc);
+
+struct PipelineDescHash {
+    inline size_t operator()(const PipelineDesc& desc) const { return hashPipelineDesc(desc); }
+};
+
+typedef std::function<VkShaderModule(const std::string& name)> ShaderLoader;
+
+// Graphics pipelines by description. get() never blocks: a variant that was
+// not built yet is queued for the cache's compile thread and the fallback is
+// returned until it is ready, so a new combination of state costs at worst a
+// few frames drawn with the fallback instead of a hitch. Pipelines are owned
+// by the resource manager with a shared layout, so they are retired like any
+// other resource. All methods may be called from any thread.
+class PipelineCache {
+public:
+    PipelineCache();
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    void init(VkDevice device, ResourceManager& resources, ShaderLoader loader);
+    // Stops the compile thread and destroys every pipeline and shader module
+    void shutdown();
+
+    // Builds the pipeline on the calling thread unless it is cached already;
+    // for pipelines that have to exist up front, such as fallbacks
+    PipelineHandle compile(const PipelineDesc& desc);
+    // The cached pipeline, or fallback while it is queued, compiling or failed
+    PipelineHandle get(const PipelineDesc& desc, PipelineHandle fallback);
+    bool isReady(const PipelineDesc& desc);
+
+    // Drops queued compiles, waits for those in flight and destroys every
+    // pipeline, e.g. before the render pass they were built for goes away
+    void clear();
+
+    // Queued plus compiling
+    uint32_t pendingCompiles();
+    size_t size();
+    size_t shaderModuleCount();
+
+private:
+    enum class State {
+        Queued,
+        Compiling,
+        Ready,
+        Failed
+    };
+
+    struct Entry {
+        State state = State::Queued;
+        PipelineHandle pipeline;
+    };
+
+    VkPipeline createPipeline(const PipelineDesc& desc);
+    // Loaded once and shared by every pipeline using it
+    VkShaderModule getShaderModule(const std::string& name);
+    void compileLoop();
+
+    VkDevice device;
+    ResourceManager* resources;
+    ShaderLoader loader;
+    // Lets the driver reuse compiled shader code between variants
+    VkPipelineCache driverCache;
+
+    // Not the compile mutex, loading a module does not block get()
+    std::mutex moduleMutex;
+    std::unordered_map<std::string, VkShaderModule> modules;
+
+    std::mutex mutex;
+    std::unordered_map<PipelineDesc, Entry, PipelineDescHash> entries;
+    std::deque<PipelineDesc> queue;
+    std::condition_variable queueCondition;
+    // Signalled whenever a compile finishes, on the thread or in compile()
+    std::condition_variable compileCondition;
+    uint32_t compiling;
+    bool stopping;
+    std::thread thread;
+};
+
+#endif //PIPELINE_CACHE_CLASS
@@ -11,17 +11,61 @@
 #include <optional>
 #include <set>
 #include <cstdint>
+#include <cstdio>
 #include <algorithm>
 #include <fstream>
 #include <array>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <mutex>
 
 #include "glm.hpp"
 #include <GLFW/glfw3.h>
 
+#include "JobSystem.hpp"
+#include "Scene.hpp"
+#include "Components.hpp"
+#include "TransformHierarchy.hpp"
+#include "SpscQueue.hpp"
+#include "ResourceManager.hpp"
+#include "ComputeQueue.hpp"
+#include "Camera.hpp"
+#include "MeshSimplifier.hpp"
+#include "Meshlets.hpp"
+#include "AssetPack.hpp"
+#include "AsyncFileReader.hpp"
+#include "DrawPackets.hpp"
+#include "PipelineCache.hpp"
+#include "FrameCapture.hpp"
+#include "DepthPyramid.hpp"
+#include "LightGrid.hpp"
+#include "ShadowAtlas.hpp"
+#include "ParticleSystem.hpp"
+#include "Overlay.hpp"
+
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
+// Longest the main thread sleeps while rendering on demand before it looks
+// at the window again, in seconds
+const double ON_DEMAND_WAIT_TIMEOUT = 0.5;
+// One snapshot being simulated while the other one is being recorded
+const size_t SNAPSHOT_COUNT = 2;
+// Levels of detail kept per mesh, level 0 is the full-detail mesh
+const uint32_t MAX_MESH_LODS = 8;
+// Meshes with at least this many triangles are split into meshlets, instances
+// drawn at full detail are then culled cluster by cluster on the GPU
+const uint32_t CLUSTER_MIN_TRIANGLES = 4096;
+// Dynamic resolution moves the render scale in steps of this much per axis,
+// each time from the average GPU time of this many completed frames. The
+// scale is left alone while that time is between HEADROOM of the target and
+// the target itself.
+const float RENDER_SCALE_STEP = 0.05f;
+const uint32_t RENDER_SCALE_SAMPLES = 8;
+const float RENDER_SCALE_HEADROOM = 0.8f;
 
 // Validation layers 
 const std::vector<const char*> validationLayers = {
@@ -29,7 +73,8 @@ const std::vector<const char*> validationLayers = {
 };
 
 struct Vertex {
-    glm::vec2 pos;
+    glm::vec3 pos;
+    glm::vec3 normal;
     glm::vec3 color;
 
     static VkVertexInputBindingDescription getBindingDescriptor() {
@@ -40,23 +85,221 @@ struct Vertex {
 
         return bindingDescriptor;
     }
-    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescription() {
-        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescription() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
 
         attributeDescriptions[0].binding = 0;
         attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
         attributeDescriptions[0].offset = offsetof(Vertex, pos);
-        
+
         attributeDescriptions[1].binding = 0;
         attributeDescriptions[1].location = 1;
         attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, color);
+        attributeDescriptions[1].offset = offsetof(Vertex, normal);
+        
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[2].offset = offsetof(Vertex, color);
+
+        return attributeDescriptions;
+    }
+};
+
+// Per-instance data gathered from the scene every frame
+struct InstanceData {
+    glm::mat4 model;
+
+    static VkVertexInputBindingDescription getBindingDescriptor() {
+        VkVertexInputBindingDescription bindingDescriptor{};
+        bindingDescriptor.binding = 1;
+        bindingDescriptor.stride = sizeof(InstanceData);
+        bindingDescriptor.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescriptor;
+    }
+    // A mat4 attribute takes one location per column
+    static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescription() {
+        std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
+
+        for (uint32_t i = 0; i < 4; i++) {
+            attributeDescriptions[i].binding = 1;
+            attributeDescriptions[i].location = 3 + i;
+            attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[i].offset = offsetof(InstanceData, model) + sizeof(glm::vec4) * i;
+        }
 
         return attributeDescriptions;
     }
 };
 
+// Index range of one level of detail inside the shared index buffer
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Object-space deviation from level 0
+    float error;
+};
+
+// One mesh inside the shared vertex/index buffers. All of its levels index
+// the same vertices, coarser levels simply reference fewer of them.
+struct Mesh {
+    int32_t vertexOffset;
+    uint32_t lodCount;
+    std::array<MeshLod, MAX_MESH_LODS> lods;
+    // Object-space bounding sphere
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+    // Meshlets of level 0, none for meshes that are always drawn whole
+    uint32_t meshletOffset;
+    uint32_t meshletCount;
+};
+
+// Sizes and levels of a mesh ready for the shared buffers. Cooked meshes
+// store it as their metadata; their payload holds the vertices, indices,
+// meshlets, meshlet vertices and meshlet triangles back to back.
+struct MeshInfo {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    uint32_t meshletVertexCount;
+    uint32_t meshletTriangleBytes;
+    uint32_t lodCount;
+    // firstIndex is relative to the mesh's own indices
+    MeshLod lods[MAX_MESH_LODS];
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+};
+
+struct MeshData {
+    MeshInfo info;
+    std::vector<Vertex> vertices;
+    // Every level back to back
+    std::vector<uint32_t> indices;
+    MeshletData meshlets;
+};
+
+// Bytes of one shared geometry buffer until initVulkan uploads it: spans into
+// the asset pack's mapping or into the renderer's own copies, written
+// straight into the upload memory
+struct GeometryStream {
+    std::vector<std::pair<const void*, size_t>> spans;
+    size_t size = 0;
+
+    void append(const void* data, size_t bytes);
+    void copyTo(void* destination) const;
+};
+
+// Generates the LOD chain, and the meshlets of meshes with at least
+// CLUSTER_MIN_TRIANGLES triangles; the asset cooker does this offline
+MeshData buildMeshData(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                    const LodSettings& settings = LodSettings());
+
+// One instanced draw of a mesh LOD, instances are contiguous in the instance buffer
+struct DrawCommand {
+    uint32_t mesh;
+    uint32_t lod;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    // Clustered draws only: first of their ClusterDraws, one per instance
+    uint32_t firstClusterDraw;
+};
+
+// One instance of a clustered mesh, rewritten by the host every frame. It
+// starts with the VkDrawIndexedIndirectCommand the culling pass fills in;
+// the mesh shader path reads the meshlet range and transform only.
+struct ClusterDraw {
+    uint32_t indexCount;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t firstInstance;
+    uint32_t meshletOffset;
+    uint32_t meshletCount;
+    // First of the instance's meshlet visibility flags
+    uint32_t visibilityOffset;
+    glm::mat4 model;
+    // Second VkDrawIndexedIndirectCommand, the meshlets the late occlusion
+    // phase found visible; its indices follow the early ones
+    uint32_t lateIndexCount;
+    uint32_t lateInstanceCount;
+    uint32_t lateFirstIndex;
+    int32_t lateVertexOffset;
+    uint32_t lateFirstInstance;
+    uint32_t padding[3];
+};
+
+// Which meshlets a culling dispatch or task shader handles
+// Everything the frustum and normal cone let through, no occlusion culling
+const uint32_t CLUSTER_PHASE_ALL = 0;
+// Only what was visible last frame
+const uint32_t CLUSTER_PHASE_EARLY = 1;
+// Everything else that is not hidden behind the depth the early phase left
+const uint32_t CLUSTER_PHASE_LATE = 2;
+
+struct ClusterPushConstants {
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;
+    // Mesh shader path: the draw this task dispatch belongs to
+    uint32_t drawIndex;
+    uint32_t drawCount;
+    uint32_t phase;
+};
+
+// Upscale pipeline, fragment stage
+struct UpscalePushConstants {
+    // Rendered part of the scene target over its full size
+    glm::vec2 scale;
+    // Texture coordinates of the centre of the last rendered texel
+    glm::vec2 limit;
+};
+
+// New contents of a static bucket, only sent when something in it changed
+struct StaticBucketUpdate {
+    uint32_t bucket;
+    // Sorted by mesh and LOD, firstInstance indexes instances
+    std::vector<DrawCommand> drawList;
+    std::vector<InstanceData> instances;
+};
+
+// Everything the render thread needs for one frame. The update thread fills
+// it in; once queued it is read only until the render thread hands it back.
+struct RenderSnapshot {
+    uint64_t frameIndex;
+    // Time the update covered in seconds
+    float deltaTime;
+    VkExtent2D framebufferExtent;
+    // The last frame before the update thread idles, drawn at maxRenderScale
+    bool settle;
+    glm::mat4 viewProjection;
+    glm::mat4 view;
+    glm::mat4 projection;
+    float nearPlane;
+    float farPlane;
+    glm::vec3 cameraPosition;
+    // Every PointLight in the scene
+    std::vector<LightData> lights;
+    // The lights casting shadows this frame
+    std::vector<ShadowLight> shadows;
+    // Emitters spawning particles this frame
+    std::vector<ParticleEmitterData> emitters;
+    // The overlay's triangles, drawn over everything else
+    std::vector<OverlayVertex> overlay;
+    std::vector<DrawCommand> drawList;
+    // One per draw, sorted by key; recorded in this order
+    std::vector<DrawPacket> packets;
+    std::vector<InstanceData> instances;
+    // Dynamic shadow casters. Their draws' instances are in shadowCasters,
+    // which indexes the camera's instances. The draws of face
+    // light * SHADOW_FACES + face of shadows run from shadowFaceDraws[i] to
+    // shadowFaceDraws[i + 1]
+    std::vector<DrawCommand> shadowDrawList;
+    std::vector<uint32_t> shadowFaceDraws;
+    std::vector<uint32_t> shadowCasters;
+    std::vector<StaticBucketUpdate> staticUpdates;
+};
+
 #ifdef NDEBUG
     const bool enableVailidationLayers = false;
 #else
@@ -87,12 +330,49 @@ static void DestroyDebugUtilsMessengerExt(VkInstance instance,
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // A compute-only family when there is one, otherwise a second queue of
+    // the graphics family, otherwise the graphics queue itself
+    std::optional<uint32_t> computeFamily;
+    uint32_t computeQueueIndex = 0;
+
+    bool hasDedicatedCompute() {
+        return computeFamily.has_value() && computeFamily != graphicsFamily;
+    }
+    bool hasAsyncCompute() {
+        return hasDedicatedCompute() || computeQueueIndex > 0;
+    }
 
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value();
     }
 };
 
+// Compute work recorded every frame on the compute queue. record must end by
+// releasing whatever graphics consumes; acquire runs at the start of the
+// graphics command buffer of the same frame to take ownership back.
+struct ComputePass {
+    std::function<void(VkCommandBuffer commandBuffer, size_t frame)> record;
+    std::function<void(VkCommandBuffer commandBuffer, size_t frame)> acquire;
+};
+
+// Shading of every draw, each view is a permutation of the fragment shader
+enum class DebugView : uint32_t {
+    None,
+    // Vertex colors without lighting
+    Unlit,
+    // World-space normals as colors
+    Normals
+};
+
+struct FrameTiming {
+    uint64_t frame;
+    // Render thread, from the frame's fence wait returning to its present
+    float cpuMilliseconds;
+    // First to last command of the frame's graphics work, compute passes on
+    // their own queue are not included; negative without timestamp support
+    float gpuMilliseconds;
+};
+
 // Swap Chain
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilites;
@@ -106,12 +386,143 @@ public:
     Renderer();
     void run();
 
+    inline JobSystem& getJobSystem() { return jobs; }
+    inline Scene& getScene() { return scene; }
+    inline TransformHierarchy& getTransforms() { return transforms; }
+    inline ResourceManager& getResources() { return resources; }
+    inline ComputeQueue& getComputeQueue() { return computeQueue; }
+    // Streaming reads for any thread, completions never run on the caller
+    inline AsyncFileReader& getFileReader() { return fileReader; }
+    inline uint32_t getGraphicsFamily() const { return graphicsFamily; }
+    // Owned by the update thread, read when the snapshot is taken
+    inline Camera& getCamera() { return camera; }
+
+    // Registers a mesh and generates its LOD chain; returns the id
+    // MeshInstance components refer to. Add meshes before run().
+    uint32_t addMesh(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices,
+                    const LodSettings& settings = LodSettings());
+    uint32_t addMesh(const MeshData& data);
+    // A cooked mesh from the asset pack, checked here and uploaded straight
+    // from the mapping; throws if it is malformed. Keep the pack open until
+    // run().
+    uint32_t addMesh(const std::string& name);
+    inline const Mesh& getMesh(uint32_t mesh) const { return meshes[mesh]; }
+
+    // Maps a pack written by the asset cooker; its meshes can then be added
+    // by name and its shaders replace the loose .spv files
+    inline void loadAssetPack(const std::string& path) { assets.open(path); }
+    inline const AssetPack& getAssets() const { return assets; }
+
+    // Largest projected LOD error allowed, in pixels
+    inline void setLodErrorThreshold(float pixels) { lodErrorThreshold = pixels; }
+
+    // The bucket is gathered and recorded again next frame; call it from the
+    // update thread after moving static entities
+    void invalidateStaticBucket(uint32_t bucket);
+
+    // Ignored where the device cannot draw lines; the variants compile in the
+    // background and frames stay solid until they are ready
+    inline void setWireframe(bool enabled) {
+        wireframe.store(enabled, std::memory_order_relaxed);
+        requestRedraw();
+    }
+    // Picks the fragment shader permutation, built in the background at startup
+    inline void setDebugView(DebugView view) {
+        debugView.store(view, std::memory_order_relaxed);
+        requestRedraw();
+    }
+    // Meshlets of clustered meshes hidden behind what is already drawn are
+    // skipped; on by default
+    inline void setOcclusionCulling(bool enabled) { occlusionCulling.store(enabled, std::memory_order_relaxed); }
+
+    // Writes the memory stats as JSON to path every interval seconds, from
+    // the render thread; set it before run()
+    inline void setMemoryReport(const std::string& path, float intervalSeconds) {
+        memoryReportPath = path;
+        memoryReportInterval = intervalSeconds;
+    }
+
+    // Copies of the presented frames, start and stop capturing from any
+    // thread; nothing is read back while it is stopped
+    inline FrameCapture& getFrameCapture() { return frameCapture; }
+
+    // Binds and draws of the most recently recorded frame
+    inline DrawStats getDrawStats() const {
+        std::lock_guard<std::mutex> lock(drawStatsMutex);
+        return drawStats;
+    }
+    // The latest frame whose GPU work has completed, a frame or two behind
+    inline FrameTiming getFrameTiming() const {
+        std::lock_guard<std::mutex> lock(frameTimingMutex);
+        return frameTiming;
+    }
+
+    // Lines, rectangles and text drawn over the frame in one draw. Owned by
+    // the update thread, fill it from the update callback; it starts out
+    // empty every frame
+    inline OverlayBatch& getOverlay() { return overlay; }
+    // Frame times, draws and binds in the top left corner, drawn with the overlay
+    inline void setStatsOverlay(bool enabled) {
+        statsOverlay.store(enabled, std::memory_order_relaxed);
+        requestRedraw();
+    }
+
+    // Renders the scene at a fraction of the window's resolution, picked from
+    // the measured GPU time to stay just under milliseconds, and upscales it;
+    // the overlay stays at full resolution. 0 turns it off, the default, and
+    // it does nothing without timestamp support.
+    inline void setTargetFrameTime(float milliseconds) {
+        targetFrameTime.store(milliseconds, std::memory_order_relaxed);
+    }
+    // Bounds of the scale per axis, at most 1; set them before run()
+    inline void setRenderScaleRange(float minimum, float maximum) {
+        minRenderScale = minimum;
+        maxRenderScale = std::min(maximum, 1.0f);
+    }
+    // Of the frames being recorded now, per axis
+    inline float getRenderScale() const { return renderScale.load(std::memory_order_relaxed); }
+
+    // Passes run on the render thread in registration order; add them before run()
+    inline void addComputePass(ComputePass pass) { computePasses.push_back(std::move(pass)); }
+
+    // Called on the update thread once per frame before the snapshot is
+    // taken, with the time since the previous update in seconds
+    inline void setUpdateCallback(std::function<void(float)> callback) { updateCallback = std::move(callback); }
+    // The update callback gets this instead of the measured time, so runs
+    // can be reproduced; 0 uses the clock
+    inline void setFixedTimestep(float seconds) { fixedTimestep = seconds; }
+    // run() returns after this many frames, 0 runs until the window is closed
+    inline void setFrameLimit(uint64_t frames) { frameLimit = frames; }
+
+    // Draws frames only when something asks for one instead of continuously,
+    // the main thread sleeps in between: after requestRedraw(), when the
+    // window is resized or uncovered, while the camera moves, after a static
+    // bucket is invalidated, while particles are alive and while pipeline
+    // variants compile. With a target frame time, one more frame is drawn at
+    // the largest render scale before it sleeps. The update
+    // callback only runs for frames that are drawn and its time step leaves
+    // out the time spent idle, so call requestRedraw() from it for as long as
+    // anything else animates.
+    inline void setOnDemandRendering(bool enabled) {
+        onDemandRendering.store(enabled, std::memory_order_relaxed);
+        requestRedraw();
+    }
+    // Any thread; the next frame is drawn even when rendering on demand, and
+    // a main thread sleeping for one is woken up
+    void requestRedraw();
+    // Called on the render thread once a frame's GPU work has completed,
+    // a frame or two after it was submitted; set it before run()
+    inline void setFrameTimingCallback(std::function<void(const FrameTiming&)> callback) {
+        frameTimingCallback = std::move(callback);
+    }
+
     ~Renderer();
 
 private:
     void initVulkan();
     void mainLoop();
-    void drawFrame();
+    void renderLoop();
+    void drawFrame(const RenderSnapshot& snapshot);
     void cleanup();
 
 // Vulkan Device Physical
@@ -124,17 +535,43 @@ private:
     const std::vector<const char*> deviceExtensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
+    // Enabled when present, features depending on them check isDeviceExtensionEnabled
+    const std::vector<const char*> optionalDeviceExtensions = {
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+#ifdef VK_EXT_mesh_shader
+        // Mesh shaders need SPIR-V 1.4, which needs float controls on 1.1
+        VK_EXT_MESH_SHADER_EXTENSION_NAME,
+        VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+        VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME
+#endif
+    };
+    std::vector<const char*> enabledDeviceExtensions;
+
+    bool isDeviceExtensionSupported(const VkPhysicalDevice& device, const char* extension);
+    bool isDeviceExtensionEnabled(const char* extension) const;
 
 // Vulkan Device 
     void createLogicalDevice();
 
     VkDevice device;
+    bool multiDrawIndirect;
+    // Task and mesh shaders are supported and enabled
+    bool meshShaders;
+    // Polygon modes other than fill
+    bool fillModeNonSolid;
 
 // Queue Families
     QueueFamilyIndices findQueueFamilies(const VkPhysicalDevice& device);
 
     VkQueue graphicsQueue;
     VkQueue presentQueue;
+    uint32_t graphicsFamily;
+
+// Async compute
+    VkSemaphore submitComputePasses();
+
+    ComputeQueue computeQueue;
+    std::vector<ComputePass> computePasses;
 
 // Vulkan instace 
     void createInstance();
@@ -160,60 +597,395 @@ private:
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     std::vector<VkImage> swapChainImages;
+    // Created with transfer source usage, so frames can be captured
+    bool swapChainReadable;
     std::vector<VkImageView> swapChainImageViews;
+    // Latest framebuffer size seen by the update thread, GLFW may only be
+    // queried from the main thread
+    VkExtent2D framebufferExtent;
 
 // Graphics Pipeline
+    // Layouts are shared by every variant and live as long as the device
+    void createPipelineLayouts();
+    // features are the fragment shader's ShaderFeature bits
+    PipelineDesc getPipelineDesc(DrawPipeline pipeline, bool wireframe, uint32_t features) const;
+    static uint32_t getShaderFeatures(DebugView view);
     void createGraphicsPipeline();
     static std::vector<char> readFile(const std::string& filename);
     VkShaderModule createShaderModule(const std::vector<char>& code);
+    VkShaderModule createShaderModule(const void* code, size_t size);
+    // From the asset pack when it has the shader, otherwise from the shader directory
+    VkShaderModule loadShader(const std::string& name);
 
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    PipelineCache pipelineCache;
+    VkPipelineLayout meshPipelineLayout;
+    // Task/mesh pipelines, VK_NULL_HANDLE without mesh shaders
+    VkPipelineLayout clusterPipelineLayout;
+    // Default solid pipeline, the fallback for variants of the vertex pipeline
+    PipelineHandle graphicsPipeline;
+    std::atomic<bool> wireframe;
+    std::atomic<DebugView> debugView;
+
+// Depth buffer
+    void createDepthResources();
+    VkFormat findDepthFormat();
+    VkImageAspectFlags getDepthAspect() const;
+
+    ImageHandle depthImage;
+    VkFormat depthFormat;
 
 // Render Pass
     void createRenderPass();
 
     VkRenderPass renderPass;
+    // With clustered meshes the frame ends in a second, compatible pass that
+    // loads what the first one left and draws what occlusion culling found
+    // visible late; VK_NULL_HANDLE otherwise
+    VkRenderPass lateRenderPass;
 
 // Framebuffers
 void createFrameBuffers();
 
+// Scene target and depth, used by both the render pass and the late one
+VkFramebuffer sceneFramebuffer;
+// Present pass, one per swapchain image
 std::vector<VkFramebuffer> swapChainFrameBuffers;
 
+// Dynamic resolution
+// The scene is drawn into the top left renderExtent of a target the size of
+// the swapchain, so changing the scale allocates nothing. The present pass
+// stretches that corner over the swapchain image and draws the overlay on
+// top of it at full resolution. The scale follows the GPU time of completed
+// frames in steps, and cached command buffers are recorded again only when
+// it actually changes.
+void createPresentRenderPass();
+void createUpscaleResources();
+void createSceneTarget();
+// renderExtent from the swapchain size and the current scale
+void updateRenderExtent();
+void updateRenderScale(const FrameTiming& timing);
+// From the next frame recorded on, starts measuring afresh
+void setRenderScale(float scale);
+PipelineDesc getUpscalePipelineDesc() const;
+void recordPresentPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, DrawStats& stats);
+
+ImageHandle sceneImage;
+SamplerHandle sceneSampler;
+VkRenderPass presentRenderPass;
+VkDescriptorSetLayout upscaleSetLayout;
+VkDescriptorPool upscaleDescriptorPool;
+// Rewritten whenever the scene target is created again
+VkDescriptorSet upscaleDescriptorSet;
+VkPipelineLayout upscalePipelineLayout;
+PipelineHandle upscalePipeline;
+// Part of the scene target and depth buffer the frame renders to
+VkExtent2D renderExtent;
+std::atomic<float> renderScale;
+std::atomic<float> targetFrameTime;
+float minRenderScale;
+float maxRenderScale;
+// Render thread, GPU time of the frames measured towards the next decision
+float renderScaleTime;
+uint32_t renderScaleSamples;
+// Frames before it were recorded at another scale and are not measured
+uint64_t renderScaleFrame;
+
 // Command Buffers
 void createCommandPool();
 void createCommandBuffers();
+void recordCommandBuffer(uint32_t imageIndex, const RenderSnapshot& snapshot);
+// Begins a secondary command buffer inside the render pass and sets the
+// viewport; framebuffer may be VK_NULL_HANDLE for buffers reused across images
+void beginSecondaryCommandBuffer(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer,
+                                VkCommandBufferUsageFlags flags);
+// Everything but the static buckets, recorded every frame
+VkCommandBuffer recordDynamicDraws(uint32_t imageIndex, const RenderSnapshot& snapshot, const Pipeline* pipeline,
+                                const Pipeline* meshShaderPipeline, DrawStats& stats);
 
 VkCommandPool commandPool;
 std::vector<VkCommandBuffer> commandBuffers;
+// Secondary per swapchain image holding the dynamic draws
+std::vector<VkCommandBuffer> dynamicCommandBuffers;
+// Bumped whenever the render pass or the swapchain size changes
+uint64_t renderTargetGeneration;
 
 // Vertex Buffers
-void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                VkDeviceMemory& bufferMemory);
 void createVertexBuffer();
 void createIndexBuffer();
+// Device-local buffer holding data, written directly when the memory allows it
+BufferHandle createStaticBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+                            BufferSharing sharing = BufferSharing::Exclusive);
+// Same, with fill writing the contents into the mapped upload memory
+BufferHandle createStaticBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                            const std::function<void(void*)>& fill,
+                            BufferSharing sharing = BufferSharing::Exclusive);
 
 void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
-const std::vector<Vertex> vertices = {
-    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-    {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-    {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-    {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}
+// Checks the payload, laid out as a cooked mesh's, against info and adds
+// it to the shared geometry. The payload has to stay valid until the upload,
+// storage is kept alive for that when it holds the payload.
+uint32_t appendMesh(const MeshInfo& info, const uint8_t* payload, std::vector<uint8_t> storage);
+// Drops the geometry streams once they are on the GPU
+void releaseMeshData();
+
+AssetPack assets;
+
+// Every mesh and every LOD of it, uploaded once in initVulkan
+GeometryStream vertices;
+GeometryStream indices;
+// Payloads the streams point into that are not in the asset pack's mapping
+std::vector<std::vector<uint8_t>> meshStorage;
+std::vector<Mesh> meshes;
+
+BufferHandle vertexBuffer;
+BufferHandle indexBuffer;
+
+// Camera
+// The view-projection matrix lives in a uniform buffer per frame in flight
+// rather than in push constants, which secondary command buffers do not
+// inherit; cached buffers keep reading the current camera
+void createCameraResources();
+
+VkDescriptorSetLayout cameraSetLayout;
+VkDescriptorPool cameraDescriptorPool;
+std::vector<VkDescriptorSet> cameraDescriptorSets;
+std::vector<BufferHandle> cameraBuffers;
+
+// Lighting
+// Clustered point lights, the lighting set is bound at set 1 and the shadow
+// set at set 2, next to the camera or the cluster set
+void createLightResources();
+void extractLights(RenderSnapshot& snapshot);
+// Culls the dynamic instances against every shadow face once the camera's
+// draws are gathered, and appends the instances of each face's draws
+void extractShadowCasters(RenderSnapshot& snapshot);
+// set followed by the frame's lighting and shadow sets
+std::array<VkDescriptorSet, 3> getDrawDescriptorSets(VkDescriptorSet set) const;
+// The static casters' pipeline, or with dynamicCasters the one drawing
+// the snapshot's shadowCasters
+PipelineDesc getShadowPipelineDesc(bool dynamicCasters) const;
+// Every static bucket, or the dynamic casters of face, into the bound shadow face
+void recordShadowCasters(VkCommandBuffer commandBuffer, const RenderSnapshot& snapshot, bool staticCasters,
+                        uint32_t face, DrawStats& stats);
+
+LightGrid lightGrid;
+ShadowAtlas shadowAtlas;
+// Live with the render pass like the other pipelines
+PipelineHandle shadowPipeline;
+PipelineHandle shadowCasterPipeline;
+std::vector<ChunkView> lightChunks;
+// Update thread, parallel to the snapshot's lights
+std::vector<Entity> lightEntities;
+// Update thread, the faces of every shadowed light each camera instance
+// reaches into, light * instances + instance
+std::vector<uint8_t> casterFaces;
+// Update thread, one light's dynamic casters and their draws per face
+struct ShadowCasterBin {
+    std::array<std::vector<uint32_t>, SHADOW_FACES> casters;
+    std::array<std::vector<DrawCommand>, SHADOW_FACES> draws;
 };
+std::vector<ShadowCasterBin> shadowCasterBins;
+
+// Particles
+// Simulated on the compute queue, drawn after everything opaque
+void createParticleResources();
+void extractParticles(RenderSnapshot& snapshot);
+PipelineDesc getParticlePipelineDesc() const;
+void recordParticles(BindState& state);
+
+ParticleSystem particleSystem;
+PipelineHandle particlePipeline;
+std::vector<ChunkView> emitterChunks;
+// Update thread, seconds of emission so far
+double particleTime;
+
+// Overlay
+// 2D debug displays of the update thread, drawn last in a single draw
+void createOverlayResources();
+// Adds the stats display when it is enabled and hands the frame's
+// triangles to the snapshot
+void extractOverlay(RenderSnapshot& snapshot);
+PipelineDesc getOverlayPipelineDesc() const;
+void recordOverlay(BindState& state);
+
+OverlayBatch overlay;
+OverlayRenderer overlayRenderer;
+PipelineHandle overlayPipeline;
+std::atomic<bool> statsOverlay;
+// Update thread, the last frames' update times for the stats display's graph
+std::array<float, 120> frameTimeHistory;
+size_t frameTimeCursor;
+
+// Scene
+void createInstanceBuffers();
+void reserveInstanceBuffer(size_t frame, size_t instanceCount);
+void uploadInstances(const RenderSnapshot& snapshot);
+void extractSnapshot(RenderSnapshot& snapshot);
+// Coarsest level whose error projects to at most lodErrorThreshold pixels
+uint32_t selectLod(const Mesh& mesh, const glm::mat4& model, float pixelsPerUnit) const;
 
-const std::vector<uint16_t> indices = {
-    0, 1, 2, 2, 3, 0
+JobSystem jobs;
+AsyncFileReader fileReader;
+Scene scene;
+TransformHierarchy transforms;
+std::vector<ChunkView> drawChunks;
+// Instances of one chunk sharing a (mesh, LOD) pair
+struct DrawRun {
+    uint32_t slot;
+    uint32_t count;
+    // View depth of the nearest instance
+    float depth;
+    // Where the next instance goes in the snapshot's instances
+    uint32_t offset;
 };
+// Per chunk, first of its instances in instanceDrawRuns and of its runs in
+// chunkDrawRuns
+std::vector<uint32_t> chunkInstanceOffsets;
+std::vector<uint32_t> chunkDrawRunCounts;
+std::vector<DrawRun> chunkDrawRuns;
+// Per instance, its run within its chunk, UINT32_MAX for none, so the gather
+// pass does not select LODs again
+std::vector<uint32_t> instanceDrawRuns;
+// Every used run keyed by its pair, draw holds the run
+std::vector<DrawPacket> drawRunOrder;
+std::vector<DrawPacket> packetScratch;
 
-VkBuffer vertexBuffer;
-VkDeviceMemory vertexBufferMemory;
-VkBuffer indexBuffer;
-VkDeviceMemory indexBufferMemory;
+mutable std::mutex drawStatsMutex;
+DrawStats drawStats;
 
-// Memory requirements
-uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+Camera camera;
+float lodErrorThreshold;
+
+std::vector<BufferHandle> instanceBuffers;
+std::vector<size_t> instanceBufferCapacity;
+
+// Cluster culling
+// Meshlets of every clustered mesh, uploaded once next to the vertex buffer.
+// Without mesh shaders a compute pass culls them into a compacted index
+// buffer per frame that is drawn indirectly; with them the task shader culls
+// and the mesh shader draws straight from the meshlet data.
+void createClusterLayout();
+void createClusterResources();
+void prepareClusterDraws(const RenderSnapshot& snapshot);
+void recordClusterCulling(VkCommandBuffer commandBuffer, size_t frame);
+void dispatchClusterCulling(VkCommandBuffer commandBuffer, size_t frame, uint32_t phase);
+void acquireClusterDraws(VkCommandBuffer commandBuffer, size_t frame);
+// meshShaderPipeline is the task/mesh variant to draw with, unused without
+// mesh shaders; late draws what the late occlusion phase added
+void recordClusterDraw(BindState& state, const DrawCommand& draw, const Pipeline* meshShaderPipeline,
+                    bool late = false);
+bool isClustered(const DrawCommand& draw) const;
+bool isClustered(uint32_t mesh, uint32_t lod) const;
+
+std::vector<Meshlet> meshlets;
+GeometryStream meshletVertices;
+GeometryStream meshletTriangles;
+
+BufferHandle meshletBuffer;
+BufferHandle meshletVertexBuffer;
+BufferHandle meshletTriangleBuffer;
+
+VkDescriptorSetLayout clusterSetLayout;
+VkDescriptorPool clusterDescriptorPool;
+std::vector<VkDescriptorSet> clusterDescriptorSets;
+// Compute culling pipeline, or the task/mesh pipeline which lives with the swapchain
+PipelineHandle clusterPipeline;
+
+// Per frame in flight
+std::vector<BufferHandle> clusterDrawBuffers;
+std::vector<size_t> clusterDrawCapacity;
+// Compacted indices written by the culling pass
+std::vector<BufferHandle> clusterIndexBuffers;
+std::vector<size_t> clusterIndexCapacity;
+std::vector<ClusterPushConstants> clusterConstants;
+std::vector<uint32_t> clusterMaxMeshlets;
+
+// Occlusion culling
+// Clustered meshes are drawn in two phases. The early phase draws the
+// meshlets that were visible last frame; the depth buffer it leaves is
+// reduced into a depth pyramid, the late phase tests every other meshlet
+// against it and draws the ones that turned visible in the late render pass.
+// Without mesh shaders the early phase is the compute culling pass and the
+// late one a dispatch on the graphics queue; with them the task shader runs
+// once per phase.
+void recordLatePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, const RenderSnapshot& snapshot,
+                const Pipeline* pipeline, const Pipeline* meshShaderPipeline, DrawStats& stats);
+// Stages testing against the depth pyramid and writing the visibility flags
+VkPipelineStageFlags getOcclusionStages() const;
+
+DepthPyramid depthPyramid;
+// Shared by the frames in flight, one flag per meshlet of every clustered
+// instance. Flags from another frame, or of another instance after the draw
+// list changed, only cost extra early draws or late tests.
+BufferHandle clusterVisibilityBuffer;
+size_t clusterVisibilityCapacity;
+// Per frame in flight, which meshlets the compute culling pass drew early
+std::vector<BufferHandle> clusterEarlyBuffers;
+std::vector<size_t> clusterEarlyCapacity;
+std::atomic<bool> occlusionCulling;
+
+#ifdef VK_EXT_mesh_shader
+PFN_vkCmdDrawMeshTasksEXT cmdDrawMeshTasks;
+#endif
+
+// Static geometry
+// The update thread gathers static entities per bucket and only hands a
+// bucket over when its entities or their LODs changed. The render thread
+// keeps each bucket's instances in a buffer of their own and replays one
+// secondary command buffer per frame in flight, recorded again only when the
+// bucket, the pipeline or the render targets change. Clustered draws are
+// culled every frame and stay with the dynamic draws.
+struct StaticInstance {
+    Entity entity;
+    uint32_t slot;
+    const glm::mat4* model;
+};
+
+// Update thread
+struct StaticBucketState {
+    // As of the last update sent
+    std::vector<Entity> entities;
+    std::vector<uint32_t> slots;
+    std::vector<StaticInstance> frameInstances;
+    bool dirty = false;
+};
+
+struct StaticCommandBuffer {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    // What it was recorded against, 0 for never
+    uint64_t version = 0;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    uint64_t renderTargets = 0;
+    uint32_t drawCalls = 0;
+};
+
+// Render thread
+struct StaticBucket {
+    uint64_t version = 0;
+    BufferHandle instanceBuffer;
+    std::vector<DrawCommand> drawList;
+    std::array<StaticCommandBuffer, MAX_FRAMES_IN_FLIGHT> commandBuffers;
+};
+
+void extractStaticBuckets(RenderSnapshot& snapshot, float pixelsPerUnit);
+void updateStaticBuckets(const RenderSnapshot& snapshot);
+VkCommandBuffer getStaticCommandBuffer(StaticBucket& bucket, const Pipeline* pipeline, DrawStats& stats);
+
+std::vector<StaticBucketState> staticBucketStates;
+std::vector<StaticBucket> staticBuckets;
+// Per draw chunk, first of its instances in staticSlots or UINT32_MAX
+std::vector<uint32_t> chunkStaticOffsets;
+std::vector<uint32_t> staticSlots;
+
+// Resources
+// Runtime resources live behind generational handles and are destroyed once
+// the frames that could still use them have completed
+ResourceManager resources;
+
+// Frame capture
+// Declared after the resource manager, its buffers are released first
+FrameCapture frameCapture;
 
 // Synchronization
 void createSyncObjects();
@@ -222,13 +994,71 @@ std::vector<VkSemaphore> imageAvailableSemaphores;
 std::vector<VkSemaphore> renderFinishedSemaphores;
 std::vector<VkFence> inFlightFences;
 std::vector<VkFence> imagesInFlight;
+// Frame number last submitted with each in-flight slot
+std::vector<uint64_t> submittedFrames;
 size_t currentFrame;
 
+// Frame timing
+// Two timestamps per frame in flight around its graphics work, read once the
+// frame's fence has been waited on anyway so reading them never stalls
+void createTimestampQueries();
+void reportFrameTiming();
+
+// VK_NULL_HANDLE where the graphics queue has no timestamps
+VkQueryPool timestampPool;
+// Nanoseconds per tick
+float timestampPeriod;
+uint64_t timestampMask;
+// Per frame in flight: the frame still to be reported, 0 for none
+std::vector<uint64_t> timedFrames;
+std::vector<float> frameCpuMilliseconds;
+// Latest reported, read by the update thread
+mutable std::mutex frameTimingMutex;
+FrameTiming frameTiming;
+std::function<void(const FrameTiming&)> frameTimingCallback;
+
 public:
 inline void setFrameBufferResized(bool var) {frameBufferResized = var;}
 private:
 
-bool frameBufferResized;
+std::atomic<bool> frameBufferResized;
+
+// Update / render threads
+// The main thread polls events, simulates and fills snapshots; the render
+// thread records and submits them. Snapshots cycle through the two queues so
+// the update thread never runs more than one frame ahead.
+std::array<RenderSnapshot, SNAPSHOT_COUNT> snapshots;
+SpscQueue<RenderSnapshot*, SNAPSHOT_COUNT> readySnapshots;
+SpscQueue<RenderSnapshot*, SNAPSHOT_COUNT> freeSnapshots;
+std::thread renderThread;
+std::exception_ptr renderError;
+std::function<void(float)> updateCallback;
+uint64_t frameIndex;
+uint64_t frameLimit;
+float fixedTimestep;
+
+std::string memoryReportPath;
+float memoryReportInterval;
+
+// On-demand rendering
+// Update thread; the camera moved or a static bucket was invalidated since
+// the last snapshot, e.g. by a GLFW callback while idle
+bool hasPendingChanges() const;
+// Sleeps in glfwWaitEventsTimeout unless a redraw was requested meanwhile
+void waitForRedraw();
+
+std::atomic<bool> onDemandRendering;
+std::atomic<bool> redrawRequested;
+// While the main thread may be sleeping; requests only post an empty event
+// to wake it then. Set before redrawRequested is checked and checked after
+// it is set, so a request can never slip in unnoticed.
+std::atomic<bool> waitingForEvents;
+// Update thread, the camera of the previous snapshot and when the particles
+// emitted so far have all died, in particleTime
+Camera snapshotCamera;
+double particleSettleTime;
+// The frame drawn last was the settle frame, nothing changed since
+bool idleSettled;
 
 // Validation layers
     bool checkValidationLayerSupport();
@@ -263,6 +1093,13 @@ bool frameBufferResized;
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
     auto app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
     app->setFrameBufferResized(true);
+    app->requestRedraw();
+}
+
+// The window was uncovered or needs its contents again
+static void windowRefreshCallback(GLFWwindow* window) {
+    auto app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+    app->requestRedraw();
 }
 
 
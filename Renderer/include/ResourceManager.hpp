@@ -0,0 +1,350 @@
+#ifndef RESOURCE_MANAGER_CLASS
+#define RESOURCE_MANAGER_CLASS
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <utility>
+#include <functional>
+#include <array>
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+// Memory accounting
+enum class MemoryCategory {
+    Geometry,
+    Staging,
+    Textures,
+    RenderTargets,
+    Uniforms,
+    Other
+};
+
+const size_t MEMORY_CATEGORY_COUNT = 6;
+
+const char* memoryCategoryName(MemoryCategory category);
+
+struct MemoryCategoryStats {
+    // What the driver asked for, including alignment padding
+    VkDeviceSize allocatedBytes;
+    // What the resources actually need; the difference is wasted space
+    VkDeviceSize requestedBytes;
+    VkDeviceSize peakBytes;
+    uint32_t allocationCount;
+};
+
+struct MemoryHeapStats {
+    VkDeviceSize size;
+    bool deviceLocal;
+    VkDeviceSize allocatedBytes;
+    uint32_t allocationCount;
+    // VK_EXT_memory_budget readings for the whole process, zero without it
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+};
+
+struct MemoryStats {
+    std::array<MemoryCategoryStats, MEMORY_CATEGORY_COUNT> categories;
+    std::vector<MemoryHeapStats> heaps;
+    bool budgetAvailable;
+    uint32_t allocationCount;
+    uint32_t maxAllocationCount;
+    // Lifetime counters, allocations minus frees is the live count
+    uint64_t totalAllocations;
+    uint64_t totalFrees;
+};
+
+std::string memoryStatsToJson(const MemoryStats& stats);
+
+// Resources
+struct Allocation {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memoryType;
+    MemoryCategory category;
+};
+
+struct Buffer {
+    VkBuffer buffer;
+    VkDeviceSize size;
+    // Persistent mapping, nullptr unless the buffer was created mapped
+    void* mapped;
+    Allocation allocation;
+};
+
+struct Image {
+    VkImage image;
+    VkImageView view;
+    VkFormat format;
+    VkExtent3D extent;
+    Allocation allocation;
+};
+
+struct Pipeline {
+    VkPipeline pipeline;
+    // Owned by the pipeline, VK_NULL_HANDLE when shared with another one
+    VkPipelineLayout layout;
+};
+
+struct Sampler {
+    VkSampler sampler;
+};
+
+// How the CPU and GPU access a resource, drives memory type selection
+enum class MemoryUsage {
+    // Only the GPU touches it after an initial transfer
+    GpuOnly,
+    // Written once by the CPU, then read by the GPU
+    Upload,
+    // Rewritten by the CPU every frame
+    Dynamic,
+    // Written by the GPU and read back by the CPU
+    Readback
+};
+
+// Exclusive buffers belong to one queue family at a time and need ownership
+// transfers to move; concurrent ones may be used by all the manager's queue
+// families at once, which suits data the host rewrites every frame
+enum class BufferSharing {
+    Exclusive,
+    Concurrent
+};
+
+// What the device's heaps look like to the CPU
+struct MemoryArchitecture {
+    // Integrated GPUs and software drivers: device-local memory is system memory
+    bool unified;
+    // Discrete GPU that maps all of VRAM (resizable BAR / SAM)
+    bool resizableBar;
+    // Size of the largest heap reachable through a host-visible device-local type
+    VkDeviceSize hostVisibleDeviceLocalSize;
+};
+
+// Handles are a slot index plus the generation of the slot when the
+// resource was created; once the slot is recycled old handles stop resolving.
+template<typename T>
+struct ResourceHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    inline bool isValid() const { return index != UINT32_MAX; }
+
+    bool operator==(const ResourceHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const ResourceHandle& other) const {
+        return !(*this == other);
+    }
+};
+
+typedef ResourceHandle<Buffer> BufferHandle;
+typedef ResourceHandle<Image> ImageHandle;
+typedef ResourceHandle<Pipeline> PipelineHandle;
+typedef ResourceHandle<Sampler> SamplerHandle;
+
+template<typename T>
+class ResourcePool {
+public:
+    ResourceHandle<T> allocate(const T& resource) {
+        uint32_t index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.push_back({resource, 1, false});
+        }
+
+        Slot& slot = slots[index];
+        slot.resource = resource;
+        slot.alive = true;
+        aliveCount++;
+        return {index, slot.generation};
+    }
+
+    // nullptr for stale or invalid handles; slots never move, so the pointer
+    // stays valid until the handle is released
+    T* get(ResourceHandle<T> handle) {
+        if (handle.index >= slots.size()) {
+            return nullptr;
+        }
+        Slot& slot = slots[handle.index];
+        return slot.alive && slot.generation == handle.generation ? &slot.resource : nullptr;
+    }
+
+    // Invalidates every handle to the slot and returns the resource it held
+    bool release(ResourceHandle<T> handle, T& resource) {
+        T* current = get(handle);
+        if (!current) {
+            return false;
+        }
+        resource = *current;
+
+        Slot& slot = slots[handle.index];
+        slot.alive = false;
+        slot.generation++;
+        freeSlots.push_back(handle.index);
+        aliveCount--;
+        return true;
+    }
+
+    template<typename Func>
+    void forEachAlive(Func&& fn) {
+        for (Slot& slot : slots) {
+            if (slot.alive) {
+                fn(slot.resource);
+            }
+        }
+    }
+
+    void clear() {
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            if (slots[i].alive) {
+                slots[i].alive = false;
+                slots[i].generation++;
+                freeSlots.push_back(i);
+            }
+        }
+        aliveCount = 0;
+    }
+
+    inline size_t size() const { return aliveCount; }
+
+private:
+    struct Slot {
+        T resource;
+        uint32_t generation;
+        bool alive;
+    };
+
+    std::deque<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    size_t aliveCount = 0;
+};
+
+// Owns runtime-created Vulkan objects behind generational handles. destroy()
+// only retires a resource: it is released for real once every frame that
+// could still reference it has completed on the GPU, so nothing has to wait
+// for the device to go idle. All methods may be called from any thread.
+class ResourceManager {
+public:
+    ResourceManager();
+
+    ResourceManager(const ResourceManager&) = delete;
+    ResourceManager& operator=(const ResourceManager&) = delete;
+
+    // memoryBudget: VK_EXT_memory_budget was enabled on the device
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget = false);
+    // Destroys everything, retired or not; the device must be idle
+    void shutdown();
+    // Families concurrent buffers are shared between, duplicates are ignored
+    void setQueueFamilies(const std::vector<uint32_t>& families);
+
+    // Creation
+    BufferHandle createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                            MemoryCategory category, bool mapped = false);
+    // Picks the memory type from the intent; every usage but GpuOnly is
+    // host-coherent and persistently mapped
+    BufferHandle createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage,
+                            MemoryCategory category, BufferSharing sharing = BufferSharing::Exclusive);
+    ImageHandle createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+                            VkImageAspectFlags aspect, MemoryCategory category);
+    SamplerHandle createSampler(const VkSamplerCreateInfo& samplerInfo);
+    // Takes ownership of an already created pipeline and its layout
+    PipelineHandle addPipeline(VkPipeline pipeline, VkPipelineLayout layout);
+
+    // Lookup, nullptr once the handle has been destroyed
+    Buffer* get(BufferHandle handle);
+    Image* get(ImageHandle handle);
+    Pipeline* get(PipelineHandle handle);
+    Sampler* get(SamplerHandle handle);
+
+    // Deferred destruction, stale handles are ignored
+    void destroy(BufferHandle handle);
+    void destroy(ImageHandle handle);
+    void destroy(PipelineHandle handle);
+    void destroy(SamplerHandle handle);
+
+    // Frames are numbered by the caller in submission order. Resources
+    // destroyed after beginFrame(n) may still be used by frame n and are
+    // released by the first collect(completedFrame >= n).
+    void beginFrame(uint64_t frame);
+    void collect(uint64_t completedFrame);
+
+    // Memory types
+    // Best type with all the required flags, preferring the largest heap
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    uint32_t findMemoryType(uint32_t typeFilter, MemoryUsage usage, VkDeviceSize size) const;
+
+    inline const MemoryArchitecture& getMemoryArchitecture() const { return architecture; }
+    // Whether upload-once data of this size should be written straight into
+    // device-local memory instead of going through a staging copy
+    bool prefersDirectUpload(VkDeviceSize size) const;
+
+    size_t pendingDestroyCount();
+
+    // Telemetry
+    // Snapshot of the accounting plus fresh budget readings
+    MemoryStats getMemoryStats();
+    // Replaces the file atomically so readers never see a partial dump; a
+    // file that cannot be written is logged and skipped, it never throws
+    void writeMemoryReport(const std::string& path);
+
+private:
+    template<typename T>
+    struct Retired {
+        uint64_t frame;
+        T resource;
+    };
+
+    template<typename T>
+    void retire(ResourcePool<T>& pool, std::deque<Retired<T>>& queue, ResourceHandle<T> handle);
+    template<typename T>
+    void release(std::deque<Retired<T>>& queue, uint64_t completedFrame);
+
+    Allocation allocateMemory(VkDeviceSize size, VkDeviceSize requestedSize, uint32_t memoryType,
+                            MemoryCategory category);
+    void freeMemory(const Allocation& allocation, VkDeviceSize requestedSize);
+    BufferHandle createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool mapped, MemoryCategory category,
+                            BufferSharing sharing, const std::function<uint32_t(uint32_t)>& chooseMemoryType);
+    uint32_t selectMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                            VkMemoryPropertyFlags preferred, VkMemoryPropertyFlags avoided) const;
+
+    void release(const Buffer& buffer);
+    void release(const Image& image);
+    void release(const Pipeline& pipeline);
+    void release(const Sampler& sampler);
+
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    MemoryArchitecture architecture;
+    bool memoryBudget;
+    uint32_t maxAllocationCount;
+    std::vector<uint32_t> queueFamilies;
+
+    // Also orders beginFrame against destroy, so a resource retired while
+    // a frame is recorded is always tagged with that frame or a later one
+    std::mutex mutex;
+    uint64_t currentFrame;
+
+    ResourcePool<Buffer> buffers;
+    ResourcePool<Image> images;
+    ResourcePool<Pipeline> pipelines;
+    ResourcePool<Sampler> samplers;
+
+    std::deque<Retired<Buffer>> retiredBuffers;
+    std::deque<Retired<Image>> retiredImages;
+    std::deque<Retired<Pipeline>> retiredPipelines;
+    std::deque<Retired<Sampler>> retiredSamplers;
+
+    // Guarded by mutex like the pools
+    std::array<MemoryCategoryStats, MEMORY_CATEGORY_COUNT> categoryStats;
+    std::vector<MemoryHeapStats> heapStats;
+    uint64_t totalAllocations;
+    uint64_t totalFrees;
+};
+
+#endif //RESOURCE_MANAGER_CLASS
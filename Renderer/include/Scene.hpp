@@ -0,0 +1,288 @@
+#ifndef SCENE_CLASS
+#define SCENE_CLASS
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <array>
+#include <unordered_map>
+#include <type_traits>
+#include <stdexcept>
+#include <new>
+
+#include "JobSystem.hpp"
+
+const uint32_t MAX_COMPONENT_TYPES = 64;
+const size_t CHUNK_SIZE = 16 * 1024;
+
+typedef uint64_t ComponentMask;
+
+// Entities are an index into the scene's record table plus a generation that
+// is bumped whenever the index is recycled, so stale handles are detectable.
+struct Entity {
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator==(const Entity& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const Entity& other) const {
+        return !(*this == other);
+    }
+};
+
+const Entity NULL_ENTITY = {UINT32_MAX, 0};
+
+// Component types
+struct ComponentInfo {
+    size_t size;
+    size_t alignment;
+};
+
+class ComponentRegistry {
+public:
+    // Components live in raw chunk memory and are moved with memcpy, so only
+    // plain data is allowed.
+    template<typename T>
+    static uint32_t id() {
+        static_assert(std::is_trivially_copyable<T>::value, "Components must be trivially copyable");
+        static const uint32_t typeId = registerType(sizeof(T), alignof(T));
+        return typeId;
+    }
+
+    static const ComponentInfo& info(uint32_t componentId);
+
+private:
+    static uint32_t registerType(size_t size, size_t alignment);
+};
+
+template<typename... Ts>
+inline ComponentMask componentMask() {
+    return (ComponentMask(0) | ... | (ComponentMask(1) << ComponentRegistry::id<Ts>()));
+}
+
+// Archetype chunks
+struct Chunk {
+    alignas(64) uint8_t data[CHUNK_SIZE];
+    uint32_t count = 0;
+};
+
+// All entities with exactly the same component signature. Each chunk stores
+// one tightly packed array per component (SoA) followed by the owning entity
+// ids, and every chunk except the last one is always full.
+class Archetype {
+public:
+    explicit Archetype(ComponentMask mask);
+
+    ComponentMask mask;
+    std::vector<uint32_t> componentIds;
+    uint32_t capacity;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+
+    inline bool has(uint32_t componentId) const { return columnOffsets[componentId] != UINT32_MAX; }
+
+    inline void* column(Chunk& chunk, uint32_t componentId) const {
+        return chunk.data + columnOffsets[componentId];
+    }
+    template<typename T>
+    inline T* column(Chunk& chunk) const {
+        return reinterpret_cast<T*>(column(chunk, ComponentRegistry::id<T>()));
+    }
+    inline Entity* entities(Chunk& chunk) const {
+        return reinterpret_cast<Entity*>(chunk.data + entityOffset);
+    }
+
+    // Appends a row for entity and returns its chunk and row index
+    void allocateRow(Entity entity, uint32_t& chunkIndex, uint32_t& row);
+    // Fills the hole with the last row of the archetype, returning the entity
+    // that was moved into it (NULL_ENTITY when the removed row was the last)
+    Entity removeRow(uint32_t chunkIndex, uint32_t row);
+
+private:
+    std::array<uint32_t, MAX_COMPONENT_TYPES> columnOffsets;
+    uint32_t entityOffset;
+};
+
+// A single chunk matched by a query
+struct ChunkView {
+    Archetype* archetype;
+    Chunk* chunk;
+
+    inline uint32_t size() const { return chunk->count; }
+    inline const Entity* entities() const { return archetype->entities(*chunk); }
+    template<typename T>
+    inline T* get() const { return archetype->column<T>(*chunk); }
+};
+
+// Scene
+// Structural changes (create/destroy/add/remove) must happen on one thread and
+// never while a query is being iterated. Parallel iteration only hands out
+// disjoint chunks, so systems may freely write the components they query.
+class Scene {
+public:
+    Scene();
+    ~Scene();
+
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    template<typename... Ts>
+    Entity createEntity(const Ts&... components);
+    void destroyEntity(Entity entity);
+    bool isAlive(Entity entity) const;
+    inline size_t entityCount() const { return aliveCount; }
+
+    template<typename T>
+    T* getComponent(Entity entity);
+    template<typename T>
+    bool hasComponent(Entity entity) const;
+    template<typename T>
+    void addComponent(Entity entity, const T& component);
+    template<typename T>
+    void removeComponent(Entity entity);
+
+    // Queries
+    template<typename... Ts>
+    void queryChunks(std::vector<ChunkView>& chunks);
+
+    // fn(uint32_t count, const Entity* entities, Ts*... columns)
+    template<typename... Ts, typename Func>
+    void forEachChunk(Func&& fn);
+    template<typename... Ts, typename Func>
+    void parallelForEachChunk(JobSystem& jobs, Func&& fn);
+
+    // fn(Entity entity, Ts&... components)
+    template<typename... Ts, typename Func>
+    void forEach(Func&& fn);
+    template<typename... Ts, typename Func>
+    void parallelForEach(JobSystem& jobs, Func&& fn);
+
+private:
+    struct EntityRecord {
+        Archetype* archetype;
+        uint32_t chunk;
+        uint32_t row;
+        uint32_t generation;
+    };
+
+    struct QueryCache {
+        std::vector<Archetype*> matches;
+        size_t archetypesSeen = 0;
+    };
+
+    Archetype* getOrCreateArchetype(ComponentMask mask);
+    Entity allocateEntity(Archetype* archetype);
+    void moveEntity(Entity entity, ComponentMask newMask);
+    const std::vector<Archetype*>& matchArchetypes(ComponentMask mask);
+    const EntityRecord& checkedRecord(Entity entity) const;
+
+    std::vector<EntityRecord> records;
+    std::vector<uint32_t> freeIndices;
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::unordered_map<ComponentMask, Archetype*> archetypeLookup;
+    std::unordered_map<ComponentMask, QueryCache> queryCache;
+    size_t aliveCount;
+};
+
+template<typename... Ts>
+Entity Scene::createEntity(const Ts&... components) {
+    Archetype* archetype = getOrCreateArchetype(componentMask<Ts...>());
+    Entity entity = allocateEntity(archetype);
+
+    const EntityRecord& record = records[entity.index];
+    Chunk& chunk = *archetype->chunks[record.chunk];
+    (new (archetype->column<Ts>(chunk) + record.row) Ts(components), ...);
+
+    return entity;
+}
+
+template<typename T>
+T* Scene::getComponent(Entity entity) {
+    const EntityRecord& record = checkedRecord(entity);
+    uint32_t componentId = ComponentRegistry::id<T>();
+    if (!record.archetype->has(componentId)) {
+        return nullptr;
+    }
+    return record.archetype->column<T>(*record.archetype->chunks[record.chunk]) + record.row;
+}
+
+template<typename T>
+bool Scene::hasComponent(Entity entity) const {
+    return checkedRecord(entity).archetype->has(ComponentRegistry::id<T>());
+}
+
+template<typename T>
+void Scene::addComponent(Entity entity, const T& component) {
+    const EntityRecord& record = checkedRecord(entity);
+    ComponentMask mask = record.archetype->mask | componentMask<T>();
+    if (mask != record.archetype->mask) {
+        moveEntity(entity, mask);
+    }
+    *getComponent<T>(entity) = component;
+}
+
+template<typename T>
+void Scene::removeComponent(Entity entity) {
+    const EntityRecord& record = checkedRecord(entity);
+    ComponentMask mask = record.archetype->mask & ~componentMask<T>();
+    if (mask != record.archetype->mask) {
+        moveEntity(entity, mask);
+    }
+}
+
+template<typename... Ts>
+void Scene::queryChunks(std::vector<ChunkView>& chunks) {
+    chunks.clear();
+    for (Archetype* archetype : matchArchetypes(componentMask<Ts...>())) {
+        for (auto& chunk : archetype->chunks) {
+            if (chunk->count > 0) {
+                chunks.push_back({archetype, chunk.get()});
+            }
+        }
+    }
+}
+
+template<typename... Ts, typename Func>
+void Scene::forEachChunk(Func&& fn) {
+    for (Archetype* archetype : matchArchetypes(componentMask<Ts...>())) {
+        for (auto& chunk : archetype->chunks) {
+            if (chunk->count > 0) {
+                fn(chunk->count, archetype->entities(*chunk), archetype->column<Ts>(*chunk)...);
+            }
+        }
+    }
+}
+
+template<typename... Ts, typename Func>
+void Scene::parallelForEachChunk(JobSystem& jobs, Func&& fn) {
+    std::vector<ChunkView> chunks;
+    queryChunks<Ts...>(chunks);
+
+    jobs.parallelFor(chunks.size(), 4, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const ChunkView& view = chunks[i];
+            fn(view.size(), view.entities(), view.get<Ts>()...);
+        }
+    });
+}
+
+template<typename... Ts, typename Func>
+void Scene::forEach(Func&& fn) {
+    forEachChunk<Ts...>([&](uint32_t count, const Entity* entities, Ts*... columns) {
+        for (uint32_t i = 0; i < count; i++) {
+            fn(entities[i], columns[i]...);
+        }
+    });
+}
+
+template<typename... Ts, typename Func>
+void Scene::parallelForEach(JobSystem& jobs, Func&& fn) {
+    parallelForEachChunk<Ts...>(jobs, [&](uint32_t count, const Entity* entities, Ts*... columns) {
+        for (uint32_t i = 0; i < count; i++) {
+            fn(entities[i], columns[i]...);
+        }
+    });
+}
+
+#endif //SCENE_CLASS
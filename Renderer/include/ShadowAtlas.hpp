@@ -0,0 +1,170 @@
+#ifndef SHADOW_ATLAS_CLASS
+#define SHADOW_ATLAS_CLASS
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "glm.hpp"
+#include "ResourceManager.hpp"
+#include "Scene.hpp"
+#include "LightGrid.hpp"
+#include "DrawPackets.hpp"
+
+// Square atlas holding the six cube faces of every shadowed point light
+const uint32_t SHADOW_ATLAS_SIZE = 4096;
+const uint32_t SHADOW_FACES = 6;
+// Lights are ranked by importance; the first ones get the largest faces.
+// Each tier is a band of the atlas with room for its lights' faces.
+const uint32_t SHADOW_TIER_COUNT = 3;
+const std::array<uint32_t, SHADOW_TIER_COUNT> SHADOW_TIER_LIGHTS = {4, 16, 12};
+const std::array<uint32_t, SHADOW_TIER_COUNT> SHADOW_TIER_SIZES = {512, 256, 128};
+const uint32_t SHADOW_MAX_LIGHTS = 32;
+
+// One shadowed light of a frame, chosen on the update thread
+struct ShadowLight {
+    // Where its faces are in the atlas, also LightData::shadow
+    uint32_t slot;
+    glm::vec3 position;
+    float radius;
+};
+
+// Read by the fragment shader, SHADOW_FACES per slot
+struct ShadowFace {
+    glm::mat4 viewProjection;
+    // Offset and size in atlas texture coordinates
+    glm::vec4 rect;
+};
+
+// Shadow caster pipelines, one face at a time. Static casters come with
+// their instance data as vertex input; the dynamic casters of a face are
+// indices into the frame's camera instances, read from the caster set at
+// set 0, so an instance reaching into several faces is not copied for each
+struct ShadowPushConstants {
+    glm::mat4 viewProjection;
+};
+
+// Cube shadow maps of the most important point lights, packed into one depth
+// atlas. Casters are drawn depth only with each face's projection, whose near
+// plane is a hundredth of the light's radius and whose far plane is the
+// radius; the fragment shader projects its depth along the face's axis the
+// same way to compare. The depth of the static casters is kept per face in a
+// second atlas: a face is only drawn there again when its light moved, moved
+// to another tier or static geometry changed. Every frame the cached depth is
+// copied into the sampled atlas and just the dynamic casters reaching into a
+// face are drawn on top of it.
+class ShadowAtlas {
+public:
+    ShadowAtlas();
+
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    void init(VkDevice device, ResourceManager& resources, uint32_t frameCount);
+    void shutdown();
+
+    // Faces of a light that a bounding sphere reaches into, one bit per face;
+    // offset is from the light to the sphere's centre. 0 when the sphere is
+    // out of the light's radius.
+    static uint32_t getFaceMask(const glm::vec3& offset, float boundsRadius, float lightRadius);
+
+    // Update thread. Ranks the lights, gives the most important ones a slot
+    // in the tier of their rank and writes it to their LightData::shadow.
+    // Lights keep their slot while they stay in its tier, so its cached
+    // faces stay valid; entities are parallel to lights.
+    void allocate(const std::vector<Entity>& entities, std::vector<LightData>& lights,
+                const glm::vec3& cameraPosition, std::vector<ShadowLight>& shadows);
+
+    // Render thread, the frame's previous use of its buffers has to have
+    // completed. casters are the dynamic casters' indices into instances,
+    // which holds the frame's camera instances
+    void update(size_t frame, const std::vector<ShadowLight>& shadows, VkBuffer instances,
+            const std::vector<uint32_t>& casters);
+    // Graphics queue, outside of any render pass; the atlas is ready for the
+    // fragment shaders afterwards. drawCasters records the draws of either
+    // the static casters or the dynamic ones of a face, with their pipeline,
+    // its push constants and for the dynamic ones the caster set already
+    // bound. Faces are numbered by their light's place
+    // in shadows, light * SHADOW_FACES + face; the dynamic draws of a face
+    // run from dynamicDraws[face] to dynamicDraws[face + 1], faces without
+    // any keep just their cached depth.
+    void record(VkCommandBuffer commandBuffer, size_t frame, const std::vector<ShadowLight>& shadows,
+            bool staticCastersChanged, const std::vector<uint32_t>& dynamicDraws, VkPipeline staticPipeline,
+            VkPipeline dynamicPipeline,
+            const std::function<void(VkCommandBuffer, bool staticCasters, uint32_t face)>& drawCasters,
+            DrawStats& stats);
+
+    // Bound at set 2 of the graphics pipelines
+    inline VkDescriptorSetLayout getSetLayout() const { return setLayout; }
+    inline VkDescriptorSet getDescriptorSet(size_t frame) const { return descriptorSets[frame]; }
+    // For the caster pipeline
+    inline VkRenderPass getRenderPass() const { return renderPass; }
+    inline VkPipelineLayout getPipelineLayout() const { return pipelineLayout; }
+
+private:
+    struct Candidate {
+        float score;
+        uint32_t light;
+        uint32_t previousSlot;
+    };
+
+    // What a slot's static faces were last drawn for
+    struct CachedSlot {
+        bool valid = false;
+        glm::vec3 position;
+        float radius;
+    };
+
+    void createRenderPass();
+    VkFramebuffer createFramebuffer(ImageHandle image);
+    void transition(VkCommandBuffer commandBuffer, ImageHandle image, VkImageLayout oldLayout,
+                VkImageLayout newLayout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+    // Viewport and scissor of tiles[index]
+    void setTile(VkCommandBuffer commandBuffer, uint32_t index);
+
+    VkDevice device;
+    ResourceManager* resources;
+
+    // Sampled every frame, and the static casters' depth it starts from
+    ImageHandle atlas;
+    ImageHandle staticAtlas;
+    bool staticAtlasReady;
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkFramebuffer staticFramebuffer;
+    VkPipelineLayout pipelineLayout;
+    SamplerHandle sampler;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;
+    // Per frame in flight
+    std::vector<BufferHandle> faceBuffers;
+
+    // 0 the camera instances, 1 the dynamic casters' indices into them
+    VkDescriptorSetLayout casterSetLayout;
+    // Per frame in flight, along with the buffers each set was last written with
+    std::vector<VkDescriptorSet> casterDescriptorSets;
+    std::vector<BufferHandle> casterBuffers;
+    std::vector<size_t> casterBufferCapacity;
+    std::vector<std::array<VkBuffer, 2>> casterSetBuffers;
+
+    // Pixel offset and size of every slot's faces, slot * SHADOW_FACES + face
+    std::array<VkRect2D, SHADOW_MAX_LIGHTS * SHADOW_FACES> tiles;
+
+    // Update thread
+    std::array<Entity, SHADOW_MAX_LIGHTS> slotOwners;
+    std::unordered_map<uint32_t, uint32_t> ownerSlots;
+    std::vector<Candidate> candidates;
+
+    // Render thread
+    std::array<CachedSlot, SHADOW_MAX_LIGHTS> cachedSlots;
+    std::array<glm::mat4, SHADOW_MAX_LIGHTS * SHADOW_FACES> faceMatrices;
+};
+
+#endif //SHADOW_ATLAS_CLASS
@@ -0,0 +1,118 @@
+#ifndef SPSC_QUEUE_CLASS
+#define SPSC_QUEUE_CLASS
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// Bounded single-producer single-consumer ring. tryPush/tryPop never lock;
+// the blocking push/pop spin for a while and then park on a condition
+// variable that is only touched when the other side is actually waiting.
+template<typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0), waiters(0), closed(false) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool tryPush(const T& value) {
+        size_t index = tail.load(std::memory_order_relaxed);
+        if (index - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots[index & (Capacity - 1)] = value;
+        tail.store(index + 1, std::memory_order_seq_cst);
+        wakeWaiters();
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t index = head.load(std::memory_order_relaxed);
+        if (index == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[index & (Capacity - 1)];
+        head.store(index + 1, std::memory_order_seq_cst);
+        wakeWaiters();
+        return true;
+    }
+
+    // Blocks while the queue is full, returns false once the queue is closed
+    bool push(const T& value) {
+        while (!isClosed()) {
+            if (tryPush(value)) {
+                return true;
+            }
+            waitUntil([this]() { return tail.load() - head.load() < Capacity; });
+        }
+        return false;
+    }
+
+    // Blocks while the queue is empty, returns false once it is closed and drained
+    bool pop(T& value) {
+        while (true) {
+            if (tryPop(value)) {
+                return true;
+            }
+            if (isClosed()) {
+                return false;
+            }
+            waitUntil([this]() { return tail.load() != head.load(); });
+        }
+    }
+
+    // Wakes every blocked push/pop; pushes fail from now on
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(waitMutex);
+            closed = true;
+        }
+        waitCondition.notify_all();
+    }
+
+    inline bool isClosed() const { return closed.load(); }
+
+private:
+    template<typename Predicate>
+    void waitUntil(Predicate ready) {
+        for (int spin = 0; spin < 64; spin++) {
+            if (ready() || isClosed()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(waitMutex);
+        waiters++;
+        waitCondition.wait(lock, [&]() { return ready() || isClosed(); });
+        waiters--;
+    }
+
+    void wakeWaiters() {
+        if (waiters.load() > 0) {
+            {
+                std::lock_guard<std::mutex> lock(waitMutex);
+            }
+            waitCondition.notify_all();
+        }
+    }
+
+    std::array<T, Capacity> slots;
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+    alignas(64) std::atomic<uint32_t> waiters;
+    std::atomic<bool> closed;
+    std::mutex waitMutex;
+    std::condition_variable waitCondition;
+};
+
+#endif //SPSC_QUEUE_CLASS
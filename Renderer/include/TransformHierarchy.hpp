@@ -0,0 +1,85 @@
+#ifndef TRANSFORM_HIERARCHY_CLASS
+#define TRANSFORM_HIERARCHY_CLASS
+
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+#include "glm.hpp"
+#include "gtc/quaternion.hpp"
+
+#include "Scene.hpp"
+#include "Components.hpp"
+#include "JobSystem.hpp"
+
+const uint32_t NULL_TRANSFORM_NODE = UINT32_MAX;
+
+struct LocalTransform {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// Links an entity to its node in the transform hierarchy. The hierarchy
+// writes the node's world matrix into the entity's WorldTransform.
+struct TransformNode {
+    uint32_t node;
+};
+
+// Parent/child transforms stored structure-of-arrays and sorted by depth, so
+// every level only reads world matrices the previous level already wrote.
+// Nodes keep a stable id; their storage slot changes whenever the hierarchy
+// is re-sorted after a structural change.
+class TransformHierarchy {
+public:
+    TransformHierarchy();
+
+    uint32_t createNode(uint32_t parent, const LocalTransform& local = LocalTransform());
+    // Only leaf nodes can be destroyed; reparent or destroy children first
+    void destroyNode(uint32_t node);
+    void setParent(uint32_t node, uint32_t parent);
+    uint32_t getParent(uint32_t node) const;
+
+    void setLocal(uint32_t node, const LocalTransform& local);
+    LocalTransform getLocal(uint32_t node) const;
+    const glm::mat4& getWorld(uint32_t node) const;
+
+    // Recomputes world matrices of dirty nodes and everything below them
+    void update(JobSystem& jobs);
+    // Copies world matrices changed by the last update into the scene
+    void writeWorldTransforms(Scene& scene, JobSystem& jobs);
+
+    inline bool wasUpdated(uint32_t node) const { return changed[slotOf(node)] != 0; }
+    inline size_t nodeCount() const { return slotToNode.size(); }
+    inline size_t levelCount() const { return levelStart.empty() ? 0 : levelStart.size() - 1; }
+    inline size_t updatedCount() const { return lastUpdatedCount; }
+
+private:
+    uint32_t slotOf(uint32_t node) const;
+    void sortByDepth();
+    void updateRange(size_t begin, size_t end);
+    void removeSlot(uint32_t slot);
+
+    // Local transform components, one array per scalar so four nodes can be
+    // turned into matrices with a single set of SIMD operations
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+
+    std::vector<glm::mat4> world;
+    std::vector<uint32_t> parentSlot;
+    std::vector<uint8_t> dirty;
+    std::vector<uint8_t> changed;
+
+    std::vector<uint32_t> slotToNode;
+    std::vector<uint32_t> nodeToSlot;
+    std::vector<uint32_t> nodeParent;
+    std::vector<uint32_t> childCount;
+    std::vector<uint32_t> freeNodes;
+
+    std::vector<size_t> levelStart;
+    bool orderDirty;
+    size_t lastUpdatedCount;
+};
+
+#endif //TRANSFORM_HIERARCHY_CLASS
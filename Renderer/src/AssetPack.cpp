@@ -0,0 +1,241 @@
+#include "AssetPack.hpp"
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+AssetPack::AssetPack() : base(nullptr),
+                        fileSize(0),
+                        header(nullptr),
+                        entries(nullptr),
+                        toc(nullptr),
+#ifdef _WIN32
+                        file(INVALID_HANDLE_VALUE),
+                        mapping(nullptr) {
+#else
+                        file(-1) {
+#endif
+}
+
+AssetPack::~AssetPack() {
+    close();
+}
+
+void AssetPack::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+        close();
+        throw std::runtime_error("Failed to open asset pack!");
+    }
+    fileSize = static_cast<uint64_t>(size.QuadPart);
+    mapping = fileSize > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    base = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+    file = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0) {
+        close();
+        throw std::runtime_error("Failed to open asset pack!");
+    }
+    fileSize = static_cast<uint64_t>(info.st_size);
+    if (fileSize > 0) {
+        void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file, 0);
+        base = view != MAP_FAILED ? static_cast<const uint8_t*>(view) : nullptr;
+    }
+#endif
+    if (!base) {
+        close();
+        throw std::runtime_error("Failed to map asset pack!");
+    }
+
+    try {
+        validate();
+    } catch (...) {
+        close();
+        throw;
+    }
+}
+
+void AssetPack::close() {
+#ifdef _WIN32
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+#else
+    if (base) {
+        munmap(const_cast<uint8_t*>(base), fileSize);
+    }
+    if (file >= 0) {
+        ::close(file);
+    }
+    file = -1;
+#endif
+    base = nullptr;
+    fileSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    toc = nullptr;
+}
+
+void AssetPack::validate() {
+    if (fileSize < sizeof(AssetPackHeader)) {
+        throw std::runtime_error("Invalid asset pack!");
+    }
+    header = reinterpret_cast<const AssetPackHeader*>(base);
+    if (header->magic != ASSET_PACK_MAGIC || header->version != ASSET_PACK_VERSION) {
+        throw std::runtime_error("Invalid asset pack, wrong magic or version!");
+    }
+    if (header->tocOffset > fileSize || header->tocSize > fileSize - header->tocOffset ||
+        header->tocOffset % alignof(AssetPackEntry) != 0 ||
+        static_cast<uint64_t>(header->entryCount) * sizeof(AssetPackEntry) > header->tocSize) {
+        throw std::runtime_error("Invalid asset pack, table of contents out of range!");
+    }
+    toc = base + header->tocOffset;
+    entries = reinterpret_cast<const AssetPackEntry*>(toc);
+
+    // Everything the entries point at has to be inside the file, lookups
+    // never check again
+    auto inToc = [this](uint64_t offset, uint64_t size) {
+        return offset <= header->tocSize && size <= header->tocSize - offset;
+    };
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const AssetPackEntry& entry = entries[i];
+        bool valid = inToc(entry.nameOffset, entry.nameLength) &&
+                    inToc(entry.metadataOffset, entry.metadataSize) &&
+                    entry.metadataOffset % 4 == 0 &&
+                    entry.offset <= fileSize && entry.storedSize <= fileSize - entry.offset;
+        if (entry.flags & ASSET_COMPRESSED) {
+            valid = valid && entry.chunkTableOffset % 8 == 0 &&
+                    entry.chunkCount == (entry.size + ASSET_PACK_CHUNK_SIZE - 1) / ASSET_PACK_CHUNK_SIZE &&
+                    inToc(entry.chunkTableOffset, (static_cast<uint64_t>(entry.chunkCount) + 1) * sizeof(uint64_t));
+            if (valid) {
+                const uint64_t* chunks = reinterpret_cast<const uint64_t*>(toc + entry.chunkTableOffset);
+                for (uint32_t c = 0; c < entry.chunkCount && valid; c++) {
+                    valid = chunks[c] <= chunks[c + 1];
+                }
+                valid = valid && chunks[entry.chunkCount] <= entry.storedSize;
+            }
+        } else {
+            valid = valid && entry.storedSize == entry.size;
+        }
+        if (!valid) {
+            throw std::runtime_error("Invalid asset pack, entry out of range!");
+        }
+
+        // Vulkan takes SPIR-V as whole words, uncompressed code straight
+        // from the mapping
+        if (entry.type == AssetType::Shader &&
+            (entry.size % 4 != 0 || (!(entry.flags & ASSET_COMPRESSED) && entry.offset % 4 != 0))) {
+            throw std::runtime_error("Invalid asset pack, misaligned shader!");
+        }
+    }
+
+    // find() binary searches, an unsorted table would hide entries
+    for (uint32_t i = 1; i < header->entryCount; i++) {
+        if (getName(entries[i - 1]) >= getName(entries[i])) {
+            throw std::runtime_error("Invalid asset pack, table of contents not sorted!");
+        }
+    }
+}
+
+std::string AssetPack::getName(const AssetPackEntry& entry) const {
+    return std::string(reinterpret_cast<const char*>(toc + entry.nameOffset), entry.nameLength);
+}
+
+const AssetPackEntry* AssetPack::find(const std::string& name) const {
+    if (!isOpen()) {
+        return nullptr;
+    }
+
+    // The cooker sorts the entries by name
+    const AssetPackEntry* end = entries + header->entryCount;
+    const AssetPackEntry* entry = std::lower_bound(entries, end, name,
+        [this](const AssetPackEntry& entry, const std::string& name) {
+            return name.compare(0, std::string::npos, reinterpret_cast<const char*>(toc + entry.nameOffset),
+                            entry.nameLength) > 0;
+        });
+    if (entry == end || getName(*entry) != name) {
+        return nullptr;
+    }
+    return entry;
+}
+
+const void* AssetPack::getPayload(const AssetPackEntry& entry) const {
+    if (entry.flags & ASSET_COMPRESSED) {
+        return nullptr;
+    }
+    return base + entry.offset;
+}
+
+void AssetPack::read(const AssetPackEntry& entry, uint64_t offset, uint64_t size, void* destination) const {
+    if (offset > entry.size || size > entry.size - offset) {
+        throw std::runtime_error("Asset pack read out of range!");
+    }
+    uint8_t* output = static_cast<uint8_t*>(destination);
+
+    if (!(entry.flags & ASSET_COMPRESSED)) {
+        memcpy(output, base + entry.offset + offset, static_cast<size_t>(size));
+        return;
+    }
+
+    const uint64_t* chunks = reinterpret_cast<const uint64_t*>(toc + entry.chunkTableOffset);
+    const uint8_t* payload = base + entry.offset;
+    std::vector<uint8_t> scratch;
+
+    uint64_t end = offset + size;
+    for (uint64_t chunk = offset / ASSET_PACK_CHUNK_SIZE; chunk * ASSET_PACK_CHUNK_SIZE < end; chunk++) {
+        uint64_t chunkStart = chunk * ASSET_PACK_CHUNK_SIZE;
+        uint64_t chunkSize = std::min(ASSET_PACK_CHUNK_SIZE, entry.size - chunkStart);
+        const uint8_t* stored = payload + chunks[chunk];
+        uint64_t storedSize = chunks[chunk + 1] - chunks[chunk];
+
+        uint64_t copyStart = std::max(offset, chunkStart);
+        uint64_t copyEnd = std::min(end, chunkStart + chunkSize);
+        uint8_t* target = output + (copyStart - offset);
+
+        if (storedSize == chunkSize) {
+            memcpy(target, stored + (copyStart - chunkStart), static_cast<size_t>(copyEnd - copyStart));
+            continue;
+        }
+
+        // Whole chunks decompress in place, partial ones go through scratch
+        bool whole = copyStart == chunkStart && copyEnd == chunkStart + chunkSize;
+        uint8_t* chunkOutput = target;
+        if (!whole) {
+            scratch.resize(static_cast<size_t>(chunkSize));
+            chunkOutput = scratch.data();
+        }
+        if (!lzDecompress(stored, static_cast<size_t>(storedSize), chunkOutput, static_cast<size_t>(chunkSize))) {
+            throw std::runtime_error("Corrupt asset pack chunk!");
+        }
+        if (!whole) {
+            memcpy(target, scratch.data() + (copyStart - chunkStart), static_cast<size_t>(copyEnd - copyStart));
+        }
+    }
+}
@@ -0,0 +1,589 @@
+#include "AsyncFileReader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNC_FILE_READER_IO_URING
+#endif
+#endif
+
+#ifdef ASYNC_FILE_READER_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// Raw system calls, the rings are small enough not to need liburing
+static int ioUringSetup(uint32_t entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+// user_data of the read that wakes the ring thread up for new work
+static const uint64_t WAKE_TAG = UINT64_MAX;
+
+struct AsyncFileReader::Ring {
+    int fd = -1;
+    // Written by submit() and the destructor to interrupt a blocking wait
+    int wakeFd = -1;
+    uint64_t wakeValue = 0;
+    iovec wakeVector{};
+    // Whether the wake-up read is in the ring, and where
+    bool wakeArmed = false;
+    unsigned wakePosition = 0;
+
+    void* sqMemory = MAP_FAILED;
+    size_t sqSize = 0;
+    void* cqMemory = MAP_FAILED;
+    size_t cqSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    // Entries written since the last io_uring_enter
+    uint32_t unsubmitted = 0;
+
+    // One slot per read in flight, user_data is the slot index; positions
+    // are where in the submission ring each slot's read was pushed last
+    std::vector<Request> slots;
+    std::vector<iovec> vectors;
+    std::vector<unsigned> positions;
+    std::vector<uint32_t> freeSlots;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqMemory != MAP_FAILED && cqMemory != sqMemory) {
+            munmap(cqMemory, cqSize);
+        }
+        if (sqMemory != MAP_FAILED) {
+            munmap(sqMemory, sqSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (wakeFd >= 0) {
+            close(wakeFd);
+        }
+    }
+
+    bool init(uint32_t queueDepth) {
+        // One extra entry for the wake-up read
+        io_uring_params params{};
+        fd = ioUringSetup(queueDepth + 1, &params);
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (fd < 0 || wakeFd < 0) {
+            return false;
+        }
+
+        sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqSize = cqSize = std::max(sqSize, cqSize);
+        }
+        sqMemory = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMemory == MAP_FAILED) {
+            return false;
+        }
+        cqMemory = sqMemory;
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            cqMemory = mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqMemory == MAP_FAILED) {
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(sqMemory);
+        uint8_t* cq = static_cast<uint8_t*>(cqMemory);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        slots.resize(queueDepth);
+        vectors.resize(queueDepth);
+        positions.resize(queueDepth);
+        for (uint32_t i = queueDepth; i > 0; i--) {
+            freeSlots.push_back(i - 1);
+        }
+        wakeVector.iov_base = &wakeValue;
+        wakeVector.iov_len = sizeof(wakeValue);
+        return true;
+    }
+
+    // Vectored reads work on every kernel with io_uring, plain reads need 5.6.
+    // Returns the entry's position in the submission ring
+    unsigned pushRead(int file, const iovec* vector, uint64_t offset, uint64_t userData) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(vector);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;
+        return tail;
+    }
+
+    // The kernel has taken every entry before its head, later ones are
+    // still only in the ring
+    bool isSubmitted(unsigned position) const {
+        return static_cast<int>(position - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)) < 0;
+    }
+
+    void pushRequest(uint32_t slot) {
+        Request& request = slots[slot];
+        vectors[slot].iov_base = request.destination + request.done;
+        vectors[slot].iov_len = request.size - request.done;
+        positions[slot] = pushRead(request.file.handle, &vectors[slot], request.offset + request.done, slot);
+    }
+
+    void wake() {
+        uint64_t value = 1;
+        ssize_t written = write(wakeFd, &value, sizeof(value));
+        (void) written;
+    }
+};
+#else
+struct AsyncFileReader::Ring {
+    void wake() {}
+};
+#endif
+
+AsyncFileReader::AsyncFileReader(const FileReaderConfig& config) : config(config),
+                                                                stopping(false),
+                                                                pending(0),
+                                                                ringFailed(false) {
+    this->config.queueDepth = std::max(this->config.queueDepth, 1u);
+    this->config.fallbackThreads = std::max(this->config.fallbackThreads, 1u);
+}
+
+void AsyncFileReader::start() {
+#ifdef ASYNC_FILE_READER_IO_URING
+    if (!config.forceFallback) {
+        // Kernels without io_uring, seccomp filters and containers refuse it
+        ring = std::make_unique<Ring>();
+        if (!ring->init(config.queueDepth)) {
+            ring.reset();
+        }
+    }
+#endif
+
+    if (ring) {
+        threads.emplace_back(&AsyncFileReader::ringLoop, this);
+    } else {
+        for (uint32_t i = 0; i < config.fallbackThreads; i++) {
+            threads.emplace_back(&AsyncFileReader::fallbackLoop, this);
+        }
+    }
+}
+
+AsyncFileReader::~AsyncFileReader() {
+    waitIdle();
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    if (ring) {
+        ring->wake();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+AsyncFile AsyncFileReader::openFile(const std::string& path, bool direct) {
+    AsyncFile file;
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    LARGE_INTEGER size;
+    if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &size)) {
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+    file.handle = handle;
+    file.size = static_cast<uint64_t>(size.QuadPart);
+    file.direct = direct;
+#else
+    int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (direct) {
+        file.handle = ::open(path.c_str(), flags | O_DIRECT);
+        file.direct = file.handle >= 0;
+    }
+#endif
+    // tmpfs and some network file systems refuse O_DIRECT
+    if (file.handle < 0) {
+        file.handle = ::open(path.c_str(), flags);
+    }
+    struct stat info;
+    if (file.handle < 0 || fstat(file.handle, &info) != 0) {
+        closeFile(file);
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+    file.size = static_cast<uint64_t>(info.st_size);
+#endif
+    return file;
+}
+
+void AsyncFileReader::closeFile(AsyncFile& file) {
+    if (!file.isOpen()) {
+        return;
+    }
+#ifdef _WIN32
+    CloseHandle(file.handle);
+    file.handle = nullptr;
+#else
+    ::close(file.handle);
+    file.handle = -1;
+#endif
+    file.size = 0;
+    file.direct = false;
+}
+
+void* AsyncFileReader::allocateAligned(size_t size, size_t alignment) {
+    // Rounded up so direct reads may always fill whole blocks
+    size = (size + alignment - 1) / alignment * alignment;
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size, alignment);
+#else
+    void* memory = std::aligned_alloc(alignment, size);
+#endif
+    if (!memory) {
+        throw std::runtime_error("Failed to allocate aligned read buffer!");
+    }
+    return memory;
+}
+
+void AsyncFileReader::freeAligned(void* memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void AsyncFileReader::validate(const AsyncFile& file, uint64_t offset, size_t size, const void* destination) const {
+    if (!file.isOpen()) {
+        throw std::runtime_error("Failed to queue read, the file is not open!");
+    }
+    if (file.direct && (offset % DIRECT_IO_ALIGNMENT != 0 || size % DIRECT_IO_ALIGNMENT != 0 ||
+                        reinterpret_cast<uintptr_t>(destination) % DIRECT_IO_ALIGNMENT != 0)) {
+        throw std::runtime_error("Direct reads need aligned offsets, sizes and destinations!");
+    }
+}
+
+void AsyncFileReader::read(const AsyncFile& file, uint64_t offset, size_t size, void* destination,
+                        FileReadCallback callback) {
+    validate(file, offset, size, destination);
+
+    pending.fetch_add(1, std::memory_order_acq_rel);
+    std::lock_guard<std::mutex> lock(batchMutex);
+    batch.push_back({file, offset, size, static_cast<uint8_t*>(destination), 0, std::move(callback)});
+}
+
+std::future<size_t> AsyncFileReader::read(const AsyncFile& file, uint64_t offset, size_t size, void* destination) {
+    auto promise = std::make_shared<std::promise<size_t>>();
+    std::future<size_t> future = promise->get_future();
+    read(file, offset, size, destination, [promise](const FileReadResult& result) {
+        if (result.error != 0) {
+            promise->set_exception(std::make_exception_ptr(
+                std::runtime_error(std::string("Failed to read file: ") + strerror(result.error))));
+        } else {
+            promise->set_value(result.bytesRead);
+        }
+    });
+    return future;
+}
+
+void AsyncFileReader::submit() {
+    std::vector<Request> submitted;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        submitted.swap(batch);
+    }
+    if (submitted.empty()) {
+        return;
+    }
+    std::call_once(started, &AsyncFileReader::start, this);
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (auto& request : submitted) {
+            queue.push_back(std::move(request));
+        }
+    }
+    queueCondition.notify_all();
+    if (ring) {
+        ring->wake();
+    }
+}
+
+void AsyncFileReader::waitIdle() {
+    submit();
+    std::unique_lock<std::mutex> lock(idleMutex);
+    idleCondition.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+}
+
+void AsyncFileReader::complete(Request& request, int error) {
+    if (request.callback) {
+        request.callback({request.destination, request.offset, request.done, error});
+    }
+    request.callback = nullptr;
+
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idleCondition.notify_all();
+    }
+}
+
+void AsyncFileReader::ringLoop() {
+#ifdef ASYNC_FILE_READER_IO_URING
+    Ring& r = *ring;
+    uint32_t inFlight = 0;
+
+    while (!ringFailed.load(std::memory_order_relaxed)) {
+        if (!r.wakeArmed) {
+            r.wakePosition = r.pushRead(r.wakeFd, &r.wakeVector, 0, WAKE_TAG);
+            r.wakeArmed = true;
+        }
+
+        // Fill every free slot, the queue only runs dry when the caller
+        // stops submitting
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (stopping && queue.empty() && inFlight == 0) {
+                break;
+            }
+            while (!queue.empty() && !r.freeSlots.empty()) {
+                uint32_t slot = r.freeSlots.back();
+                r.freeSlots.pop_back();
+                r.slots[slot] = std::move(queue.front());
+                queue.pop_front();
+                r.pushRequest(slot);
+                inFlight++;
+            }
+        }
+
+        // Submits and sleeps until something completes, new work completes
+        // the wake-up read
+        int result = ioUringEnter(r.fd, r.unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if (result < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            failRing();
+            break;
+        }
+        r.unsubmitted -= std::min(r.unsubmitted, static_cast<uint32_t>(result));
+
+        unsigned head = *r.cqHead;
+        unsigned tail = __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = r.cqes[head & *r.cqMask];
+            if (cqe.user_data == WAKE_TAG) {
+                r.wakeArmed = false;
+                continue;
+            }
+
+            uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+            Request& request = r.slots[slot];
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                r.pushRequest(slot);
+                continue;
+            }
+            if (cqe.res > 0) {
+                request.done += static_cast<size_t>(cqe.res);
+                // Short reads before the end of the file continue where they stopped
+                if (request.done < request.size && request.offset + request.done < request.file.size) {
+                    r.pushRequest(slot);
+                    continue;
+                }
+            }
+
+            complete(request, cqe.res < 0 ? -cqe.res : 0);
+            r.freeSlots.push_back(slot);
+            inFlight--;
+        }
+        __atomic_store_n(r.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // This thread serves whatever is still queued, or comes later, itself
+    if (ringFailed.load(std::memory_order_relaxed)) {
+        fallbackLoop();
+    }
+#endif
+}
+
+void AsyncFileReader::failRing() {
+#ifdef ASYNC_FILE_READER_IO_URING
+    Ring& r = *ring;
+    ringFailed.store(true, std::memory_order_release);
+
+    // Reads the kernel took may still write into their destinations, so they
+    // are reaped before anything is released. The ring is not entered again,
+    // completions still arrive in its memory
+    std::vector<bool> busy(r.slots.size(), true);
+    for (uint32_t slot : r.freeSlots) {
+        busy[slot] = false;
+    }
+    uint32_t inKernel = 0;
+    for (size_t slot = 0; slot < r.slots.size(); slot++) {
+        if (busy[slot] && r.isSubmitted(r.positions[slot])) {
+            inKernel++;
+        }
+    }
+    bool wakeInKernel = r.wakeArmed && r.isSubmitted(r.wakePosition);
+    if (wakeInKernel) {
+        r.wake();
+    }
+
+    while (inKernel > 0 || wakeInKernel) {
+        unsigned head = *r.cqHead;
+        unsigned tail = __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = r.cqes[head & *r.cqMask];
+            if (cqe.user_data == WAKE_TAG) {
+                wakeInKernel = false;
+                continue;
+            }
+
+            uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+            Request& request = r.slots[slot];
+            inKernel--;
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                continue;
+            }
+            if (cqe.res > 0) {
+                request.done += static_cast<size_t>(cqe.res);
+                if (request.done < request.size && request.offset + request.done < request.file.size) {
+                    continue;
+                }
+            }
+            complete(request, cqe.res < 0 ? -cqe.res : 0);
+            busy[slot] = false;
+        }
+        __atomic_store_n(r.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // The rest, never submitted or cut short, is the caller's again and goes
+    // to the fallback ahead of anything queued later
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (size_t slot = r.slots.size(); slot > 0; slot--) {
+            if (busy[slot - 1]) {
+                queue.push_front(std::move(r.slots[slot - 1]));
+            }
+        }
+    }
+    r.freeSlots.clear();
+    for (uint32_t slot = static_cast<uint32_t>(r.slots.size()); slot > 0; slot--) {
+        r.freeSlots.push_back(slot - 1);
+    }
+#endif
+}
+
+void AsyncFileReader::fallbackLoop() {
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            request = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        int error = readBlocking(request.file, request.offset, request.size, request.destination, request.done);
+        complete(request, error);
+    }
+}
+
+int AsyncFileReader::readBlocking(const AsyncFile& file, uint64_t offset, size_t size, uint8_t* destination,
+                                size_t& bytesRead) {
+    bytesRead = 0;
+    while (bytesRead < size) {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        uint64_t position = offset + bytesRead;
+        overlapped.Offset = static_cast<DWORD>(position);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - bytesRead, 1u << 30));
+        DWORD read = 0;
+        if (!ReadFile(file.handle, destination + bytesRead, chunk, &read, &overlapped)) {
+            DWORD error = GetLastError();
+            return error == ERROR_HANDLE_EOF ? 0 : EIO;
+        }
+#else
+        ssize_t read = pread(file.handle, destination + bytesRead, size - bytesRead,
+                            static_cast<off_t>(offset + bytesRead));
+        if (read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+#endif
+        if (read == 0) {
+            break;
+        }
+        bytesRead += static_cast<size_t>(read);
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "Compression.hpp"
+
+#include <cstring>
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const uint32_t HASH_BITS = 16;
+
+uint32_t read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void writeLength(size_t length, std::vector<uint8_t>& output) {
+    while (length >= 255) {
+        output.push_back(255);
+        length -= 255;
+    }
+    output.push_back(static_cast<uint8_t>(length));
+}
+
+void writeSequence(const uint8_t* literals, size_t literalLength, size_t matchLength, size_t offset,
+                std::vector<uint8_t>& output) {
+    uint8_t literalNibble = static_cast<uint8_t>(literalLength < 15 ? literalLength : 15);
+    size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+    uint8_t matchNibble = static_cast<uint8_t>(matchCode < 15 ? matchCode : 15);
+    output.push_back(static_cast<uint8_t>(literalNibble << 4 | matchNibble));
+
+    if (literalLength >= 15) {
+        writeLength(literalLength - 15, output);
+    }
+    output.insert(output.end(), literals, literals + literalLength);
+
+    if (matchLength > 0) {
+        output.push_back(static_cast<uint8_t>(offset & 0xff));
+        output.push_back(static_cast<uint8_t>(offset >> 8));
+        if (matchCode >= 15) {
+            writeLength(matchCode - 15, output);
+        }
+    }
+}
+
+bool readLength(const uint8_t*& input, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (input == end) {
+            return false;
+        }
+        byte = *input++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}
+
+void lzCompress(const uint8_t* data, size_t size, std::vector<uint8_t>& output) {
+    // Most recent position of every hashed 4-byte sequence
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+
+    size_t literalStart = 0;
+    size_t position = 0;
+    while (position + MIN_MATCH <= size) {
+        uint32_t sequence = read32(data + position);
+        uint32_t& slot = table[hash(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position);
+
+        if (candidate == UINT32_MAX || position - candidate > MAX_OFFSET || read32(data + candidate) != sequence) {
+            position++;
+            continue;
+        }
+
+        size_t matchLength = MIN_MATCH;
+        while (position + matchLength < size && data[candidate + matchLength] == data[position + matchLength]) {
+            matchLength++;
+        }
+
+        writeSequence(data + literalStart, position - literalStart, matchLength, position - candidate, output);
+
+        // Seed the table inside the match so the next match can start there
+        size_t matchEnd = position + matchLength;
+        for (size_t i = position + 1; i + MIN_MATCH <= size && i < matchEnd; i += 2) {
+            table[hash(read32(data + i))] = static_cast<uint32_t>(i);
+        }
+        position = matchEnd;
+        literalStart = position;
+    }
+
+    writeSequence(data + literalStart, size - literalStart, 0, 0, output);
+}
+
+bool lzDecompress(const uint8_t* data, size_t compressedSize, uint8_t* output, size_t size) {
+    const uint8_t* input = data;
+    const uint8_t* inputEnd = data + compressedSize;
+    size_t written = 0;
+
+    while (input < inputEnd) {
+        uint8_t token = *input++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(input, inputEnd, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(inputEnd - input) || literalLength > size - written) {
+            return false;
+        }
+        memcpy(output + written, input, literalLength);
+        input += literalLength;
+        written += literalLength;
+
+        // Only the last sequence ends after its literals
+        if (input == inputEnd) {
+            break;
+        }
+
+        if (inputEnd - input < 2) {
+            return false;
+        }
+        size_t offset = input[0] | static_cast<size_t>(input[1]) << 8;
+        input += 2;
+        size_t matchLength = token & 0x0f;
+        if (matchLength == 15 && !readLength(input, inputEnd, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+
+        if (offset == 0 || offset > written || matchLength > size - written) {
+            return false;
+        }
+        // Byte by byte, matches may overlap the bytes they produce
+        const uint8_t* source = output + written - offset;
+        for (size_t i = 0; i < matchLength; i++) {
+            output[written + i] = source[i];
+        }
+        written += matchLength;
+    }
+
+    return written == size;
+}
@@ -0,0 +1,178 @@
+#include "ComputeQueue.hpp"
+
+#include <stdexcept>
+
+ComputeQueue::ComputeQueue() : device(VK_NULL_HANDLE),
+                               queue(VK_NULL_HANDLE),
+                               family(0),
+                               async(false),
+                               commandPool(VK_NULL_HANDLE) {}
+
+void ComputeQueue::init(VkDevice device, uint32_t family, uint32_t queueIndex, uint32_t graphicsFamily,
+                        size_t frameCount) {
+    this->device = device;
+    this->family = family;
+    async = family != graphicsFamily || queueIndex > 0;
+    vkGetDeviceQueue(device, family, queueIndex, &queue);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = family;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute command pool!");
+    }
+
+    commandBuffers.resize(frameCount);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(frameCount);
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate compute command buffers!");
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    fences.resize(frameCount);
+    finishedSemaphores.resize(frameCount);
+    for (size_t i = 0; i < frameCount; i++) {
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &finishedSemaphores[i]) != VK_SUCCESS ||
+            vkCreateFence(device, &fenceInfo, nullptr, &fences[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute semaphores or fences!");
+        }
+    }
+}
+
+void ComputeQueue::shutdown() {
+    for (size_t i = 0; i < fences.size(); i++) {
+        vkDestroySemaphore(device, finishedSemaphores[i], nullptr);
+        vkDestroyFence(device, fences[i], nullptr);
+    }
+    fences.clear();
+    finishedSemaphores.clear();
+
+    if (commandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device, commandPool, nullptr);
+        commandPool = VK_NULL_HANDLE;
+    }
+    commandBuffers.clear();
+}
+
+VkCommandBuffer ComputeQueue::begin(size_t frame) {
+    vkWaitForFences(device, 1, &fences[frame], VK_TRUE, UINT64_MAX);
+
+    VkCommandBuffer commandBuffer = commandBuffers[frame];
+    vkResetCommandBuffer(commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording compute command buffer!");
+    }
+    return commandBuffer;
+}
+
+VkSemaphore ComputeQueue::submit(size_t frame, const std::vector<VkSemaphore>& waitSemaphores,
+                                 const std::vector<VkPipelineStageFlags>& waitStages) {
+    if (vkEndCommandBuffer(commandBuffers[frame]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record compute command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffers[frame];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &finishedSemaphores[frame];
+
+    vkResetFences(device, 1, &fences[frame]);
+    if (vkQueueSubmit(queue, 1, &submitInfo, fences[frame]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit compute command buffer!");
+    }
+    return finishedSemaphores[frame];
+}
+
+// Ownership transfers
+static void bufferBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+                          VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+                          VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = srcFamily == dstFamily ? VK_QUEUE_FAMILY_IGNORED : srcFamily;
+    barrier.dstQueueFamilyIndex = srcFamily == dstFamily ? VK_QUEUE_FAMILY_IGNORED : dstFamily;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+static void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+                         VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+                         VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+                         VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = srcFamily == dstFamily ? VK_QUEUE_FAMILY_IGNORED : srcFamily;
+    barrier.dstQueueFamilyIndex = srcFamily == dstFamily ? VK_QUEUE_FAMILY_IGNORED : dstFamily;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// The release half only makes the writes available, its destination access
+// is ignored; the acquire half on the other queue makes them visible. The
+// semaphore between the two submissions orders them, so the stages facing
+// it are top/bottom of pipe.
+void ComputeQueue::releaseBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+                                 VkAccessFlags srcAccess, VkPipelineStageFlags srcStage) {
+    if (srcFamily == dstFamily) {
+        return;
+    }
+    bufferBarrier(commandBuffer, buffer, srcFamily, dstFamily, srcAccess, 0,
+                srcStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+}
+
+void ComputeQueue::acquireBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+                                 VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    bufferBarrier(commandBuffer, buffer, srcFamily, dstFamily, 0, dstAccess,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage);
+}
+
+void ComputeQueue::releaseImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+                                VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+                                VkAccessFlags srcAccess, VkPipelineStageFlags srcStage) {
+    if (srcFamily == dstFamily) {
+        return;
+    }
+    imageBarrier(commandBuffer, image, range, oldLayout, newLayout, srcFamily, dstFamily, srcAccess, 0,
+                srcStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+}
+
+void ComputeQueue::acquireImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+                                VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+                                VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    imageBarrier(commandBuffer, image, range, oldLayout, newLayout, srcFamily, dstFamily, 0, dstAccess,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage);
+}
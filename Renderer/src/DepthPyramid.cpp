@@ -0,0 +1,272 @@
+#include "DepthPyramid.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+static uint32_t floorPowerOfTwo(uint32_t value) {
+    uint32_t result = 1;
+    while (result * 2 <= value) {
+        result *= 2;
+    }
+    return result;
+}
+
+DepthPyramid::DepthPyramid() : device(VK_NULL_HANDLE),
+                            resources(nullptr),
+                            setLayout(VK_NULL_HANDLE),
+                            descriptorPool(VK_NULL_HANDLE),
+                            extent{0, 0},
+                            levelCount(0),
+                            depthView(VK_NULL_HANDLE) {}
+
+void DepthPyramid::init(VkDevice device, ResourceManager& resources, VkShaderModule reduceShader) {
+    this->device = device;
+    this->resources = &resources;
+
+    // 0 the level below, 1 the level written
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = DEPTH_PYRAMID_MAX_LEVELS;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = DEPTH_PYRAMID_MAX_LEVELS;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = DEPTH_PYRAMID_MAX_LEVELS;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid descriptor pool!");
+    }
+
+    // Allocated once for the most levels there can be, resize only rewrites them
+    std::vector<VkDescriptorSetLayout> layouts(DEPTH_PYRAMID_MAX_LEVELS, setLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = DEPTH_PYRAMID_MAX_LEVELS;
+    allocInfo.pSetLayouts = layouts.data();
+
+    descriptorSets.resize(DEPTH_PYRAMID_MAX_LEVELS);
+    if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!");
+    }
+
+    // Size of the part of the source that is reduced
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(int32_t) * 2;
+
+    VkPipelineLayout pipelineLayout;
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = reduceShader;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    VkPipeline computePipeline;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        throw std::runtime_error("Failed to create depth pyramid pipeline!");
+    }
+    pipeline = resources.addPipeline(computePipeline, pipelineLayout);
+
+    // Only read with texelFetch, the filter never matters
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    sampler = resources.createSampler(samplerInfo);
+}
+
+void DepthPyramid::shutdown() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    destroyViews();
+    resources->destroy(image);
+    resources->destroy(pipeline);
+    resources->destroy(sampler);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::resize(VkImage depthImage, VkFormat depthFormat, VkExtent2D depthExtent) {
+    destroyViews();
+    resources->destroy(image);
+
+    // Power of two sizes halve evenly all the way down to 1x1
+    extent = {floorPowerOfTwo(depthExtent.width), floorPowerOfTwo(depthExtent.height)};
+    levelCount = 1;
+    while ((std::max(extent.width, extent.height) >> levelCount) > 0) {
+        levelCount++;
+    }
+    levelCount = std::min(levelCount, DEPTH_PYRAMID_MAX_LEVELS);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image = resources->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                MemoryCategory::RenderTargets);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    viewInfo.image = depthImage;
+    viewInfo.format = depthFormat;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (vkCreateImageView(device, &viewInfo, nullptr, &depthView) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid source view!");
+    }
+
+    viewInfo.image = resources->get(image)->image;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    levelViews.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        viewInfo.subresourceRange.baseMipLevel = level;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create depth pyramid level view!");
+        }
+    }
+
+    std::vector<VkDescriptorImageInfo> imageInfos(levelCount * 2);
+    std::vector<VkWriteDescriptorSet> writes(levelCount * 2);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        VkDescriptorImageInfo& source = imageInfos[level * 2];
+        source.sampler = resources->get(sampler)->sampler;
+        source.imageView = level == 0 ? depthView : levelViews[level - 1];
+        source.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo& destination = imageInfos[level * 2 + 1];
+        destination.imageView = levelViews[level];
+        destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        for (uint32_t binding = 0; binding < 2; binding++) {
+            VkWriteDescriptorSet& write = writes[level * 2 + binding];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = descriptorSets[level];
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER :
+                                                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write.pImageInfo = &imageInfos[level * 2 + binding];
+        }
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void DepthPyramid::record(VkCommandBuffer commandBuffer, VkPipelineStageFlags readStages, VkExtent2D depthExtent) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = resources->get(image)->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = levelCount;
+    barrier.subresourceRange.layerCount = 1;
+
+    // Every level is written again, so the previous frame's pyramid is
+    // dropped instead of transitioned
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    vkCmdPipelineBarrier(commandBuffer, readStages | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    const Pipeline* reduce = resources->get(pipeline);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reduce->pipeline);
+
+    // Each level reads the one written just before it
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.subresourceRange.levelCount = 1;
+    int32_t sourceSize[2] = {static_cast<int32_t>(depthExtent.width), static_cast<int32_t>(depthExtent.height)};
+    for (uint32_t level = 0; level < levelCount; level++) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reduce->layout, 0, 1,
+                            &descriptorSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, reduce->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sourceSize),
+                        sourceSize);
+        uint32_t width = std::max(extent.width >> level, 1u);
+        uint32_t height = std::max(extent.height >> level, 1u);
+        vkCmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1);
+        sourceSize[0] = static_cast<int32_t>(width);
+        sourceSize[1] = static_cast<int32_t>(height);
+
+        barrier.subresourceRange.baseMipLevel = level;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | readStages, 0, 0, nullptr, 0, nullptr,
+                            1, &barrier);
+    }
+}
+
+VkImageView DepthPyramid::getView() {
+    const Image* pyramid = resources->get(image);
+    return pyramid ? pyramid->view : VK_NULL_HANDLE;
+}
+
+void DepthPyramid::destroyViews() {
+    for (VkImageView view : levelViews) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    levelViews.clear();
+    vkDestroyImageView(device, depthView, nullptr);
+    depthView = VK_NULL_HANDLE;
+}
@@ -0,0 +1,109 @@
+#include "DrawPackets.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+void sortDrawPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch) {
+    const size_t count = packets.size();
+    if (count < 2) {
+        return;
+    }
+    scratch.resize(count);
+
+    // All eight histograms in one pass over the keys
+    std::array<std::array<uint32_t, 256>, 8> histograms{};
+    for (const auto& packet : packets) {
+        for (uint32_t digit = 0; digit < 8; digit++) {
+            histograms[digit][(packet.key >> (digit * 8)) & 0xff]++;
+        }
+    }
+
+    DrawPacket* source = packets.data();
+    DrawPacket* destination = scratch.data();
+    for (uint32_t digit = 0; digit < 8; digit++) {
+        std::array<uint32_t, 256>& histogram = histograms[digit];
+        // Every key has the same digit, the pass would not move anything
+        if (histogram[(source[0].key >> (digit * 8)) & 0xff] == count) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (auto& bucket : histogram) {
+            uint32_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+        for (size_t i = 0; i < count; i++) {
+            destination[histogram[(source[i].key >> (digit * 8)) & 0xff]++] = source[i];
+        }
+        std::swap(source, destination);
+    }
+
+    if (source != packets.data()) {
+        packets.swap(scratch);
+    }
+}
+
+BindState::BindState(VkCommandBuffer commandBuffer, DrawStats& stats) : commandBuffer(commandBuffer),
+                                                                    stats(stats),
+                                                                    pipeline(VK_NULL_HANDLE),
+                                                                    descriptorSetCount(0),
+                                                                    vertexBufferCount(0),
+                                                                    indexBuffer(VK_NULL_HANDLE),
+                                                                    indexType(VK_INDEX_TYPE_UINT32) {
+}
+
+bool BindState::bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline newPipeline) {
+    if (newPipeline == pipeline) {
+        stats.redundantBinds++;
+        return false;
+    }
+    vkCmdBindPipeline(commandBuffer, bindPoint, newPipeline);
+    pipeline = newPipeline;
+    // The new layout may not be compatible with the bound sets
+    descriptorSetCount = 0;
+    stats.pipelineBinds++;
+    return true;
+}
+
+void BindState::bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, const VkDescriptorSet* sets,
+                                uint32_t count) {
+    if (count > MAX_BOUND_DESCRIPTOR_SETS) {
+        throw std::runtime_error("Too many descriptor sets bound at once!");
+    }
+    if (count == descriptorSetCount && std::equal(sets, sets + count, descriptorSets.begin())) {
+        stats.redundantBinds++;
+        return;
+    }
+    vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, 0, count, sets, 0, nullptr);
+    std::copy(sets, sets + count, descriptorSets.begin());
+    descriptorSetCount = count;
+    stats.descriptorSetBinds++;
+}
+
+void BindState::bindVertexBuffers(const VkBuffer* buffers, uint32_t count) {
+    static const std::array<VkDeviceSize, MAX_BOUND_VERTEX_BUFFERS> offsets{};
+    if (count > MAX_BOUND_VERTEX_BUFFERS) {
+        throw std::runtime_error("Too many vertex buffers bound at once!");
+    }
+    if (count == vertexBufferCount && std::equal(buffers, buffers + count, vertexBuffers.begin())) {
+        stats.redundantBinds++;
+        return;
+    }
+    vkCmdBindVertexBuffers(commandBuffer, 0, count, buffers, offsets.data());
+    std::copy(buffers, buffers + count, vertexBuffers.begin());
+    vertexBufferCount = count;
+    stats.vertexBufferBinds++;
+}
+
+void BindState::bindIndexBuffer(VkBuffer buffer, VkIndexType type) {
+    if (buffer == indexBuffer && type == indexType) {
+        stats.redundantBinds++;
+        return;
+    }
+    vkCmdBindIndexBuffer(commandBuffer, buffer, 0, type);
+    indexBuffer = buffer;
+    indexType = type;
+    stats.indexBufferBinds++;
+}
@@ -0,0 +1,412 @@
+#include "FrameCapture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+static const std::array<uint32_t, 256> crcTable = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (uint32_t bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+static uint32_t crc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < size; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        // The most bytes the sums can take before they overflow 32 bits
+        size_t count = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < count; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += count;
+        size -= count;
+    }
+    return b << 16 | a;
+}
+
+static void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Chunk data is appended by write, length and CRC are filled in around it
+template<typename F>
+static void appendChunk(std::vector<uint8_t>& png, const char* type, F write) {
+    const size_t start = png.size();
+    appendBigEndian(png, 0);
+    png.insert(png.end(), type, type + 4);
+    write();
+    const uint32_t length = static_cast<uint32_t>(png.size() - start - 8);
+    for (uint32_t i = 0; i < 4; i++) {
+        png[start + i] = static_cast<uint8_t>(length >> (24 - i * 8));
+    }
+    appendBigEndian(png, crc32(png.data() + start + 4, length + 4));
+}
+
+void encodePng(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& png) {
+    // Every row starts with its filter type, 0 for none
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    const size_t rawSize = (rowBytes + 1) * height;
+    const size_t maxBlock = 65535;
+
+    png.clear();
+    png.reserve(rawSize + (rawSize / maxBlock + 1) * 5 + 64);
+    const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    png.insert(png.end(), signature, signature + sizeof(signature));
+
+    appendChunk(png, "IHDR", [&] {
+        appendBigEndian(png, width);
+        appendBigEndian(png, height);
+        // 8 bits per channel, RGBA, deflate, no filtering method, no interlace
+        const uint8_t format[] = {8, 6, 0, 0, 0};
+        png.insert(png.end(), format, format + sizeof(format));
+    });
+
+    appendChunk(png, "IDAT", [&] {
+        // zlib stream of stored deflate blocks, none larger than 64 KiB
+        png.push_back(0x78);
+        png.push_back(0x01);
+
+        uint32_t adler = 1;
+        size_t blockLeft = 0;
+        size_t rawLeft = rawSize;
+        auto write = [&](const uint8_t* data, size_t size) {
+            adler = adler32(adler, data, size);
+            while (size > 0) {
+                if (blockLeft == 0) {
+                    blockLeft = std::min(rawLeft, maxBlock);
+                    rawLeft -= blockLeft;
+                    const uint16_t length = static_cast<uint16_t>(blockLeft);
+                    const uint16_t inverse = static_cast<uint16_t>(~length);
+                    png.push_back(rawLeft == 0 ? 1 : 0);
+                    png.push_back(static_cast<uint8_t>(length));
+                    png.push_back(static_cast<uint8_t>(length >> 8));
+                    png.push_back(static_cast<uint8_t>(inverse));
+                    png.push_back(static_cast<uint8_t>(inverse >> 8));
+                }
+                size_t count = std::min(size, blockLeft);
+                png.insert(png.end(), data, data + count);
+                data += count;
+                size -= count;
+                blockLeft -= count;
+            }
+        };
+
+        const uint8_t filter = 0;
+        for (uint32_t y = 0; y < height; y++) {
+            write(&filter, 1);
+            write(pixels + rowBytes * y, rowBytes);
+        }
+        appendBigEndian(png, adler);
+    });
+
+    appendChunk(png, "IEND", [] {});
+}
+
+FrameCapture::Session::~Session() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+FrameCapture::FrameCapture() : resources(nullptr),
+                            stopping(false) {
+}
+
+FrameCapture::~FrameCapture() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void FrameCapture::init(ResourceManager& resources) {
+    this->resources = &resources;
+    slots.resize(CAPTURE_RING_SIZE);
+
+    stopping = false;
+    thread = std::thread(&FrameCapture::encodeLoop, this);
+}
+
+void FrameCapture::shutdown() {
+    // Nothing is in flight any more, every recorded copy has landed
+    collect(UINT64_MAX);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        session.reset();
+    }
+    queueCondition.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    for (auto& slot : slots) {
+        resources->destroy(slot.buffer);
+    }
+    slots.clear();
+}
+
+void FrameCapture::start(CaptureOutput output, const std::string& path, CaptureCallback callback) {
+    auto newSession = std::make_shared<Session>();
+    newSession->output = output;
+    newSession->path = path;
+    newSession->callback = std::move(callback);
+
+    if (output == CaptureOutput::Png) {
+        std::error_code error;
+        std::filesystem::create_directories(path, error);
+        if (error) {
+            throw std::runtime_error("Failed to create capture directory " + path + "!");
+        }
+    } else if (output == CaptureOutput::RawVideo) {
+        newSession->file = fopen(path.c_str(), "wb");
+        if (!newSession->file) {
+            throw std::runtime_error("Failed to open capture file " + path + "!");
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    session = std::move(newSession);
+}
+
+void FrameCapture::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    session.reset();
+}
+
+bool FrameCapture::isCapturing() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return session != nullptr;
+}
+
+CaptureStats FrameCapture::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+bool FrameCapture::record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent,
+                        uint64_t frame) {
+    bool bgra;
+    switch (format) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        bgra = true;
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        bgra = false;
+        break;
+    default:
+        return false;
+    }
+    if (extent.width == 0 || extent.height == 0) {
+        return false;
+    }
+
+    VkBuffer buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!session) {
+            return false;
+        }
+        auto slot = std::find_if(slots.begin(), slots.end(),
+                                [](const Slot& slot) { return slot.state == SlotState::Free; });
+        if (slot == slots.end()) {
+            stats.dropped++;
+            return false;
+        }
+
+        // Buffers only grow, a smaller swapchain reuses them as they are
+        const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+        if (slot->size < size) {
+            resources->destroy(slot->buffer);
+            slot->buffer = resources->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::Readback,
+                                                MemoryCategory::Staging);
+            slot->size = size;
+        }
+        slot->state = SlotState::Pending;
+        slot->frame = frame;
+        slot->extent = extent;
+        slot->bgra = bgra;
+        slot->session = session;
+        stats.captured++;
+        buffer = resources->get(slot->buffer)->buffer;
+    }
+
+    // The render pass left the image ready to present, it goes back to that
+    // layout once the copy has read it
+    std::array<VkImageMemoryBarrier, 2> imageBarriers{};
+    for (auto& barrier : imageBarriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+    }
+    imageBarriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    imageBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarriers[1].srcAccessMask = 0;
+    imageBarriers[1].dstAccessMask = 0;
+    imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        0, 0, nullptr, 0, nullptr, 1, &imageBarriers[0]);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    // Tightly packed rows
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+    // The fence of the frame then makes the copy visible to the host
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = buffer;
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        0, 0, nullptr, 1, &bufferBarrier, 1, &imageBarriers[1]);
+    return true;
+}
+
+void FrameCapture::collect(uint64_t completedFrame) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t queued = queue.size();
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].state == SlotState::Pending && slots[i].frame <= completedFrame) {
+            slots[i].state = SlotState::Encoding;
+            queue.push_back(i);
+        }
+    }
+    if (queue.size() == queued) {
+        return;
+    }
+    // Encoded in the order they were rendered, whatever slots they took
+    std::sort(queue.begin() + queued, queue.end(),
+            [this](uint32_t a, uint32_t b) { return slots[a].frame < slots[b].frame; });
+    queueCondition.notify_one();
+}
+
+void FrameCapture::encodeLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+        // Frames already handed over are still written when stopping
+        if (queue.empty()) {
+            return;
+        }
+        Slot& slot = slots[queue.front()];
+        queue.pop_front();
+        lock.unlock();
+
+        try {
+            encode(slot);
+        } catch (const std::exception& e) {
+            // The session keeps going, a later frame may well succeed
+            std::cerr << "Frame capture failed to encode frame " << slot.frame << ": " << e.what() << "\n";
+        }
+
+        // Dropping the last reference to an ended session closes its file,
+        // better done without holding the lock
+        slot.session.reset();
+        lock.lock();
+        slot.state = SlotState::Free;
+        stats.encoded++;
+    }
+}
+
+void FrameCapture::encode(Slot& slot) {
+    // The slot is not touched by anyone else until it is free again
+    const Buffer* buffer = resources->get(slot.buffer);
+    const uint8_t* source = static_cast<const uint8_t*>(buffer->mapped);
+    const size_t size = static_cast<size_t>(slot.extent.width) * slot.extent.height * 4;
+    Session& output = *slot.session;
+
+    const uint8_t* rgba = source;
+    if (slot.bgra) {
+        pixels.resize(size);
+        for (size_t i = 0; i < size; i += 4) {
+            pixels[i] = source[i + 2];
+            pixels[i + 1] = source[i + 1];
+            pixels[i + 2] = source[i];
+            pixels[i + 3] = source[i + 3];
+        }
+        rgba = pixels.data();
+    }
+
+    if (output.callback) {
+        output.callback({slot.frame, slot.extent.width, slot.extent.height, rgba});
+    }
+
+    if (output.output == CaptureOutput::Png) {
+        encodePng(rgba, slot.extent.width, slot.extent.height, encoded);
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(slot.frame));
+        const std::string path = (std::filesystem::path(output.path) / name).string();
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Failed to open " + path + "!");
+        }
+        const size_t written = fwrite(encoded.data(), 1, encoded.size(), file);
+        fclose(file);
+        if (written != encoded.size()) {
+            throw std::runtime_error("Failed to write " + path + "!");
+        }
+    } else if (output.output == CaptureOutput::RawVideo) {
+        if (output.extent.width == 0) {
+            output.extent = slot.extent;
+        }
+        if (output.extent.width != slot.extent.width || output.extent.height != slot.extent.height) {
+            return;
+        }
+        if (fwrite(rgba, 1, size, output.file) != size) {
+            throw std::runtime_error("Failed to write " + output.path + "!");
+        }
+    }
+}
@@ -0,0 +1,265 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#elif _WIN32
+#include <windows.h>
+#endif
+
+// Queue the current thread works on, per job system it belongs to
+static thread_local const JobSystem* currentJobSystem = nullptr;
+static thread_local uint32_t currentQueueIndex = 0;
+
+JobSystem::JobSystem(const JobSystemConfig& config) : queuedJobs(0), stopping(false) {
+    uint32_t workerCount = config.workerCount;
+    if (workerCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+
+    for (uint32_t i = 0; i <= workerCount; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    unsigned int coreCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+
+        if (i < config.workerCores.size()) {
+            pinThread(workers.back(), config.workerCores[i]);
+        } else if (config.pinWorkers) {
+            pinThread(workers.back(), (config.firstCore + i) % coreCount);
+        }
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Without workers nothing has run the queued jobs yet
+    while (runOne(currentQueue())) {
+    }
+}
+
+void JobSystem::pinThread(std::thread& thread, uint32_t core) {
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet);
+#elif _WIN32
+    SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core);
+#else
+    (void) thread;
+    (void) core;
+#endif
+}
+
+void JobSystem::setTimingCallback(JobTimingCallback callback) {
+    timingCallback = std::move(callback);
+}
+
+uint32_t JobSystem::currentQueue() const {
+    if (currentJobSystem == this) {
+        return currentQueueIndex;
+    }
+    return static_cast<uint32_t>(workers.size());
+}
+
+JobHandle JobSystem::submit(const char* name, std::function<void()> function,
+                            const std::vector<JobHandle>& dependencies) {
+    auto job = std::make_shared<Job>();
+    job->function = std::move(function);
+    job->name = name;
+
+    // The extra count keeps the job from starting while dependencies are
+    // still being registered
+    job->pendingDependencies = static_cast<uint32_t>(dependencies.size()) + 1;
+    for (const auto& dependency : dependencies) {
+        bool alreadyFinished;
+        {
+            std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+            alreadyFinished = dependency->isFinished();
+            if (!alreadyFinished) {
+                dependency->continuations.push_back(job);
+            }
+        }
+        if (alreadyFinished) {
+            job->pendingDependencies--;
+        }
+    }
+
+    if (--job->pendingDependencies == 0) {
+        enqueue(job);
+    }
+
+    return job;
+}
+
+void JobSystem::enqueue(const JobHandle& job) {
+    WorkQueue& queue = *queues[currentQueue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    queuedJobs++;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeCondition.notify_one();
+}
+
+bool JobSystem::runOne(uint32_t queueIndex) {
+    JobHandle job;
+
+    // Newest job from our own queue first, it is the most likely to be cache hot
+    {
+        WorkQueue& own = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+        }
+    }
+
+    // Otherwise steal the oldest job of another queue
+    for (size_t offset = 1; !job && offset < queues.size(); offset++) {
+        WorkQueue& victim = *queues[(queueIndex + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+        }
+    }
+
+    if (!job) {
+        return false;
+    }
+
+    queuedJobs--;
+    execute(job, queueIndex);
+    return true;
+}
+
+void JobSystem::execute(const JobHandle& job, uint32_t queueIndex) {
+    auto start = std::chrono::high_resolution_clock::now();
+    try {
+        job->function();
+    } catch (...) {
+        job->error = std::current_exception();
+    }
+    if (timingCallback) {
+        timingCallback({job->name, queueIndex, start, std::chrono::high_resolution_clock::now()});
+    }
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->continuationMutex);
+        job->finished.store(true, std::memory_order_release);
+        continuations.swap(job->continuations);
+    }
+
+    for (const auto& continuation : continuations) {
+        if (--continuation->pendingDependencies == 0) {
+            enqueue(continuation);
+        }
+    }
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+    currentJobSystem = this;
+    currentQueueIndex = index;
+
+    while (true) {
+        if (runOne(index)) {
+            continue;
+        }
+
+        // Workers only stop once the queues are drained, a job still running
+        // elsewhere queues its continuations before its worker looks again
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeCondition.wait(lock, [this]() { return stopping || queuedJobs > 0; });
+        if (stopping && queuedJobs == 0) {
+            return;
+        }
+    }
+}
+
+void JobSystem::helpUntilFinished(const JobHandle& job) {
+    uint32_t queueIndex = currentQueue();
+    while (!job->isFinished()) {
+        if (!runOne(queueIndex)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    helpUntilFinished(job);
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+void JobSystem::waitAll(const std::vector<JobHandle>& jobs) {
+    // Every job has to finish before an error is reported, callers usually
+    // hand out references to their stack
+    for (const auto& job : jobs) {
+        helpUntilFinished(job);
+    }
+    for (const auto& job : jobs) {
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& fn,
+                            const char* name) {
+    if (count == 0) {
+        return;
+    }
+    grainSize = std::max<size_t>(grainSize, 1);
+
+    // A few ranges per thread so stealing can even out uneven ranges
+    size_t threadCount = workers.size() + 1;
+    size_t rangeCount = std::min((count + grainSize - 1) / grainSize, threadCount * 4);
+    if (rangeCount <= 1) {
+        fn(0, count);
+        return;
+    }
+
+    size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+    std::vector<JobHandle> jobs;
+    jobs.reserve(rangeCount);
+    for (size_t begin = rangeSize; begin < count; begin += rangeSize) {
+        size_t end = std::min(begin + rangeSize, count);
+        jobs.push_back(submit(name, [&fn, begin, end]() { fn(begin, end); }));
+    }
+
+    // The caller takes the first range itself
+    std::exception_ptr error;
+    try {
+        fn(0, rangeSize);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    waitAll(jobs);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
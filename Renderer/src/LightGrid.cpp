@@ -0,0 +1,179 @@
+#include "LightGrid.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// One invocation per cluster
+static const uint32_t CULL_GROUP_SIZE = 64;
+
+LightGrid::LightGrid() : device(VK_NULL_HANDLE),
+                        resources(nullptr),
+                        setLayout(VK_NULL_HANDLE),
+                        descriptorPool(VK_NULL_HANDLE) {}
+
+void LightGrid::init(VkDevice device, ResourceManager& resources, VkShaderModule cullShader, uint32_t frameCount) {
+    this->device = device;
+    this->resources = &resources;
+
+    // 0 the constants, 1 the lights, 2 the light count and 3 the light
+    // indices of every cluster
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lighting descriptor set layout!");
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = frameCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = 3 * frameCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frameCount;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lighting descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frameCount, setLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = frameCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    descriptorSets.resize(frameCount);
+    if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate lighting descriptor sets!");
+    }
+
+    // Everything is read by both queues: the constants and lights are written
+    // by the host, the grid by the culling pass
+    constantBuffers.resize(frameCount);
+    lightBuffers.resize(frameCount);
+    countBuffers.resize(frameCount);
+    indexBuffers.resize(frameCount);
+    for (uint32_t i = 0; i < frameCount; i++) {
+        constantBuffers[i] = resources.createBuffer(sizeof(LightingConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                    MemoryUsage::Dynamic, MemoryCategory::Uniforms, BufferSharing::Concurrent);
+        lightBuffers[i] = resources.createBuffer(sizeof(LightData) * LIGHT_GRID_MAX_LIGHTS,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::Dynamic, MemoryCategory::Uniforms,
+                    BufferSharing::Concurrent);
+        countBuffers[i] = resources.createBuffer(sizeof(uint32_t) * LIGHT_GRID_CLUSTERS,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Uniforms,
+                    BufferSharing::Concurrent);
+        indexBuffers[i] = resources.createBuffer(sizeof(uint32_t) * LIGHT_GRID_CLUSTERS * LIGHT_CLUSTER_CAPACITY,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Uniforms,
+                    BufferSharing::Concurrent);
+
+        std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+        bufferInfos[0].buffer = resources.get(constantBuffers[i])->buffer;
+        bufferInfos[1].buffer = resources.get(lightBuffers[i])->buffer;
+        bufferInfos[2].buffer = resources.get(countBuffers[i])->buffer;
+        bufferInfos[3].buffer = resources.get(indexBuffers[i])->buffer;
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            bufferInfos[binding].offset = 0;
+            bufferInfos[binding].range = VK_WHOLE_SIZE;
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = descriptorSets[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = bindings[binding].descriptorType;
+            writes[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    VkPipelineLayout pipelineLayout;
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light culling pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = cullShader;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    VkPipeline computePipeline;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        throw std::runtime_error("Failed to create light culling pipeline!");
+    }
+    pipeline = resources.addPipeline(computePipeline, pipelineLayout);
+}
+
+void LightGrid::shutdown() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    for (size_t i = 0; i < descriptorSets.size(); i++) {
+        resources->destroy(constantBuffers[i]);
+        resources->destroy(lightBuffers[i]);
+        resources->destroy(countBuffers[i]);
+        resources->destroy(indexBuffers[i]);
+    }
+    resources->destroy(pipeline);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void LightGrid::update(size_t frame, const std::vector<LightData>& lights, const glm::mat4& view,
+                    const glm::mat4& projection, float nearPlane, float farPlane, VkExtent2D extent) {
+    uint32_t lightCount = static_cast<uint32_t>(std::min<size_t>(lights.size(), LIGHT_GRID_MAX_LIGHTS));
+    if (lightCount > 0) {
+        memcpy(resources->get(lightBuffers[frame])->mapped, lights.data(), sizeof(LightData) * lightCount);
+    }
+
+    // slice = LIGHT_GRID_Z * log(depth / near) / log(far / near)
+    float logRange = std::log(farPlane / nearPlane);
+    float sliceScale = LIGHT_GRID_Z / logRange;
+
+    LightingConstants constants;
+    constants.view = view;
+    constants.inverseProjection = glm::inverse(projection);
+    constants.depthParams = glm::vec4(nearPlane, farPlane, sliceScale, -sliceScale * std::log(nearPlane));
+    constants.tileParams = glm::vec4(std::ceil(extent.width / (float) LIGHT_GRID_X),
+                                    std::ceil(extent.height / (float) LIGHT_GRID_Y),
+                                    (float) extent.width, (float) extent.height);
+    constants.grid = glm::uvec4(LIGHT_GRID_X, LIGHT_GRID_Y, LIGHT_GRID_Z, lightCount);
+    memcpy(resources->get(constantBuffers[frame])->mapped, &constants, sizeof(LightingConstants));
+}
+
+void LightGrid::record(VkCommandBuffer commandBuffer, size_t frame) {
+    // Runs even without lights, the counts have to be cleared
+    const Pipeline* cull = resources->get(pipeline);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull->layout, 0, 1,
+                        &descriptorSets[frame], 0, nullptr);
+    vkCmdDispatch(commandBuffer, (LIGHT_GRID_CLUSTERS + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
@@ -0,0 +1,352 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace {
+
+// Symmetric 4x4 matrix summing squared distances to a set of planes, each
+// weighted by the area it came from
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    static Quadric fromPlane(double nx, double ny, double nz, double d, double weight) {
+        Quadric q;
+        q.a00 = nx * nx * weight; q.a01 = nx * ny * weight; q.a02 = nx * nz * weight; q.a03 = nx * d * weight;
+        q.a11 = ny * ny * weight; q.a12 = ny * nz * weight; q.a13 = ny * d * weight;
+        q.a22 = nz * nz * weight; q.a23 = nz * d * weight;
+        q.a33 = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+    }
+
+    double evaluate(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                    + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                    + a22 * z * z + 2 * a23 * z
+                    + a33;
+        return std::max(result, 0.0);
+    }
+};
+
+// Boundary planes get this much more weight than the surface so open
+// edges keep their silhouette
+const double BOUNDARY_WEIGHT = 10.0;
+
+struct Collapse {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t fromVersion;
+    uint32_t toVersion;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+class Simplifier {
+public:
+    Simplifier(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+        : positions(positions),
+          triangles(indices),
+          triangleAlive(indices.size() / 3, true),
+          liveTriangles(indices.size() / 3),
+          quadrics(positions.size()),
+          vertexTriangles(positions.size()),
+          versions(positions.size(), 0),
+          locked(positions.size(), false) {}
+
+    std::vector<uint32_t> run(size_t targetIndexCount, float& error) {
+        lockSeams();
+        buildQuadrics();
+        for (uint32_t t = 0; t < triangleAlive.size(); t++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t a = triangles[t * 3 + k];
+                uint32_t b = triangles[t * 3 + (k + 1) % 3];
+                // Every interior edge is seen twice, once from each side
+                if (a < b || isBoundary(a, b)) {
+                    pushCollapse(a, b);
+                }
+            }
+        }
+
+        double worstError = 0.0;
+        while (liveTriangles * 3 > targetIndexCount && !heap.empty()) {
+            Collapse collapse = heap.top();
+            heap.pop();
+
+            if (versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion ||
+                !canCollapse(collapse.from, collapse.to)) {
+                continue;
+            }
+
+            Quadric merged = quadrics[collapse.from];
+            merged.add(quadrics[collapse.to]);
+            double deviation = std::sqrt(collapse.cost / std::max(merged.weight, 1e-20));
+            worstError = std::max(worstError, deviation);
+
+            performCollapse(collapse.from, collapse.to);
+        }
+        error = static_cast<float>(worstError);
+
+        std::vector<uint32_t> result;
+        result.reserve(liveTriangles * 3);
+        for (uint32_t t = 0; t < triangleAlive.size(); t++) {
+            if (triangleAlive[t]) {
+                result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+            }
+        }
+        return result;
+    }
+
+private:
+    // Vertices that share a position but not an index carry different
+    // attributes (normals, uvs); moving one would tear the surface apart
+    void lockSeams() {
+        std::vector<uint32_t> order(positions.size());
+        for (uint32_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        auto less = [this](uint32_t a, uint32_t b) {
+            const glm::vec3& pa = positions[a];
+            const glm::vec3& pb = positions[b];
+            if (pa.x != pb.x) return pa.x < pb.x;
+            if (pa.y != pb.y) return pa.y < pb.y;
+            return pa.z < pb.z;
+        };
+        std::sort(order.begin(), order.end(), less);
+        for (size_t i = 1; i < order.size(); i++) {
+            if (!less(order[i - 1], order[i])) {
+                locked[order[i - 1]] = true;
+                locked[order[i]] = true;
+            }
+        }
+    }
+
+    void buildQuadrics() {
+        for (uint32_t t = 0; t < triangleAlive.size(); t++) {
+            const uint32_t* tri = &triangles[t * 3];
+            for (uint32_t k = 0; k < 3; k++) {
+                vertexTriangles[tri[k]].push_back(t);
+            }
+
+            glm::vec3 p0 = positions[tri[0]];
+            glm::vec3 normal = glm::cross(positions[tri[1]] - p0, positions[tri[2]] - p0);
+            double length = glm::length(normal);
+            if (length <= 0.0) {
+                continue;
+            }
+            double area = length * 0.5;
+            double nx = normal.x / length, ny = normal.y / length, nz = normal.z / length;
+            double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+            Quadric plane = Quadric::fromPlane(nx, ny, nz, d, area);
+            for (uint32_t k = 0; k < 3; k++) {
+                quadrics[tri[k]].add(plane);
+            }
+        }
+
+        // A plane through each open edge, perpendicular to its triangle,
+        // penalises sliding boundary vertices inwards
+        for (uint32_t t = 0; t < triangleAlive.size(); t++) {
+            const uint32_t* tri = &triangles[t * 3];
+            glm::vec3 p0 = positions[tri[0]];
+            glm::vec3 normal = glm::cross(positions[tri[1]] - p0, positions[tri[2]] - p0);
+            if (glm::length(normal) <= 0.0f) {
+                continue;
+            }
+            normal = glm::normalize(normal);
+
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t a = tri[k];
+                uint32_t b = tri[(k + 1) % 3];
+                if (!isBoundary(a, b)) {
+                    continue;
+                }
+                glm::vec3 edge = positions[b] - positions[a];
+                glm::vec3 side = glm::cross(edge, normal);
+                double length = glm::length(side);
+                if (length <= 0.0) {
+                    continue;
+                }
+                double nx = side.x / length, ny = side.y / length, nz = side.z / length;
+                double d = -(nx * positions[a].x + ny * positions[a].y + nz * positions[a].z);
+                double weight = glm::dot(edge, edge) * BOUNDARY_WEIGHT;
+                // The constraint must not dilute the area normalisation of the error
+                Quadric plane = Quadric::fromPlane(nx, ny, nz, d, weight);
+                plane.weight = 0.0;
+                quadrics[a].add(plane);
+                quadrics[b].add(plane);
+            }
+        }
+    }
+
+    // Only one live triangle uses the directed edge a->b or b->a
+    bool isBoundary(uint32_t a, uint32_t b) const {
+        uint32_t count = 0;
+        for (uint32_t t : vertexTriangles[a]) {
+            if (!triangleAlive[t]) {
+                continue;
+            }
+            const uint32_t* tri = &triangles[t * 3];
+            if (tri[0] == b || tri[1] == b || tri[2] == b) {
+                count++;
+            }
+        }
+        return count == 1;
+    }
+
+    void pushCollapse(uint32_t a, uint32_t b) {
+        if (locked[a] && locked[b]) {
+            return;
+        }
+        Quadric merged = quadrics[a];
+        merged.add(quadrics[b]);
+
+        // Moving a onto b keeps b's position and vice versa
+        double costAB = locked[a] ? INFINITY : merged.evaluate(positions[b]);
+        double costBA = locked[b] ? INFINITY : merged.evaluate(positions[a]);
+        if (costAB <= costBA) {
+            heap.push({costAB, a, b, versions[a], versions[b]});
+        } else {
+            heap.push({costBA, b, a, versions[b], versions[a]});
+        }
+    }
+
+    // Rejects collapses that turn a triangle around from might flip over
+    bool canCollapse(uint32_t from, uint32_t to) const {
+        const glm::vec3& target = positions[to];
+        for (uint32_t t : vertexTriangles[from]) {
+            if (!triangleAlive[t]) {
+                continue;
+            }
+            const uint32_t* tri = &triangles[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                continue;
+            }
+
+            glm::vec3 p[3] = {positions[tri[0]], positions[tri[1]], positions[tri[2]]};
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for (uint32_t k = 0; k < 3; k++) {
+                if (tri[k] == from) {
+                    p[k] = target;
+                }
+            }
+            glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, after) <= 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void performCollapse(uint32_t from, uint32_t to) {
+        for (uint32_t t : vertexTriangles[from]) {
+            if (!triangleAlive[t]) {
+                continue;
+            }
+            uint32_t* tri = &triangles[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                triangleAlive[t] = false;
+                liveTriangles--;
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                if (tri[k] == from) {
+                    tri[k] = to;
+                }
+            }
+            vertexTriangles[to].push_back(t);
+        }
+        vertexTriangles[from].clear();
+        quadrics[to].add(quadrics[from]);
+
+        // Drop dead triangles so the neighbourhood walks stay short
+        std::vector<uint32_t>& around = vertexTriangles[to];
+        around.erase(std::remove_if(around.begin(), around.end(), [this](uint32_t t) {
+            return !triangleAlive[t];
+        }), around.end());
+
+        versions[from]++;
+        versions[to]++;
+
+        neighbours.clear();
+        for (uint32_t t : around) {
+            for (uint32_t k = 0; k < 3; k++) {
+                if (triangles[t * 3 + k] != to) {
+                    neighbours.push_back(triangles[t * 3 + k]);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (uint32_t neighbour : neighbours) {
+            pushCollapse(to, neighbour);
+        }
+    }
+
+    const std::vector<glm::vec3>& positions;
+    std::vector<uint32_t> triangles;
+    std::vector<bool> triangleAlive;
+    size_t liveTriangles;
+
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<uint32_t>> vertexTriangles;
+    // Bumped whenever a vertex's quadric or neighbourhood changes, queued
+    // collapses recorded against an older version are stale
+    std::vector<uint32_t> versions;
+    std::vector<bool> locked;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+    std::vector<uint32_t> neighbours;
+};
+
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                size_t targetIndexCount, float& error) {
+    error = 0.0f;
+    if (indices.size() <= targetIndexCount) {
+        return indices;
+    }
+    Simplifier simplifier(positions, indices);
+    return simplifier.run(targetIndexCount, error);
+}
+
+std::vector<LodLevel> generateLods(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                const LodSettings& settings) {
+    std::vector<LodLevel> levels;
+    levels.push_back({indices, 0.0f});
+
+    while (levels.size() < settings.maxLevels) {
+        const LodLevel& previous = levels.back();
+        size_t target = static_cast<size_t>(previous.indices.size() / 3 * settings.reduction) * 3;
+        if (target < 3) {
+            break;
+        }
+
+        // Each level starts from the previous one, so errors add up along the chain
+        float error;
+        std::vector<uint32_t> simplified = simplifyMesh(positions, previous.indices, target, error);
+        float levelError = previous.error + error;
+
+        float removed = 1.0f - static_cast<float>(simplified.size()) / previous.indices.size();
+        if (removed < settings.minimumReduction || levelError > settings.maxError) {
+            break;
+        }
+        levels.push_back({std::move(simplified), levelError});
+    }
+    return levels;
+}
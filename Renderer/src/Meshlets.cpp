@@ -0,0 +1,195 @@
+#include "Meshlets.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const uint32_t NO_LOCAL_INDEX = UINT32_MAX;
+
+struct MeshletBuilder {
+    const std::vector<glm::vec3>& positions;
+    const std::vector<uint32_t>& indices;
+    MeshletData& data;
+
+    // Local index of every mesh vertex in the meshlet being built
+    std::vector<uint32_t> localIndex;
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> triangles;
+    glm::vec3 positionSum = glm::vec3(0.0f);
+
+    uint32_t newVertexCount(uint32_t triangle) const {
+        uint32_t count = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            if (localIndex[indices[triangle * 3 + k]] == NO_LOCAL_INDEX) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    void add(uint32_t triangle) {
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t vertex = indices[triangle * 3 + k];
+            if (localIndex[vertex] == NO_LOCAL_INDEX) {
+                localIndex[vertex] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(vertex);
+                positionSum += positions[vertex];
+            }
+        }
+        triangles.push_back(triangle);
+    }
+
+    void flush() {
+        if (triangles.empty()) {
+            return;
+        }
+
+        Meshlet meshlet{};
+        meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+        meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+        meshlet.vertexCount = static_cast<uint32_t>(vertices.size());
+        meshlet.triangleCount = static_cast<uint32_t>(triangles.size());
+
+        data.vertices.insert(data.vertices.end(), vertices.begin(), vertices.end());
+        for (uint32_t triangle : triangles) {
+            for (uint32_t k = 0; k < 3; k++) {
+                data.triangles.push_back(static_cast<uint8_t>(localIndex[indices[triangle * 3 + k]]));
+            }
+        }
+        while (data.triangles.size() % 4 != 0) {
+            data.triangles.push_back(0);
+        }
+
+        // Bounding sphere around the box centre
+        glm::vec3 minBounds(INFINITY);
+        glm::vec3 maxBounds(-INFINITY);
+        for (uint32_t vertex : vertices) {
+            minBounds = glm::min(minBounds, positions[vertex]);
+            maxBounds = glm::max(maxBounds, positions[vertex]);
+        }
+        meshlet.center = (minBounds + maxBounds) * 0.5f;
+        for (uint32_t vertex : vertices) {
+            meshlet.radius = std::max(meshlet.radius, glm::length(positions[vertex] - meshlet.center));
+        }
+
+        // Normal cone, degenerate triangles have no say in it
+        std::vector<glm::vec3> normals;
+        normals.reserve(triangles.size());
+        glm::vec3 normalSum(0.0f);
+        for (uint32_t triangle : triangles) {
+            const glm::vec3& p0 = positions[indices[triangle * 3]];
+            glm::vec3 normal = glm::cross(positions[indices[triangle * 3 + 1]] - p0,
+                                        positions[indices[triangle * 3 + 2]] - p0);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normals.push_back(normal / length);
+                normalSum += normal / length;
+            }
+        }
+
+        meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.coneCutoff = 1.0f;
+        float sumLength = glm::length(normalSum);
+        if (!normals.empty() && sumLength > 0.0f) {
+            glm::vec3 axis = normalSum / sumLength;
+            float minDot = 1.0f;
+            for (const glm::vec3& normal : normals) {
+                minDot = std::min(minDot, glm::dot(axis, normal));
+            }
+            // Normals spreading past 90 degrees always face someone
+            if (minDot > 0.0f) {
+                meshlet.coneAxis = axis;
+                meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+            }
+        }
+        data.meshlets.push_back(meshlet);
+
+        for (uint32_t vertex : vertices) {
+            localIndex[vertex] = NO_LOCAL_INDEX;
+        }
+        vertices.clear();
+        triangles.clear();
+        positionSum = glm::vec3(0.0f);
+    }
+};
+
+}
+
+MeshletData buildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                        uint32_t maxVertices, uint32_t maxTriangles) {
+    MeshletData data;
+    const size_t triangleCount = indices.size() / 3;
+
+    // Triangles around every vertex
+    std::vector<uint32_t> adjacencyOffsets(positions.size() + 1, 0);
+    for (uint32_t index : indices) {
+        adjacencyOffsets[index + 1]++;
+    }
+    for (size_t i = 1; i < adjacencyOffsets.size(); i++) {
+        adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            adjacency[cursor[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    MeshletBuilder builder{positions, indices, data, std::vector<uint32_t>(positions.size(), NO_LOCAL_INDEX)};
+    std::vector<bool> emitted(triangleCount, false);
+    size_t scan = 0;
+
+    for (size_t remaining = triangleCount; remaining > 0; remaining--) {
+        // Best unemitted triangle touching the meshlet: fewest new vertices,
+        // then closest to the meshlet's centre
+        uint32_t best = UINT32_MAX;
+        uint32_t bestNew = 4;
+        float bestDistance = INFINITY;
+        if (!builder.vertices.empty()) {
+            glm::vec3 centroid = builder.positionSum / static_cast<float>(builder.vertices.size());
+            for (uint32_t vertex : builder.vertices) {
+                for (uint32_t k = adjacencyOffsets[vertex]; k < adjacencyOffsets[vertex + 1]; k++) {
+                    uint32_t triangle = adjacency[k];
+                    if (emitted[triangle]) {
+                        continue;
+                    }
+                    uint32_t newVertices = builder.newVertexCount(triangle);
+                    if (newVertices > bestNew) {
+                        continue;
+                    }
+                    glm::vec3 center = (positions[indices[triangle * 3]] + positions[indices[triangle * 3 + 1]] +
+                                        positions[indices[triangle * 3 + 2]]) / 3.0f;
+                    glm::vec3 offset = center - centroid;
+                    float distance = glm::dot(offset, offset);
+                    if (newVertices < bestNew || distance < bestDistance) {
+                        best = triangle;
+                        bestNew = newVertices;
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+
+        // Nothing connected left, continue with the next triangle in order
+        if (best == UINT32_MAX) {
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = static_cast<uint32_t>(scan);
+        }
+
+        // A full meshlet is closed; the triangle seeds the next one so it
+        // starts right next to where this one ended
+        if (builder.vertices.size() + builder.newVertexCount(best) > maxVertices ||
+            builder.triangles.size() + 1 > maxTriangles) {
+            builder.flush();
+        }
+        builder.add(best);
+        emitted[best] = true;
+    }
+    builder.flush();
+
+    return data;
+}
@@ -0,0 +1,404 @@
+#include "Overlay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// The font's glyphs in cells of 8x8 texels, 16 to a row, followed by one
+// fully covered cell that solid shapes sample
+static const uint32_t ATLAS_WIDTH = 128;
+static const uint32_t ATLAS_HEIGHT = 64;
+static const uint32_t ATLAS_CELL = 8;
+static const uint32_t GLYPH_WIDTH = 5;
+static const uint32_t GLYPH_HEIGHT = 7;
+// Printable ASCII from ' ' to '_', everything a debug display needs
+static const char FIRST_GLYPH = ' ';
+static const uint32_t GLYPH_COUNT = 64;
+static const uint32_t SOLID_CELL = GLYPH_COUNT;
+// Overlay vertices a frame's buffer starts out with room for
+static const size_t INITIAL_VERTEX_CAPACITY = 6 * 1024;
+
+// 5x7 bitmaps, rows top to bottom with the leftmost pixel in bit 4
+static const uint8_t font[GLYPH_COUNT][GLYPH_HEIGHT] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04}, // space !
+    {0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a}, // " #
+    {0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04}, {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // $ %
+    {0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d}, {0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00}, // & '
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // ( )
+    {0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00}, {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00}, // * +
+    {0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08}, {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00}, // , -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c}, {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // . /
+    {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}, {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e}, // 0 1
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f}, {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e}, // 2 3
+    {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}, {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e}, // 4 5
+    {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}, {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 6 7
+    {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}, {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c}, // 8 9
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00}, {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08}, // : ;
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00}, // < =
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, {0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // > ?
+    {0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e}, {0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, // @ A
+    {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e}, {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e}, // B C
+    {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c}, {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f}, // D E
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10}, {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f}, // F G
+    {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}, // H I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c}, {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // J K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f}, {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11}, // L M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // N O
+    {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10}, {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d}, // P Q
+    {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11}, {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e}, // R S
+    {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // T U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04}, {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a}, // V W
+    {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11}, {0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04}, // X Y
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f}, {0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e}, // Z [
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, {0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e}, // \ ]
+    {0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f} // ^ _
+};
+
+static uint32_t getGlyph(char character) {
+    if (character >= 'a' && character <= 'z') {
+        character = static_cast<char>(character - 'a' + 'A');
+    }
+    if (character < FIRST_GLYPH || character >= FIRST_GLYPH + static_cast<int>(GLYPH_COUNT)) {
+        character = '?';
+    }
+    return static_cast<uint32_t>(character - FIRST_GLYPH);
+}
+
+// Top left corner of an atlas cell in texture coordinates
+static glm::vec2 getCellUv(uint32_t cell) {
+    return glm::vec2(static_cast<float>(cell % (ATLAS_WIDTH / ATLAS_CELL) * ATLAS_CELL) / ATLAS_WIDTH,
+                    static_cast<float>(cell / (ATLAS_WIDTH / ATLAS_CELL) * ATLAS_CELL) / ATLAS_HEIGHT);
+}
+
+// Middle of the solid cell, far enough from its edges for any filtering
+static glm::vec2 getSolidUv() {
+    return getCellUv(SOLID_CELL) + glm::vec2(0.5f * ATLAS_CELL / ATLAS_WIDTH, 0.5f * ATLAS_CELL / ATLAS_HEIGHT);
+}
+
+static uint32_t packColor(const glm::vec4& color) {
+    uint32_t packed = 0;
+    for (int channel = 0; channel < 4; channel++) {
+        uint32_t value = static_cast<uint32_t>(glm::clamp(color[channel], 0.0f, 1.0f) * 255.0f + 0.5f);
+        packed |= value << (channel * 8);
+    }
+    return packed;
+}
+
+// Text is only ever scaled by whole texels, anything else would blur or
+// drop rows of the glyphs
+static float getPixelScale(float scale) {
+    return std::max(1.0f, std::round(scale));
+}
+
+void OverlayBatch::line(const glm::vec2& from, const glm::vec2& to, const glm::vec4& color, float width) {
+    glm::vec2 direction = to - from;
+    float length = glm::length(direction);
+    if (length <= 0.0f) {
+        return;
+    }
+
+    // A quad along the line, width wide across it
+    glm::vec2 normal = glm::vec2(-direction.y, direction.x) * (0.5f * width / length);
+    glm::vec2 uv = getSolidUv();
+    uint32_t packed = packColor(color);
+    vertices.push_back({from + normal, uv, packed});
+    vertices.push_back({from - normal, uv, packed});
+    vertices.push_back({to - normal, uv, packed});
+    vertices.push_back({from + normal, uv, packed});
+    vertices.push_back({to - normal, uv, packed});
+    vertices.push_back({to + normal, uv, packed});
+}
+
+void OverlayBatch::rect(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color) {
+    glm::vec2 uv = getSolidUv();
+    quad(min, max, uv, uv, packColor(color));
+}
+
+glm::vec2 OverlayBatch::text(const glm::vec2& position, const std::string& string, const glm::vec4& color,
+                            float scale) {
+    const float pixel = getPixelScale(scale);
+    const glm::vec2 glyphSize = glm::vec2(GLYPH_WIDTH, GLYPH_HEIGHT) * pixel;
+    const glm::vec2 glyphUvSize(static_cast<float>(GLYPH_WIDTH) / ATLAS_WIDTH,
+                                static_cast<float>(GLYPH_HEIGHT) / ATLAS_HEIGHT);
+    const uint32_t packed = packColor(color);
+
+    // Glyph texels land on whole framebuffer pixels
+    glm::vec2 origin(std::floor(position.x), std::floor(position.y));
+    glm::vec2 pen = origin;
+    for (char character : string) {
+        if (character == '\n') {
+            pen = glm::vec2(origin.x, pen.y + OVERLAY_LINE_HEIGHT * pixel);
+            continue;
+        }
+        uint32_t glyph = getGlyph(character);
+        if (glyph != 0) {
+            glm::vec2 uv = getCellUv(glyph);
+            quad(pen, pen + glyphSize, uv, uv + glyphUvSize, packed);
+        }
+        pen.x += OVERLAY_GLYPH_ADVANCE * pixel;
+    }
+    return measure(string, scale);
+}
+
+glm::vec2 OverlayBatch::measure(const std::string& string, float scale) {
+    size_t columns = 0;
+    size_t widest = 0;
+    size_t lines = 1;
+    for (char character : string) {
+        if (character == '\n') {
+            columns = 0;
+            lines++;
+        } else {
+            widest = std::max(widest, ++columns);
+        }
+    }
+    const float pixel = getPixelScale(scale);
+    return glm::vec2(widest * OVERLAY_GLYPH_ADVANCE, lines * OVERLAY_LINE_HEIGHT) * pixel;
+}
+
+void OverlayBatch::take(std::vector<OverlayVertex>& vertices) {
+    this->vertices.swap(vertices);
+    this->vertices.clear();
+}
+
+void OverlayBatch::quad(const glm::vec2& min, const glm::vec2& max, const glm::vec2& uvMin, const glm::vec2& uvMax,
+                        uint32_t color) {
+    vertices.push_back({min, uvMin, color});
+    vertices.push_back({glm::vec2(max.x, min.y), glm::vec2(uvMax.x, uvMin.y), color});
+    vertices.push_back({max, uvMax, color});
+    vertices.push_back({min, uvMin, color});
+    vertices.push_back({max, uvMax, color});
+    vertices.push_back({glm::vec2(min.x, max.y), glm::vec2(uvMin.x, uvMax.y), color});
+}
+
+OverlayRenderer::OverlayRenderer() : device(VK_NULL_HANDLE),
+                                    resources(nullptr),
+                                    atlasReady(false),
+                                    setLayout(VK_NULL_HANDLE),
+                                    descriptorPool(VK_NULL_HANDLE),
+                                    descriptorSet(VK_NULL_HANDLE),
+                                    pipelineLayout(VK_NULL_HANDLE) {}
+
+void OverlayRenderer::init(VkDevice device, ResourceManager& resources, uint32_t frameCount) {
+    this->device = device;
+    this->resources = &resources;
+
+    // Coverage only, the vertex color does the rest
+    std::vector<uint8_t> pixels(ATLAS_WIDTH * ATLAS_HEIGHT, 0);
+    for (uint32_t glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+        glm::vec2 cell = getCellUv(glyph);
+        uint32_t left = static_cast<uint32_t>(cell.x * ATLAS_WIDTH);
+        uint32_t top = static_cast<uint32_t>(cell.y * ATLAS_HEIGHT);
+        for (uint32_t y = 0; y < GLYPH_HEIGHT; y++) {
+            for (uint32_t x = 0; x < GLYPH_WIDTH; x++) {
+                if (font[glyph][y] >> (GLYPH_WIDTH - 1 - x) & 1) {
+                    pixels[(top + y) * ATLAS_WIDTH + left + x] = 255;
+                }
+            }
+        }
+    }
+    glm::vec2 solid = getCellUv(SOLID_CELL);
+    for (uint32_t y = 0; y < ATLAS_CELL; y++) {
+        uint32_t row = static_cast<uint32_t>(solid.y * ATLAS_HEIGHT) + y;
+        memset(&pixels[row * ATLAS_WIDTH + static_cast<uint32_t>(solid.x * ATLAS_WIDTH)], 255, ATLAS_CELL);
+    }
+
+    atlasStaging = resources.createBuffer(pixels.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::Upload,
+                MemoryCategory::Staging);
+    memcpy(resources.get(atlasStaging)->mapped, pixels.data(), pixels.size());
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {ATLAS_WIDTH, ATLAS_HEIGHT, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    atlas = resources.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                MemoryCategory::Textures);
+
+    // Glyphs are drawn texel for texel
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler = resources.createSampler(samplerInfo);
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create overlay descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create overlay descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate overlay descriptor set!");
+    }
+
+    VkDescriptorImageInfo atlasInfo{};
+    atlasInfo.sampler = resources.get(sampler)->sampler;
+    atlasInfo.imageView = resources.get(atlas)->view;
+    atlasInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptorSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &atlasInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+    // Two over the framebuffer size, mapping pixels to clip space
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(glm::vec2);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create overlay pipeline layout!");
+    }
+
+    vertexBuffers.resize(frameCount);
+    vertexCapacity.resize(frameCount, 0);
+    vertexCounts.resize(frameCount, 0);
+    for (uint32_t i = 0; i < frameCount; i++) {
+        reserve(i, INITIAL_VERTEX_CAPACITY);
+    }
+}
+
+void OverlayRenderer::shutdown() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    for (BufferHandle buffer : vertexBuffers) {
+        resources->destroy(buffer);
+    }
+    resources->destroy(atlasStaging);
+    resources->destroy(atlas);
+    resources->destroy(sampler);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void OverlayRenderer::update(size_t frame, const std::vector<OverlayVertex>& vertices) {
+    reserve(frame, vertices.size());
+    if (!vertices.empty()) {
+        memcpy(resources->get(vertexBuffers[frame])->mapped, vertices.data(), sizeof(OverlayVertex) * vertices.size());
+    }
+    vertexCounts[frame] = static_cast<uint32_t>(vertices.size());
+}
+
+void OverlayRenderer::record(VkCommandBuffer commandBuffer) {
+    if (atlasReady) {
+        return;
+    }
+
+    transition(commandBuffer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {ATLAS_WIDTH, ATLAS_HEIGHT, 1};
+    vkCmdCopyBufferToImage(commandBuffer, resources->get(atlasStaging)->buffer, resources->get(atlas)->image,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    transition(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT);
+
+    // Released once this frame has completed
+    resources->destroy(atlasStaging);
+    atlasReady = true;
+}
+
+void OverlayRenderer::draw(VkCommandBuffer commandBuffer, size_t frame, VkExtent2D extent) {
+    glm::vec2 scale(2.0f / extent.width, 2.0f / extent.height);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec2), &scale);
+    vkCmdDraw(commandBuffer, vertexCounts[frame], 1, 0, 0);
+}
+
+void OverlayRenderer::reserve(size_t frame, size_t vertexCount) {
+    if (vertexCount <= vertexCapacity[frame]) {
+        return;
+    }
+
+    resources->destroy(vertexBuffers[frame]);
+
+    size_t capacity = std::max(vertexCount, vertexCapacity[frame] * 2);
+    vertexBuffers[frame] = resources->createBuffer(sizeof(OverlayVertex) * capacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                MemoryUsage::Dynamic, MemoryCategory::Geometry);
+    vertexCapacity[frame] = capacity;
+}
+
+void OverlayRenderer::transition(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout,
+                                VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                                VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = resources->get(atlas)->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
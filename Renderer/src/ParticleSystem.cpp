@@ -0,0 +1,310 @@
+#include "ParticleSystem.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+// Sizes of the shaders' Particle and ParticleVertex, see particle_simulate.comp
+static const VkDeviceSize PARTICLE_SIZE = 64;
+static const VkDeviceSize PARTICLE_VERTEX_SIZE = 32;
+// Key and vertex index of every surviving particle
+static const VkDeviceSize PARTICLE_SORT_KEY_SIZE = 8;
+
+// Steps of particle_args.comp
+static const uint32_t PARTICLE_ARGS_EMIT = 0;
+static const uint32_t PARTICLE_ARGS_SIMULATE = 1;
+static const uint32_t PARTICLE_ARGS_DRAW = 2;
+// Steps of particle_sort.comp: a whole block in shared memory, one compare
+// distance across blocks, and the rest of a merge once it fits in a block
+static const uint32_t PARTICLE_SORT_LOCAL = 0;
+static const uint32_t PARTICLE_SORT_STEP = 1;
+static const uint32_t PARTICLE_SORT_MERGE = 2;
+
+static const glm::vec3 PARTICLE_GRAVITY(0.0f, -9.81f, 0.0f);
+
+ParticleSystem::ParticleSystem() : device(VK_NULL_HANDLE),
+                                resources(nullptr),
+                                setLayout(VK_NULL_HANDLE),
+                                descriptorPool(VK_NULL_HANDLE),
+                                pipelineLayout(VK_NULL_HANDLE),
+                                countersReady(false),
+                                seed(0) {}
+
+void ParticleSystem::init(VkDevice device, ResourceManager& resources, const ParticleShaders& shaders,
+                        uint32_t frameCount) {
+    this->device = device;
+    this->resources = &resources;
+
+    // 0 the constants, 1 the emitters, 2 the particles, 3 the dead list, 4
+    // the alive lists, 5 the counters, then the frame's 6 vertices, 7 sort
+    // keys and 8 draw
+    std::array<VkDescriptorSetLayoutBinding, 9> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle descriptor set layout!");
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = frameCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = 8 * frameCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frameCount;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frameCount, setLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = frameCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    descriptorSets.resize(frameCount);
+    if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate particle descriptor sets!");
+    }
+
+    // Never leaves the compute queue
+    particleBuffer = resources.createBuffer(PARTICLE_SIZE * PARTICLE_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                MemoryUsage::GpuOnly, MemoryCategory::Geometry);
+    deadBuffer = resources.createBuffer(sizeof(uint32_t) * PARTICLE_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                MemoryUsage::GpuOnly, MemoryCategory::Geometry);
+    aliveBuffer = resources.createBuffer(sizeof(uint32_t) * PARTICLE_CAPACITY * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                MemoryUsage::GpuOnly, MemoryCategory::Geometry);
+    counterBuffer = resources.createBuffer(sizeof(ParticleCounters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly,
+                MemoryCategory::Uniforms);
+
+    // Read by both queues: the constants and emitters are written by the
+    // host, the rest by the simulation for the frame's draw
+    constantBuffers.resize(frameCount);
+    emitterBuffers.resize(frameCount);
+    vertexBuffers.resize(frameCount);
+    sortBuffers.resize(frameCount);
+    drawBuffers.resize(frameCount);
+    for (uint32_t i = 0; i < frameCount; i++) {
+        constantBuffers[i] = resources.createBuffer(sizeof(ParticleConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                    MemoryUsage::Dynamic, MemoryCategory::Uniforms, BufferSharing::Concurrent);
+        emitterBuffers[i] = resources.createBuffer(sizeof(ParticleEmitterData) * PARTICLE_MAX_EMITTERS,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::Dynamic, MemoryCategory::Uniforms,
+                    BufferSharing::Concurrent);
+        vertexBuffers[i] = resources.createBuffer(PARTICLE_VERTEX_SIZE * PARTICLE_CAPACITY,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Geometry,
+                    BufferSharing::Concurrent);
+        sortBuffers[i] = resources.createBuffer(PARTICLE_SORT_KEY_SIZE * PARTICLE_CAPACITY,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Geometry,
+                    BufferSharing::Concurrent);
+        drawBuffers[i] = resources.createBuffer(sizeof(VkDrawIndirectCommand),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly,
+                    MemoryCategory::Uniforms, BufferSharing::Concurrent);
+
+        std::array<VkDescriptorBufferInfo, 9> bufferInfos{};
+        bufferInfos[0].buffer = resources.get(constantBuffers[i])->buffer;
+        bufferInfos[1].buffer = resources.get(emitterBuffers[i])->buffer;
+        bufferInfos[2].buffer = resources.get(particleBuffer)->buffer;
+        bufferInfos[3].buffer = resources.get(deadBuffer)->buffer;
+        bufferInfos[4].buffer = resources.get(aliveBuffer)->buffer;
+        bufferInfos[5].buffer = resources.get(counterBuffer)->buffer;
+        bufferInfos[6].buffer = resources.get(vertexBuffers[i])->buffer;
+        bufferInfos[7].buffer = resources.get(sortBuffers[i])->buffer;
+        bufferInfos[8].buffer = resources.get(drawBuffers[i])->buffer;
+
+        std::array<VkWriteDescriptorSet, 9> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            bufferInfos[binding].offset = 0;
+            bufferInfos[binding].range = VK_WHOLE_SIZE;
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = descriptorSets[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = bindings[binding].descriptorType;
+            writes[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(ParticlePushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle pipeline layout!");
+    }
+
+    // The layout is owned here, the pipelines only borrow it
+    auto createPipeline = [&](VkShaderModule shader) {
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shader;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pipelineLayout;
+
+        VkPipeline computePipeline;
+        if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create particle pipeline!");
+        }
+        return resources.addPipeline(computePipeline, VK_NULL_HANDLE);
+    };
+    argsPipeline = createPipeline(shaders.args);
+    emitPipeline = createPipeline(shaders.emit);
+    simulatePipeline = createPipeline(shaders.simulate);
+    sortPipeline = createPipeline(shaders.sort);
+}
+
+void ParticleSystem::shutdown() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    for (size_t i = 0; i < descriptorSets.size(); i++) {
+        resources->destroy(constantBuffers[i]);
+        resources->destroy(emitterBuffers[i]);
+        resources->destroy(vertexBuffers[i]);
+        resources->destroy(sortBuffers[i]);
+        resources->destroy(drawBuffers[i]);
+    }
+    resources->destroy(particleBuffer);
+    resources->destroy(deadBuffer);
+    resources->destroy(aliveBuffer);
+    resources->destroy(counterBuffer);
+    resources->destroy(argsPipeline);
+    resources->destroy(emitPipeline);
+    resources->destroy(simulatePipeline);
+    resources->destroy(sortPipeline);
+    // Pipelines do not need their layout once they are built
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void ParticleSystem::update(size_t frame, const std::vector<ParticleEmitterData>& emitters, const glm::mat4& view,
+                        const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float deltaTime) {
+    uint32_t emitterCount = static_cast<uint32_t>(std::min<size_t>(emitters.size(), PARTICLE_MAX_EMITTERS));
+    uint32_t emitCount = 0;
+    if (emitterCount > 0) {
+        memcpy(resources->get(emitterBuffers[frame])->mapped, emitters.data(),
+            sizeof(ParticleEmitterData) * emitterCount);
+        const ParticleEmitterData& last = emitters[emitterCount - 1];
+        emitCount = last.firstParticle + last.count;
+    }
+
+    // The rows of the view's rotation are the camera's axes in world space
+    ParticleConstants constants;
+    constants.viewProjection = viewProjection;
+    constants.cameraRight = glm::vec4(view[0][0], view[1][0], view[2][0], 0.0f);
+    constants.cameraUp = glm::vec4(view[0][1], view[1][1], view[2][1], 0.0f);
+    constants.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+    constants.gravity = glm::vec4(PARTICLE_GRAVITY, deltaTime);
+    constants.emission = glm::uvec4(emitCount, emitterCount, seed++, 0);
+    memcpy(resources->get(constantBuffers[frame])->mapped, &constants, sizeof(ParticleConstants));
+}
+
+void ParticleSystem::record(VkCommandBuffer commandBuffer, size_t frame) {
+    VkBuffer counters = resources->get(counterBuffer)->buffer;
+    if (!countersReady) {
+        vkCmdFillBuffer(commandBuffer, counters, 0, sizeof(ParticleCounters), 0);
+
+        VkMemoryBarrier fillBarrier{};
+        fillBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        fillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+        countersReady = true;
+    }
+
+    // Runs even without emitters, the living particles still move and the
+    // frame's draw has to be written
+    bind(commandBuffer, argsPipeline, {PARTICLE_ARGS_EMIT, 0, 0});
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                        &descriptorSets[frame], 0, nullptr);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    barrier(commandBuffer);
+
+    bind(commandBuffer, emitPipeline, {0, 0, 0});
+    vkCmdDispatchIndirect(commandBuffer, counters, offsetof(ParticleCounters, emitDispatch));
+    barrier(commandBuffer);
+
+    bind(commandBuffer, argsPipeline, {PARTICLE_ARGS_SIMULATE, 0, 0});
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    barrier(commandBuffer);
+
+    bind(commandBuffer, simulatePipeline, {0, 0, 0});
+    vkCmdDispatchIndirect(commandBuffer, counters, offsetof(ParticleCounters, simulateDispatch));
+    barrier(commandBuffer);
+
+    bind(commandBuffer, argsPipeline, {PARTICLE_ARGS_DRAW, 0, 0});
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    barrier(commandBuffer);
+
+    // Bitonic sort of the surviving particles, far to near. Every merge the
+    // capacity could need is recorded; the ones larger than the frame's
+    // sortCount return right away, and the dispatches only cover sortCount.
+    const VkDeviceSize sortDispatch = offsetof(ParticleCounters, sortDispatch);
+    bind(commandBuffer, sortPipeline, {PARTICLE_SORT_LOCAL, PARTICLE_SORT_BLOCK, 0});
+    vkCmdDispatchIndirect(commandBuffer, counters, sortDispatch);
+    for (uint32_t k = PARTICLE_SORT_BLOCK * 2; k <= PARTICLE_CAPACITY; k *= 2) {
+        for (uint32_t j = k / 2; j >= PARTICLE_SORT_BLOCK; j /= 2) {
+            barrier(commandBuffer);
+            bind(commandBuffer, sortPipeline, {PARTICLE_SORT_STEP, k, j});
+            vkCmdDispatchIndirect(commandBuffer, counters, sortDispatch);
+        }
+        barrier(commandBuffer);
+        bind(commandBuffer, sortPipeline, {PARTICLE_SORT_MERGE, k, PARTICLE_SORT_BLOCK / 2});
+        vkCmdDispatchIndirect(commandBuffer, counters, sortDispatch);
+    }
+}
+
+void ParticleSystem::draw(VkCommandBuffer commandBuffer, size_t frame) {
+    vkCmdDrawIndirect(commandBuffer, resources->get(drawBuffers[frame])->buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+}
+
+void ParticleSystem::barrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+                                VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void ParticleSystem::bind(VkCommandBuffer commandBuffer, PipelineHandle pipeline,
+                        const ParticlePushConstants& constants) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources->get(pipeline)->pipeline);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                    sizeof(ParticlePushConstants), &constants);
+}
@@ -0,0 +1,424 @@
+#include "PipelineCache.hpp"
+
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+static void hashCombine(size_t& seed, uint64_t value) {
+    // 64-bit FNV-1a over the value's bytes
+    for (uint32_t i = 0; i < 8; i++) {
+        seed ^= (value >> (i * 8)) & 0xff;
+        seed *= 1099511628211ull;
+    }
+}
+
+static void hashString(size_t& seed, const std::string& value) {
+    for (char c : value) {
+        seed ^= static_cast<uint8_t>(c);
+        seed *= 1099511628211ull;
+    }
+    hashCombine(seed, value.size());
+}
+
+size_t hashPipelineDesc(const PipelineDesc& desc) {
+    size_t seed = 14695981039346656037ull;
+    for (const auto& shader : desc.shaders) {
+        hashCombine(seed, shader.stage);
+        hashString(seed, shader.name);
+        hashCombine(seed, shader.features);
+    }
+    for (const auto& binding : desc.vertexBindings) {
+        hashCombine(seed, binding.binding);
+        hashCombine(seed, binding.stride);
+        hashCombine(seed, binding.inputRate);
+    }
+    for (const auto& attribute : desc.vertexAttributes) {
+        hashCombine(seed, attribute.location);
+        hashCombine(seed, attribute.binding);
+        hashCombine(seed, attribute.format);
+        hashCombine(seed, attribute.offset);
+    }
+    hashCombine(seed, desc.topology);
+    hashCombine(seed, desc.polygonMode);
+    hashCombine(seed, desc.cullMode);
+    hashCombine(seed, desc.frontFace);
+    hashCombine(seed, desc.depthTest);
+    hashCombine(seed, desc.depthWrite);
+    hashCombine(seed, desc.depthCompare);
+    hashCombine(seed, static_cast<uint32_t>(desc.blend));
+    hashCombine(seed, desc.colorAttachment);
+    hashCombine(seed, reinterpret_cast<uint64_t>(desc.layout));
+    hashCombine(seed, reinterpret_cast<uint64_t>(desc.renderPass));
+    hashCombine(seed, desc.subpass);
+    return seed;
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const {
+    if (shaders.size() != other.shaders.size() ||
+        vertexBindings.size() != other.vertexBindings.size() ||
+        vertexAttributes.size() != other.vertexAttributes.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < shaders.size(); i++) {
+        if (shaders[i].stage != other.shaders[i].stage || shaders[i].name != other.shaders[i].name ||
+            shaders[i].features != other.shaders[i].features) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < vertexBindings.size(); i++) {
+        const auto& a = vertexBindings[i];
+        const auto& b = other.vertexBindings[i];
+        if (a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < vertexAttributes.size(); i++) {
+        const auto& a = vertexAttributes[i];
+        const auto& b = other.vertexAttributes[i];
+        if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset) {
+            return false;
+        }
+    }
+    return topology == other.topology &&
+        polygonMode == other.polygonMode &&
+        cullMode == other.cullMode &&
+        frontFace == other.frontFace &&
+        depthTest == other.depthTest &&
+        depthWrite == other.depthWrite &&
+        depthCompare == other.depthCompare &&
+        blend == other.blend &&
+        colorAttachment == other.colorAttachment &&
+        layout == other.layout &&
+        renderPass == other.renderPass &&
+        subpass == other.subpass;
+}
+
+PipelineCache::PipelineCache() : device(VK_NULL_HANDLE),
+                                resources(nullptr),
+                                driverCache(VK_NULL_HANDLE),
+                                compiling(0),
+                                stopping(false) {
+}
+
+PipelineCache::~PipelineCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void PipelineCache::init(VkDevice device, ResourceManager& resources, ShaderLoader loader) {
+    this->device = device;
+    this->resources = &resources;
+    this->loader = std::move(loader);
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &driverCache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+
+    stopping = false;
+    thread = std::thread(&PipelineCache::compileLoop, this);
+}
+
+void PipelineCache::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    clear();
+    vkDestroyPipelineCache(device, driverCache, nullptr);
+    driverCache = VK_NULL_HANDLE;
+
+    std::lock_guard<std::mutex> lock(moduleMutex);
+    for (const auto& module : modules) {
+        vkDestroyShaderModule(device, module.second, nullptr);
+    }
+    modules.clear();
+}
+
+PipelineHandle PipelineCache::compile(const PipelineDesc& desc) {
+    std::unique_lock<std::mutex> lock(mutex);
+    Entry& entry = entries[desc];
+    while (true) {
+        if (entry.state == State::Ready) {
+            return entry.pipeline;
+        }
+        if (entry.state != State::Compiling) {
+            break;
+        }
+        compileCondition.wait(lock);
+    }
+    // A queued copy is skipped by the thread once it sees the new state
+    entry.state = State::Compiling;
+    compiling++;
+    lock.unlock();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+        pipeline = createPipeline(desc);
+    } catch (...) {
+        lock.lock();
+        entry.state = State::Failed;
+        compiling--;
+        compileCondition.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    entry.pipeline = resources->addPipeline(pipeline, VK_NULL_HANDLE);
+    entry.state = State::Ready;
+    compiling--;
+    compileCondition.notify_all();
+    return entry.pipeline;
+}
+
+PipelineHandle PipelineCache::get(const PipelineDesc& desc, PipelineHandle fallback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(desc);
+    if (it == entries.end()) {
+        entries.emplace(desc, Entry{State::Queued, PipelineHandle()});
+        queue.push_back(desc);
+        queueCondition.notify_one();
+        return fallback;
+    }
+    return it->second.state == State::Ready ? it->second.pipeline : fallback;
+}
+
+bool PipelineCache::isReady(const PipelineDesc& desc) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(desc);
+    return it != entries.end() && it->second.state == State::Ready;
+}
+
+void PipelineCache::clear() {
+    std::unique_lock<std::mutex> lock(mutex);
+    queue.clear();
+    // A compile in flight may still use the layout or the render pass
+    compileCondition.wait(lock, [this] { return compiling == 0; });
+
+    for (const auto& entry : entries) {
+        if (entry.second.state == State::Ready) {
+            resources->destroy(entry.second.pipeline);
+        }
+    }
+    entries.clear();
+}
+
+uint32_t PipelineCache::pendingCompiles() {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t pending = 0;
+    for (const auto& entry : entries) {
+        if (entry.second.state == State::Queued || entry.second.state == State::Compiling) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+size_t PipelineCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t PipelineCache::shaderModuleCount() {
+    std::lock_guard<std::mutex> lock(moduleMutex);
+    return modules.size();
+}
+
+VkShaderModule PipelineCache::getShaderModule(const std::string& name) {
+    std::lock_guard<std::mutex> lock(moduleMutex);
+    auto it = modules.find(name);
+    if (it != modules.end()) {
+        return it->second;
+    }
+    VkShaderModule module = loader(name);
+    modules.emplace(name, module);
+    return module;
+}
+
+void PipelineCache::compileLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        PipelineDesc desc = std::move(queue.front());
+        queue.pop_front();
+        auto it = entries.find(desc);
+        if (it == entries.end() || it->second.state != State::Queued) {
+            continue;
+        }
+        it->second.state = State::Compiling;
+        compiling++;
+        lock.unlock();
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        try {
+            pipeline = createPipeline(desc);
+        } catch (const std::exception& e) {
+            // The fallback stays in use, asking again will not fix the shaders
+            std::cerr << "Pipeline variant failed to compile: " << e.what() << "\n";
+        }
+
+        lock.lock();
+        // clear() waits for this compile, the entry is still there
+        Entry& entry = entries.at(desc);
+        if (pipeline != VK_NULL_HANDLE) {
+            entry.pipeline = resources->addPipeline(pipeline, VK_NULL_HANDLE);
+            entry.state = State::Ready;
+        } else {
+            entry.state = State::Failed;
+        }
+        compiling--;
+        compileCondition.notify_all();
+    }
+}
+
+VkPipeline PipelineCache::createPipeline(const PipelineDesc& desc) {
+    // One constant per feature, all of them 32-bit booleans
+    std::array<VkSpecializationMapEntry, SHADER_FEATURE_COUNT> featureEntries{};
+    for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++) {
+        featureEntries[i].constantID = i;
+        featureEntries[i].offset = i * sizeof(VkBool32);
+        featureEntries[i].size = sizeof(VkBool32);
+    }
+
+    // Stage infos point into these, they must not reallocate
+    std::vector<std::array<VkBool32, SHADER_FEATURE_COUNT>> featureValues(desc.shaders.size());
+    std::vector<VkSpecializationInfo> specializations(desc.shaders.size());
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    // Mesh shader pipelines take no vertex input or input assembly
+    bool meshShading = false;
+
+    for (size_t i = 0; i < desc.shaders.size(); i++) {
+        const PipelineShader& shader = desc.shaders[i];
+        for (uint32_t feature = 0; feature < SHADER_FEATURE_COUNT; feature++) {
+            featureValues[i][feature] = (shader.features >> feature) & 1 ? VK_TRUE : VK_FALSE;
+        }
+        specializations[i].mapEntryCount = SHADER_FEATURE_COUNT;
+        specializations[i].pMapEntries = featureEntries.data();
+        specializations[i].dataSize = sizeof(featureValues[i]);
+        specializations[i].pData = featureValues[i].data();
+
+        VkPipelineShaderStageCreateInfo stageInfo{};
+        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage = shader.stage;
+        stageInfo.module = getShaderModule(shader.name);
+        stageInfo.pName = "main";
+        stageInfo.pSpecializationInfo = &specializations[i];
+        shaderStages.push_back(stageInfo);
+#ifdef VK_EXT_mesh_shader
+        meshShading |= shader.stage == VK_SHADER_STAGE_MESH_BIT_EXT;
+#endif
+    }
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+    vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+    vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = desc.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // Set when recording
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = desc.polygonMode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = desc.cullMode;
+    rasterizer.frontFace = desc.frontFace;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+    depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = desc.depthCompare;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
+                                            VK_COLOR_COMPONENT_G_BIT |
+                                            VK_COLOR_COMPONENT_B_BIT |
+                                            VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = desc.blend == BlendMode::Opaque ? VK_FALSE : VK_TRUE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = desc.blend == BlendMode::Additive ?
+                                            VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = desc.colorAttachment ? 1 : 0;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkDynamicState dynamicStates[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = meshShading ? nullptr : &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = meshShading ? nullptr : &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.renderPass;
+    pipelineInfo.subpass = desc.subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device, driverCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline!");
+    }
+    return pipeline;
+}
@@ -1,8 +1,56 @@
 #include "Renderer.hpp"
 
 Renderer::Renderer() : physicalDevice(VK_NULL_HANDLE),
+                        multiDrawIndirect(false),
+                        meshShaders(false),
+                        fillModeNonSolid(false),
+                        swapChainReadable(false),
+                        meshPipelineLayout(VK_NULL_HANDLE),
+                        clusterPipelineLayout(VK_NULL_HANDLE),
+                        wireframe(false),
+                        debugView(DebugView::None),
+                        lateRenderPass(VK_NULL_HANDLE),
+                        sceneFramebuffer(VK_NULL_HANDLE),
+                        presentRenderPass(VK_NULL_HANDLE),
+                        upscaleSetLayout(VK_NULL_HANDLE),
+                        upscaleDescriptorPool(VK_NULL_HANDLE),
+                        upscaleDescriptorSet(VK_NULL_HANDLE),
+                        upscalePipelineLayout(VK_NULL_HANDLE),
+                        renderExtent{0, 0},
+                        renderScale(1.0f),
+                        targetFrameTime(0.0f),
+                        minRenderScale(0.5f),
+                        maxRenderScale(1.0f),
+                        renderScaleTime(0.0f),
+                        renderScaleSamples(0),
+                        renderScaleFrame(0),
+                        renderTargetGeneration(1),
+                        cameraSetLayout(VK_NULL_HANDLE),
+                        cameraDescriptorPool(VK_NULL_HANDLE),
+                        particleTime(0.0),
+                        statsOverlay(false),
+                        frameTimeHistory{},
+                        frameTimeCursor(0),
+                        lodErrorThreshold(1.0f),
+                        clusterSetLayout(VK_NULL_HANDLE),
+                        clusterDescriptorPool(VK_NULL_HANDLE),
+                        clusterVisibilityCapacity(0),
+                        occlusionCulling(true),
                         currentFrame(0),
-                        frameBufferResized(false) {}
+                        timestampPool(VK_NULL_HANDLE),
+                        timestampPeriod(0.0f),
+                        timestampMask(0),
+                        frameTiming{0, 0.0f, -1.0f},
+                        frameBufferResized(false),
+                        frameIndex(0),
+                        frameLimit(0),
+                        fixedTimestep(0.0f),
+                        memoryReportInterval(5.0f),
+                        onDemandRendering(false),
+                        redrawRequested(true),
+                        waitingForEvents(false),
+                        particleSettleTime(0.0),
+                        idleSettled(false) {}
 
 void Renderer::run() {
     initVulkan();
@@ -19,6 +67,11 @@ void Renderer::initVulkan() {
     window.reset(glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr));
     glfwSetWindowUserPointer(window.get(), this);
     glfwSetFramebufferSizeCallback(window.get(), framebufferResizeCallback);
+    glfwSetWindowRefreshCallback(window.get(), windowRefreshCallback);
+
+    int width, height;
+    glfwGetFramebufferSize(window.get(), &width, &height);
+    framebufferExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
 
     // Vulkan Initialization
     createInstance();
@@ -26,29 +79,209 @@ void Renderer::initVulkan() {
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
+    resources.init(physicalDevice, device, isDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME));
+    resources.setQueueFamilies({graphicsFamily, computeQueue.getFamily()});
+    pipelineCache.init(device, resources, [this](const std::string& name) { return loadShader(name); });
+    frameCapture.init(resources);
     createSwapChain();
     createImageViews();
     createRenderPass();
+    createPresentRenderPass();
+    createClusterLayout();
+    createCameraResources();
+    createLightResources();
+    createParticleResources();
+    createOverlayResources();
+    createUpscaleResources();
+    createPipelineLayouts();
     createGraphicsPipeline();
+    createDepthResources();
+    createSceneTarget();
     createFrameBuffers();
     createCommandPool();
     createVertexBuffer();
     createIndexBuffer();
+    createClusterResources();
+    releaseMeshData();
+    createInstanceBuffers();
     createCommandBuffers();
     createSyncObjects();
+    createTimestampQueries();
 }
 
 void Renderer::mainLoop() {
-    while (!glfwWindowShouldClose(window.get())) {
-        glfwPollEvents();
-        drawFrame();
+    for(auto& snapshot : snapshots) {
+        freeSnapshots.tryPush(&snapshot);
+    }
+    renderThread = std::thread(&Renderer::renderLoop, this);
+
+    try {
+        auto lastUpdate = std::chrono::high_resolution_clock::now();
+        while (!glfwWindowShouldClose(window.get()) && (frameLimit == 0 || frameIndex < frameLimit)) {
+            glfwPollEvents();
+
+            // Nothing to present while minimized
+            int width, height;
+            glfwGetFramebufferSize(window.get(), &width, &height);
+            if(width == 0 || height == 0) {
+                glfwWaitEvents();
+                continue;
+            }
+
+            // On demand, nothing is updated or drawn until something could
+            // have changed the frame. Checked again after every wait, so
+            // changes made while sleeping are drawn by the timeout at the latest.
+            bool settle = false;
+            if(onDemandRendering.load(std::memory_order_relaxed) && !redrawRequested.exchange(false) &&
+                !hasPendingChanges()) {
+                // Dynamic resolution may have left a scaled down frame on
+                // screen, it is drawn once more at full scale before idling
+                if(!idleSettled && targetFrameTime.load(std::memory_order_relaxed) > 0.0f) {
+                    settle = true;
+                } else {
+                    waitForRedraw();
+                    // Time spent idle is not simulated
+                    lastUpdate = std::chrono::high_resolution_clock::now();
+                    continue;
+                }
+            }
+            idleSettled = settle;
+
+            // Blocks while the render thread still holds both snapshots
+            RenderSnapshot* snapshot;
+            if(!freeSnapshots.pop(snapshot)) {
+                break;
+            }
+
+            auto now = std::chrono::high_resolution_clock::now();
+            float deltaTime = std::chrono::duration<float>(now - lastUpdate).count();
+            lastUpdate = now;
+            if(fixedTimestep > 0.0f) {
+                deltaTime = fixedTimestep;
+            }
+            if(updateCallback) {
+                updateCallback(deltaTime);
+            }
+
+            snapshot->frameIndex = frameIndex++;
+            snapshot->deltaTime = deltaTime;
+            snapshot->framebufferExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+            snapshot->settle = settle;
+            extractSnapshot(*snapshot);
+
+            // Motion carries on into the next frame
+            if(camera != snapshotCamera || particleTime < particleSettleTime) {
+                redrawRequested.store(true);
+            }
+            snapshotCamera = camera;
+
+            if(!readySnapshots.push(snapshot)) {
+                break;
+            }
+        }
+    } catch (...) {
+        // Never leave the render thread running behind an exception
+        readySnapshots.close();
+        freeSnapshots.close();
+        renderThread.join();
+        throw;
     }
 
+    readySnapshots.close();
+    renderThread.join();
+
     vkDeviceWaitIdle(device);
+
+    if(renderError) {
+        std::rethrow_exception(renderError);
+    }
+}
+
+bool Renderer::hasPendingChanges() const {
+    if(camera != snapshotCamera) {
+        return true;
+    }
+    for(const auto& state : staticBucketStates) {
+        if(state.dirty) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Renderer::waitForRedraw() {
+    waitingForEvents.store(true);
+    if(!redrawRequested.load()) {
+        glfwWaitEventsTimeout(ON_DEMAND_WAIT_TIMEOUT);
+    }
+    waitingForEvents.store(false);
+}
+
+void Renderer::requestRedraw() {
+    redrawRequested.store(true);
+    // Handled by the next wait when it is already underway or about to start
+    if(waitingForEvents.load()) {
+        glfwPostEmptyEvent();
+    }
+}
+
+void Renderer::renderLoop() {
+    try {
+        RenderSnapshot* snapshot;
+        auto lastMemoryReport = std::chrono::steady_clock::now();
+        while(readySnapshots.pop(snapshot)) {
+            drawFrame(*snapshot);
+            freeSnapshots.push(snapshot);
+
+            auto now = std::chrono::steady_clock::now();
+            if(!memoryReportPath.empty() &&
+                std::chrono::duration<float>(now - lastMemoryReport).count() >= memoryReportInterval) {
+                resources.writeMemoryReport(memoryReportPath);
+                lastMemoryReport = now;
+            }
+        }
+    } catch (...) {
+        renderError = std::current_exception();
+    }
+
+    // Unblocks the update thread if rendering stopped early
+    readySnapshots.close();
+    freeSnapshots.close();
 }
 
-void Renderer::drawFrame() {
+void Renderer::drawFrame(const RenderSnapshot& snapshot) {
     vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    auto frameStart = std::chrono::steady_clock::now();
+
+    // Every frame up to the one this slot last submitted has now completed;
+    // frame numbers start at 1 so 0 means nothing was submitted yet
+    uint64_t renderFrame = snapshot.frameIndex + 1;
+    resources.collect(submittedFrames[currentFrame]);
+    frameCapture.collect(submittedFrames[currentFrame]);
+    reportFrameTiming();
+    resources.beginFrame(renderFrame);
+    if(snapshot.settle) {
+        setRenderScale(maxRenderScale);
+    }
+
+    uploadInstances(snapshot);
+    updateStaticBuckets(snapshot);
+    prepareClusterDraws(snapshot);
+    memcpy(resources.get(cameraBuffers[currentFrame])->mapped, &snapshot.viewProjection, sizeof(glm::mat4));
+    lightGrid.update(currentFrame, snapshot.lights, snapshot.view, snapshot.projection, snapshot.nearPlane,
+                    snapshot.farPlane, renderExtent);
+    shadowAtlas.update(currentFrame, snapshot.shadows, resources.get(instanceBuffers[currentFrame])->buffer,
+                    snapshot.shadowCasters);
+    particleSystem.update(currentFrame, snapshot.emitters, snapshot.view, snapshot.viewProjection,
+                        snapshot.cameraPosition, snapshot.deltaTime);
+    overlayRenderer.update(currentFrame, snapshot.overlay);
+
+    if(snapshot.framebufferExtent.width != framebufferExtent.width ||
+        snapshot.framebufferExtent.height != framebufferExtent.height) {
+        framebufferExtent = snapshot.framebufferExtent;
+        frameBufferResized = true;
+    }
+
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
@@ -64,12 +297,20 @@ void Renderer::drawFrame() {
     }
     imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
+    // Compute runs concurrently with whatever graphics work is still in
+    // flight, only this frame's graphics waits for it
+    VkSemaphore computeFinished = submitComputePasses();
+    recordCommandBuffer(imageIndex, snapshot);
+
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphore[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    VkSemaphore waitSemaphore[] = {imageAvailableSemaphores[currentFrame], computeFinished};
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+    submitInfo.waitSemaphoreCount = computeFinished != VK_NULL_HANDLE ? 2 : 1;
     submitInfo.pWaitSemaphores = waitSemaphore;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
@@ -82,6 +323,8 @@ void Renderer::drawFrame() {
     if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
         throw std::runtime_error("Failed to submit draw command buffer!");
     }
+    submittedFrames[currentFrame] = renderFrame;
+    timedFrames[currentFrame] = renderFrame;
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -94,16 +337,15 @@ void Renderer::drawFrame() {
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
     result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    frameCpuMilliseconds[currentFrame] =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
 
-    if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frameBufferResized) {
-        frameBufferResized = false;
+    if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frameBufferResized.exchange(false)) {
         recreateSwapChain();
     } else if (result != VK_SUCCESS) {
         throw std::runtime_error(" Failed to present swap chain image");
     }
 
-    vkQueueWaitIdle(presentQueue);
-
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
@@ -120,7 +362,7 @@ void Renderer::createInstance() {
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "Jabulah Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_1;
     instanceInfo.pApplicationInfo = &appInfo;
        auto extensions = glfwGetRequiredExtensions();
     instanceInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
@@ -173,7 +415,7 @@ void Renderer::pickPhysicalDevice() {
         }
     }
 
-    if (candidates.rbegin()->first > 0) {
+    if (!candidates.empty() && candidates.rbegin()->first > 0) {
         physicalDevice = candidates.rbegin()->second;
     } else {
         throw std::runtime_error("Failed to find suitable GPU");
@@ -188,7 +430,9 @@ int Renderer::rateDevice(const VkPhysicalDevice& device) {
     VkPhysicalDeviceFeatures deviceFeatures;
     vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
     
-    int score = 0;
+    // Every device that can run the renderer rates above 0, software
+    // rasterisers such as lavapipe included
+    int score = 1;
 
     if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
         score += 1000;
@@ -196,6 +440,14 @@ int Renderer::rateDevice(const VkPhysicalDevice& device) {
     if (!deviceFeatures.geometryShader) {
         return 0;
     }
+
+    // Compute passes only overlap rasterisation on a queue of their own
+    QueueFamilyIndices indices = findQueueFamilies(device);
+    if (indices.hasDedicatedCompute()) {
+        score += 500;
+    } else if (indices.hasAsyncCompute()) {
+        score += 100;
+    }
     return score;
 }
 
@@ -238,13 +490,7 @@ VkExtent2D Renderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilite
     if(capabilites.currentExtent.width != UINT32_MAX) 
         return capabilites.currentExtent;
 
-    int width, height;
-    glfwGetFramebufferSize(window.get(), &width, &height);
-
-    VkExtent2D actualExtent = {
-        static_cast<uint32_t>(width),
-        static_cast<uint32_t>(height)
-    };
+    VkExtent2D actualExtent = framebufferExtent;
 
     actualExtent.width = std::clamp(actualExtent.width, capabilites.minImageExtent.width, capabilites.maxImageExtent.width);
     actualExtent.height = std::clamp(actualExtent.height, capabilites.minImageExtent.height, capabilites.maxImageExtent.height);
@@ -274,6 +520,11 @@ void Renderer::createSwapChain() {
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // Lets frame capture copy the images out
+    swapChainReadable = (swapChainSupport.capabilites.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+    if(swapChainReadable) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
 
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
@@ -304,6 +555,7 @@ void Renderer::createSwapChain() {
 
     swapChainImageFormat = surfaceFormat.format;
     swapChainExtent = extent;
+    updateRenderExtent();
 }
 
 void Renderer::createImageViews() {
@@ -334,6 +586,30 @@ void Renderer::createImageViews() {
 }
 
 
+bool Renderer::isDeviceExtensionSupported(const VkPhysicalDevice& device, const char* extension) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for(const auto &available :availableExtensions) {
+        if(strcmp(available.extensionName, extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Renderer::isDeviceExtensionEnabled(const char* extension) const {
+    for(const char* enabled : enabledDeviceExtensions) {
+        if(strcmp(enabled, extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool Renderer::checkDeivceExtensionsSupport(const VkPhysicalDevice& device) {
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -358,22 +634,30 @@ QueueFamilyIndices Renderer::findQueueFamilies(const VkPhysicalDevice& device) {
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-    int i = 0;
+    uint32_t i = 0;
     for(const auto &queueFamily : queueFamilies) {
-        if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        if((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value()) {
             indices.graphicsFamily = i;
         }
         VkBool32 presentSupport = false;
         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if(presentSupport) {
+        if(presentSupport && !indices.presentFamily.has_value()) {
             indices.presentFamily = i;
         }
-        if(indices.isComplete()) {
-            break;
+        if((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+            !indices.computeFamily.has_value()) {
+            indices.computeFamily = i;
         }
         i++;
     }
 
+    // No compute-only family, share the graphics family and take a second
+    // queue from it if it has one
+    if(!indices.computeFamily.has_value() && indices.graphicsFamily.has_value()) {
+        indices.computeFamily = indices.graphicsFamily;
+        indices.computeQueueIndex = queueFamilies[indices.graphicsFamily.value()].queueCount > 1 ? 1 : 0;
+    }
+
     return indices;
 }
 
@@ -382,28 +666,69 @@ void Renderer::createLogicalDevice() {
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
-                                            indices.presentFamily.value()};
+    // Queue count per family, the compute queue may be a second queue of the graphics family
+    std::map<uint32_t, uint32_t> uniqueQueueFamilies = {{indices.graphicsFamily.value(), 1}};
+    uniqueQueueFamilies[indices.presentFamily.value()] = 1;
+    uint32_t& computeQueueCount = uniqueQueueFamilies[indices.computeFamily.value()];
+    computeQueueCount = std::max(computeQueueCount, indices.computeQueueIndex + 1);
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        float queuePriority = 1.0f;
-        for(uint32_t queueFamily : uniqueQueueFamilies) {
+        const float queuePriorities[] = {1.0f, 1.0f};
+        for(const auto& queueFamily : uniqueQueueFamilies) {
             VkDeviceQueueCreateInfo queueCreateInfo{};
             queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfo.queueFamilyIndex = queueFamily.first;
+            queueCreateInfo.queueCount = queueFamily.second;
+            queueCreateInfo.pQueuePriorities = queuePriorities;
             queueCreateInfos.push_back(queueCreateInfo);
         }
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+        // Clustered draws go out in a single indirect call when possible
         VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+        // Wireframe variants
+        deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+        fillModeNonSolid = supportedFeatures.fillModeNonSolid == VK_TRUE;
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    enabledDeviceExtensions = deviceExtensions;
+    for(const char* extension : optionalDeviceExtensions) {
+        if(isDeviceExtensionSupported(physicalDevice, extension)) {
+            enabledDeviceExtensions.push_back(extension);
+        }
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledDeviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledDeviceExtensions.data();
+
+#ifdef VK_EXT_mesh_shader
+    // Only task and mesh shaders themselves, none of the optional extras
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    if(isDeviceExtensionEnabled(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &meshShaderFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        meshShaders = meshShaderFeatures.taskShader && meshShaderFeatures.meshShader;
+        VkBool32 taskShader = meshShaderFeatures.taskShader;
+        VkBool32 meshShader = meshShaderFeatures.meshShader;
+        meshShaderFeatures = {};
+        meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        meshShaderFeatures.taskShader = taskShader;
+        meshShaderFeatures.meshShader = meshShader;
+        if(meshShaders) {
+            createInfo.pNext = &meshShaderFeatures;
+        }
+    }
+#endif
 
     if(enableVailidationLayers) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -416,8 +741,19 @@ void Renderer::createLogicalDevice() {
         throw std::runtime_error("Failed to create vkDevice!");
     }
 
+#ifdef VK_EXT_mesh_shader
+    if(meshShaders) {
+        cmdDrawMeshTasks = (PFN_vkCmdDrawMeshTasksEXT) vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+        meshShaders = cmdDrawMeshTasks != nullptr;
+    }
+#endif
+
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    graphicsFamily = indices.graphicsFamily.value();
+
+    computeQueue.init(device, indices.computeFamily.value(), indices.computeQueueIndex,
+                    graphicsFamily, MAX_FRAMES_IN_FLIGHT);
 }
 
 void Renderer::createSurface() {
@@ -448,175 +784,122 @@ SwapChainSupportDetails Renderer::querySwapChainSupport(VkPhysicalDevice device)
     return details;
 }
 
-void Renderer::createGraphicsPipeline() {
-#ifdef __linux__ 
-    auto vertShaderCode = readFile("./bin/resources/shaders/vert.spv");
-    auto fragShaderCode = readFile("./bin/resources/shaders/frag.spv");
-#elif _WIN32
-    auto vertShaderCode = readFile("bin/Debug/resources/shaders/vert.spv");
-    auto fragShaderCode = readFile("bin/Debug/resources/shaders/frag.spv");
-#endif
-
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-    auto bindingDescription = Vertex::getBindingDescriptor();
-    auto attributteDescription = Vertex::getAttributeDescription();
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributteDescription.size());
-    vertexInputInfo.pVertexAttributeDescriptions = attributteDescription.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float) swapChainExtent.width;
-    viewport.height = (float) swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.extent = {0, 0};
-    scissor.extent = swapChainExtent;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f; // Used for modes like VK_POLYGON_MODE_POINT or VK_POLYGON_MODE_LINE
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-                                            VK_COLOR_COMPONENT_G_BIT | 
-                                            VK_COLOR_COMPONENT_B_BIT | 
-                                            VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    // NOTE to blend colors based of alpha:                                            
-    /*  
-        finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor;
-        finalColor.a = newAlpha.a;
-
-        colorBlendAttachment needs these params:
-            colorBlendAttachment.blendEnable = VK_TRUE;
-            colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-            colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-            colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-            colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-            colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-            colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-    */
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
-    VkDynamicState dynamicStates[] = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_LINE_WIDTH
-    };
-
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = 2;
-    dynamicState.pDynamicStates = dynamicStates;
-
+void Renderer::createPipelineLayouts() {
+    // Set 0 is the camera, set 1 the lighting and set 2 the shadows
+    std::array<VkDescriptorSetLayout, 3> setLayouts = {cameraSetLayout, lightGrid.getSetLayout(),
+                                                    shadowAtlas.getSetLayout()};
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pSetLayouts = nullptr;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
     pipelineLayoutInfo.pushConstantRangeCount = 0;
     pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
-    if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+    if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &meshPipelineLayout) != VK_SUCCESS) {
         throw std::runtime_error(" Failed to create pipeline layout!");
     }
 
-    VkGraphicsPipelineCreateInfo pipelineInfo {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-    
-    if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-        throw std::runtime_error(" Failed to create pipeline layout!");
+#ifdef VK_EXT_mesh_shader
+    if(meshShaders && !meshlets.empty()) {
+        VkPushConstantRange clusterPushConstantRange{};
+        clusterPushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        clusterPushConstantRange.offset = 0;
+        clusterPushConstantRange.size = sizeof(ClusterPushConstants);
+
+        std::array<VkDescriptorSetLayout, 3> clusterSetLayouts = {clusterSetLayout, lightGrid.getSetLayout(),
+                                                                shadowAtlas.getSetLayout()};
+        VkPipelineLayoutCreateInfo clusterLayoutInfo{};
+        clusterLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        clusterLayoutInfo.setLayoutCount = static_cast<uint32_t>(clusterSetLayouts.size());
+        clusterLayoutInfo.pSetLayouts = clusterSetLayouts.data();
+        clusterLayoutInfo.pushConstantRangeCount = 1;
+        clusterLayoutInfo.pPushConstantRanges = &clusterPushConstantRange;
+
+        if(vkCreatePipelineLayout(device, &clusterLayoutInfo, nullptr, &clusterPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create mesh shader pipeline layout!");
+        }
+    }
+#endif
+}
+
+uint32_t Renderer::getShaderFeatures(DebugView view) {
+    switch(view) {
+        case DebugView::Unlit:
+            return 0;
+        case DebugView::Normals:
+            return SHADER_FEATURE_DEBUG_NORMALS;
+        default:
+            return SHADER_FEATURE_LIGHTING;
+    }
+}
+
+PipelineDesc Renderer::getPipelineDesc(DrawPipeline pipeline, bool wireframe, uint32_t features) const {
+    PipelineDesc desc;
+    desc.polygonMode = wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+    desc.renderPass = renderPass;
+
+#ifdef VK_EXT_mesh_shader
+    // Same fixed-function state, geometry comes from the task and mesh shaders
+    if(pipeline == DrawPipeline::Cluster && meshShaders) {
+        desc.shaders = {
+            {VK_SHADER_STAGE_TASK_BIT_EXT, "task.spv"},
+            {VK_SHADER_STAGE_MESH_BIT_EXT, "mesh.spv"},
+            {VK_SHADER_STAGE_FRAGMENT_BIT, "frag.spv", features}
+        };
+        desc.layout = clusterPipelineLayout;
+        return desc;
+    }
+#endif
+
+    // Without mesh shaders clustered draws use the vertex pipeline as well
+    desc.shaders = {
+        {VK_SHADER_STAGE_VERTEX_BIT, "vert.spv"},
+        {VK_SHADER_STAGE_FRAGMENT_BIT, "frag.spv", features}
+    };
+    desc.vertexBindings = {
+        Vertex::getBindingDescriptor(),
+        InstanceData::getBindingDescriptor()
+    };
+    for (const auto& attribute : Vertex::getAttributeDescription()) {
+        desc.vertexAttributes.push_back(attribute);
+    }
+    for (const auto& attribute : InstanceData::getAttributeDescription()) {
+        desc.vertexAttributes.push_back(attribute);
+    }
+    desc.layout = meshPipelineLayout;
+    return desc;
+}
+
+void Renderer::createGraphicsPipeline() {
+    std::vector<DrawPipeline> pipelines = {DrawPipeline::Mesh};
+    if(meshShaders && !meshlets.empty()) {
+        pipelines.push_back(DrawPipeline::Cluster);
     }
 
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    // Built right away, they stand in for every variant that is still
+    // compiling in the background
+    const uint32_t defaultFeatures = getShaderFeatures(DebugView::None);
+    graphicsPipeline = pipelineCache.compile(getPipelineDesc(DrawPipeline::Mesh, false, defaultFeatures));
+    if(pipelines.size() > 1) {
+        clusterPipeline = pipelineCache.compile(getPipelineDesc(DrawPipeline::Cluster, false, defaultFeatures));
+    }
+    shadowPipeline = pipelineCache.compile(getShadowPipelineDesc(false));
+    shadowCasterPipeline = pipelineCache.compile(getShadowPipelineDesc(true));
+    particlePipeline = pipelineCache.compile(getParticlePipelineDesc());
+    overlayPipeline = pipelineCache.compile(getOverlayPipelineDesc());
+    upscalePipeline = pipelineCache.compile(getUpscalePipelineDesc());
+
+    // The debug views share the fragment shader's module, queue them now so
+    // switching views does not wait for a compile
+    for(DrawPipeline pipeline : pipelines) {
+        for(DebugView view : {DebugView::Unlit, DebugView::Normals}) {
+            pipelineCache.get(getPipelineDesc(pipeline, false, getShaderFeatures(view)), PipelineHandle());
+        }
+    }
 }
 
 void Renderer::createRenderPass() {
+    // The scene target, left for the present pass to sample
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = swapChainImageFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -625,38 +908,98 @@ void Renderer::createRenderPass() {
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    depthFormat = findDepthFormat();
+
+    // Only needed while the pass runs, never stored
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = depthFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    // Kept when the late pass follows, the depth pyramid is built from it in
+    // between and the late draws test against it
+    const bool latePass = !meshlets.empty();
+    if(latePass) {
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-    VkSubpassDependency dependency{};
+    // The scene target and depth buffer are shared by the frames in flight,
+    // so the previous frame's depth writes and its upscale reading the
+    // target have to finish before this one clears them
+    std::array<VkSubpassDependency, 2> dependencies{};
+    VkSubpassDependency& dependency = dependencies[0];
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // The present pass samples what the last scene pass drew
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
     if(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error(" Failed to create render pass!");
     }
-    
+
+    if(!latePass) {
+        return;
+    }
+
+    // Compatible with the first pass, so the framebuffers and pipelines are
+    // shared; picks up both attachments where it left them
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    if(vkCreateRenderPass(device, &renderPassInfo, nullptr, &lateRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error(" Failed to create late render pass!");
+    }
 }
 
 std::vector<char> Renderer::readFile(const std::string& filename) {
@@ -678,10 +1021,14 @@ std::vector<char> Renderer::readFile(const std::string& filename) {
 }
 
 VkShaderModule Renderer::createShaderModule(const std::vector<char>& code) {
+    return createShaderModule(code.data(), code.size());
+}
+
+VkShaderModule Renderer::createShaderModule(const void* code, size_t size) {
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    createInfo.codeSize = size;
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code);
 
     VkShaderModule shaderModule;
     if(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -691,7 +1038,43 @@ VkShaderModule Renderer::createShaderModule(const std::vector<char>& code) {
     return shaderModule;
 }
 
+VkShaderModule Renderer::loadShader(const std::string& name) {
+    // Uncompressed payloads are aligned, Vulkan reads them from the mapping
+    if(const AssetPackEntry* entry = assets.find("shaders/" + name)) {
+        if(const void* code = assets.getPayload(*entry)) {
+            return createShaderModule(code, entry->size);
+        }
+        std::vector<char> code(entry->size);
+        assets.read(*entry, code.data());
+        return createShaderModule(code);
+    }
+
+#ifdef __linux__ 
+    return createShaderModule(readFile("./bin/resources/shaders/" + name));
+#elif _WIN32
+    return createShaderModule(readFile("bin/Debug/resources/shaders/" + name));
+#endif
+}
+
 void Renderer::createFrameBuffers() {
+    VkImageView sceneAttachments[] = {
+        resources.get(sceneImage)->view,
+        resources.get(depthImage)->view
+    };
+
+    VkFramebufferCreateInfo sceneFrameBufferInfo{};
+    sceneFrameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    sceneFrameBufferInfo.renderPass = renderPass;
+    sceneFrameBufferInfo.attachmentCount = 2;
+    sceneFrameBufferInfo.pAttachments = sceneAttachments;
+    sceneFrameBufferInfo.width = swapChainExtent.width;
+    sceneFrameBufferInfo.height = swapChainExtent.height;
+    sceneFrameBufferInfo.layers = 1;
+
+    if(vkCreateFramebuffer(device, &sceneFrameBufferInfo, nullptr, &sceneFramebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create scene framebuffer!");
+    }
+
     swapChainFrameBuffers.resize(swapChainImageViews.size());
     for(size_t i = 0; i < swapChainImageViews.size(); i++) {
         VkImageView attachemnts[] = {
@@ -700,7 +1083,7 @@ void Renderer::createFrameBuffers() {
 
         VkFramebufferCreateInfo frameBufferInfo{};
         frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        frameBufferInfo.renderPass = renderPass;
+        frameBufferInfo.renderPass = presentRenderPass;
         frameBufferInfo.attachmentCount = 1;
         frameBufferInfo.pAttachments = attachemnts;
         frameBufferInfo.width = swapChainExtent.width;
@@ -713,12 +1096,68 @@ void Renderer::createFrameBuffers() {
     }
 }
 
+void Renderer::createDepthResources() {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {swapChainExtent.width, swapChainExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = depthFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // Source of the depth pyramid
+    if(lateRenderPass != VK_NULL_HANDLE) {
+        imageInfo.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+
+    depthImage = resources.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, getDepthAspect(),
+                MemoryCategory::RenderTargets);
+
+    if(lateRenderPass != VK_NULL_HANDLE) {
+        depthPyramid.resize(resources.get(depthImage)->image, depthFormat, swapChainExtent);
+    }
+}
+
+VkImageAspectFlags Renderer::getDepthAspect() const {
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if(depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+        aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+    return aspect;
+}
+
+VkFormat Renderer::findDepthFormat() {
+    const std::array<VkFormat, 3> candidates = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D32_SFLOAT_S8_UINT,
+        VK_FORMAT_D24_UNORM_S8_UINT
+    };
+    // Occlusion culling samples it for the depth pyramid
+    VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if(!meshlets.empty()) {
+        features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    }
+    for(VkFormat format : candidates) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+        if((properties.optimalTilingFeatures & features) == features) {
+            return format;
+        }
+    }
+    throw std::runtime_error("Failed to find a supported depth format!");
+}
+
 void Renderer::createCommandPool() {
     QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-    poolInfo.flags = 0;
+    // Command buffers are re-recorded every frame from the scene's draw list
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     if(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create command pool!");
@@ -727,6 +1166,7 @@ void Renderer::createCommandPool() {
 
 void Renderer::createCommandBuffers() {
     commandBuffers.resize(swapChainFrameBuffers.size());
+    dynamicCommandBuffers.resize(swapChainFrameBuffers.size());
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -738,172 +1178,1215 @@ void Renderer::createCommandBuffers() {
         throw std::runtime_error("Failed to allocate command buffers!");
     }
 
-    for(size_t i = 0; i < commandBuffers.size(); i++) {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = 0;
-        beginInfo.pInheritanceInfo = nullptr;
-
-        if(vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to begin recording command buffer!");
-        }
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    if(vkAllocateCommandBuffers(device, &allocInfo, dynamicCommandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate secondary command buffers!");
+    }
+}
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFrameBuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
-        
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+void Renderer::recordCommandBuffer(uint32_t imageIndex, const RenderSnapshot& snapshot) {
+    VkCommandBuffer commandBuffer = commandBuffers[imageIndex];
+    vkResetCommandBuffer(commandBuffer, 0);
 
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = nullptr;
 
-            VkBuffer vertexBuffers[] = {vertexBuffer};
-            VkDeviceSize offsets[] = {0};
-            vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-            vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
 
-            vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-        vkCmdEndRenderPass(commandBuffers[i]);
+    if(timestampPool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(commandBuffer, timestampPool, static_cast<uint32_t>(currentFrame) * 2, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool,
+                            static_cast<uint32_t>(currentFrame) * 2);
+    }
 
-        if(vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to record command buffer!");
+    for(const auto& pass : computePasses) {
+        if(pass.acquire) {
+            pass.acquire(commandBuffer, currentFrame);
         }
     }
-}
 
-void Renderer::createVertexBuffer() {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+    // The previous frame's late phase wrote the visibility flags this one
+    // reads and writes again
+    if(lateRenderPass != VK_NULL_HANDLE) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, getOcclusionStages(), getOcclusionStages(), 0, 1, &barrier,
+                            0, nullptr, 0, nullptr);
+    }
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                stagingBuffer, stagingBufferMemory);
-    
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = sceneFramebuffer;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = renderExtent;
+
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    DrawStats stats;
+    stats.packets = static_cast<uint32_t>(snapshot.packets.size());
+
+    // Uploads the glyph atlas the first time around
+    overlayRenderer.record(commandBuffer);
+
+    // Static shadow casters are only drawn again when static geometry changed
+    shadowAtlas.record(commandBuffer, currentFrame, snapshot.shadows, !snapshot.staticUpdates.empty(),
+                    snapshot.shadowFaceDraws, resources.get(shadowPipeline)->pipeline,
+                    resources.get(shadowCasterPipeline)->pipeline,
+                    [&](VkCommandBuffer shadowCommandBuffer, bool staticCasters, uint32_t face) {
+                        recordShadowCasters(shadowCommandBuffer, snapshot, staticCasters, face, stats);
+                    }, stats);
+
+    // Variants still compiling in the background draw with the default
+    // pipelines until they are ready
+    const bool wireframeVariant = wireframe.load(std::memory_order_relaxed) && fillModeNonSolid;
+    const uint32_t features = getShaderFeatures(debugView.load(std::memory_order_relaxed));
+    const Pipeline* pipeline = resources.get(pipelineCache.get(
+        getPipelineDesc(DrawPipeline::Mesh, wireframeVariant, features), graphicsPipeline));
+    const Pipeline* meshShaderPipeline = nullptr;
+    if(meshShaders && !meshlets.empty()) {
+        meshShaderPipeline = resources.get(pipelineCache.get(
+            getPipelineDesc(DrawPipeline::Cluster, wireframeVariant, features), clusterPipeline));
+    }
+    // Rendering on demand, nothing else would draw the frame again once they are
+    if(pipelineCache.pendingCompiles() > 0) {
+        requestRedraw();
+    }
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    // Static buckets first, their command buffers are usually replayed as
+    // they are; only the dynamic draws are recorded every frame
+    std::vector<VkCommandBuffer> secondaries;
+    for(auto& bucket : staticBuckets) {
+        if(!bucket.drawList.empty()) {
+            secondaries.push_back(getStaticCommandBuffer(bucket, pipeline, stats));
+        }
+    }
+    secondaries.push_back(recordDynamicDraws(imageIndex, snapshot, pipeline, meshShaderPipeline, stats));
 
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    vkCmdEndRenderPass(commandBuffer);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+    if(lateRenderPass != VK_NULL_HANDLE) {
+        recordLatePass(commandBuffer, imageIndex, snapshot, pipeline, meshShaderPipeline, stats);
+    }
 
-void Renderer::createIndexBuffer() {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    recordPresentPass(commandBuffer, imageIndex, stats);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                stagingBuffer, stagingBufferMemory);
-    
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, indices.data(), (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    // Read back once the frame has completed, a no-op unless capturing
+    if(swapChainReadable) {
+        frameCapture.record(commandBuffer, swapChainImages[imageIndex], swapChainImageFormat, swapChainExtent,
+                            snapshot.frameIndex + 1);
+    }
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+    {
+        std::lock_guard<std::mutex> lock(drawStatsMutex);
+        drawStats = stats;
+    }
 
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+    if(timestampPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool,
+                            static_cast<uint32_t>(currentFrame) * 2 + 1);
+    }
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
 }
 
-void Renderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+void Renderer::beginSecondaryCommandBuffer(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer,
+                                        VkCommandBufferUsageFlags flags) {
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
 
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | flags;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording secondary command buffer!");
+    }
 
-    VkBufferCopy copyRegion{};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-    vkEndCommandBuffer(commandBuffer);
+    // Dynamic state is not inherited from the primary
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float) renderExtent.width;
+    viewport.height = (float) renderExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = renderExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
 
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
+VkCommandBuffer Renderer::recordDynamicDraws(uint32_t imageIndex, const RenderSnapshot& snapshot,
+                                        const Pipeline* pipeline, const Pipeline* meshShaderPipeline,
+                                        DrawStats& stats) {
+    VkCommandBuffer commandBuffer = dynamicCommandBuffers[imageIndex];
+    beginSecondaryCommandBuffer(commandBuffer, sceneFramebuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    // Packets come sorted by the state they need, binds that would not
+    // change anything are dropped
+    BindState state(commandBuffer, stats);
+    const std::array<VkBuffer, 2> vertexBuffers = {
+        resources.get(vertexBuffer)->buffer,
+        resources.get(instanceBuffers[currentFrame])->buffer
+    };
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    for(const auto& packet : snapshot.packets) {
+        const DrawCommand& draw = snapshot.drawList[packet.draw];
+        DrawPipeline drawPipeline = getDrawPipeline(packet.key);
 
-}
+        if(drawPipeline == DrawPipeline::Cluster && meshShaders) {
+            recordClusterDraw(state, draw, meshShaderPipeline);
+            continue;
+        }
+
+        // Descriptor sets do not survive a switch to another layout
+        state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+        state.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout,
+                            getDrawDescriptorSets(cameraDescriptorSets[currentFrame]));
+        state.bindVertexBuffers(vertexBuffers);
 
-uint32_t Renderer::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
+        if(drawPipeline == DrawPipeline::Cluster) {
+            recordClusterDraw(state, draw, nullptr);
+            continue;
         }
 
+        state.bindIndexBuffer(resources.get(indexBuffer)->buffer, VK_INDEX_TYPE_UINT32);
+        const Mesh& mesh = meshes[draw.mesh];
+        const MeshLod& lod = mesh.lods[draw.lod];
+        vkCmdDrawIndexed(commandBuffer, lod.indexCount, draw.instanceCount,
+                        lod.firstIndex, mesh.vertexOffset, draw.firstInstance);
+        state.countDraw();
+    }
+
+    // Blended over everything opaque, which the late pass adds to otherwise
+    if(lateRenderPass == VK_NULL_HANDLE) {
+        recordParticles(state);
     }
-    throw std::runtime_error("Failed to find suitable memory type!");
-}
 
-void Renderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                VkDeviceMemory& bufferMemory) {
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record dynamic draws!");
+    }
+    return commandBuffer;
+}
 
-    if(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create vertex buffer");
+MeshData buildMeshData(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                    const LodSettings& settings) {
+    std::vector<glm::vec3> positions(vertices.size());
+    glm::vec3 minBounds(INFINITY);
+    glm::vec3 maxBounds(-INFINITY);
+    for(size_t i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].pos;
+        minBounds = glm::min(minBounds, positions[i]);
+        maxBounds = glm::max(maxBounds, positions[i]);
     }
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, 
-                                properties);
+    MeshData data{};
+    data.vertices = vertices;
+    data.info.vertexCount = static_cast<uint32_t>(vertices.size());
+    data.info.boundsCenter = (minBounds + maxBounds) * 0.5f;
+    for(const auto& position : positions) {
+        data.info.boundsRadius = std::max(data.info.boundsRadius, glm::length(position - data.info.boundsCenter));
+    }
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate vertex buffer memory!");
+    // Every level goes into the index array back to back
+    LodSettings lodSettings = settings;
+    lodSettings.maxLevels = std::min(lodSettings.maxLevels, MAX_MESH_LODS);
+    std::vector<LodLevel> levels = generateLods(positions, indices, lodSettings);
+    data.info.lodCount = static_cast<uint32_t>(levels.size());
+    for(size_t i = 0; i < levels.size(); i++) {
+        data.info.lods[i].firstIndex = static_cast<uint32_t>(data.indices.size());
+        data.info.lods[i].indexCount = static_cast<uint32_t>(levels[i].indices.size());
+        data.info.lods[i].error = levels[i].error;
+        data.indices.insert(data.indices.end(), levels[i].indices.begin(), levels[i].indices.end());
+    }
+    data.info.indexCount = static_cast<uint32_t>(data.indices.size());
+
+    // Dense meshes are also split into meshlets for cluster culling
+    if(indices.size() / 3 >= CLUSTER_MIN_TRIANGLES) {
+        data.meshlets = buildMeshlets(positions, indices);
+        data.info.meshletCount = static_cast<uint32_t>(data.meshlets.meshlets.size());
+        data.info.meshletVertexCount = static_cast<uint32_t>(data.meshlets.vertices.size());
+        data.info.meshletTriangleBytes = static_cast<uint32_t>(data.meshlets.triangles.size());
     }
 
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);    
+    return data;
 }
 
-void Renderer::createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+uint32_t Renderer::addMesh(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices,
+                        const LodSettings& settings) {
+    return addMesh(buildMeshData(meshVertices, meshIndices, settings));
+}
 
-    VkSemaphoreCreateInfo semaphoreInfo{};
+// Bytes of the vertices, indices, meshlets, meshlet vertices and meshlet
+// triangles, the order both cooked payloads and appendMesh lay them out in
+static void getMeshSections(const MeshInfo& info, uint64_t sizes[5]) {
+    sizes[0] = sizeof(Vertex) * static_cast<uint64_t>(info.vertexCount);
+    sizes[1] = sizeof(uint32_t) * static_cast<uint64_t>(info.indexCount);
+    sizes[2] = sizeof(Meshlet) * static_cast<uint64_t>(info.meshletCount);
+    sizes[3] = sizeof(uint32_t) * static_cast<uint64_t>(info.meshletVertexCount);
+    sizes[4] = info.meshletTriangleBytes;
+}
+
+void GeometryStream::append(const void* data, size_t bytes) {
+    if(bytes > 0) {
+        spans.emplace_back(data, bytes);
+        size += bytes;
+    }
+}
+
+void GeometryStream::copyTo(void* destination) const {
+    uint8_t* output = static_cast<uint8_t*>(destination);
+    for(const auto& span : spans) {
+        memcpy(output, span.first, span.second);
+        output += span.second;
+    }
+}
+
+uint32_t Renderer::addMesh(const MeshData& data) {
+    // The caller's arrays may not live until the upload, one copy in payload
+    // order keeps them
+    uint64_t sizes[5];
+    getMeshSections(data.info, sizes);
+    const void* sections[] = {data.vertices.data(), data.indices.data(), data.meshlets.meshlets.data(),
+                            data.meshlets.vertices.data(), data.meshlets.triangles.data()};
+    const size_t available[] = {sizeof(Vertex) * data.vertices.size(), sizeof(uint32_t) * data.indices.size(),
+                                sizeof(Meshlet) * data.meshlets.meshlets.size(),
+                                sizeof(uint32_t) * data.meshlets.vertices.size(), data.meshlets.triangles.size()};
+
+    std::vector<uint8_t> payload;
+    for(size_t i = 0; i < 5; i++) {
+        if(sizes[i] != available[i]) {
+            throw std::runtime_error("Failed to add mesh, sizes do not match its data!");
+        }
+        const uint8_t* section = static_cast<const uint8_t*>(sections[i]);
+        payload.insert(payload.end(), section, section + sizes[i]);
+    }
+
+    const uint8_t* start = payload.data();
+    return appendMesh(data.info, start, std::move(payload));
+}
+
+uint32_t Renderer::addMesh(const std::string& name) {
+    const AssetPackEntry* entry = assets.find(name);
+    if(!entry || entry->type != AssetType::Mesh) {
+        throw std::runtime_error("Failed to find mesh " + name + " in the asset pack!");
+    }
+    const MeshInfo* info = assets.getMetadata<MeshInfo>(*entry);
+
+    uint64_t payloadSize = 0;
+    if(info) {
+        uint64_t sizes[5];
+        getMeshSections(*info, sizes);
+        for(uint64_t size : sizes) {
+            payloadSize += size;
+        }
+    }
+    if(!info || payloadSize != entry->size) {
+        throw std::runtime_error("Cooked mesh " + name + " does not match this renderer's layout!");
+    }
+
+    // Uncompressed payloads are uploaded straight from the mapping,
+    // compressed ones are decompressed once and kept until then
+    if(const void* payload = assets.getPayload(*entry)) {
+        return appendMesh(*info, static_cast<const uint8_t*>(payload), {});
+    }
+    std::vector<uint8_t> payload(static_cast<size_t>(entry->size));
+    assets.read(*entry, payload.data());
+    const uint8_t* start = payload.data();
+    return appendMesh(*info, start, std::move(payload));
+}
+
+uint32_t Renderer::appendMesh(const MeshInfo& info, const uint8_t* payload, std::vector<uint8_t> storage) {
+    if(info.lodCount == 0 || info.lodCount > MAX_MESH_LODS) {
+        throw std::runtime_error("Failed to add mesh, invalid level count!");
+    }
+
+    uint64_t sizes[5];
+    getMeshSections(info, sizes);
+    const uint8_t* sections[5];
+    for(size_t i = 0; i < 5; i++) {
+        sections[i] = i == 0 ? payload : sections[i - 1] + sizes[i - 1];
+    }
+    const uint32_t* meshIndices = reinterpret_cast<const uint32_t*>(sections[1]);
+    const Meshlet* meshMeshlets = reinterpret_cast<const Meshlet*>(sections[2]);
+    const uint32_t* meshMeshletVertices = reinterpret_cast<const uint32_t*>(sections[3]);
+    const uint8_t* meshMeshletTriangles = sections[4];
+
+    // Cooked meshes are only as sound as the file they came from, anything
+    // out of range here would have the GPU read past the shared buffers
+    for(uint32_t i = 0; i < info.lodCount; i++) {
+        if(static_cast<uint64_t>(info.lods[i].firstIndex) + info.lods[i].indexCount > info.indexCount) {
+            throw std::runtime_error("Failed to add mesh, level out of range!");
+        }
+    }
+    for(uint32_t i = 0; i < info.indexCount; i++) {
+        if(meshIndices[i] >= info.vertexCount) {
+            throw std::runtime_error("Failed to add mesh, index out of range!");
+        }
+    }
+    for(uint32_t i = 0; i < info.meshletVertexCount; i++) {
+        if(meshMeshletVertices[i] >= info.vertexCount) {
+            throw std::runtime_error("Failed to add mesh, meshlet vertex out of range!");
+        }
+    }
+    for(uint32_t i = 0; i < info.meshletCount; i++) {
+        const Meshlet& meshlet = meshMeshlets[i];
+        if(static_cast<uint64_t>(meshlet.vertexOffset) + meshlet.vertexCount > info.meshletVertexCount ||
+            meshlet.triangleOffset % 4 != 0 ||
+            meshlet.triangleOffset + 3 * static_cast<uint64_t>(meshlet.triangleCount) > info.meshletTriangleBytes) {
+            throw std::runtime_error("Failed to add mesh, meshlet out of range!");
+        }
+        for(uint32_t t = 0; t < 3 * meshlet.triangleCount; t++) {
+            if(meshMeshletTriangles[meshlet.triangleOffset + t] >= meshlet.vertexCount) {
+                throw std::runtime_error("Failed to add mesh, meshlet triangle out of range!");
+            }
+        }
+    }
+
+    size_t firstVertex = vertices.size / sizeof(Vertex);
+    size_t firstIndex = indices.size / sizeof(uint32_t);
+    size_t firstMeshlet = meshlets.size();
+    size_t firstMeshletVertex = meshletVertices.size / sizeof(uint32_t);
+    size_t firstMeshletTriangle = meshletTriangles.size;
+
+    vertices.append(sections[0], static_cast<size_t>(sizes[0]));
+    indices.append(sections[1], static_cast<size_t>(sizes[1]));
+    meshlets.insert(meshlets.end(), meshMeshlets, meshMeshlets + info.meshletCount);
+    meshletVertices.append(sections[3], static_cast<size_t>(sizes[3]));
+    meshletTriangles.append(sections[4], static_cast<size_t>(sizes[4]));
+    if(!storage.empty()) {
+        meshStorage.push_back(std::move(storage));
+    }
+
+    Mesh mesh{};
+    mesh.vertexOffset = static_cast<int32_t>(firstVertex);
+    mesh.boundsCenter = info.boundsCenter;
+    mesh.boundsRadius = info.boundsRadius;
+    mesh.lodCount = info.lodCount;
+    for(uint32_t i = 0; i < info.lodCount; i++) {
+        mesh.lods[i] = info.lods[i];
+        mesh.lods[i].firstIndex += static_cast<uint32_t>(firstIndex);
+    }
+
+    // Meshlets come relative to the mesh's own meshlet data
+    if(info.meshletCount > 0) {
+        mesh.meshletOffset = static_cast<uint32_t>(firstMeshlet);
+        mesh.meshletCount = info.meshletCount;
+        for(size_t i = firstMeshlet; i < meshlets.size(); i++) {
+            meshlets[i].vertexOffset += static_cast<uint32_t>(firstMeshletVertex);
+            meshlets[i].triangleOffset += static_cast<uint32_t>(firstMeshletTriangle);
+        }
+    }
+
+    meshes.push_back(mesh);
+    return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void Renderer::releaseMeshData() {
+    // Meshlets stay, whether there are any decides which passes are recorded
+    vertices = GeometryStream();
+    indices = GeometryStream();
+    meshletVertices = GeometryStream();
+    meshletTriangles = GeometryStream();
+    meshStorage.clear();
+    meshStorage.shrink_to_fit();
+}
+
+void Renderer::createVertexBuffer() {
+    if(vertices.size == 0) {
+        throw std::runtime_error("Failed to create vertex buffer, no meshes were added!");
+    }
+    // Mesh shaders fetch vertices themselves
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    if(meshShaders) {
+        usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    }
+    vertexBuffer = createStaticBuffer(vertices.size, usage, [this](void* destination) {
+        vertices.copyTo(destination);
+    });
+}
+
+void Renderer::createIndexBuffer() {
+    indexBuffer = createStaticBuffer(indices.size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, [this](void* destination) {
+        indices.copyTo(destination);
+    });
+}
+
+BufferHandle Renderer::createStaticBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+                                        BufferSharing sharing) {
+    return createStaticBuffer(size, usage, [data, size](void* destination) {
+        memcpy(destination, data, (size_t) size);
+    }, sharing);
+}
+
+BufferHandle Renderer::createStaticBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                        const std::function<void(void*)>& fill, BufferSharing sharing) {
+    // With resizable BAR or unified memory the data goes straight into its
+    // final device-local home
+    if(resources.prefersDirectUpload(size)) {
+        BufferHandle buffer = resources.createBuffer(size, usage, MemoryUsage::Upload, MemoryCategory::Geometry,
+                    sharing);
+        fill(resources.get(buffer)->mapped);
+        return buffer;
+    }
+
+    BufferHandle stagingBuffer = resources.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::Upload,
+                MemoryCategory::Staging);
+    fill(resources.get(stagingBuffer)->mapped);
+
+    BufferHandle buffer = resources.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, MemoryUsage::GpuOnly,
+                MemoryCategory::Geometry, sharing);
+    copyBuffer(resources.get(stagingBuffer)->buffer, resources.get(buffer)->buffer, size);
+
+    resources.destroy(stagingBuffer);
+    return buffer;
+}
+
+void Renderer::createInstanceBuffers() {
+    instanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    instanceBufferCapacity.resize(MAX_FRAMES_IN_FLIGHT, 0);
+
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        reserveInstanceBuffer(i, 1024);
+    }
+}
+
+void Renderer::reserveInstanceBuffer(size_t frame, size_t instanceCount) {
+    if(instanceCount <= instanceBufferCapacity[frame]) {
+        return;
+    }
+
+    resources.destroy(instanceBuffers[frame]);
+
+    size_t capacity = std::max(instanceCount, instanceBufferCapacity[frame] * 2);
+    VkDeviceSize bufferSize = sizeof(InstanceData) * capacity;
+    // Also read by the dynamic shadow casters through their indices
+    instanceBuffers[frame] = resources.createBuffer(bufferSize,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::Dynamic,
+                MemoryCategory::Geometry);
+    instanceBufferCapacity[frame] = capacity;
+}
+
+VkSemaphore Renderer::submitComputePasses() {
+    if(computePasses.empty()) {
+        return VK_NULL_HANDLE;
+    }
+
+    VkCommandBuffer commandBuffer = computeQueue.begin(currentFrame);
+    for(const auto& pass : computePasses) {
+        pass.record(commandBuffer, currentFrame);
+    }
+    return computeQueue.submit(currentFrame);
+}
+
+void Renderer::uploadInstances(const RenderSnapshot& snapshot) {
+    reserveInstanceBuffer(currentFrame, snapshot.instances.size());
+    if(!snapshot.instances.empty()) {
+        memcpy(resources.get(instanceBuffers[currentFrame])->mapped, snapshot.instances.data(),
+                sizeof(InstanceData) * snapshot.instances.size());
+    }
+}
+
+uint32_t Renderer::selectLod(const Mesh& mesh, const glm::mat4& model, float pixelsPerUnit) const {
+    glm::vec3 center = glm::vec3(model * glm::vec4(mesh.boundsCenter, 1.0f));
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+                    std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+    // Distance to the nearest point of the bounding sphere, so the error is
+    // never underestimated for any part of the mesh
+    float distance = glm::length(center - camera.position) - mesh.boundsRadius * scale;
+    if(distance <= camera.nearPlane) {
+        return 0;
+    }
+
+    // Object-space error that still projects below the threshold
+    float allowedError = lodErrorThreshold * distance / (pixelsPerUnit * scale);
+    uint32_t lod = 0;
+    while(lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error <= allowedError) {
+        lod++;
+    }
+    return lod;
+}
+
+void Renderer::extractSnapshot(RenderSnapshot& snapshot) {
+    transforms.update(jobs);
+    transforms.writeWorldTransforms(scene, jobs);
+
+    float aspect = snapshot.framebufferExtent.width / (float) snapshot.framebufferExtent.height;
+    snapshot.view = camera.view();
+    snapshot.projection = camera.projection(aspect);
+    snapshot.viewProjection = snapshot.projection * snapshot.view;
+    snapshot.nearPlane = camera.nearPlane;
+    snapshot.farPlane = camera.farPlane;
+    snapshot.cameraPosition = camera.position;
+    // Pixels actually rendered, fewer while dynamic resolution scales down
+    float pixelsPerUnit = camera.pixelsPerUnit((float) snapshot.framebufferExtent.height * getRenderScale());
+
+    scene.queryChunks<WorldTransform, MeshInstance>(drawChunks);
+    extractStaticBuckets(snapshot, pixelsPerUnit);
+    extractLights(snapshot);
+    extractParticles(snapshot);
+    extractOverlay(snapshot);
+
+    // Every chunk lists the (mesh, LOD) pairs its instances use, with their
+    // counts and the nearest instance's view depth for the sort keys. Only
+    // those runs are merged into draws, so the work follows the instances
+    // rather than chunks times pairs. Each instance keeps the index of its
+    // run, so both passes agree and LODs are only selected once
+    const size_t meshCount = meshes.size();
+    const glm::vec3 viewDirection = glm::normalize(camera.target - camera.position);
+    chunkInstanceOffsets.resize(drawChunks.size());
+    chunkDrawRunCounts.resize(drawChunks.size());
+    uint32_t chunkInstanceCount = 0;
+    for(size_t c = 0; c < drawChunks.size(); c++) {
+        chunkInstanceOffsets[c] = chunkInstanceCount;
+        chunkInstanceCount += drawChunks[c].size();
+    }
+    // A chunk never has more runs than instances, so its runs share its
+    // instances' offset
+    instanceDrawRuns.resize(chunkInstanceCount);
+    chunkDrawRuns.resize(chunkInstanceCount);
+    jobs.parallelFor(drawChunks.size(), 16, [&](size_t begin, size_t end) {
+        for(size_t c = begin; c < end; c++) {
+            const WorldTransform* transforms = drawChunks[c].get<WorldTransform>();
+            const MeshInstance* instances = drawChunks[c].get<MeshInstance>();
+            const uint32_t* lodSlots = chunkStaticOffsets[c] != UINT32_MAX ? &staticSlots[chunkStaticOffsets[c]] : nullptr;
+            uint32_t* instanceRuns = &instanceDrawRuns[chunkInstanceOffsets[c]];
+            DrawRun* runs = &chunkDrawRuns[chunkInstanceOffsets[c]];
+            uint32_t runCount = 0;
+            uint32_t lastRun = 0;
+            for(uint32_t i = 0; i < drawChunks[c].size(); i++) {
+                instanceRuns[i] = UINT32_MAX;
+                uint32_t mesh = instances[i].mesh;
+                if(mesh >= meshCount) {
+                    continue;
+                }
+                // Static instances only come through here when clustered
+                uint32_t lod = lodSlots ? lodSlots[i] % MAX_MESH_LODS :
+                                        selectLod(meshes[mesh], transforms[i].matrix, pixelsPerUnit);
+                if(lodSlots && !isClustered(mesh, lod)) {
+                    continue;
+                }
+
+                // Neighbouring instances mostly share their pair, a chunk
+                // only holds a few hundred instances to search otherwise
+                uint32_t slot = mesh * MAX_MESH_LODS + lod;
+                if(lastRun >= runCount || runs[lastRun].slot != slot) {
+                    lastRun = 0;
+                    while(lastRun < runCount && runs[lastRun].slot != slot) {
+                        lastRun++;
+                    }
+                    if(lastRun == runCount) {
+                        runs[runCount++] = {slot, 0, INFINITY, 0};
+                    }
+                }
+                instanceRuns[i] = lastRun;
+                runs[lastRun].count++;
+                float depth = glm::dot(glm::vec3(transforms[i].matrix[3]) - camera.position, viewDirection);
+                runs[lastRun].depth = std::min(runs[lastRun].depth, depth);
+            }
+            chunkDrawRunCounts[c] = runCount;
+        }
+    }, "Renderer::countInstances");
+
+    // Radix sorted by pair, the stable sort keeps each pair's runs in chunk
+    // order; only the pair's bytes take a pass
+    drawRunOrder.clear();
+    for(size_t c = 0; c < drawChunks.size(); c++) {
+        for(uint32_t r = 0; r < chunkDrawRunCounts[c]; r++) {
+            uint32_t run = chunkInstanceOffsets[c] + r;
+            drawRunOrder.push_back({chunkDrawRuns[run].slot, run, 0});
+        }
+    }
+    sortDrawPackets(drawRunOrder, packetScratch);
+
+    std::vector<DrawCommand>& drawList = snapshot.drawList;
+    std::vector<DrawPacket>& packets = snapshot.packets;
+    drawList.clear();
+    packets.clear();
+    uint32_t instanceCount = 0;
+    uint32_t clusterDrawCount = 0;
+    for(size_t first = 0; first < drawRunOrder.size();) {
+        const uint32_t slot = static_cast<uint32_t>(drawRunOrder[first].key);
+        uint32_t firstInstance = instanceCount;
+        float depth = INFINITY;
+        size_t next = first;
+        for(; next < drawRunOrder.size() && drawRunOrder[next].key == slot; next++) {
+            DrawRun& run = chunkDrawRuns[drawRunOrder[next].draw];
+            run.offset = instanceCount;
+            instanceCount += run.count;
+            depth = std::min(depth, run.depth);
+        }
+        first = next;
+
+        DrawCommand draw{slot / MAX_MESH_LODS, slot % MAX_MESH_LODS, firstInstance, instanceCount - firstInstance, 0};
+        DrawPipeline pipeline = DrawPipeline::Mesh;
+        if(isClustered(draw)) {
+            pipeline = DrawPipeline::Cluster;
+            draw.firstClusterDraw = clusterDrawCount;
+            clusterDrawCount += draw.instanceCount;
+        }
+        // Every mesh shares the one material there is so far
+        uint64_t key = makeDrawKey(DrawPass::Opaque, pipeline, 0, draw.mesh, depth);
+        packets.push_back({key, static_cast<uint32_t>(drawList.size()), 0});
+        drawList.push_back(draw);
+    }
+    sortDrawPackets(packets, packetScratch);
+
+    snapshot.instances.resize(instanceCount);
+    InstanceData* instanceData = snapshot.instances.data();
+
+    jobs.parallelFor(drawChunks.size(), 16, [&](size_t begin, size_t end) {
+        for(size_t c = begin; c < end; c++) {
+            const WorldTransform* transforms = drawChunks[c].get<WorldTransform>();
+            const uint32_t* instanceRuns = &instanceDrawRuns[chunkInstanceOffsets[c]];
+            DrawRun* runs = &chunkDrawRuns[chunkInstanceOffsets[c]];
+            for(uint32_t i = 0; i < drawChunks[c].size(); i++) {
+                if(instanceRuns[i] != UINT32_MAX) {
+                    instanceData[runs[instanceRuns[i]].offset++].model = transforms[i].matrix;
+                }
+            }
+        }
+    }, "Renderer::gatherInstances");
+
+    extractShadowCasters(snapshot);
+}
+
+bool Renderer::isClustered(const DrawCommand& draw) const {
+    return isClustered(draw.mesh, draw.lod);
+}
+
+bool Renderer::isClustered(uint32_t mesh, uint32_t lod) const {
+    return lod == 0 && meshes[mesh].meshletCount > 0;
+}
+
+void Renderer::createClusterLayout() {
+    if(meshlets.empty()) {
+        return;
+    }
+
+    VkShaderStageFlags stages = VK_SHADER_STAGE_COMPUTE_BIT;
+#ifdef VK_EXT_mesh_shader
+    if(meshShaders) {
+        stages = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
+#endif
+
+    // 0 meshlets, 1 meshlet vertices, 2 meshlet triangles, 3 draws,
+    // 4 the compacted indices when culling or the vertices for mesh shaders,
+    // 5 the visibility flags, 6 the early-drawn flags and 7 the depth pyramid
+    std::array<VkDescriptorSetLayoutBinding, 8> bindings{};
+    for(uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = stages;
+    }
+    bindings[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &clusterSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create cluster descriptor set layout!");
+    }
+
+    VkShaderModule reduceShaderModule = loadShader("reduce.spv");
+    depthPyramid.init(device, resources, reduceShaderModule);
+    vkDestroyShaderModule(device, reduceShaderModule, nullptr);
+
+    // The mesh shader pipeline is rebuilt with the swapchain
+    if(meshShaders) {
+        return;
+    }
+
+    VkShaderModule cullShaderModule = loadShader("cull.spv");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(ClusterPushConstants);
+
+    VkPipelineLayout pipelineLayout;
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &clusterSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        vkDestroyShaderModule(device, cullShaderModule, nullptr);
+        throw std::runtime_error("Failed to create cluster culling pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = cullShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    VkPipeline pipeline;
+    if(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyShaderModule(device, cullShaderModule, nullptr);
+        throw std::runtime_error("Failed to create cluster culling pipeline!");
+    }
+    clusterPipeline = resources.addPipeline(pipeline, pipelineLayout);
+
+    vkDestroyShaderModule(device, cullShaderModule, nullptr);
+}
+
+void Renderer::createClusterResources() {
+    if(meshlets.empty()) {
+        return;
+    }
+
+    // Uploaded on the graphics queue but read by the culling pass as well
+    meshletBuffer = createStaticBuffer(meshlets.data(), sizeof(Meshlet) * meshlets.size(),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, BufferSharing::Concurrent);
+    meshletVertexBuffer = createStaticBuffer(meshletVertices.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                [this](void* destination) { meshletVertices.copyTo(destination); }, BufferSharing::Concurrent);
+    meshletTriangleBuffer = createStaticBuffer(meshletTriangles.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                [this](void* destination) { meshletTriangles.copyTo(destination); }, BufferSharing::Concurrent);
+
+    clusterDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    clusterDrawCapacity.resize(MAX_FRAMES_IN_FLIGHT, 0);
+    clusterIndexBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    clusterIndexCapacity.resize(MAX_FRAMES_IN_FLIGHT, 0);
+    clusterConstants.resize(MAX_FRAMES_IN_FLIGHT);
+    clusterMaxMeshlets.resize(MAX_FRAMES_IN_FLIGHT, 0);
+    clusterEarlyBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    clusterEarlyCapacity.resize(MAX_FRAMES_IN_FLIGHT, 0);
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 7 * MAX_FRAMES_IN_FLIGHT;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+
+    if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &clusterDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create cluster descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, clusterSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = clusterDescriptorPool;
+    allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+    allocInfo.pSetLayouts = layouts.data();
+
+    clusterDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    if(vkAllocateDescriptorSets(device, &allocInfo, clusterDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate cluster descriptor sets!");
+    }
+
+    if(!meshShaders) {
+        addComputePass({
+            [this](VkCommandBuffer commandBuffer, size_t frame) { recordClusterCulling(commandBuffer, frame); },
+            [this](VkCommandBuffer commandBuffer, size_t frame) { acquireClusterDraws(commandBuffer, frame); }
+        });
+    }
+}
+
+void Renderer::prepareClusterDraws(const RenderSnapshot& snapshot) {
+    if(meshlets.empty()) {
+        return;
+    }
+
+    // Every instance of a clustered mesh drawn at full detail becomes its
+    // own draw with room for all of its indices
+    uint32_t drawCount = 0;
+    uint32_t maxMeshlets = 0;
+    size_t indexCount = 0;
+    size_t meshletCount = 0;
+    for(const auto& draw : snapshot.drawList) {
+        if(isClustered(draw)) {
+            const Mesh& mesh = meshes[draw.mesh];
+            drawCount += draw.instanceCount;
+            indexCount += static_cast<size_t>(mesh.lods[0].indexCount) * draw.instanceCount;
+            meshletCount += static_cast<size_t>(mesh.meshletCount) * draw.instanceCount;
+            maxMeshlets = std::max(maxMeshlets, mesh.meshletCount);
+        }
+    }
+
+    // Read once so both phases of the frame agree
+    uint32_t phase = occlusionCulling.load(std::memory_order_relaxed) ? CLUSTER_PHASE_EARLY : CLUSTER_PHASE_ALL;
+    clusterConstants[currentFrame] = {snapshot.viewProjection, glm::vec4(snapshot.cameraPosition, 1.0f), 0, drawCount,
+                                    phase};
+    clusterMaxMeshlets[currentFrame] = maxMeshlets;
+    if(drawCount == 0) {
+        return;
+    }
+
+    // Grown like the instance buffers; the old ones are retired, not waited on
+    if(drawCount > clusterDrawCapacity[currentFrame]) {
+        resources.destroy(clusterDrawBuffers[currentFrame]);
+        size_t capacity = std::max<size_t>(drawCount, clusterDrawCapacity[currentFrame] * 2);
+        // Host-written every frame and read by both queues
+        clusterDrawBuffers[currentFrame] = resources.createBuffer(sizeof(ClusterDraw) * capacity,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::Dynamic,
+                    MemoryCategory::Geometry, BufferSharing::Concurrent);
+        clusterDrawCapacity[currentFrame] = capacity;
+    }
+    if(!meshShaders && indexCount > clusterIndexCapacity[currentFrame]) {
+        resources.destroy(clusterIndexBuffers[currentFrame]);
+        size_t capacity = std::max(indexCount, clusterIndexCapacity[currentFrame] * 2);
+        clusterIndexBuffers[currentFrame] = resources.createBuffer(sizeof(uint32_t) * capacity,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MemoryUsage::GpuOnly,
+                    MemoryCategory::Geometry);
+        clusterIndexCapacity[currentFrame] = capacity;
+    }
+    // Contents are lost when growing, which only makes the next frame's
+    // early phase draw a different set
+    if(meshletCount > clusterVisibilityCapacity) {
+        resources.destroy(clusterVisibilityBuffer);
+        size_t capacity = std::max(meshletCount, clusterVisibilityCapacity * 2);
+        clusterVisibilityBuffer = resources.createBuffer(sizeof(uint32_t) * capacity,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Geometry,
+                    BufferSharing::Concurrent);
+        clusterVisibilityCapacity = capacity;
+    }
+    if(!meshShaders && meshletCount > clusterEarlyCapacity[currentFrame]) {
+        resources.destroy(clusterEarlyBuffers[currentFrame]);
+        size_t capacity = std::max(meshletCount, clusterEarlyCapacity[currentFrame] * 2);
+        clusterEarlyBuffers[currentFrame] = resources.createBuffer(sizeof(uint32_t) * capacity,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Geometry,
+                    BufferSharing::Concurrent);
+        clusterEarlyCapacity[currentFrame] = capacity;
+    }
+
+    ClusterDraw* clusterDraws = static_cast<ClusterDraw*>(resources.get(clusterDrawBuffers[currentFrame])->mapped);
+    uint32_t firstIndex = 0;
+    uint32_t visibilityOffset = 0;
+    for(const auto& draw : snapshot.drawList) {
+        if(!isClustered(draw)) {
+            continue;
+        }
+        const Mesh& mesh = meshes[draw.mesh];
+        for(uint32_t i = 0; i < draw.instanceCount; i++) {
+            ClusterDraw& clusterDraw = clusterDraws[draw.firstClusterDraw + i];
+            clusterDraw.indexCount = 0;
+            clusterDraw.instanceCount = 1;
+            clusterDraw.firstIndex = firstIndex;
+            clusterDraw.vertexOffset = mesh.vertexOffset;
+            clusterDraw.firstInstance = draw.firstInstance + i;
+            clusterDraw.meshletOffset = mesh.meshletOffset;
+            clusterDraw.meshletCount = mesh.meshletCount;
+            clusterDraw.visibilityOffset = visibilityOffset;
+            clusterDraw.model = snapshot.instances[draw.firstInstance + i].model;
+            // lateFirstIndex is only known once the early phase has run
+            clusterDraw.lateIndexCount = 0;
+            clusterDraw.lateInstanceCount = 1;
+            clusterDraw.lateFirstIndex = firstIndex;
+            clusterDraw.lateVertexOffset = mesh.vertexOffset;
+            clusterDraw.lateFirstInstance = draw.firstInstance + i;
+            firstIndex += mesh.lods[0].indexCount;
+            visibilityOffset += mesh.meshletCount;
+        }
+    }
+
+    // The set was last used by this slot's previous frame, which has completed.
+    // Mesh shaders have no early-drawn flags, the binding gets the visibility
+    // flags to stay valid
+    std::array<VkDescriptorBufferInfo, 7> bufferInfos{};
+    bufferInfos[0].buffer = resources.get(meshletBuffer)->buffer;
+    bufferInfos[1].buffer = resources.get(meshletVertexBuffer)->buffer;
+    bufferInfos[2].buffer = resources.get(meshletTriangleBuffer)->buffer;
+    bufferInfos[3].buffer = resources.get(clusterDrawBuffers[currentFrame])->buffer;
+    bufferInfos[4].buffer = resources.get(meshShaders ? vertexBuffer : clusterIndexBuffers[currentFrame])->buffer;
+    bufferInfos[5].buffer = resources.get(clusterVisibilityBuffer)->buffer;
+    bufferInfos[6].buffer = resources.get(meshShaders ? clusterVisibilityBuffer :
+                                                    clusterEarlyBuffers[currentFrame])->buffer;
+
+    VkDescriptorImageInfo pyramidInfo{};
+    pyramidInfo.sampler = depthPyramid.getSampler();
+    pyramidInfo.imageView = depthPyramid.getView();
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    std::array<VkWriteDescriptorSet, 8> writes{};
+    for(uint32_t i = 0; i < writes.size(); i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = clusterDescriptorSets[currentFrame];
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        if(i < bufferInfos.size()) {
+            bufferInfos[i].offset = 0;
+            bufferInfos[i].range = VK_WHOLE_SIZE;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        } else {
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[i].pImageInfo = &pyramidInfo;
+        }
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void Renderer::recordClusterCulling(VkCommandBuffer commandBuffer, size_t frame) {
+    if(clusterConstants[frame].drawCount == 0) {
+        return;
+    }
+
+    dispatchClusterCulling(commandBuffer, frame, clusterConstants[frame].phase);
+
+    ComputeQueue::releaseBuffer(commandBuffer, resources.get(clusterIndexBuffers[frame])->buffer,
+                            computeQueue.getFamily(), graphicsFamily,
+                            VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+void Renderer::dispatchClusterCulling(VkCommandBuffer commandBuffer, size_t frame, uint32_t phase) {
+    ClusterPushConstants constants = clusterConstants[frame];
+    constants.phase = phase;
+
+    const Pipeline* pipeline = resources.get(clusterPipeline);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout, 0, 1,
+                        &clusterDescriptorSets[frame], 0, nullptr);
+
+    // One workgroup per meshlet and draw; dispatch sizes are only guaranteed
+    // up to 65535 per dimension, so draws go in batches
+    const uint32_t maxGroups = 65535;
+    for(uint32_t first = 0; first < constants.drawCount; first += maxGroups) {
+        constants.drawIndex = first;
+        vkCmdPushConstants(commandBuffer, pipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                        sizeof(ClusterPushConstants), &constants);
+        vkCmdDispatch(commandBuffer, clusterMaxMeshlets[frame], std::min(maxGroups, constants.drawCount - first), 1);
+    }
+}
+
+void Renderer::acquireClusterDraws(VkCommandBuffer commandBuffer, size_t frame) {
+    if(clusterConstants[frame].drawCount == 0) {
+        return;
+    }
+    // The draws are shared concurrently, only the compacted indices move
+    ComputeQueue::acquireBuffer(commandBuffer, resources.get(clusterIndexBuffers[frame])->buffer,
+                            computeQueue.getFamily(), graphicsFamily,
+                            VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+}
+
+void Renderer::recordClusterDraw(BindState& state, const DrawCommand& draw, const Pipeline* meshShaderPipeline,
+                                bool late) {
+    VkCommandBuffer commandBuffer = state.getCommandBuffer();
+
+#ifdef VK_EXT_mesh_shader
+    if(meshShaders) {
+        state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, meshShaderPipeline->pipeline);
+        state.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, clusterPipelineLayout,
+                            getDrawDescriptorSets(clusterDescriptorSets[currentFrame]));
+
+        // One task workgroup per 32 meshlets of each instance
+        ClusterPushConstants constants = clusterConstants[currentFrame];
+        if(late) {
+            constants.phase = CLUSTER_PHASE_LATE;
+        }
+        uint32_t taskCount = (meshes[draw.mesh].meshletCount + 31) / 32;
+        for(uint32_t i = 0; i < draw.instanceCount; i++) {
+            constants.drawIndex = draw.firstClusterDraw + i;
+            vkCmdPushConstants(commandBuffer, clusterPipelineLayout,
+                            VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0,
+                            sizeof(ClusterPushConstants), &constants);
+            cmdDrawMeshTasks(commandBuffer, taskCount, 1, 1);
+            state.countDraw();
+        }
+        return;
+    }
+#endif
+
+    // Regular pipeline and vertex buffers, only the indices come from the
+    // culling pass
+    state.bindIndexBuffer(resources.get(clusterIndexBuffers[currentFrame])->buffer, VK_INDEX_TYPE_UINT32);
+    VkBuffer drawBuffer = resources.get(clusterDrawBuffers[currentFrame])->buffer;
+    VkDeviceSize commandOffset = late ? offsetof(ClusterDraw, lateIndexCount) : 0;
+    const uint32_t batch = multiDrawIndirect ? 65535 : 1;
+    for(uint32_t first = 0; first < draw.instanceCount; first += batch) {
+        vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer,
+                            (draw.firstClusterDraw + first) * sizeof(ClusterDraw) + commandOffset,
+                            std::min(batch, draw.instanceCount - first), sizeof(ClusterDraw));
+        state.countDraw();
+    }
+}
+
+VkPipelineStageFlags Renderer::getOcclusionStages() const {
+#ifdef VK_EXT_mesh_shader
+    if(meshShaders) {
+        return VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+    }
+#endif
+    return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+}
+
+void Renderer::recordLatePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, const RenderSnapshot& snapshot,
+                            const Pipeline* pipeline, const Pipeline* meshShaderPipeline, DrawStats& stats) {
+    const ClusterPushConstants& constants = clusterConstants[currentFrame];
+    const bool occlusion = constants.phase == CLUSTER_PHASE_EARLY && constants.drawCount > 0;
+
+    if(occlusion) {
+        VkImageMemoryBarrier depthBarrier{};
+        depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.image = resources.get(depthImage)->image;
+        depthBarrier.subresourceRange.aspectMask = getDepthAspect();
+        depthBarrier.subresourceRange.levelCount = 1;
+        depthBarrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+        depthPyramid.record(commandBuffer, getOcclusionStages(), renderExtent);
+
+        depthBarrier.srcAccessMask = 0;
+        depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                            0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+        // Without mesh shaders the late phase appends to the indices and
+        // draws the early draws are still reading
+        if(!meshShaders) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+            dispatchClusterCulling(commandBuffer, currentFrame, CLUSTER_PHASE_LATE);
+
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+    }
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = lateRenderPass;
+    renderPassInfo.framebuffer = sceneFramebuffer;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = renderExtent;
+
+    // Always begun, it is what moves the scene target to the layout the
+    // present pass samples it in
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float) renderExtent.width;
+    viewport.height = (float) renderExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = renderExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    BindState state(commandBuffer, stats);
+    if(occlusion) {
+        const std::array<VkBuffer, 2> vertexBuffers = {
+            resources.get(vertexBuffer)->buffer,
+            resources.get(instanceBuffers[currentFrame])->buffer
+        };
+        for(const auto& draw : snapshot.drawList) {
+            if(!isClustered(draw)) {
+                continue;
+            }
+            if(!meshShaders) {
+                state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+                state.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout,
+                                    getDrawDescriptorSets(cameraDescriptorSets[currentFrame]));
+                state.bindVertexBuffers(vertexBuffers);
+            }
+            recordClusterDraw(state, draw, meshShaderPipeline, true);
+        }
+    }
+    // Blended over everything opaque, so after the late draws
+    recordParticles(state);
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+void Renderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(graphicsQueue);
+
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+
+}
+
+void Renderer::createSyncObjects() {
+    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+    submittedFrames.resize(MAX_FRAMES_IN_FLIGHT, 0);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
     VkFenceCreateInfo fenceInfo{};
@@ -919,23 +2402,78 @@ void Renderer::createSyncObjects() {
     }
 }
 
-void Renderer::recreateSwapChain() {
-    int width = 0;
-    int height = 0;
-    glfwGetFramebufferSize(window.get(), &width, &height);
-    while (width == 0 || height == 0) {
-        glfwGetFramebufferSize(window.get(), &width, &height);
-        glfwWaitEvents();
+void Renderer::createTimestampQueries() {
+    timedFrames.resize(MAX_FRAMES_IN_FLIGHT, 0);
+    frameCpuMilliseconds.resize(MAX_FRAMES_IN_FLIGHT, 0.0f);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    // Frames are still timed on the CPU without them
+    uint32_t validBits = queueFamilies[graphicsFamily].timestampValidBits;
+    if(validBits == 0) {
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+    if(vkCreateQueryPool(device, &poolInfo, nullptr, &timestampPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool!");
+    }
+}
+
+void Renderer::reportFrameTiming() {
+    uint64_t frame = timedFrames[currentFrame];
+    if(frame == 0) {
+        return;
+    }
+    timedFrames[currentFrame] = 0;
+
+    FrameTiming timing{frame, frameCpuMilliseconds[currentFrame], -1.0f};
+    // The fence was waited on, the results are there without waiting
+    uint64_t timestamps[2];
+    if(timestampPool != VK_NULL_HANDLE &&
+        vkGetQueryPoolResults(device, timestampPool, static_cast<uint32_t>(currentFrame) * 2, 2, sizeof(timestamps),
+                            timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+        timing.gpuMilliseconds = static_cast<float>(ticks * static_cast<double>(timestampPeriod) / 1e6);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(frameTimingMutex);
+        frameTiming = timing;
     }
+    updateRenderScale(timing);
+    if(frameTimingCallback) {
+        frameTimingCallback(timing);
+    }
+}
 
+void Renderer::recreateSwapChain() {
+    // Runs on the render thread, minimized windows never produce a snapshot
     vkDeviceWaitIdle(device);
 
     cleanupSwapchain();
+    // Cached static command buffers were recorded for the old render pass and size
+    renderTargetGeneration++;
 
     createSwapChain();
     createImageViews();
     createRenderPass();
+    createPresentRenderPass();
     createGraphicsPipeline();
+    createDepthResources();
+    createSceneTarget();
     createFrameBuffers();
     createCommandBuffers();
 }
@@ -1006,12 +2544,19 @@ void Renderer::cleanupSwapchain() {
     for(auto framebuffer : swapChainFrameBuffers) {
         vkDestroyFramebuffer(device, framebuffer, nullptr);
     }
+    vkDestroyFramebuffer(device, sceneFramebuffer, nullptr);
 
     vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(dynamicCommandBuffers.size()),
+                        dynamicCommandBuffers.data());
 
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    // Every pipeline was built for the render pass
+    pipelineCache.clear();
+    resources.destroy(depthImage);
+    resources.destroy(sceneImage);
     vkDestroyRenderPass(device, renderPass, nullptr);
+    vkDestroyRenderPass(device, lateRenderPass, nullptr);
+    vkDestroyRenderPass(device, presentRenderPass, nullptr);
     for (auto imageView :swapChainImageViews) {
         vkDestroyImageView(device, imageView, nullptr);
     }
@@ -1020,17 +2565,34 @@ void Renderer::cleanupSwapchain() {
 
 void Renderer::cleanup() {
     cleanupSwapchain();
+    pipelineCache.shutdown();
+    vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(device, clusterPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(device, upscalePipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, upscaleDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, upscaleSetLayout, nullptr);
+    vkDestroyDescriptorPool(device, cameraDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, cameraSetLayout, nullptr);
+    // Writes out whatever was still waiting to be encoded
+    frameCapture.shutdown();
+    depthPyramid.shutdown();
+    lightGrid.shutdown();
+    shadowAtlas.shutdown();
+    particleSystem.shutdown();
+    overlayRenderer.shutdown();
+
+    // Vertex, index and instance buffers plus anything still retired
+    resources.shutdown();
+    computeQueue.shutdown();
+    vkDestroyDescriptorPool(device, clusterDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, clusterSetLayout, nullptr);
 
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
-
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
     for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
         vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
         vkDestroyFence(device, inFlightFences[i], nullptr);
     }
+    vkDestroyQueryPool(device, timestampPool, nullptr);
     vkDestroyCommandPool(device, commandPool, nullptr);
     vkDestroyDevice(device, nullptr);
     if (enableVailidationLayers) {
@@ -1042,6 +2604,885 @@ void Renderer::cleanup() {
     glfwTerminate();
 }
 
+void Renderer::createCameraResources() {
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cameraSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create camera descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+
+    if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &cameraDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create camera descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, cameraSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = cameraDescriptorPool;
+    allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+    allocInfo.pSetLayouts = layouts.data();
+
+    cameraDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    if(vkAllocateDescriptorSets(device, &allocInfo, cameraDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate camera descriptor sets!");
+    }
+
+    cameraBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        cameraBuffers[i] = resources.createBuffer(sizeof(glm::mat4), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                    MemoryUsage::Dynamic, MemoryCategory::Uniforms);
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = resources.get(cameraBuffers[i])->buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(glm::mat4);
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = cameraDescriptorSets[i];
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    }
+}
+
+void Renderer::createLightResources() {
+    VkShaderModule cullShaderModule = loadShader("lightcull.spv");
+    lightGrid.init(device, resources, cullShaderModule, MAX_FRAMES_IN_FLIGHT);
+    vkDestroyShaderModule(device, cullShaderModule, nullptr);
+    shadowAtlas.init(device, resources, MAX_FRAMES_IN_FLIGHT);
+
+    // The grid is shared concurrently, there is nothing to acquire
+    addComputePass({
+        [this](VkCommandBuffer commandBuffer, size_t frame) { lightGrid.record(commandBuffer, frame); },
+        nullptr
+    });
+}
+
+void Renderer::extractLights(RenderSnapshot& snapshot) {
+    scene.queryChunks<WorldTransform, PointLight>(lightChunks);
+
+    std::vector<LightData>& lights = snapshot.lights;
+    lights.clear();
+    lightEntities.clear();
+    for(const auto& chunk : lightChunks) {
+        const Entity* entities = chunk.entities();
+        const WorldTransform* transforms = chunk.get<WorldTransform>();
+        const PointLight* pointLights = chunk.get<PointLight>();
+        for(uint32_t i = 0; i < chunk.size(); i++) {
+            lights.push_back({glm::vec3(transforms[i].matrix[3]), pointLights[i].radius,
+                            pointLights[i].color * pointLights[i].intensity, -1});
+            lightEntities.push_back(entities[i]);
+        }
+    }
+    shadowAtlas.allocate(lightEntities, lights, snapshot.cameraPosition, snapshot.shadows);
+}
+
+void Renderer::extractShadowCasters(RenderSnapshot& snapshot) {
+    std::vector<DrawCommand>& shadowDraws = snapshot.shadowDrawList;
+    std::vector<uint32_t>& faceDraws = snapshot.shadowFaceDraws;
+    std::vector<uint32_t>& casters = snapshot.shadowCasters;
+    shadowDraws.clear();
+    faceDraws.clear();
+    casters.clear();
+    if(snapshot.shadows.empty()) {
+        return;
+    }
+
+    // Every camera instance against every light at once, each block of
+    // instances finds the draw it starts in since draws are in instance order
+    const std::vector<DrawCommand>& drawList = snapshot.drawList;
+    const size_t instanceCount = snapshot.instances.size();
+    const size_t lightCount = snapshot.shadows.size();
+    casterFaces.resize(lightCount * instanceCount);
+    jobs.parallelFor(instanceCount, 1024, [&](size_t begin, size_t end) {
+        auto draw = std::upper_bound(drawList.begin(), drawList.end(), static_cast<uint32_t>(begin),
+                                    [](uint32_t instance, const DrawCommand& command) {
+                                        return instance < command.firstInstance;
+                                    }) - 1;
+        for(size_t i = begin; i < end; i++) {
+            while(i >= draw->firstInstance + draw->instanceCount) {
+                draw++;
+            }
+            const Mesh& mesh = meshes[draw->mesh];
+            const glm::mat4& model = snapshot.instances[i].model;
+            float scale = std::max(glm::length(glm::vec3(model[0])),
+                            std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+            glm::vec3 center = glm::vec3(model * glm::vec4(mesh.boundsCenter, 1.0f));
+            float radius = mesh.boundsRadius * scale;
+            for(size_t light = 0; light < lightCount; light++) {
+                const ShadowLight& shadow = snapshot.shadows[light];
+                casterFaces[light * instanceCount + i] = static_cast<uint8_t>(
+                    ShadowAtlas::getFaceMask(center - shadow.position, radius, shadow.radius));
+            }
+        }
+    }, "Renderer::shadowCasterFaces");
+
+    // Each face's draws keep the camera's (mesh, LOD) pairs, with only the
+    // instances that reach into it; one pass over a light's masks bins its
+    // instances into all six faces. Clustered meshes are drawn whole
+    shadowCasterBins.resize(std::max(shadowCasterBins.size(), lightCount));
+    jobs.parallelFor(lightCount, 1, [&](size_t begin, size_t end) {
+        for(size_t light = begin; light < end; light++) {
+            ShadowCasterBin& bin = shadowCasterBins[light];
+            const uint8_t* faces = &casterFaces[light * instanceCount];
+            for(uint32_t face = 0; face < SHADOW_FACES; face++) {
+                bin.casters[face].clear();
+                bin.draws[face].clear();
+            }
+            for(const auto& draw : drawList) {
+                std::array<uint32_t, SHADOW_FACES> firstCasters;
+                for(uint32_t face = 0; face < SHADOW_FACES; face++) {
+                    firstCasters[face] = static_cast<uint32_t>(bin.casters[face].size());
+                }
+                for(uint32_t i = draw.firstInstance; i < draw.firstInstance + draw.instanceCount; i++) {
+                    for(uint32_t face = 0; faces[i] >> face; face++) {
+                        if(faces[i] & (1u << face)) {
+                            bin.casters[face].push_back(i);
+                        }
+                    }
+                }
+                for(uint32_t face = 0; face < SHADOW_FACES; face++) {
+                    uint32_t count = static_cast<uint32_t>(bin.casters[face].size()) - firstCasters[face];
+                    if(count > 0) {
+                        bin.draws[face].push_back({draw.mesh, draw.lod, firstCasters[face], count, 0});
+                    }
+                }
+            }
+        }
+    }, "Renderer::binShadowCasters");
+
+    for(size_t light = 0; light < lightCount; light++) {
+        const ShadowCasterBin& bin = shadowCasterBins[light];
+        for(uint32_t face = 0; face < SHADOW_FACES; face++) {
+            faceDraws.push_back(static_cast<uint32_t>(shadowDraws.size()));
+            uint32_t firstCaster = static_cast<uint32_t>(casters.size());
+            casters.insert(casters.end(), bin.casters[face].begin(), bin.casters[face].end());
+            for(DrawCommand draw : bin.draws[face]) {
+                draw.firstInstance += firstCaster;
+                shadowDraws.push_back(draw);
+            }
+        }
+    }
+    faceDraws.push_back(static_cast<uint32_t>(shadowDraws.size()));
+}
+
+void Renderer::createParticleResources() {
+    ParticleShaders shaders;
+    shaders.args = loadShader("particleargs.spv");
+    shaders.emit = loadShader("particleemit.spv");
+    shaders.simulate = loadShader("particlesimulate.spv");
+    shaders.sort = loadShader("particlesort.spv");
+    particleSystem.init(device, resources, shaders, MAX_FRAMES_IN_FLIGHT);
+    for(VkShaderModule shader : {shaders.args, shaders.emit, shaders.simulate, shaders.sort}) {
+        vkDestroyShaderModule(device, shader, nullptr);
+    }
+
+    // What the draw reads is shared concurrently, there is nothing to acquire
+    addComputePass({
+        [this](VkCommandBuffer commandBuffer, size_t frame) { particleSystem.record(commandBuffer, frame); },
+        nullptr
+    });
+}
+
+void Renderer::extractParticles(RenderSnapshot& snapshot) {
+    scene.queryChunks<WorldTransform, ParticleEmitter>(emitterChunks);
+
+    // Whole particles due between the previous update and this one, so
+    // fractional rates add up without any state per emitter
+    double previousTime = particleTime;
+    particleTime += snapshot.deltaTime;
+
+    std::vector<ParticleEmitterData>& emitters = snapshot.emitters;
+    emitters.clear();
+    uint32_t firstParticle = 0;
+    for(const auto& chunk : emitterChunks) {
+        const WorldTransform* transforms = chunk.get<WorldTransform>();
+        const ParticleEmitter* particleEmitters = chunk.get<ParticleEmitter>();
+        for(uint32_t i = 0; i < chunk.size(); i++) {
+            const ParticleEmitter& emitter = particleEmitters[i];
+            particleSettleTime = std::max(particleSettleTime, particleTime + emitter.lifetime);
+            uint32_t count = static_cast<uint32_t>(std::floor(particleTime * emitter.rate) -
+                                                std::floor(previousTime * emitter.rate));
+            if(count == 0) {
+                continue;
+            }
+            const glm::mat4& matrix = transforms[i].matrix;
+            emitters.push_back({glm::vec3(matrix[3]), firstParticle, glm::normalize(glm::vec3(matrix[1])),
+                                emitter.spread, emitter.color, emitter.speed, emitter.lifetime, emitter.size, count});
+            firstParticle += count;
+        }
+    }
+}
+
+PipelineDesc Renderer::getParticlePipelineDesc() const {
+    // Quads are expanded from the particle buffers, depth is tested but the
+    // particles do not hide each other
+    PipelineDesc desc;
+    desc.shaders = {
+        {VK_SHADER_STAGE_VERTEX_BIT, "particlevert.spv"},
+        {VK_SHADER_STAGE_FRAGMENT_BIT, "particlefrag.spv"}
+    };
+    desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    desc.cullMode = VK_CULL_MODE_NONE;
+    desc.depthWrite = false;
+    desc.blend = BlendMode::Alpha;
+    desc.layout = particleSystem.getPipelineLayout();
+    // Compatible with the late pass as well
+    desc.renderPass = renderPass;
+    return desc;
+}
+
+void Renderer::recordParticles(BindState& state) {
+    state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, resources.get(particlePipeline)->pipeline);
+    state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, particleSystem.getPipelineLayout(),
+                        particleSystem.getDescriptorSet(currentFrame));
+    particleSystem.draw(state.getCommandBuffer(), currentFrame);
+    state.countDraw();
+}
+
+void Renderer::createOverlayResources() {
+    overlayRenderer.init(device, resources, MAX_FRAMES_IN_FLIGHT);
+}
+
+void Renderer::extractOverlay(RenderSnapshot& snapshot) {
+    frameTimeHistory[frameTimeCursor] = snapshot.deltaTime;
+    frameTimeCursor = (frameTimeCursor + 1) % frameTimeHistory.size();
+
+    if(statsOverlay.load(std::memory_order_relaxed)) {
+        // Counts and GPU time are those of the latest frame the render
+        // thread finished, the update times are the last second or two
+        DrawStats stats = getDrawStats();
+        FrameTiming timing = getFrameTiming();
+
+        float totalTime = 0.0f;
+        uint32_t updates = 0;
+        for(float time : frameTimeHistory) {
+            if(time > 0.0f) {
+                totalTime += time;
+                updates++;
+            }
+        }
+        float averageMilliseconds = updates > 0 ? totalTime / updates * 1000.0f : 0.0f;
+
+        char gpu[32];
+        if(timing.gpuMilliseconds < 0.0f) {
+            snprintf(gpu, sizeof(gpu), "   N/A");
+        } else {
+            snprintf(gpu, sizeof(gpu), "%6.2f MS", timing.gpuMilliseconds);
+        }
+        char text[512];
+        snprintf(text, sizeof(text),
+                "FRAME %6.2f MS %5.0f FPS\n"
+                "CPU   %6.2f MS\n"
+                "GPU   %s\n"
+                "DRAWS %u, %u CACHED\n"
+                "BINDS %u, %u SKIPPED\n"
+                "BUCKETS %u, %u RECORDED\n"
+                "SHADOW FACES %u, %u CACHED\n"
+                "RESOLUTION %3.0f%%",
+                averageMilliseconds, averageMilliseconds > 0.0f ? 1000.0f / averageMilliseconds : 0.0f,
+                timing.cpuMilliseconds, gpu, stats.drawCalls, stats.cachedDrawCalls, stats.stateChanges(),
+                stats.redundantBinds, stats.cachedBuckets + stats.recordedBuckets, stats.recordedBuckets,
+                stats.shadowFacesRendered + stats.shadowFacesCached, stats.shadowFacesCached,
+                getRenderScale() * 100.0f);
+
+        // Text on a dark panel, the frame time graph below it
+        const float scale = 2.0f;
+        const float margin = 8.0f;
+        const float padding = 6.0f;
+        const float graphHeight = 48.0f;
+        glm::vec2 textSize = OverlayBatch::measure(text, scale);
+        glm::vec2 origin(margin + padding);
+        float graphWidth = std::max(textSize.x, 2.0f * frameTimeHistory.size());
+        glm::vec2 graphMin = origin + glm::vec2(0.0f, textSize.y + padding);
+        glm::vec2 graphMax = graphMin + glm::vec2(graphWidth, graphHeight);
+
+        overlay.rect(glm::vec2(margin), graphMax + glm::vec2(padding), glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+        overlay.text(origin, text, glm::vec4(1.0f), scale);
+
+        // From no time at the bottom to two 60 Hz frames at the top, with the
+        // one frame mark across the middle
+        const float graphSeconds = 2.0f / 60.0f;
+        float middle = (graphMin.y + graphMax.y) * 0.5f;
+        overlay.line(glm::vec2(graphMin.x, middle), glm::vec2(graphMax.x, middle), glm::vec4(1.0f, 1.0f, 1.0f, 0.3f));
+        float step = graphWidth / (frameTimeHistory.size() - 1);
+        glm::vec2 previous;
+        for(size_t i = 0; i < frameTimeHistory.size(); i++) {
+            // Oldest first, the cursor points at it
+            float time = frameTimeHistory[(frameTimeCursor + i) % frameTimeHistory.size()];
+            float height = std::min(time / graphSeconds, 1.0f) * graphHeight;
+            glm::vec2 point(graphMin.x + i * step, graphMax.y - height);
+            if(i > 0) {
+                overlay.line(previous, point, glm::vec4(0.3f, 1.0f, 0.3f, 1.0f), 1.5f);
+            }
+            previous = point;
+        }
+    }
+
+    overlay.take(snapshot.overlay);
+}
+
+PipelineDesc Renderer::getOverlayPipelineDesc() const {
+    // Pixel-space triangles over the finished frame, in the order they were added
+    PipelineDesc desc;
+    desc.shaders = {
+        {VK_SHADER_STAGE_VERTEX_BIT, "overlayvert.spv"},
+        {VK_SHADER_STAGE_FRAGMENT_BIT, "overlayfrag.spv"}
+    };
+    desc.vertexBindings = {OverlayVertex::getBindingDescriptor()};
+    for (const auto& attribute : OverlayVertex::getAttributeDescription()) {
+        desc.vertexAttributes.push_back(attribute);
+    }
+    desc.cullMode = VK_CULL_MODE_NONE;
+    desc.depthTest = false;
+    desc.depthWrite = false;
+    desc.blend = BlendMode::Alpha;
+    desc.layout = overlayRenderer.getPipelineLayout();
+    desc.renderPass = presentRenderPass;
+    return desc;
+}
+
+void Renderer::recordOverlay(BindState& state) {
+    if(overlayRenderer.empty(currentFrame)) {
+        return;
+    }
+    state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, resources.get(overlayPipeline)->pipeline);
+    state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, overlayRenderer.getPipelineLayout(),
+                        overlayRenderer.getDescriptorSet());
+    state.bindVertexBuffer(overlayRenderer.getVertexBuffer(currentFrame));
+    overlayRenderer.draw(state.getCommandBuffer(), currentFrame, swapChainExtent);
+    state.countDraw();
+}
+
+void Renderer::createPresentRenderPass() {
+    // Every pixel is written by the upscale, the previous contents never matter
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = swapChainImageFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    // Waits for the image to be acquired, the scene passes order their own
+    // writes before the upscale reads them
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &dependency;
+
+    if(vkCreateRenderPass(device, &renderPassInfo, nullptr, &presentRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create present render pass!");
+    }
+}
+
+void Renderer::createUpscaleResources() {
+    // Bilinear, clamped so the edge of the rendered part never blends with
+    // what lies beyond it
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = 0.0f;
+    sceneSampler = resources.createSampler(samplerInfo);
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &upscaleSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &upscaleDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = upscaleDescriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &upscaleSetLayout;
+
+    if(vkAllocateDescriptorSets(device, &allocInfo, &upscaleDescriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate upscale descriptor set!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(UpscalePushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &upscaleSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &upscalePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale pipeline layout!");
+    }
+}
+
+void Renderer::createSceneTarget() {
+    // Full size, any scale renders into a corner of it
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {swapChainExtent.width, swapChainExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = swapChainImageFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    sceneImage = resources.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                MemoryCategory::RenderTargets);
+
+    // Only ever written with the device idle
+    VkDescriptorImageInfo descriptorImageInfo{};
+    descriptorImageInfo.sampler = resources.get(sceneSampler)->sampler;
+    descriptorImageInfo.imageView = resources.get(sceneImage)->view;
+    descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = upscaleDescriptorSet;
+    write.dstBinding = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &descriptorImageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+void Renderer::updateRenderExtent() {
+    const float scale = renderScale.load(std::memory_order_relaxed);
+    VkExtent2D extent = {
+        std::max(1u, static_cast<uint32_t>(std::lround(swapChainExtent.width * scale))),
+        std::max(1u, static_cast<uint32_t>(std::lround(swapChainExtent.height * scale)))
+    };
+    if(extent.width != renderExtent.width || extent.height != renderExtent.height) {
+        renderExtent = extent;
+        // Cached static command buffers set the viewport
+        renderTargetGeneration++;
+    }
+}
+
+void Renderer::updateRenderScale(const FrameTiming& timing) {
+    const float scale = renderScale.load(std::memory_order_relaxed);
+    const float target = targetFrameTime.load(std::memory_order_relaxed);
+    float desired = 1.0f;
+    if(target > 0.0f && timing.gpuMilliseconds >= 0.0f) {
+        // Frames recorded before the last change say nothing about the scale
+        if(timing.frame < renderScaleFrame) {
+            return;
+        }
+        renderScaleTime += timing.gpuMilliseconds;
+        if(++renderScaleSamples < RENDER_SCALE_SAMPLES) {
+            return;
+        }
+        const float average = renderScaleTime / renderScaleSamples;
+        renderScaleTime = 0.0f;
+        renderScaleSamples = 0;
+        if(average <= target && average >= target * RENDER_SCALE_HEADROOM) {
+            return;
+        }
+
+        // Most of the GPU time grows with the pixel count, the square of the
+        // scale; aims for the middle of the band so it does not swing back
+        const float aim = target * (1.0f + RENDER_SCALE_HEADROOM) * 0.5f;
+        desired = std::round(scale * std::sqrt(aim / average) / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+        desired = std::clamp(desired, minRenderScale, maxRenderScale);
+    }
+    setRenderScale(desired);
+}
+
+void Renderer::setRenderScale(float scale) {
+    if(scale == renderScale.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    renderScale.store(scale, std::memory_order_relaxed);
+    renderScaleFrame = *std::max_element(submittedFrames.begin(), submittedFrames.end()) + 1;
+    renderScaleTime = 0.0f;
+    renderScaleSamples = 0;
+    updateRenderExtent();
+}
+
+PipelineDesc Renderer::getUpscalePipelineDesc() const {
+    // A single triangle over the whole swapchain image, no vertex input
+    PipelineDesc desc;
+    desc.shaders = {
+        {VK_SHADER_STAGE_VERTEX_BIT, "upscalevert.spv"},
+        {VK_SHADER_STAGE_FRAGMENT_BIT, "upscalefrag.spv"}
+    };
+    desc.cullMode = VK_CULL_MODE_NONE;
+    desc.depthTest = false;
+    desc.depthWrite = false;
+    desc.layout = upscalePipelineLayout;
+    desc.renderPass = presentRenderPass;
+    return desc;
+}
+
+void Renderer::recordPresentPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, DrawStats& stats) {
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = presentRenderPass;
+    renderPassInfo.framebuffer = swapChainFrameBuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float) swapChainExtent.width;
+    viewport.height = (float) swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    glm::vec2 fullSize((float) swapChainExtent.width, (float) swapChainExtent.height);
+    glm::vec2 renderSize((float) renderExtent.width, (float) renderExtent.height);
+    UpscalePushConstants constants;
+    constants.scale = renderSize / fullSize;
+    constants.limit = (renderSize - glm::vec2(0.5f)) / fullSize;
+
+    BindState state(commandBuffer, stats);
+    state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, resources.get(upscalePipeline)->pipeline);
+    state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipelineLayout, upscaleDescriptorSet);
+    vkCmdPushConstants(commandBuffer, upscalePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants),
+                    &constants);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    state.countDraw();
+
+    // At full resolution over the upscaled frame
+    recordOverlay(state);
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+std::array<VkDescriptorSet, 3> Renderer::getDrawDescriptorSets(VkDescriptorSet set) const {
+    return {set, lightGrid.getDescriptorSet(currentFrame), shadowAtlas.getDescriptorSet(currentFrame)};
+}
+
+PipelineDesc Renderer::getShadowPipelineDesc(bool dynamicCasters) const {
+    // Depth only without a fragment shader, so early depth testing rejects
+    // whatever is hidden; both sides so the winding of the casters never matters.
+    // Dynamic casters fetch their instance by index instead of as vertex input
+    PipelineDesc desc;
+    desc.shaders = {
+        {VK_SHADER_STAGE_VERTEX_BIT, dynamicCasters ? "shadowcastersvert.spv" : "shadowvert.spv"}
+    };
+    desc.vertexBindings = {
+        Vertex::getBindingDescriptor()
+    };
+    for (const auto& attribute : Vertex::getAttributeDescription()) {
+        desc.vertexAttributes.push_back(attribute);
+    }
+    if (!dynamicCasters) {
+        desc.vertexBindings.push_back(InstanceData::getBindingDescriptor());
+        for (const auto& attribute : InstanceData::getAttributeDescription()) {
+            desc.vertexAttributes.push_back(attribute);
+        }
+    }
+    desc.cullMode = VK_CULL_MODE_NONE;
+    desc.colorAttachment = false;
+    desc.layout = shadowAtlas.getPipelineLayout();
+    desc.renderPass = shadowAtlas.getRenderPass();
+    return desc;
+}
+
+void Renderer::recordShadowCasters(VkCommandBuffer commandBuffer, const RenderSnapshot& snapshot, bool staticCasters,
+                                uint32_t face, DrawStats& stats) {
+    auto drawList = [&](const DrawCommand* draws, size_t drawCount) {
+        for(size_t i = 0; i < drawCount; i++) {
+            const Mesh& mesh = meshes[draws[i].mesh];
+            const MeshLod& lod = mesh.lods[draws[i].lod];
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, draws[i].instanceCount,
+                            lod.firstIndex, mesh.vertexOffset, draws[i].firstInstance);
+            stats.shadowDrawCalls++;
+        }
+    };
+
+    VkBuffer buffers[] = {resources.get(vertexBuffer)->buffer, VK_NULL_HANDLE};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindIndexBuffer(commandBuffer, resources.get(indexBuffer)->buffer, 0, VK_INDEX_TYPE_UINT32);
+    if(staticCasters) {
+        // Only drawn when a face's cache is out of date, so not culled
+        for(const auto& bucket : staticBuckets) {
+            if(!bucket.drawList.empty()) {
+                buffers[1] = resources.get(bucket.instanceBuffer)->buffer;
+                vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+                drawList(bucket.drawList.data(), bucket.drawList.size());
+            }
+        }
+    } else {
+        // Their instances come from the caster set instead
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+        uint32_t first = snapshot.shadowFaceDraws[face];
+        drawList(snapshot.shadowDrawList.data() + first, snapshot.shadowFaceDraws[face + 1] - first);
+    }
+}
+
+void Renderer::invalidateStaticBucket(uint32_t bucket) {
+    if(bucket >= staticBucketStates.size()) {
+        staticBucketStates.resize(bucket + 1);
+    }
+    staticBucketStates[bucket].dirty = true;
+}
+
+void Renderer::extractStaticBuckets(RenderSnapshot& snapshot, float pixelsPerUnit) {
+    snapshot.staticUpdates.clear();
+
+    // LODs of every static instance, the dynamic passes reuse them to pick
+    // out the clustered ones
+    const uint32_t staticId = ComponentRegistry::id<StaticGeometry>();
+    const size_t meshCount = meshes.size();
+    chunkStaticOffsets.assign(drawChunks.size(), UINT32_MAX);
+    uint32_t staticCount = 0;
+    for(size_t c = 0; c < drawChunks.size(); c++) {
+        if(drawChunks[c].archetype->has(staticId)) {
+            chunkStaticOffsets[c] = staticCount;
+            staticCount += drawChunks[c].size();
+        }
+    }
+    staticSlots.resize(staticCount);
+    if(staticCount == 0 && staticBucketStates.empty()) {
+        return;
+    }
+
+    jobs.parallelFor(drawChunks.size(), 16, [&](size_t begin, size_t end) {
+        for(size_t c = begin; c < end; c++) {
+            if(chunkStaticOffsets[c] == UINT32_MAX) {
+                continue;
+            }
+            const WorldTransform* transforms = drawChunks[c].get<WorldTransform>();
+            const MeshInstance* instances = drawChunks[c].get<MeshInstance>();
+            uint32_t* slots = &staticSlots[chunkStaticOffsets[c]];
+            for(uint32_t i = 0; i < drawChunks[c].size(); i++) {
+                uint32_t mesh = instances[i].mesh;
+                slots[i] = mesh < meshCount ?
+                    mesh * MAX_MESH_LODS + selectLod(meshes[mesh], transforms[i].matrix, pixelsPerUnit) : UINT32_MAX;
+            }
+        }
+    }, "Renderer::selectStaticLods");
+
+    for(auto& state : staticBucketStates) {
+        state.frameInstances.clear();
+    }
+    for(size_t c = 0; c < drawChunks.size(); c++) {
+        if(chunkStaticOffsets[c] == UINT32_MAX) {
+            continue;
+        }
+        const WorldTransform* transforms = drawChunks[c].get<WorldTransform>();
+        const StaticGeometry* statics = drawChunks[c].get<StaticGeometry>();
+        const Entity* entities = drawChunks[c].entities();
+        const uint32_t* slots = &staticSlots[chunkStaticOffsets[c]];
+        for(uint32_t i = 0; i < drawChunks[c].size(); i++) {
+            uint32_t slot = slots[i];
+            if(slot == UINT32_MAX || isClustered(slot / MAX_MESH_LODS, slot % MAX_MESH_LODS)) {
+                continue;
+            }
+            uint32_t bucket = statics[i].bucket;
+            if(bucket >= staticBucketStates.size()) {
+                staticBucketStates.resize(bucket + 1);
+            }
+            staticBucketStates[bucket].frameInstances.push_back({entities[i], slot, &transforms[i].matrix});
+        }
+    }
+
+    // Only buckets whose entities or LODs changed are sent over
+    for(uint32_t b = 0; b < staticBucketStates.size(); b++) {
+        StaticBucketState& state = staticBucketStates[b];
+        std::vector<StaticInstance>& frameInstances = state.frameInstances;
+        bool changed = state.dirty || frameInstances.size() != state.entities.size();
+        for(size_t i = 0; i < frameInstances.size() && !changed; i++) {
+            changed = frameInstances[i].entity != state.entities[i] || frameInstances[i].slot != state.slots[i];
+        }
+        if(!changed) {
+            continue;
+        }
+
+        state.entities.resize(frameInstances.size());
+        state.slots.resize(frameInstances.size());
+        for(size_t i = 0; i < frameInstances.size(); i++) {
+            state.entities[i] = frameInstances[i].entity;
+            state.slots[i] = frameInstances[i].slot;
+        }
+        state.dirty = false;
+
+        std::stable_sort(frameInstances.begin(), frameInstances.end(),
+            [](const StaticInstance& a, const StaticInstance& b) { return a.slot < b.slot; });
+
+        StaticBucketUpdate update;
+        update.bucket = b;
+        update.instances.resize(frameInstances.size());
+        for(size_t i = 0; i < frameInstances.size(); i++) {
+            update.instances[i].model = *frameInstances[i].model;
+            uint32_t slot = frameInstances[i].slot;
+            if(i == 0 || slot != frameInstances[i - 1].slot) {
+                update.drawList.push_back({slot / MAX_MESH_LODS, slot % MAX_MESH_LODS, static_cast<uint32_t>(i), 0, 0});
+            }
+            update.drawList.back().instanceCount++;
+        }
+        snapshot.staticUpdates.push_back(std::move(update));
+    }
+}
+
+void Renderer::updateStaticBuckets(const RenderSnapshot& snapshot) {
+    for(const auto& update : snapshot.staticUpdates) {
+        if(update.bucket >= staticBuckets.size()) {
+            staticBuckets.resize(update.bucket + 1);
+        }
+        StaticBucket& bucket = staticBuckets[update.bucket];
+
+        // Frames in flight may still read the old instances, a new buffer
+        // leaves them alone until they are done
+        resources.destroy(bucket.instanceBuffer);
+        bucket.instanceBuffer = BufferHandle();
+        if(!update.instances.empty()) {
+            VkDeviceSize size = sizeof(InstanceData) * update.instances.size();
+            bucket.instanceBuffer = resources.createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::Upload,
+                        MemoryCategory::Geometry);
+            memcpy(resources.get(bucket.instanceBuffer)->mapped, update.instances.data(), (size_t) size);
+        }
+        bucket.drawList = update.drawList;
+        bucket.version++;
+    }
+}
+
+VkCommandBuffer Renderer::getStaticCommandBuffer(StaticBucket& bucket, const Pipeline* pipeline, DrawStats& stats) {
+    // One per frame in flight, each binds its frame's camera; the frame's
+    // fence has been waited on, so the buffer is no longer pending
+    StaticCommandBuffer& cached = bucket.commandBuffers[currentFrame];
+    if(cached.version == bucket.version && cached.pipeline == pipeline->pipeline &&
+        cached.renderTargets == renderTargetGeneration) {
+        stats.cachedBuckets++;
+        stats.cachedDrawCalls += cached.drawCalls;
+        return cached.commandBuffer;
+    }
+
+    if(cached.commandBuffer == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        if(vkAllocateCommandBuffers(device, &allocInfo, &cached.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate static command buffer!");
+        }
+    }
+
+    // Any framebuffer of the render pass may execute it
+    beginSecondaryCommandBuffer(cached.commandBuffer, VK_NULL_HANDLE, 0);
+
+    uint32_t drawCalls = stats.drawCalls;
+    BindState state(cached.commandBuffer, stats);
+    state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+    state.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout,
+                        getDrawDescriptorSets(cameraDescriptorSets[currentFrame]));
+    const std::array<VkBuffer, 2> vertexBuffers = {
+        resources.get(vertexBuffer)->buffer,
+        resources.get(bucket.instanceBuffer)->buffer
+    };
+    state.bindVertexBuffers(vertexBuffers);
+    state.bindIndexBuffer(resources.get(indexBuffer)->buffer, VK_INDEX_TYPE_UINT32);
+    for(const auto& draw : bucket.drawList) {
+        const Mesh& mesh = meshes[draw.mesh];
+        const MeshLod& lod = mesh.lods[draw.lod];
+        vkCmdDrawIndexed(cached.commandBuffer, lod.indexCount, draw.instanceCount,
+                        lod.firstIndex, mesh.vertexOffset, draw.firstInstance);
+        state.countDraw();
+    }
+
+    if(vkEndCommandBuffer(cached.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record static command buffer!");
+    }
+
+    cached.version = bucket.version;
+    cached.pipeline = pipeline->pipeline;
+    cached.renderTargets = renderTargetGeneration;
+    cached.drawCalls = stats.drawCalls - drawCalls;
+    stats.recordedBuckets++;
+    return cached.commandBuffer;
+}
+
 Renderer::~Renderer() {
     cleanup();
 }
\ No newline at end of file
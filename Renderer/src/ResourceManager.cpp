@@ -0,0 +1,525 @@
+#include "ResourceManager.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+// Discrete GPUs without resizable BAR still expose a 256 MiB window
+const VkDeviceSize DEFAULT_BAR_SIZE = 256ull * 1024 * 1024;
+
+static const char* MEMORY_CATEGORY_NAMES[MEMORY_CATEGORY_COUNT] = {
+    "geometry", "staging", "textures", "renderTargets", "uniforms", "other"
+};
+
+const char* memoryCategoryName(MemoryCategory category) {
+    return MEMORY_CATEGORY_NAMES[static_cast<size_t>(category)];
+}
+
+ResourceManager::ResourceManager() : physicalDevice(VK_NULL_HANDLE),
+                                     device(VK_NULL_HANDLE),
+                                     memoryProperties{},
+                                     architecture{},
+                                     memoryBudget(false),
+                                     maxAllocationCount(0),
+                                     currentFrame(0),
+                                     categoryStats{},
+                                     totalAllocations(0),
+                                     totalFrees(0) {}
+
+void ResourceManager::init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget) {
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+    // Budget queries go through vkGetPhysicalDeviceMemoryProperties2
+    this->memoryBudget = memoryBudget && deviceProperties.apiVersion >= VK_API_VERSION_1_1;
+
+    heapStats.assign(memoryProperties.memoryHeapCount, MemoryHeapStats{});
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+        heapStats[heap].size = memoryProperties.memoryHeaps[heap].size;
+        heapStats[heap].deviceLocal = (memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    // A device-local heap is mappable when some host-coherent type lives in it
+    const VkMemoryPropertyFlags mappableDeviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    bool allHeapsMappableDeviceLocal = true;
+    architecture = {};
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+        if (!(memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            allHeapsMappableDeviceLocal = false;
+            continue;
+        }
+
+        bool mappable = false;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            const VkMemoryType& type = memoryProperties.memoryTypes[i];
+            mappable |= type.heapIndex == heap && (type.propertyFlags & mappableDeviceLocal) == mappableDeviceLocal;
+        }
+
+        if (mappable) {
+            architecture.hostVisibleDeviceLocalSize = std::max(architecture.hostVisibleDeviceLocalSize,
+                                                            memoryProperties.memoryHeaps[heap].size);
+        } else {
+            allHeapsMappableDeviceLocal = false;
+        }
+    }
+
+    // Software rasterisers such as lavapipe report themselves as CPU devices;
+    // a discrete GPU always has a separate, non device-local system heap
+    architecture.unified = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+                        deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ||
+                        allHeapsMappableDeviceLocal;
+    architecture.resizableBar = !architecture.unified && architecture.hostVisibleDeviceLocalSize > DEFAULT_BAR_SIZE;
+}
+
+void ResourceManager::shutdown() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    release(retiredBuffers, UINT64_MAX);
+    release(retiredImages, UINT64_MAX);
+    release(retiredPipelines, UINT64_MAX);
+    release(retiredSamplers, UINT64_MAX);
+
+    buffers.forEachAlive([this](const Buffer& buffer) { release(buffer); });
+    images.forEachAlive([this](const Image& image) { release(image); });
+    pipelines.forEachAlive([this](const Pipeline& pipeline) { release(pipeline); });
+    samplers.forEachAlive([this](const Sampler& sampler) { release(sampler); });
+    buffers.clear();
+    images.clear();
+    pipelines.clear();
+    samplers.clear();
+}
+
+void ResourceManager::setQueueFamilies(const std::vector<uint32_t>& families) {
+    queueFamilies = families;
+    std::sort(queueFamilies.begin(), queueFamilies.end());
+    queueFamilies.erase(std::unique(queueFamilies.begin(), queueFamilies.end()), queueFamilies.end());
+}
+
+// Memory types
+uint32_t ResourceManager::selectMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                                           VkMemoryPropertyFlags preferred, VkMemoryPropertyFlags avoided) const {
+    uint32_t best = UINT32_MAX;
+    int bestScore = 0;
+    VkDeviceSize bestHeapSize = 0;
+
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+        if (!(typeFilter & (1 << i)) || (flags & required) != required) {
+            continue;
+        }
+
+        int score = static_cast<int>(std::bitset<32>(flags & preferred).count()) -
+                    static_cast<int>(std::bitset<32>(flags & avoided).count());
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+        if (best == UINT32_MAX || score > bestScore || (score == bestScore && heapSize > bestHeapSize)) {
+            best = i;
+            bestScore = score;
+            bestHeapSize = heapSize;
+        }
+    }
+
+    if (best == UINT32_MAX) {
+        throw std::runtime_error("Failed to find suitable memory type!");
+    }
+    return best;
+}
+
+uint32_t ResourceManager::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+    return selectMemoryType(typeFilter, properties, 0, 0);
+}
+
+uint32_t ResourceManager::findMemoryType(uint32_t typeFilter, MemoryUsage usage, VkDeviceSize size) const {
+    const VkMemoryPropertyFlags hostAccess = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    switch (usage) {
+    case MemoryUsage::GpuOnly:
+        // Leave a small BAR window to the data that really needs mapping
+        return selectMemoryType(typeFilter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                                architecture.unified || architecture.resizableBar ? 0 : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    case MemoryUsage::Upload:
+        // Without a direct path this is a staging buffer, keep it out of VRAM
+        if (prefersDirectUpload(size)) {
+            return selectMemoryType(typeFilter, hostAccess, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        }
+        return selectMemoryType(typeFilter, hostAccess, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    case MemoryUsage::Dynamic: {
+        // Small per-frame data is worth a slice of even a 256 MiB BAR: the
+        // GPU then reads it at VRAM speed instead of over PCIe every draw
+        bool deviceLocal = size <= architecture.hostVisibleDeviceLocalSize / 8;
+        return selectMemoryType(typeFilter, hostAccess, deviceLocal ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : 0, 0);
+    }
+    case MemoryUsage::Readback:
+        return selectMemoryType(typeFilter, hostAccess, VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                architecture.unified ? 0 : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    throw std::runtime_error("Unknown memory usage!");
+}
+
+bool ResourceManager::prefersDirectUpload(VkDeviceSize size) const {
+    // CPU writes into write-combined VRAM beat a staging copy plus a queue
+    // round trip once the whole of VRAM is mappable
+    return architecture.unified ||
+        (architecture.resizableBar && size <= architecture.hostVisibleDeviceLocalSize / 4);
+}
+
+// Creation
+Allocation ResourceManager::allocateMemory(VkDeviceSize size, VkDeviceSize requestedSize, uint32_t memoryType,
+                                           MemoryCategory category) {
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    Allocation allocation{};
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate resource memory!");
+    }
+    allocation.size = size;
+    allocation.memoryType = memoryType;
+    allocation.category = category;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryCategoryStats& categoryStat = categoryStats[static_cast<size_t>(category)];
+    categoryStat.allocatedBytes += size;
+    categoryStat.requestedBytes += requestedSize;
+    categoryStat.peakBytes = std::max(categoryStat.peakBytes, categoryStat.allocatedBytes);
+    categoryStat.allocationCount++;
+
+    MemoryHeapStats& heapStat = heapStats[memoryProperties.memoryTypes[memoryType].heapIndex];
+    heapStat.allocatedBytes += size;
+    heapStat.allocationCount++;
+    totalAllocations++;
+
+    return allocation;
+}
+
+// Called with the mutex held
+void ResourceManager::freeMemory(const Allocation& allocation, VkDeviceSize requestedSize) {
+    vkFreeMemory(device, allocation.memory, nullptr);
+
+    MemoryCategoryStats& categoryStat = categoryStats[static_cast<size_t>(allocation.category)];
+    categoryStat.allocatedBytes -= allocation.size;
+    categoryStat.requestedBytes -= requestedSize;
+    categoryStat.allocationCount--;
+
+    MemoryHeapStats& heapStat = heapStats[memoryProperties.memoryTypes[allocation.memoryType].heapIndex];
+    heapStat.allocatedBytes -= allocation.size;
+    heapStat.allocationCount--;
+    totalFrees++;
+}
+
+BufferHandle ResourceManager::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool mapped,
+                                           MemoryCategory category, BufferSharing sharing,
+                                           const std::function<uint32_t(uint32_t)>& chooseMemoryType) {
+    Buffer buffer{};
+    buffer.size = size;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // Concurrent sharing needs at least two distinct families
+    if (sharing == BufferSharing::Concurrent && queueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer.buffer, &memRequirements);
+    // No memory type fitting or no memory left, the buffer is not handed out
+    try {
+        buffer.allocation = allocateMemory(memRequirements.size, size,
+                                        chooseMemoryType(memRequirements.memoryTypeBits), category);
+    } catch (...) {
+        vkDestroyBuffer(device, buffer.buffer, nullptr);
+        throw;
+    }
+    vkBindBufferMemory(device, buffer.buffer, buffer.allocation.memory, 0);
+
+    if (mapped) {
+        vkMapMemory(device, buffer.allocation.memory, 0, size, 0, &buffer.mapped);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return buffers.allocate(buffer);
+}
+
+BufferHandle ResourceManager::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                                           MemoryCategory category, bool mapped) {
+    return createBuffer(size, usage, mapped, category, BufferSharing::Exclusive, [&](uint32_t typeBits) {
+        return findMemoryType(typeBits, properties);
+    });
+}
+
+BufferHandle ResourceManager::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage,
+                                           MemoryCategory category, BufferSharing sharing) {
+    return createBuffer(size, usage, memoryUsage != MemoryUsage::GpuOnly, category, sharing, [&](uint32_t typeBits) {
+        return findMemoryType(typeBits, memoryUsage, size);
+    });
+}
+
+ImageHandle ResourceManager::createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+                                         VkImageAspectFlags aspect, MemoryCategory category) {
+    Image image{};
+    image.format = imageInfo.format;
+    image.extent = imageInfo.extent;
+
+    if (vkCreateImage(device, &imageInfo, nullptr, &image.image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image.image, &memRequirements);
+    // No memory type fitting or no memory left, the image is not handed out
+    try {
+        image.allocation = allocateMemory(memRequirements.size, memRequirements.size,
+                                        findMemoryType(memRequirements.memoryTypeBits, properties), category);
+    } catch (...) {
+        vkDestroyImage(device, image.image, nullptr);
+        throw;
+    }
+    vkBindImageMemory(device, image.image, image.allocation.memory, 0);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image.image;
+    if (imageInfo.imageType == VK_IMAGE_TYPE_3D) {
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_3D;
+    } else {
+        viewInfo.viewType = imageInfo.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+    }
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange.aspectMask = aspect;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = imageInfo.mipLevels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = imageInfo.arrayLayers;
+
+    if (vkCreateImageView(device, &viewInfo, nullptr, &image.view) != VK_SUCCESS) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeMemory(image.allocation, memRequirements.size);
+        vkDestroyImage(device, image.image, nullptr);
+        throw std::runtime_error("Failed to create image view!");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return images.allocate(image);
+}
+
+SamplerHandle ResourceManager::createSampler(const VkSamplerCreateInfo& samplerInfo) {
+    Sampler sampler{};
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler.sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create sampler!");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return samplers.allocate(sampler);
+}
+
+PipelineHandle ResourceManager::addPipeline(VkPipeline pipeline, VkPipelineLayout layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelines.allocate({pipeline, layout});
+}
+
+// Lookup
+Buffer* ResourceManager::get(BufferHandle handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return buffers.get(handle);
+}
+
+Image* ResourceManager::get(ImageHandle handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return images.get(handle);
+}
+
+Pipeline* ResourceManager::get(PipelineHandle handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelines.get(handle);
+}
+
+Sampler* ResourceManager::get(SamplerHandle handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return samplers.get(handle);
+}
+
+// Deferred destruction
+template<typename T>
+void ResourceManager::retire(ResourcePool<T>& pool, std::deque<Retired<T>>& queue, ResourceHandle<T> handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    T resource;
+    if (pool.release(handle, resource)) {
+        queue.push_back({currentFrame, resource});
+    }
+}
+
+void ResourceManager::destroy(BufferHandle handle) {
+    retire(buffers, retiredBuffers, handle);
+}
+
+void ResourceManager::destroy(ImageHandle handle) {
+    retire(images, retiredImages, handle);
+}
+
+void ResourceManager::destroy(PipelineHandle handle) {
+    retire(pipelines, retiredPipelines, handle);
+}
+
+void ResourceManager::destroy(SamplerHandle handle) {
+    retire(samplers, retiredSamplers, handle);
+}
+
+void ResourceManager::beginFrame(uint64_t frame) {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentFrame = frame;
+}
+
+void ResourceManager::collect(uint64_t completedFrame) {
+    std::lock_guard<std::mutex> lock(mutex);
+    release(retiredBuffers, completedFrame);
+    release(retiredImages, completedFrame);
+    release(retiredPipelines, completedFrame);
+    release(retiredSamplers, completedFrame);
+}
+
+size_t ResourceManager::pendingDestroyCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return retiredBuffers.size() + retiredImages.size() + retiredPipelines.size() + retiredSamplers.size();
+}
+
+template<typename T>
+void ResourceManager::release(std::deque<Retired<T>>& queue, uint64_t completedFrame) {
+    // Retired in frame order, so the queue is sorted
+    while (!queue.empty() && queue.front().frame <= completedFrame) {
+        release(queue.front().resource);
+        queue.pop_front();
+    }
+}
+
+void ResourceManager::release(const Buffer& buffer) {
+    if (buffer.mapped) {
+        vkUnmapMemory(device, buffer.allocation.memory);
+    }
+    vkDestroyBuffer(device, buffer.buffer, nullptr);
+    freeMemory(buffer.allocation, buffer.size);
+}
+
+void ResourceManager::release(const Image& image) {
+    vkDestroyImageView(device, image.view, nullptr);
+    vkDestroyImage(device, image.image, nullptr);
+    freeMemory(image.allocation, image.allocation.size);
+}
+
+void ResourceManager::release(const Pipeline& pipeline) {
+    vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+    if (pipeline.layout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, pipeline.layout, nullptr);
+    }
+}
+
+void ResourceManager::release(const Sampler& sampler) {
+    vkDestroySampler(device, sampler.sampler, nullptr);
+}
+
+// Telemetry
+MemoryStats ResourceManager::getMemoryStats() {
+    MemoryStats stats{};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.categories = categoryStats;
+        stats.heaps = heapStats;
+        stats.totalAllocations = totalAllocations;
+        stats.totalFrees = totalFrees;
+    }
+    stats.allocationCount = static_cast<uint32_t>(stats.totalAllocations - stats.totalFrees);
+    stats.maxAllocationCount = maxAllocationCount;
+    stats.budgetAvailable = memoryBudget;
+
+    if (memoryBudget) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+        for (size_t heap = 0; heap < stats.heaps.size(); heap++) {
+            stats.heaps[heap].budget = budgetProperties.heapBudget[heap];
+            stats.heaps[heap].usage = budgetProperties.heapUsage[heap];
+        }
+    }
+    return stats;
+}
+
+std::string memoryStatsToJson(const MemoryStats& stats) {
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"budgetAvailable\": " << (stats.budgetAvailable ? "true" : "false") << ",\n";
+    json << "  \"allocationCount\": " << stats.allocationCount << ",\n";
+    json << "  \"maxAllocationCount\": " << stats.maxAllocationCount << ",\n";
+    json << "  \"totalAllocations\": " << stats.totalAllocations << ",\n";
+    json << "  \"totalFrees\": " << stats.totalFrees << ",\n";
+
+    json << "  \"categories\": {\n";
+    for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+        const MemoryCategoryStats& category = stats.categories[i];
+        json << "    \"" << MEMORY_CATEGORY_NAMES[i] << "\": {"
+             << "\"allocatedBytes\": " << category.allocatedBytes
+             << ", \"requestedBytes\": " << category.requestedBytes
+             << ", \"peakBytes\": " << category.peakBytes
+             << ", \"allocations\": " << category.allocationCount << "}"
+             << (i + 1 < MEMORY_CATEGORY_COUNT ? ",\n" : "\n");
+    }
+    json << "  },\n";
+
+    json << "  \"heaps\": [\n";
+    for (size_t i = 0; i < stats.heaps.size(); i++) {
+        const MemoryHeapStats& heap = stats.heaps[i];
+        json << "    {\"index\": " << i
+             << ", \"size\": " << heap.size
+             << ", \"deviceLocal\": " << (heap.deviceLocal ? "true" : "false")
+             << ", \"allocatedBytes\": " << heap.allocatedBytes
+             << ", \"allocations\": " << heap.allocationCount
+             << ", \"budget\": " << heap.budget
+             << ", \"usage\": " << heap.usage << "}"
+             << (i + 1 < stats.heaps.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+    return json.str();
+}
+
+void ResourceManager::writeMemoryReport(const std::string& path) {
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Memory report skipped, failed to open " << temporaryPath << "\n";
+            return;
+        }
+        file << memoryStatsToJson(getMemoryStats());
+    }
+#ifdef _WIN32
+    // rename does not replace existing files on Windows
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Memory report skipped, failed to replace " << path << "\n";
+    }
+}
@@ -0,0 +1,211 @@
+#include "Scene.hpp"
+
+#include <mutex>
+
+// Component registry
+// Fixed storage so references handed out by info() stay valid while other
+// threads register new types.
+static std::array<ComponentInfo, MAX_COMPONENT_TYPES> registeredComponents;
+static uint32_t registeredComponentCount = 0;
+static std::mutex registryMutex;
+
+uint32_t ComponentRegistry::registerType(size_t size, size_t alignment) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (registeredComponentCount >= MAX_COMPONENT_TYPES) {
+        throw std::runtime_error("Too many component types registered!");
+    }
+    registeredComponents[registeredComponentCount] = {size, alignment};
+    return registeredComponentCount++;
+}
+
+const ComponentInfo& ComponentRegistry::info(uint32_t componentId) {
+    return registeredComponents[componentId];
+}
+
+// Archetype
+static uint32_t alignOffset(size_t offset, size_t alignment) {
+    return static_cast<uint32_t>((offset + alignment - 1) & ~(alignment - 1));
+}
+
+Archetype::Archetype(ComponentMask mask) : mask(mask), capacity(0), entityOffset(0) {
+    columnOffsets.fill(UINT32_MAX);
+
+    size_t rowSize = sizeof(Entity);
+    for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++) {
+        if (mask & (ComponentMask(1) << id)) {
+            componentIds.push_back(id);
+            rowSize += ComponentRegistry::info(id).size;
+        }
+    }
+
+    // Start from the ideal row count and shrink until the padded layout fits
+    capacity = static_cast<uint32_t>(CHUNK_SIZE / rowSize);
+    while (capacity > 0) {
+        size_t offset = 0;
+        for (uint32_t id : componentIds) {
+            const ComponentInfo& info = ComponentRegistry::info(id);
+            offset = alignOffset(offset, info.alignment);
+            columnOffsets[id] = static_cast<uint32_t>(offset);
+            offset += info.size * capacity;
+        }
+        offset = alignOffset(offset, alignof(Entity));
+        entityOffset = static_cast<uint32_t>(offset);
+        offset += sizeof(Entity) * capacity;
+
+        if (offset <= CHUNK_SIZE) {
+            break;
+        }
+        capacity--;
+    }
+
+    if (capacity == 0) {
+        throw std::runtime_error("Component signature does not fit in a single chunk!");
+    }
+}
+
+void Archetype::allocateRow(Entity entity, uint32_t& chunkIndex, uint32_t& row) {
+    if (chunks.empty() || chunks.back()->count == capacity) {
+        chunks.push_back(std::make_unique<Chunk>());
+    }
+
+    chunkIndex = static_cast<uint32_t>(chunks.size() - 1);
+    Chunk& chunk = *chunks.back();
+    row = chunk.count++;
+    entities(chunk)[row] = entity;
+}
+
+Entity Archetype::removeRow(uint32_t chunkIndex, uint32_t row) {
+    Chunk& chunk = *chunks[chunkIndex];
+    Chunk& last = *chunks.back();
+    uint32_t lastRow = last.count - 1;
+
+    Entity moved = NULL_ENTITY;
+    if (&chunk != &last || row != lastRow) {
+        for (uint32_t id : componentIds) {
+            size_t size = ComponentRegistry::info(id).size;
+            uint8_t* dst = static_cast<uint8_t*>(column(chunk, id)) + size * row;
+            uint8_t* src = static_cast<uint8_t*>(column(last, id)) + size * lastRow;
+            memcpy(dst, src, size);
+        }
+        moved = entities(last)[lastRow];
+        entities(chunk)[row] = moved;
+    }
+
+    last.count--;
+    if (last.count == 0) {
+        chunks.pop_back();
+    }
+
+    return moved;
+}
+
+// Scene
+Scene::Scene() : aliveCount(0) {}
+
+Scene::~Scene() {}
+
+const Scene::EntityRecord& Scene::checkedRecord(Entity entity) const {
+    if (!isAlive(entity)) {
+        throw std::runtime_error("Entity is not alive!");
+    }
+    return records[entity.index];
+}
+
+bool Scene::isAlive(Entity entity) const {
+    return entity.index < records.size()
+        && records[entity.index].generation == entity.generation
+        && records[entity.index].archetype != nullptr;
+}
+
+Archetype* Scene::getOrCreateArchetype(ComponentMask mask) {
+    auto found = archetypeLookup.find(mask);
+    if (found != archetypeLookup.end()) {
+        return found->second;
+    }
+
+    archetypes.push_back(std::make_unique<Archetype>(mask));
+    Archetype* archetype = archetypes.back().get();
+    archetypeLookup[mask] = archetype;
+    return archetype;
+}
+
+Entity Scene::allocateEntity(Archetype* archetype) {
+    Entity entity;
+    if (!freeIndices.empty()) {
+        entity.index = freeIndices.back();
+        freeIndices.pop_back();
+        entity.generation = records[entity.index].generation;
+    } else {
+        entity.index = static_cast<uint32_t>(records.size());
+        entity.generation = 0;
+        records.push_back({nullptr, 0, 0, 0});
+    }
+
+    EntityRecord& record = records[entity.index];
+    record.archetype = archetype;
+    archetype->allocateRow(entity, record.chunk, record.row);
+    aliveCount++;
+
+    return entity;
+}
+
+void Scene::destroyEntity(Entity entity) {
+    EntityRecord record = checkedRecord(entity);
+
+    Entity moved = record.archetype->removeRow(record.chunk, record.row);
+    if (moved != NULL_ENTITY) {
+        records[moved.index].chunk = record.chunk;
+        records[moved.index].row = record.row;
+    }
+
+    EntityRecord& freed = records[entity.index];
+    freed.archetype = nullptr;
+    freed.generation++;
+    freeIndices.push_back(entity.index);
+    aliveCount--;
+}
+
+void Scene::moveEntity(Entity entity, ComponentMask newMask) {
+    EntityRecord record = checkedRecord(entity);
+    Archetype* source = record.archetype;
+    Archetype* target = getOrCreateArchetype(newMask);
+
+    uint32_t chunkIndex, row;
+    target->allocateRow(entity, chunkIndex, row);
+
+    // Copy the components both signatures share; new ones are left for the caller
+    Chunk& srcChunk = *source->chunks[record.chunk];
+    Chunk& dstChunk = *target->chunks[chunkIndex];
+    for (uint32_t id : source->componentIds) {
+        if (target->has(id)) {
+            size_t size = ComponentRegistry::info(id).size;
+            memcpy(static_cast<uint8_t*>(target->column(dstChunk, id)) + size * row,
+                   static_cast<uint8_t*>(source->column(srcChunk, id)) + size * record.row,
+                   size);
+        }
+    }
+
+    Entity moved = source->removeRow(record.chunk, record.row);
+    if (moved != NULL_ENTITY) {
+        records[moved.index].chunk = record.chunk;
+        records[moved.index].row = record.row;
+    }
+
+    EntityRecord& updated = records[entity.index];
+    updated.archetype = target;
+    updated.chunk = chunkIndex;
+    updated.row = row;
+}
+
+const std::vector<Archetype*>& Scene::matchArchetypes(ComponentMask mask) {
+    // Archetypes are never destroyed, so each cached query only has to look at
+    // the ones created since it last ran.
+    QueryCache& cache = queryCache[mask];
+    for (; cache.archetypesSeen < archetypes.size(); cache.archetypesSeen++) {
+        Archetype* archetype = archetypes[cache.archetypesSeen].get();
+        if ((archetype->mask & mask) == mask) {
+            cache.matches.push_back(archetype);
+        }
+    }
+    return cache.matches;
+}
@@ -0,0 +1,635 @@
+#include "ShadowAtlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "Camera.hpp"
+
+// Lights holding a slot rank as if this much more important, so lights of
+// about the same importance do not keep trading slots and their caches
+static const float SHADOW_SLOT_HYSTERESIS = 1.25f;
+
+// Light to fragment direction and up vector of the faces, in the order the
+// fragment shader picks them by major axis: +x, -x, +y, -y, +z, -z
+static const std::array<glm::vec3, SHADOW_FACES> faceDirections = {
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+};
+static const std::array<glm::vec3, SHADOW_FACES> faceUps = {
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)
+};
+
+// Tier of a rank, or of a slot since both count up through the tiers
+static uint32_t getTier(uint32_t index) {
+    uint32_t first = 0;
+    for (uint32_t tier = 0; tier < SHADOW_TIER_COUNT; tier++) {
+        first += SHADOW_TIER_LIGHTS[tier];
+        if (index < first) {
+            return tier;
+        }
+    }
+    return SHADOW_TIER_COUNT;
+}
+
+ShadowAtlas::ShadowAtlas() : device(VK_NULL_HANDLE),
+                            resources(nullptr),
+                            staticAtlasReady(false),
+                            renderPass(VK_NULL_HANDLE),
+                            framebuffer(VK_NULL_HANDLE),
+                            staticFramebuffer(VK_NULL_HANDLE),
+                            pipelineLayout(VK_NULL_HANDLE),
+                            setLayout(VK_NULL_HANDLE),
+                            descriptorPool(VK_NULL_HANDLE),
+                            casterSetLayout(VK_NULL_HANDLE) {
+    slotOwners.fill(NULL_ENTITY);
+}
+
+void ShadowAtlas::init(VkDevice device, ResourceManager& resources, uint32_t frameCount) {
+    this->device = device;
+    this->resources = &resources;
+
+    // Each tier is a band of rows, its lights' faces side by side
+    uint32_t bandTop = 0;
+    uint32_t firstSlot = 0;
+    for (uint32_t tier = 0; tier < SHADOW_TIER_COUNT; tier++) {
+        const uint32_t size = SHADOW_TIER_SIZES[tier];
+        const uint32_t perRow = SHADOW_ATLAS_SIZE / size;
+        const uint32_t faceCount = SHADOW_TIER_LIGHTS[tier] * SHADOW_FACES;
+        for (uint32_t i = 0; i < faceCount; i++) {
+            VkRect2D& tile = tiles[firstSlot * SHADOW_FACES + i];
+            tile.offset = {static_cast<int32_t>(i % perRow * size), static_cast<int32_t>(bandTop + i / perRow * size)};
+            tile.extent = {size, size};
+        }
+        bandTop += (faceCount + perRow - 1) / perRow * size;
+        firstSlot += SHADOW_TIER_LIGHTS[tier];
+    }
+    if (bandTop > SHADOW_ATLAS_SIZE || firstSlot != SHADOW_MAX_LIGHTS) {
+        throw std::runtime_error("Shadow atlas tiers do not fit the atlas!");
+    }
+
+    // 16 bits are always supported for sampling and hold the normalized
+    // distance well enough
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_D16_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    atlas = resources.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+                MemoryCategory::RenderTargets);
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    staticAtlas = resources.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+                MemoryCategory::RenderTargets);
+
+    createRenderPass();
+    framebuffer = createFramebuffer(atlas);
+    staticFramebuffer = createFramebuffer(staticAtlas);
+
+    // 0 the camera instances, 1 the dynamic casters' indices into them
+    std::array<VkDescriptorSetLayoutBinding, 2> casterBindings{};
+    for (uint32_t i = 0; i < casterBindings.size(); i++) {
+        casterBindings[i].binding = i;
+        casterBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        casterBindings[i].descriptorCount = 1;
+        casterBindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo casterLayoutInfo{};
+    casterLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    casterLayoutInfo.bindingCount = static_cast<uint32_t>(casterBindings.size());
+    casterLayoutInfo.pBindings = casterBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &casterLayoutInfo, nullptr, &casterSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow caster descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(ShadowPushConstants);
+
+    // The static caster pipeline leaves the caster set unused
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &casterSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow pipeline layout!");
+    }
+
+    // Compared in hardware, the fragment shader filters by taking several taps
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.compareEnable = VK_TRUE;
+    samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    sampler = resources.createSampler(samplerInfo);
+
+    // 0 the faces, 1 the atlas
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow descriptor set layout!");
+    }
+
+    // A fragment set and a caster set per frame
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = frameCount * 3;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = frameCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frameCount * 2;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frameCount, setLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = frameCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    descriptorSets.resize(frameCount);
+    if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate shadow descriptor sets!");
+    }
+
+    // Written by update() once the frame's buffers are known
+    std::vector<VkDescriptorSetLayout> casterLayouts(frameCount, casterSetLayout);
+    allocInfo.pSetLayouts = casterLayouts.data();
+    casterDescriptorSets.resize(frameCount);
+    if (vkAllocateDescriptorSets(device, &allocInfo, casterDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate shadow caster descriptor sets!");
+    }
+    casterBuffers.resize(frameCount);
+    casterBufferCapacity.assign(frameCount, 1024);
+    casterSetBuffers.assign(frameCount, {VK_NULL_HANDLE, VK_NULL_HANDLE});
+    for (uint32_t i = 0; i < frameCount; i++) {
+        casterBuffers[i] = resources.createBuffer(sizeof(uint32_t) * casterBufferCapacity[i],
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::Dynamic, MemoryCategory::Geometry);
+    }
+
+    // Written once, cached command buffers binding the sets stay valid
+    faceBuffers.resize(frameCount);
+    for (uint32_t i = 0; i < frameCount; i++) {
+        faceBuffers[i] = resources.createBuffer(sizeof(ShadowFace) * SHADOW_MAX_LIGHTS * SHADOW_FACES,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::Dynamic, MemoryCategory::Uniforms);
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = resources.get(faceBuffers[i])->buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorImageInfo atlasInfo{};
+        atlasInfo.sampler = resources.get(sampler)->sampler;
+        atlasInfo.imageView = resources.get(atlas)->view;
+        atlasInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = descriptorSets[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = bindings[binding].descriptorType;
+        }
+        writes[0].pBufferInfo = &bufferInfo;
+        writes[1].pImageInfo = &atlasInfo;
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void ShadowAtlas::shutdown() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    for (BufferHandle buffer : faceBuffers) {
+        resources->destroy(buffer);
+    }
+    for (BufferHandle buffer : casterBuffers) {
+        resources->destroy(buffer);
+    }
+    vkDestroyFramebuffer(device, framebuffer, nullptr);
+    vkDestroyFramebuffer(device, staticFramebuffer, nullptr);
+    vkDestroyRenderPass(device, renderPass, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    resources->destroy(atlas);
+    resources->destroy(staticAtlas);
+    resources->destroy(sampler);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, casterSetLayout, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void ShadowAtlas::createRenderPass() {
+    // Both atlases keep what is outside the faces drawn, layouts are changed
+    // around the pass by record()
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = VK_FORMAT_D16_UNORM;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 0;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 0;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &depthAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow render pass!");
+    }
+}
+
+VkFramebuffer ShadowAtlas::createFramebuffer(ImageHandle image) {
+    VkImageView view = resources->get(image)->view;
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &view;
+    framebufferInfo.width = SHADOW_ATLAS_SIZE;
+    framebufferInfo.height = SHADOW_ATLAS_SIZE;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer result;
+    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &result) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow framebuffer!");
+    }
+    return result;
+}
+
+uint32_t ShadowAtlas::getFaceMask(const glm::vec3& offset, float boundsRadius, float lightRadius) {
+    float reach = lightRadius + boundsRadius;
+    if (glm::dot(offset, offset) >= reach * reach) {
+        return 0;
+    }
+
+    // A face's frustum is bounded by four planes through the light at 45
+    // degrees to its axis; the sphere reaches in unless it is entirely
+    // behind one of them
+    const float slack = boundsRadius * 1.41421356f;
+    uint32_t mask = 0;
+    for (uint32_t face = 0; face < SHADOW_FACES; face++) {
+        uint32_t axis = face / 2;
+        float along = face % 2 == 0 ? offset[axis] : -offset[axis];
+        float across = std::max(std::abs(offset[(axis + 1) % 3]), std::abs(offset[(axis + 2) % 3]));
+        if (along - across > -slack) {
+            mask |= 1u << face;
+        }
+    }
+    return mask;
+}
+
+void ShadowAtlas::allocate(const std::vector<Entity>& entities, std::vector<LightData>& lights,
+                        const glm::vec3& cameraPosition, std::vector<ShadowLight>& shadows) {
+    ownerSlots.clear();
+    for (uint32_t slot = 0; slot < SHADOW_MAX_LIGHTS; slot++) {
+        if (slotOwners[slot] != NULL_ENTITY) {
+            ownerSlots[slotOwners[slot].index] = slot;
+        }
+    }
+
+    // Brightness times how much of the view the light's reach covers
+    candidates.clear();
+    for (uint32_t i = 0; i < lights.size(); i++) {
+        LightData& light = lights[i];
+        light.shadow = -1;
+
+        glm::vec3 offset = light.position - cameraPosition;
+        float radiusSquared = light.radius * light.radius;
+        float luminance = glm::dot(light.color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+        float score = luminance * radiusSquared / std::max(glm::dot(offset, offset), radiusSquared);
+        if (!(score > 0.0f)) {
+            continue;
+        }
+
+        uint32_t previousSlot = UINT32_MAX;
+        auto owner = ownerSlots.find(entities[i].index);
+        if (owner != ownerSlots.end() && slotOwners[owner->second] == entities[i]) {
+            previousSlot = owner->second;
+            score *= SHADOW_SLOT_HYSTERESIS;
+        }
+        candidates.push_back({score, i, previousSlot});
+    }
+
+    size_t count = std::min<size_t>(candidates.size(), SHADOW_MAX_LIGHTS);
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                    [](const Candidate& a, const Candidate& b) { return a.score > b.score; });
+
+    // Lights staying in their tier keep their slot first, the others then
+    // take the slots left over in theirs
+    std::array<Entity, SHADOW_MAX_LIGHTS> owners;
+    owners.fill(NULL_ENTITY);
+    std::array<uint32_t, SHADOW_MAX_LIGHTS> slots;
+    slots.fill(UINT32_MAX);
+    for (uint32_t rank = 0; rank < count; rank++) {
+        const Candidate& candidate = candidates[rank];
+        if (candidate.previousSlot != UINT32_MAX && getTier(candidate.previousSlot) == getTier(rank)) {
+            slots[rank] = candidate.previousSlot;
+            owners[candidate.previousSlot] = entities[candidate.light];
+        }
+    }
+    for (uint32_t rank = 0; rank < count; rank++) {
+        if (slots[rank] != UINT32_MAX) {
+            continue;
+        }
+        // A tier has as many slots as ranks, one of them is always free
+        uint32_t slot = 0;
+        while (getTier(slot) != getTier(rank) || owners[slot] != NULL_ENTITY) {
+            slot++;
+        }
+        slots[rank] = slot;
+        owners[slot] = entities[candidates[rank].light];
+    }
+    slotOwners = owners;
+
+    shadows.clear();
+    for (uint32_t rank = 0; rank < count; rank++) {
+        LightData& light = lights[candidates[rank].light];
+        light.shadow = static_cast<int32_t>(slots[rank]);
+        shadows.push_back({slots[rank], light.position, light.radius});
+    }
+}
+
+void ShadowAtlas::update(size_t frame, const std::vector<ShadowLight>& shadows, VkBuffer instances,
+                        const std::vector<uint32_t>& casters) {
+    ShadowFace* faces = static_cast<ShadowFace*>(resources->get(faceBuffers[frame])->mapped);
+    for (const auto& shadow : shadows) {
+        // 90 degrees square, the faces meet at their edges
+        Camera faceCamera;
+        faceCamera.position = shadow.position;
+        faceCamera.fovY = 1.5707963f;
+        faceCamera.nearPlane = shadow.radius * 0.01f;
+        faceCamera.farPlane = shadow.radius;
+        glm::mat4 projection = faceCamera.projection(1.0f);
+
+        for (uint32_t face = 0; face < SHADOW_FACES; face++) {
+            uint32_t index = shadow.slot * SHADOW_FACES + face;
+            faceCamera.target = shadow.position + faceDirections[face];
+            faceCamera.up = faceUps[face];
+            faceMatrices[index] = projection * faceCamera.view();
+
+            const VkRect2D& tile = tiles[index];
+            faces[index].viewProjection = faceMatrices[index];
+            faces[index].rect = glm::vec4(tile.offset.x, tile.offset.y, tile.extent.width, tile.extent.height) /
+                                (float) SHADOW_ATLAS_SIZE;
+        }
+    }
+
+    if (casters.size() > casterBufferCapacity[frame]) {
+        resources->destroy(casterBuffers[frame]);
+        size_t capacity = std::max(casters.size(), casterBufferCapacity[frame] * 2);
+        casterBuffers[frame] = resources->createBuffer(sizeof(uint32_t) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    MemoryUsage::Dynamic, MemoryCategory::Geometry);
+        casterBufferCapacity[frame] = capacity;
+    }
+    if (!casters.empty()) {
+        memcpy(resources->get(casterBuffers[frame])->mapped, casters.data(), sizeof(uint32_t) * casters.size());
+    }
+
+    // Either buffer is replaced when it grows
+    std::array<VkBuffer, 2> buffers = {instances, resources->get(casterBuffers[frame])->buffer};
+    if (buffers == casterSetBuffers[frame]) {
+        return;
+    }
+    std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    for (uint32_t binding = 0; binding < writes.size(); binding++) {
+        bufferInfos[binding].buffer = buffers[binding];
+        bufferInfos[binding].offset = 0;
+        bufferInfos[binding].range = VK_WHOLE_SIZE;
+        writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[binding].dstSet = casterDescriptorSets[frame];
+        writes[binding].dstBinding = binding;
+        writes[binding].descriptorCount = 1;
+        writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[binding].pBufferInfo = &bufferInfos[binding];
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    casterSetBuffers[frame] = buffers;
+}
+
+void ShadowAtlas::record(VkCommandBuffer commandBuffer, size_t frame, const std::vector<ShadowLight>& shadows,
+                        bool staticCastersChanged, const std::vector<uint32_t>& dynamicDraws,
+                        VkPipeline staticPipeline, VkPipeline dynamicPipeline,
+                        const std::function<void(VkCommandBuffer, bool staticCasters, uint32_t face)>& drawCasters,
+                        DrawStats& stats) {
+    if (staticCastersChanged) {
+        for (auto& cached : cachedSlots) {
+            cached.valid = false;
+        }
+    }
+
+    std::vector<const ShadowLight*> stale;
+    for (const auto& shadow : shadows) {
+        CachedSlot& cached = cachedSlots[shadow.slot];
+        if (!cached.valid || cached.position != shadow.position || cached.radius != shadow.radius) {
+            stale.push_back(&shadow);
+            cached.valid = true;
+            cached.position = shadow.position;
+            cached.radius = shadow.radius;
+        }
+    }
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = {SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE};
+
+    const VkPipelineStageFlags depthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    const VkAccessFlags depthAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // Static casters of the faces whose cache is out of date. The first time
+    // around nothing is cached, so the old contents can be dropped
+    if (!stale.empty()) {
+        transition(commandBuffer, staticAtlas,
+                staticAtlasReady ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, 0, depthStages, depthAccess);
+
+        renderPassInfo.framebuffer = staticFramebuffer;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, staticPipeline);
+        for (const ShadowLight* shadow : stale) {
+            for (uint32_t face = 0; face < SHADOW_FACES; face++) {
+                uint32_t index = shadow->slot * SHADOW_FACES + face;
+                setTile(commandBuffer, index);
+
+                VkClearAttachment clear{};
+                clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+                clear.clearValue.depthStencil = {1.0f, 0};
+                VkClearRect clearRect{};
+                clearRect.rect = tiles[index];
+                clearRect.layerCount = 1;
+                vkCmdClearAttachments(commandBuffer, 1, &clear, 1, &clearRect);
+
+                ShadowPushConstants constants{faceMatrices[index]};
+                vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                                sizeof(ShadowPushConstants), &constants);
+                drawCasters(commandBuffer, true, static_cast<uint32_t>(shadow - shadows.data()) * SHADOW_FACES + face);
+                stats.shadowFacesRendered++;
+            }
+        }
+        vkCmdEndRenderPass(commandBuffer);
+
+        transition(commandBuffer, staticAtlas, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_READ_BIT);
+        staticAtlasReady = true;
+    }
+    stats.shadowFacesCached += static_cast<uint32_t>(shadows.size() - stale.size()) * SHADOW_FACES;
+
+    // Last frame's atlas is replaced once its fragment shaders are done
+    if (shadows.empty()) {
+        transition(commandBuffer, atlas, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
+        return;
+    }
+    transition(commandBuffer, atlas, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    std::vector<VkImageCopy> regions;
+    regions.reserve(shadows.size() * SHADOW_FACES);
+    for (const auto& shadow : shadows) {
+        for (uint32_t face = 0; face < SHADOW_FACES; face++) {
+            const VkRect2D& tile = tiles[shadow.slot * SHADOW_FACES + face];
+            VkImageCopy region{};
+            region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+            region.srcSubresource.layerCount = 1;
+            region.srcOffset = {tile.offset.x, tile.offset.y, 0};
+            region.dstSubresource = region.srcSubresource;
+            region.dstOffset = region.srcOffset;
+            region.extent = {tile.extent.width, tile.extent.height, 1};
+            regions.push_back(region);
+        }
+    }
+    vkCmdCopyImage(commandBuffer, resources->get(staticAtlas)->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                resources->get(atlas)->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(regions.size()), regions.data());
+
+    transition(commandBuffer, atlas, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT, depthStages, depthAccess);
+
+    // Dynamic casters on top of the copied static depth, faces none of them
+    // reach into are left with the copy
+    renderPassInfo.framebuffer = framebuffer;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, dynamicPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+                        &casterDescriptorSets[frame], 0, nullptr);
+    for (uint32_t light = 0; light < shadows.size(); light++) {
+        for (uint32_t face = 0; face < SHADOW_FACES; face++) {
+            uint32_t first = light * SHADOW_FACES + face;
+            if (dynamicDraws[first] == dynamicDraws[first + 1]) {
+                continue;
+            }
+            uint32_t index = shadows[light].slot * SHADOW_FACES + face;
+            setTile(commandBuffer, index);
+            ShadowPushConstants constants{faceMatrices[index]};
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                            sizeof(ShadowPushConstants), &constants);
+            drawCasters(commandBuffer, false, light * SHADOW_FACES + face);
+        }
+    }
+    vkCmdEndRenderPass(commandBuffer);
+
+    transition(commandBuffer, atlas, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT);
+}
+
+void ShadowAtlas::transition(VkCommandBuffer commandBuffer, ImageHandle image, VkImageLayout oldLayout,
+                            VkImageLayout newLayout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                            VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = resources->get(image)->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void ShadowAtlas::setTile(VkCommandBuffer commandBuffer, uint32_t index) {
+    const VkRect2D& tile = tiles[index];
+
+    VkViewport viewport{};
+    viewport.x = (float) tile.offset.x;
+    viewport.y = (float) tile.offset.y;
+    viewport.width = (float) tile.extent.width;
+    viewport.height = (float) tile.extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &tile);
+}
@@ -0,0 +1,381 @@
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SIMD_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Nodes per parallel task; large enough to amortise the dispatch, small enough
+// to spread a single wide level across every core
+const size_t TRANSFORM_BATCH_SIZE = 1024;
+
+TransformHierarchy::TransformHierarchy() : orderDirty(false), lastUpdatedCount(0) {}
+
+uint32_t TransformHierarchy::slotOf(uint32_t node) const {
+    if (node >= nodeToSlot.size() || nodeToSlot[node] == UINT32_MAX) {
+        throw std::runtime_error("Invalid transform node!");
+    }
+    return nodeToSlot[node];
+}
+
+uint32_t TransformHierarchy::createNode(uint32_t parent, const LocalTransform& local) {
+    uint32_t parentIndex = UINT32_MAX;
+    if (parent != NULL_TRANSFORM_NODE) {
+        parentIndex = slotOf(parent);
+    }
+
+    uint32_t node;
+    if (!freeNodes.empty()) {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        node = static_cast<uint32_t>(nodeToSlot.size());
+        nodeToSlot.push_back(UINT32_MAX);
+        nodeParent.push_back(NULL_TRANSFORM_NODE);
+        childCount.push_back(0);
+    }
+
+    uint32_t slot = static_cast<uint32_t>(slotToNode.size());
+    positionX.push_back(0.0f); positionY.push_back(0.0f); positionZ.push_back(0.0f);
+    rotationX.push_back(0.0f); rotationY.push_back(0.0f); rotationZ.push_back(0.0f); rotationW.push_back(1.0f);
+    scaleX.push_back(1.0f); scaleY.push_back(1.0f); scaleZ.push_back(1.0f);
+    world.push_back(glm::mat4(1.0f));
+    parentSlot.push_back(parentIndex);
+    dirty.push_back(1);
+    changed.push_back(0);
+    slotToNode.push_back(node);
+
+    nodeToSlot[node] = slot;
+    nodeParent[node] = parent;
+    childCount[node] = 0;
+    if (parent != NULL_TRANSFORM_NODE) {
+        childCount[parent]++;
+    }
+
+    setLocal(node, local);
+    orderDirty = true;
+    return node;
+}
+
+void TransformHierarchy::removeSlot(uint32_t slot) {
+    uint32_t last = static_cast<uint32_t>(slotToNode.size() - 1);
+    if (slot != last) {
+        positionX[slot] = positionX[last]; positionY[slot] = positionY[last]; positionZ[slot] = positionZ[last];
+        rotationX[slot] = rotationX[last]; rotationY[slot] = rotationY[last];
+        rotationZ[slot] = rotationZ[last]; rotationW[slot] = rotationW[last];
+        scaleX[slot] = scaleX[last]; scaleY[slot] = scaleY[last]; scaleZ[slot] = scaleZ[last];
+        world[slot] = world[last];
+        parentSlot[slot] = parentSlot[last];
+        dirty[slot] = dirty[last];
+        changed[slot] = changed[last];
+        slotToNode[slot] = slotToNode[last];
+        nodeToSlot[slotToNode[slot]] = slot;
+    }
+
+    positionX.pop_back(); positionY.pop_back(); positionZ.pop_back();
+    rotationX.pop_back(); rotationY.pop_back(); rotationZ.pop_back(); rotationW.pop_back();
+    scaleX.pop_back(); scaleY.pop_back(); scaleZ.pop_back();
+    world.pop_back();
+    parentSlot.pop_back();
+    dirty.pop_back();
+    changed.pop_back();
+    slotToNode.pop_back();
+}
+
+void TransformHierarchy::destroyNode(uint32_t node) {
+    uint32_t slot = slotOf(node);
+    if (childCount[node] != 0) {
+        throw std::runtime_error("Cannot destroy a transform node that still has children!");
+    }
+
+    if (nodeParent[node] != NULL_TRANSFORM_NODE) {
+        childCount[nodeParent[node]]--;
+    }
+
+    removeSlot(slot);
+    nodeToSlot[node] = UINT32_MAX;
+    nodeParent[node] = NULL_TRANSFORM_NODE;
+    freeNodes.push_back(node);
+    orderDirty = true;
+}
+
+void TransformHierarchy::setParent(uint32_t node, uint32_t parent) {
+    uint32_t slot = slotOf(node);
+    for (uint32_t ancestor = parent; ancestor != NULL_TRANSFORM_NODE; ancestor = nodeParent[ancestor]) {
+        slotOf(ancestor);
+        if (ancestor == node) {
+            throw std::runtime_error("Reparenting would create a transform cycle!");
+        }
+    }
+
+    if (nodeParent[node] != NULL_TRANSFORM_NODE) {
+        childCount[nodeParent[node]]--;
+    }
+    if (parent != NULL_TRANSFORM_NODE) {
+        childCount[parent]++;
+    }
+
+    nodeParent[node] = parent;
+    parentSlot[slot] = parent == NULL_TRANSFORM_NODE ? UINT32_MAX : nodeToSlot[parent];
+    dirty[slot] = 1;
+    orderDirty = true;
+}
+
+uint32_t TransformHierarchy::getParent(uint32_t node) const {
+    slotOf(node);
+    return nodeParent[node];
+}
+
+void TransformHierarchy::setLocal(uint32_t node, const LocalTransform& local) {
+    uint32_t slot = slotOf(node);
+    positionX[slot] = local.position.x;
+    positionY[slot] = local.position.y;
+    positionZ[slot] = local.position.z;
+    rotationX[slot] = local.rotation.x;
+    rotationY[slot] = local.rotation.y;
+    rotationZ[slot] = local.rotation.z;
+    rotationW[slot] = local.rotation.w;
+    scaleX[slot] = local.scale.x;
+    scaleY[slot] = local.scale.y;
+    scaleZ[slot] = local.scale.z;
+    dirty[slot] = 1;
+}
+
+LocalTransform TransformHierarchy::getLocal(uint32_t node) const {
+    uint32_t slot = slotOf(node);
+    LocalTransform local;
+    local.position = glm::vec3(positionX[slot], positionY[slot], positionZ[slot]);
+    local.rotation = glm::quat(rotationW[slot], rotationX[slot], rotationY[slot], rotationZ[slot]);
+    local.scale = glm::vec3(scaleX[slot], scaleY[slot], scaleZ[slot]);
+    return local;
+}
+
+const glm::mat4& TransformHierarchy::getWorld(uint32_t node) const {
+    return world[slotOf(node)];
+}
+
+template<typename T>
+static void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+    std::vector<T> sorted(values.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        sorted[i] = values[order[i]];
+    }
+    values.swap(sorted);
+}
+
+void TransformHierarchy::sortByDepth() {
+    // Depth of every node, walking up until a node with a known depth is found
+    std::vector<uint32_t> depth(nodeToSlot.size(), UINT32_MAX);
+    std::vector<uint32_t> path;
+    uint32_t maxDepth = 0;
+    for (uint32_t node : slotToNode) {
+        uint32_t current = node;
+        while (current != NULL_TRANSFORM_NODE && depth[current] == UINT32_MAX) {
+            path.push_back(current);
+            current = nodeParent[current];
+        }
+        uint32_t base = current == NULL_TRANSFORM_NODE ? 0 : depth[current] + 1;
+        while (!path.empty()) {
+            depth[path.back()] = base++;
+            path.pop_back();
+        }
+        maxDepth = std::max(maxDepth, depth[node]);
+    }
+
+    // Stable counting sort of the slots by depth
+    levelStart.assign(maxDepth + 2, 0);
+    for (uint32_t node : slotToNode) {
+        levelStart[depth[node] + 1]++;
+    }
+    for (size_t level = 1; level < levelStart.size(); level++) {
+        levelStart[level] += levelStart[level - 1];
+    }
+
+    std::vector<size_t> cursor(levelStart.begin(), levelStart.end() - 1);
+    std::vector<uint32_t> order(slotToNode.size());
+    for (uint32_t slot = 0; slot < slotToNode.size(); slot++) {
+        order[cursor[depth[slotToNode[slot]]]++] = slot;
+    }
+
+    permute(positionX, order); permute(positionY, order); permute(positionZ, order);
+    permute(rotationX, order); permute(rotationY, order); permute(rotationZ, order); permute(rotationW, order);
+    permute(scaleX, order); permute(scaleY, order); permute(scaleZ, order);
+    permute(world, order);
+    permute(dirty, order);
+    permute(changed, order);
+    permute(slotToNode, order);
+
+    for (uint32_t slot = 0; slot < slotToNode.size(); slot++) {
+        nodeToSlot[slotToNode[slot]] = slot;
+    }
+    for (uint32_t slot = 0; slot < slotToNode.size(); slot++) {
+        uint32_t parent = nodeParent[slotToNode[slot]];
+        parentSlot[slot] = parent == NULL_TRANSFORM_NODE ? UINT32_MAX : nodeToSlot[parent];
+    }
+
+    orderDirty = false;
+}
+
+// Builds local matrices for `count` consecutive slots of the SoA arrays
+static void composeLocalScalar(const float* px, const float* py, const float* pz,
+                               const float* qx, const float* qy, const float* qz, const float* qw,
+                               const float* sx, const float* sy, const float* sz,
+                               size_t count, glm::mat4* out) {
+    for (size_t i = 0; i < count; i++) {
+        float xx = qx[i] * qx[i], yy = qy[i] * qy[i], zz = qz[i] * qz[i];
+        float xy = qx[i] * qy[i], xz = qx[i] * qz[i], yz = qy[i] * qz[i];
+        float wx = qw[i] * qx[i], wy = qw[i] * qy[i], wz = qw[i] * qz[i];
+
+        glm::mat4& m = out[i];
+        m[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * sx[i], 2.0f * (xy + wz) * sx[i], 2.0f * (xz - wy) * sx[i], 0.0f);
+        m[1] = glm::vec4(2.0f * (xy - wz) * sy[i], (1.0f - 2.0f * (xx + zz)) * sy[i], 2.0f * (yz + wx) * sy[i], 0.0f);
+        m[2] = glm::vec4(2.0f * (xz + wy) * sz[i], 2.0f * (yz - wx) * sz[i], (1.0f - 2.0f * (xx + yy)) * sz[i], 0.0f);
+        m[3] = glm::vec4(px[i], py[i], pz[i], 1.0f);
+    }
+}
+
+#ifdef TRANSFORM_SIMD_SSE
+// Same as composeLocalScalar for exactly four slots, one node per SIMD lane
+static void composeLocal4(const float* px, const float* py, const float* pz,
+                          const float* qx, const float* qy, const float* qz, const float* qw,
+                          const float* sx, const float* sy, const float* sz,
+                          glm::mat4* out) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 x = _mm_loadu_ps(qx), y = _mm_loadu_ps(qy), z = _mm_loadu_ps(qz), w = _mm_loadu_ps(qw);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    __m128 scaleXs = _mm_loadu_ps(sx), scaleYs = _mm_loadu_ps(sy), scaleZs = _mm_loadu_ps(sz);
+
+    __m128 m00 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleXs);
+    __m128 m01 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleXs);
+    __m128 m02 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleXs);
+    __m128 m10 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleYs);
+    __m128 m11 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleYs);
+    __m128 m12 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleYs);
+    __m128 m20 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZs);
+    __m128 m21 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZs);
+    __m128 m22 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZs);
+    __m128 m30 = _mm_loadu_ps(px), m31 = _mm_loadu_ps(py), m32 = _mm_loadu_ps(pz), m33 = one;
+
+    // Each transpose turns "one column element for four nodes" into "one
+    // column for each of the four nodes"
+    __m128 c0 = zero;
+    _MM_TRANSPOSE4_PS(m00, m01, m02, c0);
+    __m128 c1 = zero;
+    _MM_TRANSPOSE4_PS(m10, m11, m12, c1);
+    __m128 c2 = zero;
+    _MM_TRANSPOSE4_PS(m20, m21, m22, c2);
+    _MM_TRANSPOSE4_PS(m30, m31, m32, m33);
+
+    _mm_storeu_ps(&out[0][0][0], m00); _mm_storeu_ps(&out[0][1][0], m10); _mm_storeu_ps(&out[0][2][0], m20); _mm_storeu_ps(&out[0][3][0], m30);
+    _mm_storeu_ps(&out[1][0][0], m01); _mm_storeu_ps(&out[1][1][0], m11); _mm_storeu_ps(&out[1][2][0], m21); _mm_storeu_ps(&out[1][3][0], m31);
+    _mm_storeu_ps(&out[2][0][0], m02); _mm_storeu_ps(&out[2][1][0], m12); _mm_storeu_ps(&out[2][2][0], m22); _mm_storeu_ps(&out[2][3][0], m32);
+    _mm_storeu_ps(&out[3][0][0], c0);  _mm_storeu_ps(&out[3][1][0], c1);  _mm_storeu_ps(&out[3][2][0], c2);  _mm_storeu_ps(&out[3][3][0], m33);
+}
+#endif
+
+static inline void multiplyMatrix(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#ifdef TRANSFORM_SIMD_SSE
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for (int column = 0; column < 4; column++) {
+        __m128 result = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+        result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+        result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+        result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+        _mm_storeu_ps(&out[column][0], result);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+void TransformHierarchy::updateRange(size_t begin, size_t end) {
+    glm::mat4 local[4];
+    for (size_t first = begin; first < end; first += 4) {
+        size_t count = std::min<size_t>(4, end - first);
+
+        // A node is recomputed when it was edited or its parent moved this frame
+        bool needsUpdate[4] = {false, false, false, false};
+        bool anyUpdate = false;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t parent = parentSlot[first + i];
+            needsUpdate[i] = dirty[first + i] || (parent != UINT32_MAX && changed[parent]);
+            anyUpdate |= needsUpdate[i];
+        }
+        if (!anyUpdate) {
+            continue;
+        }
+
+#ifdef TRANSFORM_SIMD_SSE
+        if (count == 4) {
+            composeLocal4(&positionX[first], &positionY[first], &positionZ[first],
+                          &rotationX[first], &rotationY[first], &rotationZ[first], &rotationW[first],
+                          &scaleX[first], &scaleY[first], &scaleZ[first], local);
+        } else
+#endif
+        {
+            composeLocalScalar(&positionX[first], &positionY[first], &positionZ[first],
+                               &rotationX[first], &rotationY[first], &rotationZ[first], &rotationW[first],
+                               &scaleX[first], &scaleY[first], &scaleZ[first], count, local);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (!needsUpdate[i]) {
+                continue;
+            }
+            uint32_t parent = parentSlot[first + i];
+            if (parent == UINT32_MAX) {
+                world[first + i] = local[i];
+            } else {
+                multiplyMatrix(world[parent], local[i], world[first + i]);
+            }
+            dirty[first + i] = 0;
+            changed[first + i] = 1;
+        }
+    }
+}
+
+void TransformHierarchy::update(JobSystem& jobs) {
+    if (orderDirty) {
+        sortByDepth();
+    }
+
+    std::fill(changed.begin(), changed.end(), 0);
+
+    // Levels run one after another; the nodes inside a level are independent
+    for (size_t level = 0; level + 1 < levelStart.size(); level++) {
+        size_t levelBegin = levelStart[level];
+        size_t levelEnd = levelStart[level + 1];
+        jobs.parallelFor(levelEnd - levelBegin, TRANSFORM_BATCH_SIZE, [&](size_t begin, size_t end) {
+            updateRange(levelBegin + begin, levelBegin + end);
+        }, "TransformHierarchy::update");
+    }
+
+    lastUpdatedCount = std::count(changed.begin(), changed.end(), 1);
+}
+
+void TransformHierarchy::writeWorldTransforms(Scene& scene, JobSystem& jobs) {
+    scene.parallelForEachChunk<TransformNode, WorldTransform>(jobs,
+        [&](uint32_t count, const Entity*, TransformNode* nodes, WorldTransform* transforms) {
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t node = nodes[i].node;
+                if (node >= nodeToSlot.size() || nodeToSlot[node] == UINT32_MAX) {
+                    continue;
+                }
+                uint32_t slot = nodeToSlot[node];
+                if (changed[slot]) {
+                    transforms[i].matrix = world[slot];
+                }
+            }
+        });
+}
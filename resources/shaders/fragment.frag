@@ -1,9 +1,130 @@
 #version 450
 
+// Features are specialization constants, every permutation shares this
+// module and the unused branches are folded away when the pipeline is built.
+// Ids match ShaderFeature in PipelineCache.hpp.
+layout(constant_id = 0) const bool LIGHTING = true;
+layout(constant_id = 1) const bool DEBUG_NORMALS = false;
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec3 fragPosition;
 
 layout(location = 0) out vec4 outColor;
 
+// Matches LIGHT_CLUSTER_CAPACITY in LightGrid.hpp
+const uint CLUSTER_CAPACITY = 128;
+
+struct Light {
+    vec3 position;
+    float radius;
+    vec3 color;
+    // Slot in the shadow atlas, -1 without shadows
+    int shadow;
+};
+
+// Filled by light_cull.comp, see LightGrid.hpp
+layout(set = 1, binding = 0) uniform Lighting {
+    mat4 view;
+    mat4 inverseProjection;
+    vec4 depthParams;
+    vec4 tileParams;
+    uvec4 grid;
+} lighting;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights { Light lights[]; };
+layout(std430, set = 1, binding = 2) readonly buffer ClusterCounts { uint clusterCounts[]; };
+layout(std430, set = 1, binding = 3) readonly buffer ClusterLights { uint clusterLights[]; };
+
+struct ShadowFace {
+    mat4 viewProjection;
+    // Offset and size in atlas texture coordinates
+    vec4 rect;
+};
+
+// Six faces per slot, see ShadowAtlas.hpp
+layout(std430, set = 2, binding = 0) readonly buffer ShadowFaces { ShadowFace shadowFaces[]; };
+layout(set = 2, binding = 1) uniform sampler2DShadow shadowAtlas;
+
+const vec3 lightDirection = normalize(vec3(0.4, 1.0, 0.6));
+
+// Fraction of the light reaching the fragment. The face is the one the light
+// to fragment direction points through, in the order +x, -x, +y, -y, +z, -z;
+// the 3x3 filter is kept inside the tile so it never reads a neighbour's.
+float pointShadow(Light light, vec3 toLight, float ndotl) {
+    vec3 direction = -toLight;
+    vec3 absolute = abs(direction);
+    uint face;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z) {
+        face = direction.x > 0.0 ? 0u : 1u;
+    } else if (absolute.y >= absolute.z) {
+        face = direction.y > 0.0 ? 2u : 3u;
+    } else {
+        face = direction.z > 0.0 ? 4u : 5u;
+    }
+    ShadowFace shadowFace = shadowFaces[uint(light.shadow) * 6u + face];
+
+    vec4 projected = shadowFace.viewProjection * vec4(fragPosition, 1.0);
+    vec2 uv = projected.xy / projected.w * 0.5 + 0.5;
+    vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 tileMin = shadowFace.rect.xy + texel * 1.5;
+    vec2 tileMax = shadowFace.rect.xy + shadowFace.rect.zw - texel * 1.5;
+    uv = clamp(shadowFace.rect.xy + uv * shadowFace.rect.zw, tileMin, tileMax);
+
+    // Depth along the face's axis, moved towards the light by a slope scaled
+    // bias against acne and projected like the casters were: near plane at
+    // a hundredth of the radius, far plane at the radius
+    float near = light.radius * 0.01;
+    float bias = (0.002 + 0.01 * (1.0 - ndotl)) * light.radius;
+    float axisDepth = max(max(absolute.x, absolute.y), absolute.z) - bias;
+    axisDepth = max(axisDepth, near);
+    float reference = light.radius * (axisDepth - near) / (axisDepth * (light.radius - near));
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowAtlas, vec3(uv + vec2(x, y) * texel, reference));
+        }
+    }
+    return lit / 9.0;
+}
+
+// Only the lights binned into the fragment's cluster are visited
+vec3 pointLights(vec3 normal) {
+    float depth = -(lighting.view * vec4(fragPosition, 1.0)).z;
+    float slice = log(max(depth, lighting.depthParams.x)) * lighting.depthParams.z + lighting.depthParams.w;
+    uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy / lighting.tileParams.xy), uint(max(slice, 0.0))),
+                    lighting.grid.xyz - 1);
+    uint cluster = cell.x + (cell.y + cell.z * lighting.grid.y) * lighting.grid.x;
+
+    vec3 result = vec3(0.0);
+    uint count = clusterCounts[cluster];
+    for (uint i = 0; i < count; i++) {
+        Light light = lights[clusterLights[cluster * CLUSTER_CAPACITY + i]];
+        vec3 toLight = light.position - fragPosition;
+        float distanceSquared = dot(toLight, toLight);
+        // Inverse square, windowed to reach zero at the radius
+        float window = clamp(1.0 - distanceSquared / (light.radius * light.radius), 0.0, 1.0);
+        float attenuation = window * window / max(distanceSquared, 0.01);
+        float diffuse = max(dot(normal, toLight * inversesqrt(max(distanceSquared, 1e-8))), 0.0);
+        if (light.shadow >= 0 && diffuse * attenuation > 0.0) {
+            attenuation *= pointShadow(light, toLight, diffuse);
+        }
+        result += light.color * (diffuse * attenuation);
+    }
+    return result;
+}
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    if (DEBUG_NORMALS) {
+        outColor = vec4(normalize(fragNormal) * 0.5 + 0.5, 1.0);
+        return;
+    }
+
+    vec3 color = fragColor;
+    if (LIGHTING) {
+        vec3 normal = normalize(fragNormal);
+        float diffuse = max(dot(normal, lightDirection), 0.0);
+        color *= 0.2 + 0.8 * diffuse + pointLights(normal);
+    }
+    outColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D atlas;
+
+layout(location = 0) in vec2 fragUv;
+layout(location = 1) in vec4 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+// The atlas only holds coverage, glyph texels and the solid cell are fully
+// covered and everything around the glyphs is empty
+void main() {
+    outColor = vec4(fragColor.rgb, fragColor.a * texture(atlas, fragUv).r);
+}
\ No newline at end of file
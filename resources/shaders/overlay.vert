@@ -0,0 +1,20 @@
+#version 450
+
+// Overlay triangles in framebuffer pixels, origin at the top left
+layout(push_constant) uniform Constants {
+    // Two over the framebuffer size
+    vec2 scale;
+} constants;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inUv;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+    gl_Position = vec4(inPosition * constants.scale - 1.0, 0.0, 1.0);
+    fragUv = inUv;
+    fragColor = inColor;
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 450
+
+// One camera-facing quad per instance, in the order of the sorted keys so
+// the particles blend far to near. Drawn as a strip of four vertices.
+layout(set = 0, binding = 0) uniform Constants {
+    mat4 viewProjection;
+    vec4 cameraRight;
+    vec4 cameraUp;
+    vec4 cameraPosition;
+    vec4 gravity;
+    uvec4 emission;
+} constants;
+
+struct ParticleVertex {
+    vec4 positionSize;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Vertices { ParticleVertex vertices[]; };
+layout(std430, set = 0, binding = 7) readonly buffer SortKeys { uvec2 sortKeys[]; };
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragCorner;
+
+void main() {
+    ParticleVertex particle = vertices[sortKeys[gl_InstanceIndex].y];
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1) * 2.0 - 1.0;
+    vec3 offset = constants.cameraRight.xyz * corner.x + constants.cameraUp.xyz * corner.y;
+    gl_Position = constants.viewProjection * vec4(particle.positionSize.xyz + offset * particle.positionSize.w, 1.0);
+    fragColor = particle.color;
+    fragCorner = corner;
+}
\ No newline at end of file
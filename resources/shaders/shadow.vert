@@ -0,0 +1,14 @@
+#version 450
+
+// Draws shadow casters into one face of the shadow atlas, depth only, see
+// ShadowAtlas.hpp
+layout(push_constant) uniform Face {
+    mat4 viewProjection;
+} face;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 3) in mat4 inModel;
+
+void main() {
+    gl_Position = face.viewProjection * (inModel * vec4(inPosition, 1.0));
+}
\ No newline at end of file
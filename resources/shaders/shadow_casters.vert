@@ -0,0 +1,19 @@
+#version 450
+
+// Draws the dynamic shadow casters of one face, depth only, see
+// ShadowAtlas.hpp. The face's instances are indices into the frame's camera
+// instances, so an instance reaching into several faces is stored once
+layout(push_constant) uniform Face {
+    mat4 viewProjection;
+} face;
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances { mat4 models[]; };
+layout(std430, set = 0, binding = 1) readonly buffer Casters { uint casters[]; };
+
+layout(location = 0) in vec3 inPosition;
+
+void main() {
+    // gl_InstanceIndex starts at the draw's firstInstance
+    mat4 model = models[casters[gl_InstanceIndex]];
+    gl_Position = face.viewProjection * (model * vec4(inPosition, 1.0));
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 450
+
+// Stretches the rendered top left corner of the scene target over the whole
+// swapchain image with bilinear filtering
+layout(set = 0, binding = 0) uniform sampler2D scene;
+
+layout(push_constant) uniform Constants {
+    // Rendered size over the size of the target
+    vec2 scale;
+    // Centre of the last rendered texel, what lies beyond was not drawn
+    vec2 limit;
+} constants;
+
+layout(location = 0) in vec2 fragUv;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = vec4(texture(scene, min(fragUv * constants.scale, constants.limit)).rgb, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 450
+
+// One triangle covering the whole target, without any vertex input
+layout(location = 0) out vec2 fragUv;
+
+void main() {
+    fragUv = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1) * 2.0;
+    gl_Position = vec4(fragUv * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -1,11 +1,24 @@
 #version 450
 
-layout(location = 0) in vec2 inPosition;
-layout(location = 1) in vec3 inColor;
+// Not a push constant, cached secondary command buffers could not update it
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 viewProjection;
+} camera;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inColor;
+layout(location = 3) in mat4 inModel;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragPosition;
 
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 1.0);
+    vec4 position = inModel * vec4(inPosition, 1.0);
+    gl_Position = camera.viewProjection * position;
+    fragPosition = position.xyz;
     fragColor = inColor;
+    // Instances only carry rotation and uniform scale
+    fragNormal = mat3(inModel) * inNormal;
 }
\ No newline at end of file
@@ -2,5 +2,22 @@
 setlocal
 	glslc.exe ../resources/shaders/fragment.frag -o ../resources/shaders/frag.spv 
 	glslc.exe ../resources/shaders/vertex.vert -o ../resources/shaders/vert.spv
+	glslc.exe ../resources/shaders/cluster_cull.comp -o ../resources/shaders/cull.spv
+	glslc.exe ../resources/shaders/depth_reduce.comp -o ../resources/shaders/reduce.spv
+	glslc.exe ../resources/shaders/light_cull.comp -o ../resources/shaders/lightcull.spv
+	glslc.exe ../resources/shaders/shadow.vert -o ../resources/shaders/shadowvert.spv
+	glslc.exe ../resources/shaders/shadow_casters.vert -o ../resources/shaders/shadowcastersvert.spv
+	glslc.exe ../resources/shaders/particle_args.comp -o ../resources/shaders/particleargs.spv
+	glslc.exe ../resources/shaders/particle_emit.comp -o ../resources/shaders/particleemit.spv
+	glslc.exe ../resources/shaders/particle_simulate.comp -o ../resources/shaders/particlesimulate.spv
+	glslc.exe ../resources/shaders/particle_sort.comp -o ../resources/shaders/particlesort.spv
+	glslc.exe ../resources/shaders/particle.vert -o ../resources/shaders/particlevert.spv
+	glslc.exe ../resources/shaders/particle.frag -o ../resources/shaders/particlefrag.spv
+	glslc.exe ../resources/shaders/overlay.vert -o ../resources/shaders/overlayvert.spv
+	glslc.exe ../resources/shaders/overlay.frag -o ../resources/shaders/overlayfrag.spv
+	glslc.exe ../resources/shaders/upscale.vert -o ../resources/shaders/upscalevert.spv
+	glslc.exe ../resources/shaders/upscale.frag -o ../resources/shaders/upscalefrag.spv
+	glslc.exe --target-spv=spv1.4 ../resources/shaders/cluster.task -o ../resources/shaders/task.spv
+	glslc.exe --target-spv=spv1.4 ../resources/shaders/cluster.mesh -o ../resources/shaders/mesh.spv
 endlocal
 pause
\ No newline at end of file
@@ -1,2 +1,19 @@
 ./glslc ../resources/shaders/vertex.vert -o vert.spv
-./glslc ../resources/shaders/fragment.frag -o frag.spv
\ No newline at end of file
+./glslc ../resources/shaders/fragment.frag -o frag.spv
+./glslc ../resources/shaders/cluster_cull.comp -o cull.spv
+./glslc ../resources/shaders/depth_reduce.comp -o reduce.spv
+./glslc ../resources/shaders/light_cull.comp -o lightcull.spv
+./glslc ../resources/shaders/shadow.vert -o shadowvert.spv
+./glslc ../resources/shaders/shadow_casters.vert -o shadowcastersvert.spv
+./glslc ../resources/shaders/particle_args.comp -o particleargs.spv
+./glslc ../resources/shaders/particle_emit.comp -o particleemit.spv
+./glslc ../resources/shaders/particle_simulate.comp -o particlesimulate.spv
+./glslc ../resources/shaders/particle_sort.comp -o particlesort.spv
+./glslc ../resources/shaders/particle.vert -o particlevert.spv
+./glslc ../resources/shaders/particle.frag -o particlefrag.spv
+./glslc ../resources/shaders/overlay.vert -o overlayvert.spv
+./glslc ../resources/shaders/overlay.frag -o overlayfrag.spv
+./glslc ../resources/shaders/upscale.vert -o upscalevert.spv
+./glslc ../resources/shaders/upscale.frag -o upscalefrag.spv
+./glslc --target-spv=spv1.4 ../resources/shaders/cluster.task -o task.spv
+./glslc --target-spv=spv1.4 ../resources/shaders/cluster.mesh -o mesh.spv
\ No newline at end of file
@@ -1,11 +1,138 @@
 #include <iostream>
+#include <cmath>
 #include "Renderer.hpp"
 #include "glm.hpp"
 #include "gtx/string_cast.hpp"
+#include "gtc/matrix_transform.hpp"
 
-int main() {
+// Turned around its own centre by the update callback
+struct Spin {
+    float speed;
+};
+
+// UV sphere with shared vertices, dense enough for the LOD chain to matter
+static void createSphere(uint32_t rings, uint32_t segments, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    const float pi = 3.14159265f;
+    auto addVertex = [&vertices](const glm::vec3& position) {
+        glm::vec3 color = glm::vec3(0.5f) + position * 0.5f;
+        vertices.push_back({position * 0.5f, position, color});
+    };
+
+    addVertex(glm::vec3(0.0f, 1.0f, 0.0f));
+    for (uint32_t ring = 1; ring < rings; ring++) {
+        float theta = pi * ring / rings;
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            float phi = 2.0f * pi * segment / segments;
+            addVertex(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    }
+    addVertex(glm::vec3(0.0f, -1.0f, 0.0f));
+
+    const uint32_t south = static_cast<uint32_t>(vertices.size() - 1);
+    auto ringVertex = [segments](uint32_t ring, uint32_t segment) {
+        return 1 + (ring - 1) * segments + segment % segments;
+    };
+    for (uint32_t segment = 0; segment < segments; segment++) {
+        indices.insert(indices.end(), {0, ringVertex(1, segment), ringVertex(1, segment + 1)});
+    }
+    for (uint32_t ring = 1; ring < rings - 1; ring++) {
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            uint32_t a = ringVertex(ring, segment);
+            uint32_t b = ringVertex(ring, segment + 1);
+            uint32_t c = ringVertex(ring + 1, segment);
+            uint32_t d = ringVertex(ring + 1, segment + 1);
+            indices.insert(indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    for (uint32_t segment = 0; segment < segments; segment++) {
+        indices.insert(indices.end(), {south, ringVertex(rings - 1, segment + 1), ringVertex(rings - 1, segment)});
+    }
+}
+
+int main(int argc, char** argv) {
     Renderer app;
 
+    // VkEngine [assets.pack]: a pack from the asset cooker provides the
+    // shaders and, when it has one, the sphere
+    uint32_t sphere;
+    try {
+        if (argc > 1) {
+            app.loadAssetPack(argv[1]);
+        }
+        if (app.getAssets().find("meshes/sphere")) {
+            sphere = app.addMesh("meshes/sphere");
+        } else {
+            std::vector<Vertex> sphereVertices;
+            std::vector<uint32_t> sphereIndices;
+            createSphere(64, 128, sphereVertices, sphereIndices);
+            sphere = app.addMesh(sphereVertices, sphereIndices);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // A field of spheres running off into the distance, far rows get
+    // coarser LODs
+    Scene& scene = app.getScene();
+    const int gridSize = 32;
+    const float spacing = 1.5f;
+    for (int z = 0; z < gridSize; z++) {
+        for (int x = 0; x < gridSize; x++) {
+            glm::vec3 position((x - gridSize * 0.5f) * spacing, 0.0f, -z * spacing);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            scene.createEntity(WorldTransform{model}, MeshInstance{sphere}, Spin{1.0f});
+        }
+    }
+
+    // Smaller spheres underneath that never move; each block of eight rows
+    // is a static bucket, recorded once and replayed every frame
+    for (int z = 0; z < gridSize; z++) {
+        for (int x = 0; x < gridSize; x++) {
+            glm::vec3 position((x - gridSize * 0.5f) * spacing, -1.0f, -z * spacing);
+            glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.4f));
+            scene.createEntity(WorldTransform{model}, MeshInstance{sphere}, StaticGeometry{static_cast<uint32_t>(z / 8)});
+        }
+    }
+
+    // Small coloured lights between the two layers, four per sphere; each
+    // fragment only shades the few whose cluster it falls into
+    for (int z = 0; z < gridSize * 2; z++) {
+        for (int x = 0; x < gridSize * 2; x++) {
+            glm::vec3 position((x * 0.5f - gridSize * 0.5f) * spacing, -0.5f, -z * 0.5f * spacing);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            glm::vec3 color(0.5f + 0.5f * std::sin(x * 0.7f), 0.5f + 0.5f * std::sin(z * 0.9f + 2.0f),
+                            0.5f + 0.5f * std::sin((x + z) * 0.5f + 4.0f));
+            scene.createEntity(WorldTransform{model}, PointLight{color, 0.5f, 1.5f});
+        }
+    }
+
+    // Fountains along the field, half a million particles between them once
+    // they are all going; the transform's +y is where they spray
+    for (int i = 0; i < 4; i++) {
+        glm::vec3 position((i - 1.5f) * gridSize * spacing * 0.25f, 0.5f, -gridSize * spacing * 0.5f);
+        glm::vec4 color(0.4f + 0.2f * i, 0.6f, 1.0f - 0.2f * i, 0.6f);
+        scene.createEntity(WorldTransform{glm::translate(glm::mat4(1.0f), position)},
+                           ParticleEmitter{50000.0f, 2.5f, 6.0f, 0.35f, 0.04f, color});
+    }
+
+    Camera& camera = app.getCamera();
+    camera.position = glm::vec3(0.0f, 3.0f, 6.0f);
+    camera.target = glm::vec3(0.0f, 0.0f, -10.0f);
+
+    // Frame times, draws and binds in the top left corner
+    app.setStatsOverlay(true);
+    // Renders fewer pixels whenever the GPU falls behind 60 Hz
+    app.setTargetFrameTime(1000.0f / 60.0f);
+
+    // Spin the upper spheres around their own centres on the update thread
+    app.setUpdateCallback([&app](float deltaTime) {
+        app.getScene().parallelForEach<WorldTransform, Spin>(app.getJobSystem(),
+            [deltaTime](Entity, WorldTransform& transform, Spin& spin) {
+                transform.matrix = glm::rotate(transform.matrix, deltaTime * spin.speed, glm::vec3(0.0f, 1.0f, 0.0f));
+            });
+    });
+
     try {
         app.run();
     } catch (const std::exception e) {
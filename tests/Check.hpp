@@ -0,0 +1,21 @@
+#ifndef CHECK_CLASS
+#define CHECK_CLASS
+
+#include <iostream>
+
+// The tests are plain executables: CHECK reports what failed and main
+// returns checkFailures(), so CTest sees any failure as a non-zero exit
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            checkFailures()++;                                                              \
+        }                                                                                   \
+    } while (false)
+
+#endif //CHECK_CLASS
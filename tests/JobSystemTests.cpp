@@ -0,0 +1,112 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.hpp"
+#include "Check.hpp"
+
+static JobSystemConfig workers(uint32_t count) {
+    JobSystemConfig config;
+    config.workerCount = count;
+    return config;
+}
+
+static void testWaitRunsJob() {
+    JobSystem jobs(workers(2));
+    std::atomic<int> runs{0};
+    JobHandle job = jobs.submit("run", [&runs]() { runs++; });
+    jobs.wait(job);
+    CHECK(job->isFinished());
+    CHECK(runs == 1);
+}
+
+static void testDependenciesRunFirst() {
+    JobSystem jobs(workers(3));
+    std::mutex orderMutex;
+    std::vector<int> order;
+    auto record = [&](int step) {
+        return [&, step]() {
+            std::lock_guard<std::mutex> lock(orderMutex);
+            order.push_back(step);
+        };
+    };
+
+    // first -> (left, right) -> last
+    JobHandle first = jobs.submit("first", record(0));
+    JobHandle left = jobs.submit("left", record(1), {first});
+    JobHandle right = jobs.submit("right", record(1), {first});
+    JobHandle last = jobs.submit("last", record(2), {left, right});
+    jobs.wait(last);
+
+    CHECK(order.size() == 4 && order[0] == 0 && order[1] == 1 && order[2] == 1 && order[3] == 2);
+}
+
+static void testWaitRethrows() {
+    JobSystem jobs(workers(2));
+    JobHandle job = jobs.submit("throw", []() { throw std::runtime_error("job failed"); });
+    bool caught = false;
+    try {
+        jobs.wait(job);
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    CHECK(caught);
+}
+
+static void testParallelForCoversEveryIndexOnce() {
+    JobSystem jobs(workers(4));
+    const size_t count = 10007;
+    std::vector<std::atomic<int>> visits(count);
+    jobs.parallelFor(count, 64, [&visits](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            visits[i]++;
+        }
+    });
+
+    bool once = true;
+    for (const auto& visit : visits) {
+        once = once && visit == 1;
+    }
+    CHECK(once);
+}
+
+static void testNestedWaitFromJob() {
+    // A job waiting on another helps instead of blocking its worker
+    JobSystem jobs(workers(1));
+    std::atomic<int> inner{0};
+    JobHandle outer = jobs.submit("outer", [&jobs, &inner]() {
+        JobHandle child = jobs.submit("inner", [&inner]() { inner++; });
+        jobs.wait(child);
+    });
+    jobs.wait(outer);
+    CHECK(inner == 1);
+}
+
+static void testDestructorDrainsQueuedJobs() {
+    std::atomic<int> runs{0};
+    {
+        JobSystem jobs(workers(2));
+        // Workers asleep when the jobs arrive may only wake once it is stopping
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        JobHandle gate = jobs.submit("gate", [&runs]() { runs++; });
+        for (int i = 0; i < 1000; i++) {
+            jobs.submit("queued", [&runs]() { runs++; });
+        }
+        // Continuations released while shutting down run as well
+        jobs.submit("continuation", [&runs]() { runs++; }, {gate});
+    }
+    CHECK(runs == 1002);
+}
+
+int main() {
+    testWaitRunsJob();
+    testDependenciesRunFirst();
+    testWaitRethrows();
+    testParallelForCoversEveryIndexOnce();
+    testNestedWaitFromJob();
+    testDestructorDrainsQueuedJobs();
+    return checkFailures();
+}
@@ -0,0 +1,133 @@
+#include <cmath>
+#include <vector>
+
+#include "MeshSimplifier.hpp"
+#include "Check.hpp"
+
+// Flat square of size x size quads on z = 0, two triangles each
+static void createGrid(uint32_t size, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices) {
+    for (uint32_t y = 0; y <= size; y++) {
+        for (uint32_t x = 0; x <= size; x++) {
+            positions.push_back(glm::vec3(static_cast<float>(x), static_cast<float>(y), 0.0f));
+        }
+    }
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            uint32_t corner = y * (size + 1) + x;
+            indices.insert(indices.end(), {corner, corner + 1, corner + size + 2});
+            indices.insert(indices.end(), {corner, corner + size + 2, corner + size + 1});
+        }
+    }
+}
+
+// Closed unit sphere, poles plus rings of segments vertices
+static void createSphere(uint32_t rings, uint32_t segments, std::vector<glm::vec3>& positions,
+                        std::vector<uint32_t>& indices) {
+    const float pi = 3.14159265f;
+    positions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    for (uint32_t ring = 1; ring < rings; ring++) {
+        float theta = pi * ring / rings;
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            float phi = 2.0f * pi * segment / segments;
+            positions.push_back(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                                        std::sin(theta) * std::sin(phi)));
+        }
+    }
+    positions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+
+    const uint32_t south = static_cast<uint32_t>(positions.size() - 1);
+    auto ringVertex = [segments](uint32_t ring, uint32_t segment) {
+        return 1 + (ring - 1) * segments + segment % segments;
+    };
+    for (uint32_t segment = 0; segment < segments; segment++) {
+        indices.insert(indices.end(), {0, ringVertex(1, segment + 1), ringVertex(1, segment)});
+        for (uint32_t ring = 1; ring + 1 < rings; ring++) {
+            uint32_t a = ringVertex(ring, segment);
+            uint32_t b = ringVertex(ring, segment + 1);
+            uint32_t c = ringVertex(ring + 1, segment);
+            uint32_t d = ringVertex(ring + 1, segment + 1);
+            indices.insert(indices.end(), {a, b, d});
+            indices.insert(indices.end(), {a, d, c});
+        }
+        indices.insert(indices.end(), {south, ringVertex(rings - 1, segment), ringVertex(rings - 1, segment + 1)});
+    }
+}
+
+// Every index in range and no triangle collapsed to a line or a point
+static bool isValidMesh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) {
+    if (indices.size() % 3 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a >= positions.size() || b >= positions.size() || c >= positions.size() || a == b || b == c || a == c) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testFlatGridSimplifiesWithoutError() {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createGrid(16, positions, indices);
+
+    // Only the coplanar interior can go, the border keeps the square's shape
+    float error = -1.0f;
+    std::vector<uint32_t> simplified = simplifyMesh(positions, indices, indices.size() / 4 / 3 * 3, error);
+    CHECK(isValidMesh(positions, simplified));
+    CHECK(simplified.size() <= indices.size() / 4);
+    CHECK(error >= 0.0f && error < 1e-3f);
+}
+
+static void testSphereStaysWithinErrorBound() {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createSphere(16, 32, positions, indices);
+
+    float error = -1.0f;
+    size_t target = indices.size() / 2 / 3 * 3;
+    std::vector<uint32_t> simplified = simplifyMesh(positions, indices, target, error);
+    CHECK(isValidMesh(positions, simplified));
+    CHECK(simplified.size() <= target);
+    // Halving a 960 triangle unit sphere moves its surface by a few percent
+    // of the radius at most
+    CHECK(error > 0.0f && error < 0.05f);
+}
+
+static void testTargetAboveInputKeepsMesh() {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createSphere(8, 16, positions, indices);
+
+    float error = -1.0f;
+    std::vector<uint32_t> simplified = simplifyMesh(positions, indices, indices.size(), error);
+    CHECK(simplified == indices);
+    CHECK(error == 0.0f);
+}
+
+static void testLodChainGetsCoarser() {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createSphere(16, 32, positions, indices);
+
+    LodSettings settings;
+    settings.maxError = 0.2f;
+    std::vector<LodLevel> levels = generateLods(positions, indices, settings);
+    CHECK(levels.size() > 1 && levels.size() <= settings.maxLevels);
+    CHECK(!levels.empty() && levels[0].indices == indices && levels[0].error == 0.0f);
+    for (size_t i = 1; i < levels.size(); i++) {
+        CHECK(isValidMesh(positions, levels[i].indices));
+        CHECK(levels[i].indices.size() < levels[i - 1].indices.size());
+        CHECK(levels[i].error >= levels[i - 1].error);
+        CHECK(levels[i].error <= settings.maxError);
+    }
+}
+
+int main() {
+    testFlatGridSimplifiesWithoutError();
+    testSphereStaysWithinErrorBound();
+    testTargetAboveInputKeepsMesh();
+    testLodChainGetsCoarser();
+    return checkFailures();
+}
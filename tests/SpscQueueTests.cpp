@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "SpscQueue.hpp"
+#include "Check.hpp"
+
+static void testTryPushStopsWhenFull() {
+    SpscQueue<int, 4> queue;
+    for (int i = 0; i < 4; i++) {
+        CHECK(queue.tryPush(i));
+    }
+    CHECK(!queue.tryPush(4));
+
+    int value = -1;
+    for (int i = 0; i < 4; i++) {
+        CHECK(queue.tryPop(value) && value == i);
+    }
+    CHECK(!queue.tryPop(value));
+}
+
+static void testIndicesWrapAround() {
+    SpscQueue<int, 2> queue;
+    int value = -1;
+    for (int i = 0; i < 100; i++) {
+        CHECK(queue.tryPush(i));
+        CHECK(queue.tryPop(value) && value == i);
+    }
+}
+
+static void testBlockingTransferKeepsOrder() {
+    // A small ring so both sides block on each other regularly
+    SpscQueue<uint32_t, 8> queue;
+    const uint32_t count = 200000;
+    std::thread producer([&queue]() {
+        for (uint32_t i = 0; i < count; i++) {
+            queue.push(i);
+        }
+        queue.close();
+    });
+
+    uint32_t expected = 0;
+    bool ordered = true;
+    uint32_t value;
+    while (queue.pop(value)) {
+        ordered = ordered && value == expected;
+        expected++;
+    }
+    producer.join();
+
+    CHECK(ordered);
+    CHECK(expected == count);
+}
+
+static void testCloseWakesBlockedPop() {
+    SpscQueue<int, 4> queue;
+    bool popped = true;
+    std::thread consumer([&queue, &popped]() {
+        int value;
+        popped = queue.pop(value);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.close();
+    consumer.join();
+    CHECK(!popped);
+}
+
+static void testClosedQueueDrainsThenRefuses() {
+    SpscQueue<int, 4> queue;
+    CHECK(queue.push(7));
+    queue.close();
+    CHECK(!queue.push(8));
+
+    int value = -1;
+    CHECK(queue.pop(value) && value == 7);
+    CHECK(!queue.pop(value));
+}
+
+int main() {
+    testTryPushStopsWhenFull();
+    testIndicesWrapAround();
+    testBlockingTransferKeepsOrder();
+    testCloseWakesBlockedPop();
+    testClosedQueueDrainsThenRefuses();
+    return checkFailures();
+}
@@ -0,0 +1,472 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+
+#include "Renderer.hpp"
+#include "AssetPack.hpp"
+#include "Compression.hpp"
+
+// Packs meshes, textures and shaders into one archive the renderer maps:
+//   AssetCooker <output.pack> [--compress | --store] <input>...
+// .obj files become meshes/<name> with their LODs and meshlets generated,
+// .ppm files become textures/<name> as RGBA8 with a full mip chain and
+// .spv files become shaders/<file>. --compress and --store switch
+// compression on and off for the inputs that follow them.
+
+struct CookedAsset {
+    std::string name;
+    AssetType type;
+    bool compress;
+    std::vector<uint8_t> metadata;
+    std::vector<uint8_t> payload;
+};
+
+static std::vector<uint8_t> readBinary(const std::string& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+    return data;
+}
+
+static std::string baseName(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static std::string stem(const std::string& path) {
+    std::string name = baseName(path);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+static std::string extension(const std::string& path) {
+    std::string name = baseName(path);
+    size_t dot = name.find_last_of('.');
+    std::string result = dot == std::string::npos ? "" : name.substr(dot + 1);
+    std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { return std::tolower(c); });
+    return result;
+}
+
+template<typename T>
+static void append(std::vector<uint8_t>& bytes, const T* data, size_t count) {
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(data);
+    bytes.insert(bytes.end(), begin, begin + sizeof(T) * count);
+}
+
+// Meshes
+
+// Positions with optional vertex colours, normals and polygonal faces of
+// v, v/t, v//n or v/t/n corners; faces are triangulated as fans. Corners
+// without a normal get the area-weighted normal of their position.
+static void loadObj(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors;
+    std::vector<glm::vec3> normals;
+    std::map<std::pair<int64_t, int64_t>, uint32_t> cornerVertices;
+    std::vector<uint32_t> vertexPositions;
+    bool missingNormals = false;
+
+    auto resolve = [](int64_t index, size_t count) {
+        return index < 0 ? static_cast<int64_t>(count) + index : index - 1;
+    };
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+
+        if (keyword == "v") {
+            glm::vec3 position(0.0f);
+            glm::vec3 color(1.0f);
+            stream >> position.x >> position.y >> position.z;
+            if (!(stream >> color.x >> color.y >> color.z)) {
+                color = glm::vec3(1.0f);
+            }
+            positions.push_back(position);
+            colors.push_back(color);
+        } else if (keyword == "vn") {
+            glm::vec3 normal(0.0f);
+            stream >> normal.x >> normal.y >> normal.z;
+            normals.push_back(normal);
+        } else if (keyword == "f") {
+            std::vector<uint32_t> face;
+            std::string corner;
+            while (stream >> corner) {
+                int64_t position = 0;
+                int64_t normal = -1;
+                size_t firstSlash = corner.find('/');
+                size_t secondSlash = firstSlash == std::string::npos ? firstSlash : corner.find('/', firstSlash + 1);
+                bool hasNormal = secondSlash != std::string::npos && secondSlash + 1 < corner.size();
+                try {
+                    position = resolve(std::stoll(corner.substr(0, firstSlash)), positions.size());
+                    if (hasNormal) {
+                        normal = resolve(std::stoll(corner.substr(secondSlash + 1)), normals.size());
+                    }
+                } catch (const std::exception&) {
+                    throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": malformed face");
+                }
+                if (position < 0 || position >= static_cast<int64_t>(positions.size()) ||
+                    (hasNormal && (normal < 0 || normal >= static_cast<int64_t>(normals.size())))) {
+                    throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": index out of range");
+                }
+                if (normal < 0) {
+                    missingNormals = true;
+                }
+
+                auto inserted = cornerVertices.emplace(std::make_pair(position, normal),
+                                                    static_cast<uint32_t>(vertices.size()));
+                if (inserted.second) {
+                    glm::vec3 vertexNormal = normal >= 0 ? normals[normal] : glm::vec3(0.0f);
+                    vertices.push_back({positions[position], vertexNormal, colors[position]});
+                    vertexPositions.push_back(static_cast<uint32_t>(position));
+                }
+                face.push_back(inserted.first->second);
+            }
+            for (size_t i = 2; i < face.size(); i++) {
+                indices.insert(indices.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+
+    if (missingNormals) {
+        std::vector<glm::vec3> smooth(positions.size(), glm::vec3(0.0f));
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            const glm::vec3& p0 = vertices[indices[t]].pos;
+            glm::vec3 normal = glm::cross(vertices[indices[t + 1]].pos - p0, vertices[indices[t + 2]].pos - p0);
+            for (size_t k = 0; k < 3; k++) {
+                smooth[vertexPositions[indices[t + k]]] += normal;
+            }
+        }
+        for (auto& corner : cornerVertices) {
+            if (corner.first.second < 0) {
+                glm::vec3 normal = smooth[corner.first.first];
+                float length = glm::length(normal);
+                vertices[corner.second].normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            }
+        }
+    }
+
+    if (indices.empty()) {
+        throw std::runtime_error(path + " has no faces!");
+    }
+}
+
+static CookedAsset cookMesh(const std::string& path) {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    loadObj(path, vertices, indices);
+    MeshData data = buildMeshData(vertices, indices);
+
+    // Same section order Renderer::addMesh reads them in
+    CookedAsset asset{"meshes/" + stem(path), AssetType::Mesh, false, {}, {}};
+    append(asset.metadata, &data.info, 1);
+    append(asset.payload, data.vertices.data(), data.vertices.size());
+    append(asset.payload, data.indices.data(), data.indices.size());
+    append(asset.payload, data.meshlets.meshlets.data(), data.meshlets.meshlets.size());
+    append(asset.payload, data.meshlets.vertices.data(), data.meshlets.vertices.size());
+    append(asset.payload, data.meshlets.triangles.data(), data.meshlets.triangles.size());
+    return asset;
+}
+
+// Textures
+
+// Binary (P6) or plain (P3) pixmaps; 16-bit samples keep their high byte
+static CookedAsset cookTexture(const std::string& path) {
+    std::vector<uint8_t> file = readBinary(path);
+    size_t cursor = 0;
+    auto token = [&]() {
+        while (cursor < file.size()) {
+            if (file[cursor] == '#') {
+                while (cursor < file.size() && file[cursor] != '\n') {
+                    cursor++;
+                }
+            } else if (std::isspace(file[cursor])) {
+                cursor++;
+            } else {
+                break;
+            }
+        }
+        std::string result;
+        while (cursor < file.size() && !std::isspace(file[cursor]) && file[cursor] != '#') {
+            result += static_cast<char>(file[cursor++]);
+        }
+        return result;
+    };
+
+    std::string magic = token();
+    if (magic != "P6" && magic != "P3") {
+        throw std::runtime_error(path + " is not a P3 or P6 pixmap!");
+    }
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t maxValue = 0;
+    try {
+        width = static_cast<uint32_t>(std::stoul(token()));
+        height = static_cast<uint32_t>(std::stoul(token()));
+        maxValue = static_cast<uint32_t>(std::stoul(token()));
+    } catch (const std::exception&) {
+        throw std::runtime_error(path + " has a malformed header!");
+    }
+    if (width == 0 || height == 0 || maxValue == 0 || maxValue > 65535) {
+        throw std::runtime_error(path + " has a malformed header!");
+    }
+
+    const size_t texelCount = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> texels(texelCount * 4, 255);
+    if (magic == "P6") {
+        // Exactly one whitespace byte separates the header from the samples
+        cursor++;
+        size_t sampleSize = maxValue > 255 ? 2 : 1;
+        if (file.size() < cursor + texelCount * 3 * sampleSize) {
+            throw std::runtime_error(path + " is truncated!");
+        }
+        for (size_t i = 0; i < texelCount * 3; i++) {
+            uint32_t value = file[cursor + i * sampleSize];
+            if (sampleSize == 2) {
+                value = value << 8 | file[cursor + i * sampleSize + 1];
+            }
+            texels[i / 3 * 4 + i % 3] = static_cast<uint8_t>(value * 255 / maxValue);
+        }
+    } else {
+        for (size_t i = 0; i < texelCount * 3; i++) {
+            std::string sample = token();
+            if (sample.empty()) {
+                throw std::runtime_error(path + " is truncated!");
+            }
+            texels[i / 3 * 4 + i % 3] = static_cast<uint8_t>(std::min<uint32_t>(std::stoul(sample), maxValue) * 255 / maxValue);
+        }
+    }
+
+    TextureInfo info{width, height, VK_FORMAT_R8G8B8A8_SRGB, 1};
+    CookedAsset asset{"textures/" + stem(path), AssetType::Texture, false, {}, {}};
+    asset.payload = texels;
+
+    // Box-filtered mip chain down to 1x1, odd edges reuse their last texel
+    uint32_t mipWidth = width;
+    uint32_t mipHeight = height;
+    std::vector<uint8_t> level = texels;
+    while (mipWidth > 1 || mipHeight > 1) {
+        uint32_t nextWidth = std::max(1u, mipWidth / 2);
+        uint32_t nextHeight = std::max(1u, mipHeight / 2);
+        std::vector<uint8_t> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+        for (uint32_t y = 0; y < nextHeight; y++) {
+            for (uint32_t x = 0; x < nextWidth; x++) {
+                uint32_t x0 = std::min(x * 2, mipWidth - 1);
+                uint32_t x1 = std::min(x * 2 + 1, mipWidth - 1);
+                uint32_t y0 = std::min(y * 2, mipHeight - 1);
+                uint32_t y1 = std::min(y * 2 + 1, mipHeight - 1);
+                for (uint32_t c = 0; c < 4; c++) {
+                    uint32_t sum = level[(y0 * mipWidth + x0) * 4 + c] + level[(y0 * mipWidth + x1) * 4 + c] +
+                                level[(y1 * mipWidth + x0) * 4 + c] + level[(y1 * mipWidth + x1) * 4 + c];
+                    next[(y * nextWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        asset.payload.insert(asset.payload.end(), next.begin(), next.end());
+        level.swap(next);
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+        info.mipLevels++;
+    }
+
+    append(asset.metadata, &info, 1);
+    return asset;
+}
+
+// Shaders
+
+static CookedAsset cookShader(const std::string& path) {
+    CookedAsset asset{"shaders/" + baseName(path), AssetType::Shader, false, {}, readBinary(path)};
+    uint32_t magic = 0;
+    if (asset.payload.size() >= 4) {
+        memcpy(&magic, asset.payload.data(), sizeof(magic));
+    }
+    if (asset.payload.size() % 4 != 0 || magic != 0x07230203) {
+        throw std::runtime_error(path + " is not SPIR-V!");
+    }
+    return asset;
+}
+
+// Pack
+
+static void pad(std::vector<uint8_t>& bytes, size_t alignment) {
+    bytes.resize((bytes.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void writePack(const std::string& path, std::vector<CookedAsset>& assets) {
+    std::sort(assets.begin(), assets.end(), [](const CookedAsset& a, const CookedAsset& b) {
+        return a.name < b.name;
+    });
+    for (size_t i = 1; i < assets.size(); i++) {
+        if (assets[i].name == assets[i - 1].name) {
+            throw std::runtime_error("Two inputs cook to " + assets[i].name + "!");
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to create " + path + "!");
+    }
+
+    // Entries first, then names, metadata and chunk tables after them
+    std::vector<AssetPackEntry> entries(assets.size());
+    std::vector<uint8_t> tocData;
+
+    uint64_t offset = ASSET_PACK_ALIGNMENT;
+    std::vector<std::vector<uint8_t>> stored(assets.size());
+    std::vector<std::vector<uint64_t>> chunkTables(assets.size());
+    for (size_t i = 0; i < assets.size(); i++) {
+        CookedAsset& asset = assets[i];
+        AssetPackEntry& entry = entries[i];
+        entry.type = asset.type;
+        entry.size = asset.payload.size();
+        entry.offset = offset;
+
+        // Chunks that do not shrink are kept raw; if none shrink the whole
+        // payload stays uncompressed and can be used in place
+        bool compressed = false;
+        if (asset.compress) {
+            std::vector<uint8_t> chunks;
+            std::vector<uint64_t> table;
+            for (uint64_t start = 0; start < asset.payload.size(); start += ASSET_PACK_CHUNK_SIZE) {
+                size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(ASSET_PACK_CHUNK_SIZE, asset.payload.size() - start));
+                table.push_back(chunks.size());
+                std::vector<uint8_t> packed;
+                lzCompress(asset.payload.data() + start, chunkSize, packed);
+                if (packed.size() < chunkSize) {
+                    chunks.insert(chunks.end(), packed.begin(), packed.end());
+                    compressed = true;
+                } else {
+                    chunks.insert(chunks.end(), asset.payload.begin() + start, asset.payload.begin() + start + chunkSize);
+                }
+            }
+            table.push_back(chunks.size());
+            if (compressed) {
+                stored[i] = std::move(chunks);
+                chunkTables[i] = std::move(table);
+            }
+        }
+        if (!compressed) {
+            stored[i] = asset.payload;
+        }
+        entry.flags = compressed ? ASSET_COMPRESSED : 0;
+        entry.storedSize = stored[i].size();
+        offset = alignUp(offset + entry.storedSize, ASSET_PACK_ALIGNMENT);
+    }
+
+    tocData.resize(sizeof(AssetPackEntry) * entries.size());
+    for (size_t i = 0; i < assets.size(); i++) {
+        AssetPackEntry& entry = entries[i];
+        entry.nameOffset = static_cast<uint32_t>(tocData.size());
+        entry.nameLength = static_cast<uint32_t>(assets[i].name.size());
+        append(tocData, assets[i].name.data(), assets[i].name.size());
+
+        pad(tocData, 4);
+        entry.metadataOffset = static_cast<uint32_t>(tocData.size());
+        entry.metadataSize = static_cast<uint32_t>(assets[i].metadata.size());
+        append(tocData, assets[i].metadata.data(), assets[i].metadata.size());
+
+        entry.chunkTableOffset = 0;
+        entry.chunkCount = 0;
+        if (entry.flags & ASSET_COMPRESSED) {
+            pad(tocData, 8);
+            entry.chunkTableOffset = static_cast<uint32_t>(tocData.size());
+            entry.chunkCount = static_cast<uint32_t>(chunkTables[i].size() - 1);
+            append(tocData, chunkTables[i].data(), chunkTables[i].size());
+        }
+    }
+    memcpy(tocData.data(), entries.data(), sizeof(AssetPackEntry) * entries.size());
+
+    AssetPackHeader header{};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.alignment = static_cast<uint32_t>(ASSET_PACK_ALIGNMENT);
+    header.tocOffset = offset;
+    header.tocSize = tocData.size();
+
+    std::vector<uint8_t> padding(ASSET_PACK_ALIGNMENT, 0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(padding.data()), ASSET_PACK_ALIGNMENT - sizeof(header));
+    for (size_t i = 0; i < assets.size(); i++) {
+        file.write(reinterpret_cast<const char*>(stored[i].data()), stored[i].size());
+        uint64_t end = entries[i].offset + entries[i].storedSize;
+        file.write(reinterpret_cast<const char*>(padding.data()), alignUp(end, ASSET_PACK_ALIGNMENT) - end);
+    }
+    file.write(reinterpret_cast<const char*>(tocData.data()), tocData.size());
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+
+    for (size_t i = 0; i < assets.size(); i++) {
+        std::cout << assets[i].name << ": " << entries[i].size << " bytes";
+        if (entries[i].flags & ASSET_COMPRESSED) {
+            std::cout << ", " << entries[i].storedSize << " stored";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << assets.size() << " assets, " << offset + tocData.size() << " bytes written to " << path << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: AssetCooker <output.pack> [--compress | --store] <input>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::vector<CookedAsset> assets;
+        bool compress = false;
+        for (int i = 2; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument == "--compress") {
+                compress = true;
+                continue;
+            }
+            if (argument == "--store") {
+                compress = false;
+                continue;
+            }
+
+            std::string type = extension(argument);
+            if (type == "obj") {
+                assets.push_back(cookMesh(argument));
+            } else if (type == "ppm") {
+                assets.push_back(cookTexture(argument));
+            } else if (type == "spv") {
+                assets.push_back(cookShader(argument));
+            } else {
+                throw std::runtime_error("Don't know how to cook " + argument + "!");
+            }
+            assets.back().compress = compress;
+        }
+        writePack(argv[1], assets);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,520 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+
+#include "Renderer.hpp"
+#include "FrameCapture.hpp"
+#include "gtc/matrix_transform.hpp"
+
+// Renders fixed scenes for a fixed number of frames, compares the last frame
+// of each against a golden image and the frame times against baselines:
+//   RenderRegression <golden directory> [--update] [--scene <name>] [--frames <n>]
+//                    [--tolerance <fraction>] [--threshold <fraction>]
+// Golden images are <directory>/<scene>.png, baselines are
+// <directory>/baselines.txt; --update rewrites both instead of checking.
+// Run it from the directory VkEngine runs from, on a software device so the
+// results do not depend on the GPU, e.g. lavapipe on a virtual display:
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json xvfb-run -a ./RenderRegression golden
+// CTest runs it against tests/golden, the regression workflow writes that
+// directory when run by hand. Exits with a failure when an image or a timing
+// regressed, or when there is no golden or baseline to compare with.
+
+struct Options {
+    std::string goldenDirectory;
+    bool update = false;
+    std::string scene;
+    uint64_t frames = 120;
+    // Frames left out of the timings, pipelines and buffers settle in them
+    uint64_t warmupFrames = 20;
+    // Largest fraction of pixels allowed to differ
+    double tolerance = 0.001;
+    // Largest relative slowdown of a timing percentile
+    double threshold = 0.25;
+};
+
+// Channels closer than this are the same, rasterisers may round differently
+const int CHANNEL_TOLERANCE = 8;
+// Timings within this many milliseconds of their baseline are noise
+const double TIMING_SLACK_MS = 0.1;
+
+struct RgbaImage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Tightly packed RGBA8
+    std::vector<uint8_t> pixels;
+};
+
+struct TestScene {
+    std::string name;
+    // Fills the renderer's scene and camera before it runs
+    std::function<void(Renderer& app, uint32_t sphere)> setup;
+};
+
+// Turned around its own centre every update
+struct Spin {
+    float speed;
+};
+
+static void createSphere(uint32_t rings, uint32_t segments, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    const float pi = 3.14159265f;
+    auto addVertex = [&vertices](const glm::vec3& position) {
+        glm::vec3 color = glm::vec3(0.5f) + position * 0.5f;
+        vertices.push_back({position * 0.5f, position, color});
+    };
+
+    addVertex(glm::vec3(0.0f, 1.0f, 0.0f));
+    for (uint32_t ring = 1; ring < rings; ring++) {
+        float theta = pi * ring / rings;
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            float phi = 2.0f * pi * segment / segments;
+            addVertex(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    }
+    addVertex(glm::vec3(0.0f, -1.0f, 0.0f));
+
+    const uint32_t south = static_cast<uint32_t>(vertices.size() - 1);
+    auto ringVertex = [segments](uint32_t ring, uint32_t segment) {
+        return 1 + (ring - 1) * segments + segment % segments;
+    };
+    for (uint32_t segment = 0; segment < segments; segment++) {
+        indices.insert(indices.end(), {0, ringVertex(1, segment), ringVertex(1, segment + 1)});
+    }
+    for (uint32_t ring = 1; ring < rings - 1; ring++) {
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            uint32_t a = ringVertex(ring, segment);
+            uint32_t b = ringVertex(ring, segment + 1);
+            uint32_t c = ringVertex(ring + 1, segment);
+            uint32_t d = ringVertex(ring + 1, segment + 1);
+            indices.insert(indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    for (uint32_t segment = 0; segment < segments; segment++) {
+        indices.insert(indices.end(), {south, ringVertex(rings - 1, segment + 1), ringVertex(rings - 1, segment)});
+    }
+}
+
+static std::vector<TestScene> createScenes() {
+    std::vector<TestScene> scenes;
+
+    // The demo scene: spinning spheres above static buckets
+    scenes.push_back({"spheres", [](Renderer& app, uint32_t sphere) {
+        Scene& scene = app.getScene();
+        const int gridSize = 32;
+        const float spacing = 1.5f;
+        for (int z = 0; z < gridSize; z++) {
+            for (int x = 0; x < gridSize; x++) {
+                glm::vec3 position((x - gridSize * 0.5f) * spacing, 0.0f, -z * spacing);
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+                scene.createEntity(WorldTransform{model}, MeshInstance{sphere}, Spin{1.0f});
+                model = glm::scale(glm::translate(glm::mat4(1.0f), position - glm::vec3(0.0f, 1.0f, 0.0f)),
+                                glm::vec3(0.4f));
+                scene.createEntity(WorldTransform{model}, MeshInstance{sphere},
+                                StaticGeometry{static_cast<uint32_t>(z / 8)});
+            }
+        }
+        app.getCamera().position = glm::vec3(0.0f, 3.0f, 6.0f);
+        app.getCamera().target = glm::vec3(0.0f, 0.0f, -10.0f);
+    }});
+
+    // Static geometry only, every frame after the first replays the buckets
+    scenes.push_back({"static", [](Renderer& app, uint32_t sphere) {
+        Scene& scene = app.getScene();
+        const int gridSize = 48;
+        for (int z = 0; z < gridSize; z++) {
+            for (int x = 0; x < gridSize; x++) {
+                glm::vec3 position((x - gridSize * 0.5f) * 0.8f, 0.0f, (z - gridSize * 0.5f) * 0.8f);
+                glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.6f));
+                scene.createEntity(WorldTransform{model}, MeshInstance{sphere},
+                                StaticGeometry{static_cast<uint32_t>(z / 12)});
+            }
+        }
+        app.getCamera().position = glm::vec3(0.0f, 25.0f, 12.0f);
+        app.getCamera().target = glm::vec3(0.0f);
+    }});
+
+    // A row running off into the distance: clustered spheres up close,
+    // every level of detail further away
+    scenes.push_back({"lod", [](Renderer& app, uint32_t sphere) {
+        Scene& scene = app.getScene();
+        for (int z = 0; z < 256; z++) {
+            for (int x = -2; x <= 2; x++) {
+                glm::vec3 position(x * 1.2f, 0.0f, -z * 1.2f);
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+                scene.createEntity(WorldTransform{model}, MeshInstance{sphere}, Spin{0.5f});
+            }
+        }
+        app.getCamera().position = glm::vec3(0.0f, 1.0f, 2.0f);
+        app.getCamera().target = glm::vec3(0.0f, 0.0f, -20.0f);
+    }});
+
+    return scenes;
+}
+
+static std::vector<uint8_t> readBinary(const std::string& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+    return data;
+}
+
+static void writeBinary(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+static uint32_t readBigEndian(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+        static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+// Reads the PNGs encodePng writes: RGBA8, unfiltered rows, stored deflate
+// blocks. Golden images are written by --update, so nothing else is needed.
+static RgbaImage readPng(const std::string& path) {
+    std::vector<uint8_t> png = readBinary(path);
+    const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (png.size() < 8 || !std::equal(signature, signature + 8, png.begin())) {
+        throw std::runtime_error(path + " is not a PNG!");
+    }
+
+    RgbaImage image;
+    std::vector<uint8_t> compressed;
+    size_t offset = 8;
+    while (offset + 12 <= png.size()) {
+        uint32_t length = readBigEndian(&png[offset]);
+        std::string type(reinterpret_cast<const char*>(&png[offset + 4]), 4);
+        const uint8_t* data = &png[offset + 8];
+        if (offset + 12 + length > png.size()) {
+            break;
+        }
+        if (type == "IHDR") {
+            image.width = readBigEndian(data);
+            image.height = readBigEndian(data + 4);
+            if (data[8] != 8 || data[9] != 6 || data[12] != 0) {
+                throw std::runtime_error(path + " is not a non-interlaced RGBA8 PNG!");
+            }
+        } else if (type == "IDAT") {
+            compressed.insert(compressed.end(), data, data + length);
+        }
+        offset += 12 + length;
+    }
+
+    const size_t rowBytes = static_cast<size_t>(image.width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * image.height);
+    // Skips the zlib header, the checksum at the end is not checked
+    size_t position = 2;
+    bool last = false;
+    while (!last) {
+        if (position + 5 > compressed.size()) {
+            throw std::runtime_error(path + " is truncated!");
+        }
+        uint8_t header = compressed[position];
+        last = header & 1;
+        if ((header >> 1 & 3) != 0) {
+            throw std::runtime_error(path + " is compressed, golden images are written by --update!");
+        }
+        size_t length = compressed[position + 1] | compressed[position + 2] << 8;
+        position += 5;
+        if (position + length > compressed.size()) {
+            throw std::runtime_error(path + " is truncated!");
+        }
+        raw.insert(raw.end(), compressed.begin() + position, compressed.begin() + position + length);
+        position += length;
+    }
+
+    if (raw.size() != (rowBytes + 1) * image.height) {
+        throw std::runtime_error(path + " has the wrong amount of pixel data!");
+    }
+    image.pixels.resize(rowBytes * image.height);
+    for (uint32_t y = 0; y < image.height; y++) {
+        const uint8_t* row = &raw[(rowBytes + 1) * y];
+        if (row[0] != 0) {
+            throw std::runtime_error(path + " uses row filters, golden images are written by --update!");
+        }
+        std::copy(row + 1, row + 1 + rowBytes, image.pixels.begin() + rowBytes * y);
+    }
+    return image;
+}
+
+static void writePng(const std::string& path, const RgbaImage& image) {
+    std::vector<uint8_t> png;
+    encodePng(image.pixels.data(), image.width, image.height, png);
+    writeBinary(path, png);
+}
+
+// Fraction of pixels with a channel further than CHANNEL_TOLERANCE off;
+// diff shows those in red over a darkened copy of the expected image
+static double compareImages(const RgbaImage& expected, const RgbaImage& actual, RgbaImage& diff) {
+    diff.width = expected.width;
+    diff.height = expected.height;
+    diff.pixels.resize(expected.pixels.size());
+
+    size_t mismatched = 0;
+    for (size_t i = 0; i < expected.pixels.size(); i += 4) {
+        bool same = true;
+        for (size_t channel = 0; channel < 3; channel++) {
+            if (std::abs(expected.pixels[i + channel] - actual.pixels[i + channel]) > CHANNEL_TOLERANCE) {
+                same = false;
+            }
+        }
+        if (same) {
+            for (size_t channel = 0; channel < 3; channel++) {
+                diff.pixels[i + channel] = expected.pixels[i + channel] / 4;
+            }
+        } else {
+            diff.pixels[i] = 255;
+            diff.pixels[i + 1] = 0;
+            diff.pixels[i + 2] = 0;
+            mismatched++;
+        }
+        diff.pixels[i + 3] = 255;
+    }
+    return static_cast<double>(mismatched) / (expected.pixels.size() / 4);
+}
+
+// "<scene> <metric> <milliseconds>" per line, # starts a comment
+static std::map<std::string, double> readBaselines(const std::string& path) {
+    std::map<std::string, double> baselines;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream stream(line);
+        std::string scene, metric;
+        double value;
+        if (stream >> scene >> metric >> value) {
+            baselines[scene + " " + metric] = value;
+        }
+    }
+    return baselines;
+}
+
+static void writeBaselines(const std::string& path, const std::map<std::string, double>& baselines) {
+    std::ofstream file(path);
+    file << "# scene metric milliseconds, written by RenderRegression --update\n";
+    for (const auto& [key, value] : baselines) {
+        file << key << " " << value << "\n";
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+static double percentile(std::vector<float> values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+struct SceneResult {
+    RgbaImage image;
+    std::map<std::string, double> timings;
+};
+
+static SceneResult renderScene(const TestScene& scene, const Options& options) {
+    auto app = std::make_unique<Renderer>();
+
+    std::vector<Vertex> sphereVertices;
+    std::vector<uint32_t> sphereIndices;
+    createSphere(64, 128, sphereVertices, sphereIndices);
+    uint32_t sphere = app->addMesh(sphereVertices, sphereIndices);
+    scene.setup(*app, sphere);
+
+    // A fixed step makes every run simulate the same frames
+    app->setFixedTimestep(1.0f / 60.0f);
+    app->setFrameLimit(options.frames);
+
+    std::vector<float> cpuTimes;
+    std::vector<float> gpuTimes;
+    app->setFrameTimingCallback([&](const FrameTiming& timing) {
+        if (timing.frame <= options.warmupFrames) {
+            return;
+        }
+        cpuTimes.push_back(timing.cpuMilliseconds);
+        if (timing.gpuMilliseconds >= 0.0f) {
+            gpuTimes.push_back(timing.gpuMilliseconds);
+        }
+    });
+
+    // Only the last frame is captured, it is encoded before run() returns
+    SceneResult result;
+    uint64_t capturedFrame = 0;
+    uint64_t updates = 0;
+    Renderer& renderer = *app;
+    app->setUpdateCallback([&](float deltaTime) {
+        renderer.getScene().parallelForEach<WorldTransform, Spin>(renderer.getJobSystem(),
+            [deltaTime](Entity, WorldTransform& transform, Spin& spin) {
+                transform.matrix = glm::rotate(transform.matrix, deltaTime * spin.speed, glm::vec3(0.0f, 1.0f, 0.0f));
+            });
+        if (++updates == options.frames) {
+            renderer.getFrameCapture().start(CaptureOutput::Callback, "", [&](const CapturedFrame& frame) {
+                if (frame.frame < capturedFrame) {
+                    return;
+                }
+                capturedFrame = frame.frame;
+                result.image.width = frame.width;
+                result.image.height = frame.height;
+                result.image.pixels.assign(frame.pixels, frame.pixels + static_cast<size_t>(frame.width) * frame.height * 4);
+            });
+        }
+    });
+
+    app->run();
+
+    if (capturedFrame != options.frames) {
+        throw std::runtime_error("The last frame of " + scene.name + " was not captured!");
+    }
+    result.timings["cpu.p50"] = percentile(cpuTimes, 0.5);
+    result.timings["cpu.p95"] = percentile(cpuTimes, 0.95);
+    result.timings["cpu.p99"] = percentile(cpuTimes, 0.99);
+    if (!gpuTimes.empty()) {
+        result.timings["gpu.p50"] = percentile(gpuTimes, 0.5);
+        result.timings["gpu.p95"] = percentile(gpuTimes, 0.95);
+        result.timings["gpu.p99"] = percentile(gpuTimes, 0.99);
+    }
+    return result;
+}
+
+// Returns false when the scene regressed
+static bool checkScene(const TestScene& scene, const SceneResult& result, const Options& options,
+                    const std::map<std::string, double>& baselines) {
+    bool passed = true;
+    const std::string golden = options.goldenDirectory + "/" + scene.name + ".png";
+
+    RgbaImage expected = readPng(golden);
+    if (expected.width != result.image.width || expected.height != result.image.height) {
+        std::cout << "  image: " << result.image.width << "x" << result.image.height << ", golden is "
+                << expected.width << "x" << expected.height << " FAILED" << std::endl;
+        passed = false;
+    } else {
+        RgbaImage diff;
+        double mismatch = compareImages(expected, result.image, diff);
+        bool imagePassed = mismatch <= options.tolerance;
+        std::cout << "  image: " << mismatch * 100.0 << "% of pixels differ" << (imagePassed ? "" : " FAILED")
+                << std::endl;
+        if (!imagePassed) {
+            writePng(options.goldenDirectory + "/" + scene.name + ".diff.png", diff);
+            passed = false;
+        }
+    }
+    if (!passed) {
+        writePng(options.goldenDirectory + "/" + scene.name + ".actual.png", result.image);
+    }
+
+    for (const auto& [metric, value] : result.timings) {
+        auto baseline = baselines.find(scene.name + " " + metric);
+        if (baseline == baselines.end()) {
+            std::cout << "  " << metric << ": " << value << " ms, no baseline FAILED" << std::endl;
+            passed = false;
+            continue;
+        }
+        bool timingPassed = value <= baseline->second * (1.0 + options.threshold) ||
+            value - baseline->second <= TIMING_SLACK_MS;
+        std::cout << "  " << metric << ": " << value << " ms, baseline " << baseline->second << " ms"
+                << (timingPassed ? "" : " FAILED") << std::endl;
+        passed = passed && timingPassed;
+    }
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: RenderRegression <golden directory> [--update] [--scene <name>] [--frames <n>] "
+                "[--tolerance <fraction>] [--threshold <fraction>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Options options;
+    options.goldenDirectory = argv[1];
+    try {
+        for (int i = 2; i < argc; i++) {
+            std::string argument = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(argument + " needs a value!");
+                }
+                return argv[++i];
+            };
+            if (argument == "--update") {
+                options.update = true;
+            } else if (argument == "--scene") {
+                options.scene = value();
+            } else if (argument == "--frames") {
+                options.frames = std::stoull(value());
+            } else if (argument == "--tolerance") {
+                options.tolerance = std::stod(value());
+            } else if (argument == "--threshold") {
+                options.threshold = std::stod(value());
+            } else {
+                throw std::runtime_error("Unknown option " + argument + "!");
+            }
+        }
+        if (options.frames <= options.warmupFrames) {
+            throw std::runtime_error("Needs more than " + std::to_string(options.warmupFrames) + " frames!");
+        }
+
+        const std::string baselinePath = options.goldenDirectory + "/baselines.txt";
+        if (options.update) {
+            std::filesystem::create_directories(options.goldenDirectory);
+        } else if (!std::filesystem::exists(baselinePath)) {
+            throw std::runtime_error(baselinePath + " is missing, write the goldens with --update!");
+        }
+        std::map<std::string, double> baselines = readBaselines(baselinePath);
+
+        bool passed = true;
+        bool ranAny = false;
+        for (const auto& scene : createScenes()) {
+            if (!options.scene.empty() && scene.name != options.scene) {
+                continue;
+            }
+            ranAny = true;
+            std::cout << scene.name << ":" << std::endl;
+            SceneResult result = renderScene(scene, options);
+
+            if (options.update) {
+                writePng(options.goldenDirectory + "/" + scene.name + ".png", result.image);
+                for (const auto& [metric, value] : result.timings) {
+                    baselines[scene.name + " " + metric] = value;
+                    std::cout << "  " << metric << ": " << value << " ms" << std::endl;
+                }
+            } else if (!checkScene(scene, result, options, baselines)) {
+                passed = false;
+            }
+        }
+        if (!ranAny) {
+            throw std::runtime_error("No scene called " + options.scene + "!");
+        }
+
+        if (options.update) {
+            writeBaselines(baselinePath, baselines);
+        } else if (!passed) {
+            std::cout << "Regressions found" << std::endl;
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}